@@ -35,12 +35,17 @@ class ICoreProtocol : public xengine::IBase
 public:
     ICoreProtocol()
       : IBase("coreprotocol") {}
+    const CMintConfig* MintConfig()
+    {
+        return dynamic_cast<const CMintConfig*>(xengine::IBase::Config());
+    }
     virtual const uint256& GetGenesisBlockHash() = 0;
     virtual void GetGenesisBlock(CBlock& block) = 0;
     virtual Errno ValidateTransaction(const CTransaction& tx, int nHeight) = 0;
     virtual Errno ValidateBlock(const CBlock& block) = 0;
     virtual Errno ValidateOrigin(const CBlock& block, const CProfile& parentProfile, CProfile& forkProfile) = 0;
     virtual Errno VerifyProofOfWork(const CBlock& block, const CBlockIndex* pIndexPrev) = 0;
+    virtual void PrevalidateProofOfWork(const CBlock& block) = 0;
     virtual Errno VerifyDelegatedProofOfStake(const CBlock& block, const CBlockIndex* pIndexPrev,
                                               const CDelegateAgreement& agreement)
         = 0;
@@ -116,10 +121,14 @@ public:
     virtual bool GetLastBlockTime(const uint256& hashFork, int nDepth, std::vector<int64>& vTime) = 0;
     virtual bool GetBlock(const uint256& hashBlock, CBlock& block) = 0;
     virtual bool GetBlockEx(const uint256& hashBlock, CBlockEx& block) = 0;
+    virtual bool GetRawBlock(const uint256& hashBlock, std::vector<unsigned char>& vchBlock) = 0;
     virtual bool GetOrigin(const uint256& hashFork, CBlock& block) = 0;
     virtual bool Exists(const uint256& hashBlock) = 0;
     virtual bool GetTransaction(const uint256& txid, CTransaction& tx) = 0;
     virtual bool GetTransaction(const uint256& txid, CTransaction& tx, uint256& hashFork, int& nHeight) = 0;
+    virtual bool GetTransaction(const uint256& txid, CTransaction& tx, CTxContxt& txContxt, uint256& hashFork,
+                                uint256& hashBlock, int& nHeight)
+        = 0;
     virtual bool GetTxLocation(const uint256& txid, uint256& hashFork, int& nHeight) = 0;
     virtual bool GetTxUnspent(const uint256& hashFork, const std::vector<CTxIn>& vInput,
                               std::vector<CTxOut>& vOutput)
@@ -191,6 +200,9 @@ public:
     virtual bool ListForkUnspent(const uint256& hashFork, const CDestination& dest, uint32 nMax, const std::vector<CTxUnspent>& vUnpsentOnChain, std::vector<CTxUnspent>& vUnspent) = 0;
     virtual bool ListForkUnspentBatch(const uint256& hashFork, uint32 nMax, const std::map<CDestination, std::vector<CTxUnspent>>& mapUnspentOnChain, std::map<CDestination, std::vector<CTxUnspent>>& mapUnspent) = 0;
     virtual bool FilterTx(const uint256& hashFork, CTxFilter& filter) = 0;
+    virtual bool FetchCmpctTx(const uint256& hashFork, const uint256& hashSalt, const std::map<uint64, uint32>& mapShortTxId,
+                              std::vector<CTransaction>& vtx, std::vector<bool>& vFilled)
+        = 0;
     virtual bool ArrangeBlockTx(const uint256& hashFork, const uint256& hashPrev, int64 nBlockTime, std::size_t nMaxSize,
                                 std::vector<CTransaction>& vtx, int64& nTotalTxFee)
         = 0;
@@ -289,6 +301,8 @@ public:
     /* Sync */
     virtual bool SynchronizeWalletTx(const CDestination& destNew) = 0;
     virtual bool ResynchronizeWalletTx() = 0;
+    virtual bool GetResyncProgress(uint256& hashFork, int& nHeight, int& nLastHeight, std::size_t& nTxCount, bool& fIncomplete) = 0;
+    virtual bool CancelResync() = 0;
 
     const CBasicConfig* Config()
     {
@@ -384,6 +398,8 @@ public:
         = 0;
     virtual bool SynchronizeWalletTx(const CDestination& destNew) = 0;
     virtual bool ResynchronizeWalletTx() = 0;
+    virtual bool GetWalletResyncProgress(uint256& hashFork, int& nHeight, int& nLastHeight, std::size_t& nTxCount, bool& fIncomplete) = 0;
+    virtual bool CancelWalletResync() = 0;
     virtual bool SignOfflineTransaction(const CDestination& destIn, CTransaction& tx, bool& fCompleted) = 0;
     virtual Errno SendOfflineSignedTransaction(CTransaction& tx) = 0;
     /* Mint */
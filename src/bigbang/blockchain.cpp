@@ -12,6 +12,7 @@ using namespace xengine;
 
 #define ENROLLED_CACHE_COUNT (120)
 #define AGREEMENT_CACHE_COUNT (16)
+#define PARALLEL_VERIFY_TX_COUNT (16)
 
 namespace bigbang
 {
@@ -214,14 +215,11 @@ bool CBlockChain::GetBlockLocation(const uint256& hashBlock, uint256& hashFork,
 bool CBlockChain::GetBlockHash(const uint256& hashFork, int nHeight, uint256& hashBlock)
 {
     CBlockIndex* pIndex = nullptr;
-    if (!cntrBlock.RetrieveFork(hashFork, &pIndex) || pIndex->GetBlockHeight() < nHeight)
+    if (!cntrBlock.RetrieveFork(hashFork, &pIndex) || pIndex->GetBlockHeight() < nHeight
+        || !cntrBlock.RetrieveAncestor(pIndex, nHeight, &pIndex))
     {
         return false;
     }
-    while (pIndex != nullptr && pIndex->GetBlockHeight() > nHeight)
-    {
-        pIndex = pIndex->pPrev;
-    }
     while (pIndex != nullptr && pIndex->GetBlockHeight() == nHeight && pIndex->IsExtended())
     {
         pIndex = pIndex->pPrev;
@@ -233,14 +231,11 @@ bool CBlockChain::GetBlockHash(const uint256& hashFork, int nHeight, uint256& ha
 bool CBlockChain::GetBlockHash(const uint256& hashFork, int nHeight, vector<uint256>& vBlockHash)
 {
     CBlockIndex* pIndex = nullptr;
-    if (!cntrBlock.RetrieveFork(hashFork, &pIndex) || pIndex->GetBlockHeight() < nHeight)
+    if (!cntrBlock.RetrieveFork(hashFork, &pIndex) || pIndex->GetBlockHeight() < nHeight
+        || !cntrBlock.RetrieveAncestor(pIndex, nHeight, &pIndex))
     {
         return false;
     }
-    while (pIndex != nullptr && pIndex->GetBlockHeight() > nHeight)
-    {
-        pIndex = pIndex->pPrev;
-    }
     while (pIndex != nullptr && pIndex->GetBlockHeight() == nHeight)
     {
         vBlockHash.push_back(pIndex->GetBlockHash());
@@ -253,15 +248,12 @@ bool CBlockChain::GetBlockHash(const uint256& hashFork, int nHeight, vector<uint
 bool CBlockChain::GetLastBlockOfHeight(const uint256& hashFork, const int nHeight, uint256& hashBlock, int64& nTime)
 {
     CBlockIndex* pIndex = nullptr;
-    if (!cntrBlock.RetrieveFork(hashFork, &pIndex) || pIndex->GetBlockHeight() < nHeight)
+    if (!cntrBlock.RetrieveFork(hashFork, &pIndex) || pIndex->GetBlockHeight() < nHeight
+        || !cntrBlock.RetrieveAncestor(pIndex, nHeight, &pIndex))
     {
         return false;
     }
-    while (pIndex != nullptr && pIndex->GetBlockHeight() > nHeight)
-    {
-        pIndex = pIndex->pPrev;
-    }
-    if (pIndex == nullptr || pIndex->GetBlockHeight() != nHeight)
+    if (pIndex->GetBlockHeight() != nHeight)
     {
         return false;
     }
@@ -317,6 +309,11 @@ bool CBlockChain::GetBlockEx(const uint256& hashBlock, CBlockEx& block)
     return cntrBlock.Retrieve(hashBlock, block);
 }
 
+bool CBlockChain::GetRawBlock(const uint256& hashBlock, std::vector<unsigned char>& vchBlock)
+{
+    return cntrBlock.RetrieveRaw(hashBlock, vchBlock);
+}
+
 bool CBlockChain::GetOrigin(const uint256& hashFork, CBlock& block)
 {
     return cntrBlock.RetrieveOrigin(hashFork, block);
@@ -337,6 +334,13 @@ bool CBlockChain::GetTransaction(const uint256& txid, CTransaction& tx, uint256&
     return cntrBlock.RetrieveTx(txid, tx, hashFork, nHeight);
 }
 
+bool CBlockChain::GetTransaction(const uint256& txid, CTransaction& tx, CTxContxt& txContxt, uint256& hashFork,
+                                 uint256& hashBlock, int& nHeight)
+{
+    uint32 nTxOrdinal = 0;
+    return cntrBlock.RetrieveTxInBlock(txid, tx, txContxt, hashFork, hashBlock, nHeight, nTxOrdinal);
+}
+
 bool CBlockChain::ExistsTx(const uint256& txid)
 {
     return cntrBlock.ExistsTx(txid);
@@ -528,6 +532,7 @@ Errno CBlockChain::AddNewBlock(const CBlock& block, CBlockChainUpdate& update)
         nForkHeight = pIndexPrev->nHeight + 1;
     }
 
+    vector<uint32> vVerifyTx;
     for (const CTransaction& tx : block.vtx)
     {
         uint256 txid = tx.GetHash();
@@ -540,12 +545,7 @@ Errno CBlockChain::AddNewBlock(const CBlock& block, CBlockChainUpdate& update)
         }
         if (!pTxPool->Exists(txid))
         {
-            err = pCoreProtocol->VerifyBlockTx(tx, txContxt, pIndexPrev, nForkHeight, pIndexPrev->GetOriginHash());
-            if (err != OK)
-            {
-                Log("AddNewBlock Verify BlockTx Error(%s) : %s ", ErrorString(err), txid.ToString().c_str());
-                return err;
-            }
+            vVerifyTx.push_back(vTxContxt.size());
         }
         if (tx.nTimeStamp > block.nTimeStamp)
         {
@@ -557,10 +557,17 @@ Errno CBlockChain::AddNewBlock(const CBlock& block, CBlockChainUpdate& update)
         vTxContxt.push_back(txContxt);
         view.AddTx(txid, tx, txContxt.destIn, txContxt.GetValueIn());
 
-        StdTrace("BlockChain", "AddNewBlock: verify tx success, new tx: %s, new block: %s", txid.GetHex().c_str(), hash.GetHex().c_str());
-
         nTotalFee += tx.nTxFee;
     }
+
+    err = VerifyBlockTx(block, vTxContxt, vVerifyTx, pIndexPrev, nForkHeight);
+    if (err != OK)
+    {
+        return err;
+    }
+    StdTrace("BlockChain", "AddNewBlock: verify tx success, tx count: %ld, verified: %ld, new block: %s",
+             block.vtx.size(), vVerifyTx.size(), hash.GetHex().c_str());
+
     view.AddBlock(hash, blockex);
 
     if (block.txMint.nAmount > nTotalFee + nReward)
@@ -1721,6 +1728,50 @@ Errno CBlockChain::VerifyBlock(const uint256& hashBlock, const CBlock& block, CB
     return OK;
 }
 
+Errno CBlockChain::VerifyBlockTx(const CBlock& block, const vector<CTxContxt>& vTxContxt, const vector<uint32>& vVerifyTx,
+                                 CBlockIndex* pIndexPrev, int nForkHeight)
+{
+    const uint256 hashFork = pIndexPrev->GetOriginHash();
+    vector<Errno> vErr(vVerifyTx.size(), OK);
+
+    // Signature and template checks only read the tx contexts, small blocks are not worth the threads
+    auto fnVerify = [&](const uint32 n) -> bool {
+        const uint32 i = vVerifyTx[n];
+        vErr[n] = pCoreProtocol->VerifyBlockTx(block.vtx[i], vTxContxt[i], pIndexPrev, nForkHeight, hashFork);
+        return (vErr[n] == OK);
+    };
+
+    // the first failing tx in block order is reported whichever worker finds a failure first
+    uint32 nFailed = vVerifyTx.size();
+    if (vVerifyTx.size() < PARALLEL_VERIFY_TX_COUNT)
+    {
+        for (uint32 n = 0; n < vVerifyTx.size(); n++)
+        {
+            if (!fnVerify(n))
+            {
+                nFailed = n;
+                break;
+            }
+        }
+    }
+    else
+    {
+        nFailed = poolVerifyTx.ExecuteUntilFirst(vVerifyTx.size(), fnVerify);
+    }
+
+    if (nFailed < vVerifyTx.size())
+    {
+        if (vErr[nFailed] != OK)
+        {
+            Log("AddNewBlock Verify BlockTx Error(%s) : %s ", ErrorString(vErr[nFailed]), block.vtx[vVerifyTx[nFailed]].GetHash().ToString().c_str());
+            return vErr[nFailed];
+        }
+        Log("AddNewBlock Verify BlockTx Error : block: %s", block.GetHash().ToString().c_str());
+        return ERR_BLOCK_TRANSACTIONS_INVALID;
+    }
+    return OK;
+}
+
 bool CBlockChain::VerifyBlockCertTx(const CBlock& block)
 {
     map<CDestination, int> mapBlockCert;
@@ -11,6 +11,7 @@
 
 #include "base.h"
 #include "blockbase.h"
+#include "parallelpool.h"
 namespace bigbang
 {
 
@@ -33,10 +34,13 @@ public:
     bool GetLastBlockTime(const uint256& hashFork, int nDepth, std::vector<int64>& vTime) override;
     bool GetBlock(const uint256& hashBlock, CBlock& block) override;
     bool GetBlockEx(const uint256& hashBlock, CBlockEx& block) override;
+    bool GetRawBlock(const uint256& hashBlock, std::vector<unsigned char>& vchBlock) override;
     bool GetOrigin(const uint256& hashFork, CBlock& block) override;
     bool Exists(const uint256& hashBlock) override;
     bool GetTransaction(const uint256& txid, CTransaction& tx) override;
     bool GetTransaction(const uint256& txid, CTransaction& tx, uint256& hashFork, int& nHeight) override;
+    bool GetTransaction(const uint256& txid, CTransaction& tx, CTxContxt& txContxt, uint256& hashFork,
+                        uint256& hashBlock, int& nHeight) override;
     bool ExistsTx(const uint256& txid) override;
     bool GetTxLocation(const uint256& txid, uint256& hashFork, int& nHeight) override;
     bool GetTxUnspent(const uint256& hashFork, const std::vector<CTxIn>& vInput,
@@ -98,6 +102,8 @@ protected:
     Errno VerifyBlock(const uint256& hashBlock, const CBlock& block, CBlockIndex* pIndexPrev,
                       int64& nReward, CDelegateAgreement& agreement, std::size_t& nEnrollTrust, CBlockIndex** ppIndexRef);
     bool VerifyBlockCertTx(const CBlock& block);
+    Errno VerifyBlockTx(const CBlock& block, const std::vector<CTxContxt>& vTxContxt, const std::vector<uint32>& vVerifyTx,
+                        CBlockIndex* pIndexPrev, int nForkHeight);
 
     void InitCheckPoints();
     void InitCheckPoints(const uint256& hashFork, const std::vector<CCheckPoint>& vCheckPoints);
@@ -111,6 +117,7 @@ protected:
     storage::CBlockBase cntrBlock;
     xengine::CCache<uint256, CDelegateEnrolled> cacheEnrolled;
     xengine::CCache<uint256, CDelegateAgreement> cacheAgreement;
+    xengine::CParallelPool poolVerifyTx;
 
     std::map<uint256, MapCheckPointsType> mapForkCheckPoints;
 };
@@ -15,28 +15,14 @@
 using namespace std;
 using namespace xengine;
 
-#define INITIAL_HASH_RATE (8)
 #define WAIT_AGREEMENT_TIME_OFFSET -5
 #define WAIT_NEWBLOCK_TIME (BLOCK_TARGET_SPACING + 5)
 #define WAIT_LAST_EXTENDED_TIME 0 //(BLOCK_TARGET_SPACING - 10)
+#define POW_SEARCH_SLICE 500
 
 namespace bigbang
 {
 
-//////////////////////////////
-// CBlockMakerHashAlgo
-
-class CHashAlgo_Cryptonight : public bigbang::CBlockMakerHashAlgo
-{
-public:
-    CHashAlgo_Cryptonight(int64 nHashRateIn)
-      : CBlockMakerHashAlgo("Cryptonight", nHashRateIn) {}
-    uint256 Hash(const std::vector<unsigned char>& vchData)
-    {
-        return crypto::CryptoPowHash(&vchData[0], vchData.size());
-    }
-};
-
 //////////////////////////////
 // CBlockMakerProfile
 bool CBlockMakerProfile::BuildTemplate()
@@ -71,16 +57,10 @@ CBlockMaker::CBlockMaker()
     pDispatcher = nullptr;
     pConsensus = nullptr;
     pService = nullptr;
-    mapHashAlgo[CM_CRYPTONIGHT] = new CHashAlgo_Cryptonight(INITIAL_HASH_RATE);
 }
 
 CBlockMaker::~CBlockMaker()
 {
-    for (map<int, CBlockMakerHashAlgo*>::iterator it = mapHashAlgo.begin(); it != mapHashAlgo.end(); ++it)
-    {
-        delete ((*it).second);
-    }
-    mapHashAlgo.clear();
 }
 
 bool CBlockMaker::HandleInitialize()
@@ -200,6 +180,12 @@ bool CBlockMaker::HandleInvoke()
 
     if (!mapWorkProfile.empty())
     {
+        if (!powEngine.Start(MintConfig()->nPowThreads))
+        {
+            Error("Failed to start proof-of-work hash threads");
+            return false;
+        }
+        Log("Proof-of-work: %lu hash threads", powEngine.GetThreadCount());
         if (!ThreadDelayStart(thrPow))
         {
             return false;
@@ -224,8 +210,10 @@ void CBlockMaker::HandleHalt()
     thrMaker.Interrupt();
     ThreadExit(thrMaker);
 
+    powEngine.Cancel();
     thrPow.Interrupt();
     ThreadExit(thrPow);
+    powEngine.Stop();
 
     IBlockMaker::HandleHalt();
 }
@@ -272,6 +260,7 @@ bool CBlockMaker::HandleEvent(CEventBlockMakerUpdate& eventUpdate)
 
         condBlock.notify_all();
     }
+    powEngine.Cancel();
     return true;
 }
 
@@ -737,12 +726,9 @@ bool CBlockMaker::CreateProofOfWork()
         return false;
     }
     CBlockMakerProfile& profile = (*it).second;
-    CBlockMakerHashAlgo* pHashAlgo = mapHashAlgo[profile.nAlgo];
-    if (pHashAlgo == nullptr)
-    {
-        StdError("blockmaker", "pHashAlgo is null");
-        return false;
-    }
+
+    // a new block cancels from here on, even before the search is started
+    uint64 nCancelGeneration = powEngine.GetCancelGeneration();
 
     vector<unsigned char> vchWorkData;
     int nPrevBlockHeight = 0;
@@ -759,53 +745,47 @@ bool CBlockMaker::CreateProofOfWork()
     uint64_t& nNonce = *((uint64_t*)&vchWorkData[vchWorkData.size() - sizeof(uint64_t)]);
     nNonce = (GetTime() % 0xFFFFFF) << 40;
 
-    int64& nHashRate = pHashAlgo->nHashRate;
     int64 nHashComputeCount = 0;
     int64 nHashComputeBeginTime = GetTime();
 
-    Log("Proof-of-work: start hash compute, target height: %d, difficulty bits: (%d)", nPrevBlockHeight + 1, nBits);
+    Log("Proof-of-work: start hash compute, target height: %d, difficulty bits: (%d), threads: %lu",
+        nPrevBlockHeight + 1, nBits, powEngine.GetThreadCount());
 
     uint256 hashTarget = (~uint256(uint64(0)) >> nBits);
     while (!InterruptedPoW(hashPrev))
     {
-        if (nHashRate == 0)
+        uint256 hash;
+        uint64 nSliceHashCount = 0;
+        int nResult = powEngine.Search(vchWorkData, hashTarget, POW_SEARCH_SLICE, nCancelGeneration, hash, nSliceHashCount);
+        nHashComputeCount += nSliceHashCount;
+        if (nResult == CPowMiningEngine::SEARCH_CANCELLED)
         {
-            nHashRate = 1;
+            nCancelGeneration = powEngine.GetCancelGeneration();
+            continue;
         }
-        for (int i = 0; i < nHashRate; i++)
+        if (nResult == CPowMiningEngine::SEARCH_FOUND)
         {
-            uint256 hash = pHashAlgo->Hash(vchWorkData);
-            nHashComputeCount++;
-            if (hash <= hashTarget)
-            {
-                int64 nDuration = GetTime() - nHashComputeBeginTime;
-                int nCompHashRate = ((nDuration <= 0) ? 0 : (nHashComputeCount / nDuration));
+            int64 nDuration = GetTime() - nHashComputeBeginTime;
+            int nCompHashRate = ((nDuration <= 0) ? 0 : (nHashComputeCount / nDuration));
 
-                Log("Proof-of-work: block found (%s), target height: %d, compute: (rate:%ld, count:%ld, duration:%lds, hashrate:%ld), difficulty bits: (%d)\nhash :   %s\ntarget : %s",
-                    pHashAlgo->strAlgo.c_str(), nPrevBlockHeight + 1, nHashRate, nHashComputeCount, nDuration, nCompHashRate, nBits,
-                    hash.GetHex().c_str(), hashTarget.GetHex().c_str());
+            Log("Proof-of-work: block found, target height: %d, compute: (count:%ld, duration:%lds, hashrate:%ld), difficulty bits: (%d)\nhash :   %s\ntarget : %s",
+                nPrevBlockHeight + 1, nHashComputeCount, nDuration, nCompHashRate, nBits,
+                hash.GetHex().c_str(), hashTarget.GetHex().c_str());
 
-                uint256 hashBlock;
-                Errno err = pService->SubmitWork(vchWorkData, profile.templMint, profile.keyMint, hashBlock);
-                if (err != OK)
-                {
-                    return false;
-                }
-                return true;
+            uint256 hashBlock;
+            Errno err = pService->SubmitWork(vchWorkData, profile.templMint, profile.keyMint, hashBlock);
+            if (err != OK)
+            {
+                return false;
             }
-            nNonce++;
+            return true;
         }
 
         int64 nNetTime = GetNetTime();
         if (nTime + 1 < nNetTime)
         {
-            nHashRate /= (nNetTime - nTime);
             nTime = nNetTime;
         }
-        else if (nTime == nNetTime)
-        {
-            nHashRate *= 2;
-        }
     }
     Log("Proof-of-work: target height: %d, compute interrupted.", nPrevBlockHeight + 1);
     return false;
@@ -10,23 +10,11 @@
 #include "base.h"
 #include "event.h"
 #include "key.h"
+#include "powengine.h"
 
 namespace bigbang
 {
 
-class CBlockMakerHashAlgo
-{
-public:
-    CBlockMakerHashAlgo(const std::string& strAlgoIn, int64 nHashRateIn)
-      : strAlgo(strAlgoIn), nHashRate(nHashRateIn) {}
-    virtual ~CBlockMakerHashAlgo() {}
-    virtual uint256 Hash(const std::vector<unsigned char>& vchData) = 0;
-
-public:
-    const std::string strAlgo;
-    int64 nHashRate;
-};
-
 class CBlockMakerProfile
 {
 public:
@@ -107,9 +95,9 @@ protected:
     boost::condition_variable condBlock;
     std::atomic<bool> fExit;
     CForkStatus lastStatus;
-    std::map<int, CBlockMakerHashAlgo*> mapHashAlgo;
     std::map<int, CBlockMakerProfile> mapWorkProfile;
     std::map<CDestination, CBlockMakerProfile> mapDelegatedProfile;
+    CPowMiningEngine powEngine;
     ICoreProtocol* pCoreProtocol;
     IBlockChain* pBlockChain;
     IForkManager* pForkManager;
@@ -861,10 +861,10 @@ void CCheckBlockFork::UpdateMaxTrust(CBlockIndex* pBlockIndex)
     }
 }
 
-bool CCheckBlockFork::AddBlockTx(const CTransaction& txIn, const CTxContxt& contxtIn, int nHeight, const uint256& hashAtForkIn, uint32 nFileNoIn, uint32 nOffsetIn)
+bool CCheckBlockFork::AddBlockTx(const CTransaction& txIn, const CTxContxt& contxtIn, int nHeight, const uint256& hashAtForkIn, uint32 nFileNoIn, uint32 nOffsetIn, uint32 nBlockOffsetIn, uint32 nTxOrdinalIn)
 {
     const uint256 txid = txIn.GetHash();
-    map<uint256, CCheckBlockTx>::iterator mt = mapBlockTx.insert(make_pair(txid, CCheckBlockTx(txIn, contxtIn, nHeight, hashAtForkIn, nFileNoIn, nOffsetIn))).first;
+    map<uint256, CCheckBlockTx>::iterator mt = mapBlockTx.insert(make_pair(txid, CCheckBlockTx(txIn, contxtIn, nHeight, hashAtForkIn, nFileNoIn, nOffsetIn, nBlockOffsetIn, nTxOrdinalIn))).first;
     if (mt == mapBlockTx.end())
     {
         StdLog("check", "AddBlockTx: add block tx fail, txid: %s.", txid.GetHex().c_str());
@@ -1499,7 +1499,7 @@ bool CCheckBlockWalker::UpdateBlockTx(CCheckForkManager& objForkMn)
                     CTxContxt txContxt;
                     txContxt.destIn = block.txMint.sendTo;
                     uint32 nTxOffset = pIndex->nOffset + block.GetTxSerializedOffset();
-                    if (!AddBlockTx(block.txMint, txContxt, block.GetBlockHeight(), hashFork, pIndex->nFile, nTxOffset, vFork))
+                    if (!AddBlockTx(block.txMint, txContxt, block.GetBlockHeight(), hashFork, pIndex->nFile, nTxOffset, pIndex->nOffset, 0, vFork))
                     {
                         StdError("check", "UpdateBlockTx: Add mint tx fail, txid: %s, block: %s",
                                  block.txMint.GetHash().GetHex().c_str(), pIndex->GetBlockHash().GetHex().c_str());
@@ -1511,7 +1511,7 @@ bool CCheckBlockWalker::UpdateBlockTx(CCheckForkManager& objForkMn)
                     nTxOffset += ss.GetSerializeSize(var);
                     for (int i = 0; i < block.vtx.size(); i++)
                     {
-                        if (!AddBlockTx(block.vtx[i], block.vTxContxt[i], block.GetBlockHeight(), hashFork, pIndex->nFile, nTxOffset, vFork))
+                        if (!AddBlockTx(block.vtx[i], block.vTxContxt[i], block.GetBlockHeight(), hashFork, pIndex->nFile, nTxOffset, pIndex->nOffset, i + 1, vFork))
                         {
                             StdError("check", "UpdateBlockTx: Add tx fail, txid: %s, block: %s",
                                      block.vtx[i].GetHash().GetHex().c_str(), pIndex->GetBlockHash().GetHex().c_str());
@@ -1531,14 +1531,14 @@ bool CCheckBlockWalker::UpdateBlockTx(CCheckForkManager& objForkMn)
     return true;
 }
 
-bool CCheckBlockWalker::AddBlockTx(const CTransaction& txIn, const CTxContxt& contxtIn, int nHeight, const uint256& hashAtForkIn, uint32 nFileNoIn, uint32 nOffsetIn, const vector<uint256>& vFork)
+bool CCheckBlockWalker::AddBlockTx(const CTransaction& txIn, const CTxContxt& contxtIn, int nHeight, const uint256& hashAtForkIn, uint32 nFileNoIn, uint32 nOffsetIn, uint32 nBlockOffsetIn, uint32 nTxOrdinalIn, const vector<uint256>& vFork)
 {
     for (const uint256& hashFork : vFork)
     {
         map<uint256, CCheckBlockFork>::iterator it = mapCheckFork.find(hashFork);
         if (it != mapCheckFork.end())
         {
-            if (!it->second.AddBlockTx(txIn, contxtIn, nHeight, hashAtForkIn, nFileNoIn, nOffsetIn))
+            if (!it->second.AddBlockTx(txIn, contxtIn, nHeight, hashAtForkIn, nFileNoIn, nOffsetIn, nBlockOffsetIn, nTxOrdinalIn))
             {
                 StdError("check", "Block add tx: Add fail, txid: %s, fork: %s",
                          txIn.GetHash().GetHex().c_str(), hashFork.GetHex().c_str());
@@ -1716,6 +1716,7 @@ bool CCheckBlockWalker::CheckBlockIndex()
             if (!fOnlyCheck)
             {
                 dbBlockIndex.AddNewBlock(CBlockOutline(it->second));
+                fBlockIndexRepaired = true;
             }
         }
     }
@@ -1728,6 +1729,7 @@ bool CCheckBlockWalker::CheckBlockIndex()
             if (!fOnlyCheck)
             {
                 dbBlockIndex.RemoveBlock(blockOut.hashBlock);
+                fBlockIndexRepaired = true;
             }
         }
     }
@@ -2254,17 +2256,18 @@ bool CCheckRepairData::CheckTxIndex()
                     StdLog("check", "Retrieve db tx index fail, height: %d, block: %s, mint tx: %s.",
                            block.GetBlockHeight(), block.GetHash().GetHex().c_str(), block.txMint.GetHash().GetHex().c_str());
 
-                    mapTxNew[hashFork].push_back(make_pair(block.txMint.GetHash(), CTxIndex(block.GetBlockHeight(), pBlockIndex->nFile, nTxOffset)));
+                    mapTxNew[hashFork].push_back(make_pair(block.txMint.GetHash(), CTxIndex(block.GetBlockHeight(), pBlockIndex->nFile, nTxOffset, pBlockIndex->nOffset, 0)));
                 }
                 else
                 {
-                    if (!(txIndex.nFile == pBlockIndex->nFile && txIndex.nOffset == nTxOffset))
+                    if (!(txIndex.nFile == pBlockIndex->nFile && txIndex.nOffset == nTxOffset
+                          && txIndex.nBlockOffset == pBlockIndex->nOffset && txIndex.IsMintTx()))
                     {
                         StdLog("check", "Check tx index fail, height: %d, block: %s, mint tx: %s, db offset: %d, block offset: %d.",
                                block.GetBlockHeight(), block.GetHash().GetHex().c_str(),
                                block.txMint.GetHash().GetHex().c_str(), txIndex.nOffset, nTxOffset);
 
-                        mapTxNew[hashFork].push_back(make_pair(block.txMint.GetHash(), CTxIndex(block.GetBlockHeight(), pBlockIndex->nFile, nTxOffset)));
+                        mapTxNew[hashFork].push_back(make_pair(block.txMint.GetHash(), CTxIndex(block.GetBlockHeight(), pBlockIndex->nFile, nTxOffset, pBlockIndex->nOffset, 0)));
                     }
                 }
                 nTxOffset += ss.GetSerializeSize(block.txMint);
@@ -2278,16 +2281,17 @@ bool CCheckRepairData::CheckTxIndex()
                         StdLog("check", "Retrieve db tx index fail, height: %d, block: %s, txid: %s.",
                                block.GetBlockHeight(), block.GetHash().GetHex().c_str(), block.vtx[i].GetHash().GetHex().c_str());
 
-                        mapTxNew[hashFork].push_back(make_pair(block.vtx[i].GetHash(), CTxIndex(block.GetBlockHeight(), pBlockIndex->nFile, nTxOffset)));
+                        mapTxNew[hashFork].push_back(make_pair(block.vtx[i].GetHash(), CTxIndex(block.GetBlockHeight(), pBlockIndex->nFile, nTxOffset, pBlockIndex->nOffset, i + 1)));
                     }
                     else
                     {
-                        if (!(txIndex.nFile == pBlockIndex->nFile && txIndex.nOffset == nTxOffset))
+                        if (!(txIndex.nFile == pBlockIndex->nFile && txIndex.nOffset == nTxOffset
+                              && txIndex.nBlockOffset == pBlockIndex->nOffset && txIndex.nTxOrdinal == uint32(i + 1)))
                         {
                             StdLog("check", "Check tx index fail, height: %d, block: %s, txid: %s, db offset: %d, block offset: %d.",
                                    block.GetBlockHeight(), block.GetHash().GetHex().c_str(), block.vtx[i].GetHash().GetHex().c_str(), txIndex.nOffset, nTxOffset);
 
-                            mapTxNew[hashFork].push_back(make_pair(block.vtx[i].GetHash(), CTxIndex(block.GetBlockHeight(), pBlockIndex->nFile, nTxOffset)));
+                            mapTxNew[hashFork].push_back(make_pair(block.vtx[i].GetHash(), CTxIndex(block.GetBlockHeight(), pBlockIndex->nFile, nTxOffset, pBlockIndex->nOffset, i + 1)));
                         }
                     }
                     nTxOffset += ss.GetSerializeSize(block.vtx[i]);
@@ -2313,6 +2317,10 @@ bool CCheckRepairData::CheckTxIndex()
             }
             dbTxIndex.Flush(fork.first);
         }
+        if (dbTxIndex.IsRebuildRequired() && !dbTxIndex.SetRebuilt())
+        {
+            StdLog("check", "Repair tx index set version fail");
+        }
         StdLog("check", "Repair tx index success");
     }
 
@@ -2336,6 +2344,22 @@ bool CCheckRepairData::RemoveTxPoolFile()
     return true;
 }
 
+bool CCheckRepairData::RemoveBlockIndexSnapshot()
+{
+    CBlockIndexSnapshot snapshotIndex;
+    if (!snapshotIndex.Initialize(path(strDataPath)))
+    {
+        StdLog("check", "Remove block index snapshot: Failed to initialize snapshot");
+        return false;
+    }
+    if (!snapshotIndex.Remove())
+    {
+        StdLog("check", "Remove block index snapshot: Remove failed");
+        return false;
+    }
+    return true;
+}
+
 bool CCheckRepairData::RepairUnspent()
 {
     CUnspentDB dbUnspent;
@@ -2553,6 +2577,11 @@ bool CCheckRepairData::CheckRepairData()
         StdLog("check", "Check block index fail");
         return false;
     }
+    if (objBlockWalker.fBlockIndexRepaired && !RemoveBlockIndexSnapshot())
+    {
+        StdLog("check", "Remove block index snapshot fail");
+        return false;
+    }
     StdLog("check", "Check block index complete");
 
     StdLog("check", "Check tx index starting");
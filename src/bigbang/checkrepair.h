@@ -8,6 +8,7 @@
 #include "address.h"
 #include "block.h"
 #include "blockindexdb.h"
+#include "blockindexsnapshot.h"
 #include "core.h"
 #include "delegatecomm.h"
 #include "delegateverify.h"
@@ -34,8 +35,8 @@ namespace bigbang
 class CCheckBlockTx
 {
 public:
-    CCheckBlockTx(const CTransaction& txIn, const CTxContxt& contxtIn, int nHeight, const uint256& hashAtForkIn, uint32 nFileNoIn, uint32 nOffsetIn)
-      : tx(txIn), txContxt(contxtIn), hashAtFork(hashAtForkIn), txIndex(nHeight, nFileNoIn, nOffsetIn)
+    CCheckBlockTx(const CTransaction& txIn, const CTxContxt& contxtIn, int nHeight, const uint256& hashAtForkIn, uint32 nFileNoIn, uint32 nOffsetIn, uint32 nBlockOffsetIn, uint32 nTxOrdinalIn)
+      : tx(txIn), txContxt(contxtIn), hashAtFork(hashAtForkIn), txIndex(nHeight, nFileNoIn, nOffsetIn, nBlockOffsetIn, nTxOrdinalIn)
     {
     }
 
@@ -389,7 +390,7 @@ public:
       : pOrigin(nullptr), pLast(nullptr) {}
 
     void UpdateMaxTrust(CBlockIndex* pBlockIndex);
-    bool AddBlockTx(const CTransaction& txIn, const CTxContxt& contxtIn, int nHeight, const uint256& hashAtForkIn, uint32 nFileNoIn, uint32 nOffsetIn);
+    bool AddBlockTx(const CTransaction& txIn, const CTxContxt& contxtIn, int nHeight, const uint256& hashAtForkIn, uint32 nFileNoIn, uint32 nOffsetIn, uint32 nBlockOffsetIn, uint32 nTxOrdinalIn);
     bool AddBlockSpent(const CTxOutPoint& txPoint, const uint256& txidSpent, const CDestination& sendTo);
     bool AddBlockUnspent(const CTxOutPoint& txPoint, const CTxOut& txOut);
     bool CheckTxExist(const uint256& txid, int& nHeight);
@@ -407,7 +408,7 @@ class CCheckBlockWalker : public CTSWalker<CBlockEx>
 {
 public:
     CCheckBlockWalker(bool fTestnetIn, bool fOnlyCheckIn)
-      : nBlockCount(0), nMainChainHeight(0), nMainChainTxCount(0), objProofParam(fTestnetIn), fOnlyCheck(fOnlyCheckIn) {}
+      : nBlockCount(0), nMainChainHeight(0), nMainChainTxCount(0), objProofParam(fTestnetIn), fOnlyCheck(fOnlyCheckIn), fBlockIndexRepaired(false) {}
     ~CCheckBlockWalker();
 
     bool Initialize(const string& strPath);
@@ -424,7 +425,7 @@ public:
 
     bool UpdateBlockNext();
     bool UpdateBlockTx(CCheckForkManager& objForkMn);
-    bool AddBlockTx(const CTransaction& txIn, const CTxContxt& contxtIn, int nHeight, const uint256& hashAtForkIn, uint32 nFileNoIn, uint32 nOffsetIn, const vector<uint256>& vFork);
+    bool AddBlockTx(const CTransaction& txIn, const CTxContxt& contxtIn, int nHeight, const uint256& hashAtForkIn, uint32 nFileNoIn, uint32 nOffsetIn, uint32 nBlockOffsetIn, uint32 nTxOrdinalIn, const vector<uint256>& vFork);
     CBlockIndex* AddNewIndex(const uint256& hash, const CBlock& block, uint32 nFile, uint32 nOffset, uint256 nChainTrust);
     CBlockIndex* AddNewIndex(const uint256& hash, const CBlockOutline& objBlockOutline);
     void ClearBlockIndex();
@@ -435,6 +436,7 @@ public:
 
 public:
     bool fOnlyCheck;
+    bool fBlockIndexRepaired;
     int64 nBlockCount;
     uint32 nMainChainHeight;
     int64 nMainChainTxCount;
@@ -471,6 +473,7 @@ protected:
     bool CheckTxIndex();
 
     bool RemoveTxPoolFile();
+    bool RemoveBlockIndexSnapshot();
     bool RepairUnspent();
     bool RepairWalletTx(const vector<CWalletTx>& vAddTx, const vector<uint256>& vRemoveTx);
     bool RestructureWalletTx();
@@ -11,6 +11,7 @@
 #include "../common/template/payment.h"
 #include "../common/template/vote.h"
 #include "address.h"
+#include "mode/config_macro.h"
 #include "wallet.h"
 
 using namespace std;
@@ -19,6 +20,9 @@ using namespace xengine;
 #define DEBUG(err, ...) Debug((err), __FUNCTION__, __VA_ARGS__)
 
 static const int64 MAX_CLOCK_DRIFT = 80;
+static const std::size_t SIGNATURE_CACHE_SIZE = 0x20000;
+static const std::size_t POW_HASH_CACHE_COUNT = 0x4000;
+static const std::size_t POW_PREVALIDATE_QUEUE_SIZE = 1024;
 
 static const int PROOF_OF_WORK_BITS_LOWER_LIMIT = 8;
 static const int PROOF_OF_WORK_BITS_UPPER_LIMIT = 200;
@@ -118,10 +122,114 @@ static const int32 DELEGATE_PROOF_OF_STAKE_CONSENSUS_CHECK_REPEATED = 340935;
 
 namespace bigbang
 {
+///////////////////////////////
+// CPowHashPrevalidator
+
+CPowHashPrevalidator::CPowHashPrevalidator(size_t nCacheCount, size_t nMaxQueueIn)
+  : nMaxQueue(nMaxQueueIn), fAbort(false), cachePowHash(nCacheCount)
+{
+}
+
+void CPowHashPrevalidator::Prevalidate(const CBlock& block)
+{
+    const uint256 hashBlock = block.GetHash();
+    {
+        boost::unique_lock<boost::mutex> lock(mtx);
+        if (fAbort || queWork.size() >= nMaxQueue || setHashing.count(hashBlock) || cachePowHash.Exists(hashBlock))
+        {
+            return;
+        }
+        queWork.push_back(make_pair(hashBlock, vector<unsigned char>()));
+        block.GetSerializedProofOfWorkData(queWork.back().second);
+    }
+    condWork.notify_one();
+}
+
+void CPowHashPrevalidator::AddNew(const uint256& hashBlock, const uint256& hashPow)
+{
+    boost::unique_lock<boost::mutex> lock(mtx);
+    cachePowHash.AddNew(hashBlock, hashPow);
+}
+
+bool CPowHashPrevalidator::Retrieve(const uint256& hashBlock, uint256& hashPow)
+{
+    boost::unique_lock<boost::mutex> lock(mtx);
+    // a block being hashed by a worker is waited for, a queued one is taken back by the caller
+    while (!fAbort && setHashing.count(hashBlock))
+    {
+        condDone.wait(lock);
+    }
+    if (cachePowHash.Retrieve(hashBlock, hashPow))
+    {
+        return true;
+    }
+    for (auto it = queWork.begin(); it != queWork.end(); ++it)
+    {
+        if (it->first == hashBlock)
+        {
+            queWork.erase(it);
+            break;
+        }
+    }
+    return false;
+}
+
+bool CPowHashPrevalidator::WorkerThreadFunc()
+{
+    uint256 hashBlock;
+    vector<unsigned char> vchProofOfWork;
+    {
+        boost::unique_lock<boost::mutex> lock(mtx);
+        while (!fAbort && queWork.empty())
+        {
+            condWork.wait(lock);
+        }
+        if (fAbort)
+        {
+            return false;
+        }
+        hashBlock = queWork.front().first;
+        vchProofOfWork.swap(queWork.front().second);
+        queWork.pop_front();
+        setHashing.insert(hashBlock);
+    }
+
+    uint256 hashPow = crypto::CryptoPowHash(&vchProofOfWork[0], vchProofOfWork.size());
+
+    {
+        boost::unique_lock<boost::mutex> lock(mtx);
+        cachePowHash.AddNew(hashBlock, hashPow);
+        setHashing.erase(hashBlock);
+    }
+    condDone.notify_all();
+    return true;
+}
+
+void CPowHashPrevalidator::Reset()
+{
+    boost::unique_lock<boost::mutex> lock(mtx);
+    queWork.clear();
+    setHashing.clear();
+    cachePowHash.Clear();
+    fAbort = false;
+}
+
+void CPowHashPrevalidator::Interrupt()
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mtx);
+        queWork.clear();
+        fAbort = true;
+    }
+    condWork.notify_all();
+    condDone.notify_all();
+}
+
 ///////////////////////////////
 // CCoreProtocol
 
 CCoreProtocol::CCoreProtocol()
+  : cacheSignature(SIGNATURE_CACHE_SIZE), powPrevalidator(POW_HASH_CACHE_COUNT, POW_PREVALIDATE_QUEUE_SIZE)
 {
     nProofOfWorkLowerLimit = PROOF_OF_WORK_BITS_LOWER_LIMIT;
     nProofOfWorkUpperLimit = PROOF_OF_WORK_BITS_UPPER_LIMIT;
@@ -131,6 +239,7 @@ CCoreProtocol::CCoreProtocol()
     nProofOfWorkUpperTargetOfDpos = PROOF_OF_WORK_TARGET_OF_DPOS_UPPER;
     nProofOfWorkLowerTargetOfDpos = PROOF_OF_WORK_TARGET_OF_DPOS_LOWER;
     pBlockChain = nullptr;
+    nPrevalidateThreads = 0;
 }
 
 CCoreProtocol::~CCoreProtocol()
@@ -149,6 +258,61 @@ bool CCoreProtocol::HandleInitialize()
     return true;
 }
 
+bool CCoreProtocol::HandleInvoke()
+{
+    powPrevalidator.Reset();
+    {
+        // the prevalidate threads are started by the first block received
+        boost::unique_lock<boost::mutex> lock(mtxPrevalidate);
+        nPrevalidateThreads = (MintConfig() != nullptr ? MintConfig()->nPowCheckThreads : DEFAULT_POW_CHECK_THREAD_NUMBER);
+        nPrevalidateThreads = std::min(nPrevalidateThreads, std::max(1u, std::thread::hardware_concurrency()));
+    }
+    return ICoreProtocol::HandleInvoke();
+}
+
+void CCoreProtocol::HandleHalt()
+{
+    ICoreProtocol::HandleHalt();
+
+    boost::unique_lock<boost::mutex> lock(mtxPrevalidate);
+    nPrevalidateThreads = 0;
+    powPrevalidator.Interrupt();
+    for (auto& spThread : vThrPrevalidate)
+    {
+        ThreadExit(*spThread);
+    }
+    vThrPrevalidate.clear();
+}
+
+void CCoreProtocol::PrevalidateThreadFunc()
+{
+    // the cryptonight scratchpad is thread local, release it as the worker exits
+    crypto::CryptoPowHashAllocState();
+
+    while (powPrevalidator.WorkerThreadFunc())
+    {
+    }
+
+    crypto::CryptoPowHashFreeState();
+}
+
+bool CCoreProtocol::StartPrevalidateThreads()
+{
+    boost::unique_lock<boost::mutex> lock(mtxPrevalidate);
+    while (vThrPrevalidate.size() < nPrevalidateThreads)
+    {
+        vThrPrevalidate.push_back(unique_ptr<CThread>(new CThread("powcheck" + to_string(vThrPrevalidate.size()),
+                                                                  boost::bind(&CCoreProtocol::PrevalidateThreadFunc, this))));
+        if (!ThreadStart(*vThrPrevalidate.back()))
+        {
+            // hash on the verifying thread as without prevalidation
+            vThrPrevalidate.pop_back();
+            nPrevalidateThreads = vThrPrevalidate.size();
+        }
+    }
+    return (nPrevalidateThreads > 0);
+}
+
 Errno CCoreProtocol::Debug(const Errno& err, const char* pszFunc, const char* pszFormat, ...)
 {
     string strFormat(pszFunc);
@@ -479,9 +643,14 @@ Errno CCoreProtocol::VerifyProofOfWork(const CBlock& block, const CBlockIndex* p
 
     uint256 hashTarget = (~uint256(uint64(0)) >> nBits);
 
-    vector<unsigned char> vchProofOfWork;
-    block.GetSerializedProofOfWorkData(vchProofOfWork);
-    uint256 hash = crypto::CryptoPowHash(&vchProofOfWork[0], vchProofOfWork.size());
+    uint256 hash;
+    if (!powPrevalidator.Retrieve(block.GetHash(), hash))
+    {
+        vector<unsigned char> vchProofOfWork;
+        block.GetSerializedProofOfWorkData(vchProofOfWork);
+        hash = crypto::CryptoPowHash(&vchProofOfWork[0], vchProofOfWork.size());
+        powPrevalidator.AddNew(block.GetHash(), hash);
+    }
 
     if (hash > hashTarget)
     {
@@ -492,6 +661,14 @@ Errno CCoreProtocol::VerifyProofOfWork(const CBlock& block, const CBlockIndex* p
     return OK;
 }
 
+void CCoreProtocol::PrevalidateProofOfWork(const CBlock& block)
+{
+    if (block.vchProof.size() >= CProofOfHashWorkCompact::PROOFHASHWORK_SIZE && StartPrevalidateThreads())
+    {
+        powPrevalidator.Prevalidate(block);
+    }
+}
+
 Errno CCoreProtocol::VerifyDelegatedProofOfStake(const CBlock& block, const CBlockIndex* pIndexPrev,
                                                  const CDelegateAgreement& agreement)
 {
@@ -667,7 +844,7 @@ Errno CCoreProtocol::VerifyBlockTx(const CTransaction& tx, const CTxContxt& txCo
 
     if (tx.sendTo.GetTemplateId().GetType() == TEMPLATE_FORK && tx.nAmount < CTemplateFork::CreatedCoin())
     {
-        throw DEBUG(ERR_TRANSACTION_INPUT_INVALID, "creating fork nAmount must be at least %ld", CTemplateFork::CreatedCoin());
+        return DEBUG(ERR_TRANSACTION_INPUT_INVALID, "creating fork nAmount must be at least %ld", CTemplateFork::CreatedCoin());
     }
 
     if (!VerifyDestRecorded(tx, vchSig))
@@ -675,7 +852,7 @@ Errno CCoreProtocol::VerifyBlockTx(const CTransaction& tx, const CTxContxt& txCo
         return DEBUG(ERR_TRANSACTION_SIGNATURE_INVALID, "invalid recoreded destination\n");
     }
 
-    if (!destIn.VerifyTxSignature(tx.GetSignatureHash(), tx.nType, tx.hashAnchor, tx.sendTo, vchSig, nForkHeight, fork))
+    if (!VerifyTxSignature(tx, destIn, vchSig, nForkHeight, fork))
     {
         return DEBUG(ERR_TRANSACTION_SIGNATURE_INVALID, "invalid signature\n");
     }
@@ -754,7 +931,7 @@ Errno CCoreProtocol::VerifyTransaction(const CTransaction& tx, const vector<CTxO
         return DEBUG(ERR_TRANSACTION_SIGNATURE_INVALID, "invalid recoreded destination\n");
     }
 
-    if (!destIn.VerifyTxSignature(tx.GetSignatureHash(), tx.nType, tx.hashAnchor, tx.sendTo, vchSig, nForkHeight, fork))
+    if (!VerifyTxSignature(tx, destIn, vchSig, nForkHeight, fork))
     {
         return DEBUG(ERR_TRANSACTION_SIGNATURE_INVALID, "invalid signature\n");
     }
@@ -806,7 +983,7 @@ Errno CCoreProtocol::VerifyTransaction(const CTransaction& tx, const vector<CTxO
 
     if (tx.sendTo.GetTemplateId().GetType() == TEMPLATE_FORK && tx.nAmount < CTemplateFork::CreatedCoin())
     {
-        throw DEBUG(ERR_TRANSACTION_INPUT_INVALID, "creating fork nAmount must be at least %ld", CTemplateFork::CreatedCoin());
+        return DEBUG(ERR_TRANSACTION_INPUT_INVALID, "creating fork nAmount must be at least %ld", CTemplateFork::CreatedCoin());
     }
 
     return OK;
@@ -1232,6 +1409,35 @@ Errno CCoreProtocol::VerifyVoteTx(const CTransaction& tx, const CDestination& de
     return OK;
 }
 
+uint256 CCoreProtocol::GetSignatureCacheKey(const uint256& hashSig, const CDestination& destIn, const vector<uint8>& vchSig,
+                                            int nForkHeight, const uint256& fork)
+{
+    // Plain public key signatures do not depend on height, so txpool checks are reused by the next blocks
+    CBufStream ss;
+    ss << hashSig << destIn << vchSig << fork << (int32)(destIn.IsPubKey() ? 0 : nForkHeight);
+    return crypto::CryptoHash(ss.GetData(), ss.GetSize());
+}
+
+bool CCoreProtocol::VerifyTxSignature(const CTransaction& tx, const CDestination& destIn, const vector<uint8>& vchSig,
+                                      int nForkHeight, const uint256& fork)
+{
+    const uint256 hashSig = tx.GetSignatureHash();
+    uint256 hashKey = GetSignatureCacheKey(hashSig, destIn, vchSig, nForkHeight, fork);
+
+    bool fVerified = false;
+    if (cacheSignature.Retrieve(hashKey, fVerified))
+    {
+        return true;
+    }
+
+    if (!destIn.VerifyTxSignature(hashSig, tx.nType, tx.hashAnchor, tx.sendTo, vchSig, nForkHeight, fork))
+    {
+        return false;
+    }
+    cacheSignature.AddNew(hashKey, true);
+    return true;
+}
+
 ///////////////////////////////
 // CTestNetCoreProtocol
 
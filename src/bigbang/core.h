@@ -10,6 +10,28 @@
 namespace bigbang
 {
 
+class CPowHashPrevalidator
+{
+public:
+    CPowHashPrevalidator(std::size_t nCacheCount, std::size_t nMaxQueueIn);
+    void Prevalidate(const CBlock& block);
+    void AddNew(const uint256& hashBlock, const uint256& hashPow);
+    bool Retrieve(const uint256& hashBlock, uint256& hashPow);
+    bool WorkerThreadFunc();
+    void Reset();
+    void Interrupt();
+
+protected:
+    std::size_t nMaxQueue;
+    boost::mutex mtx;
+    boost::condition_variable condWork;
+    boost::condition_variable condDone;
+    bool fAbort;
+    std::deque<std::pair<uint256, std::vector<unsigned char>>> queWork;
+    std::set<uint256> setHashing;
+    xengine::CCache<uint256, uint256> cachePowHash;
+};
+
 class CCoreProtocol : public ICoreProtocol
 {
 public:
@@ -26,6 +48,7 @@ public:
     virtual Errno VerifyTransaction(const CTransaction& tx, const std::vector<CTxOut>& vPrevOutput, int nForkHeight, const uint256& fork) override;
 
     virtual Errno VerifyProofOfWork(const CBlock& block, const CBlockIndex* pIndexPrev) override;
+    virtual void PrevalidateProofOfWork(const CBlock& block) override;
     virtual Errno VerifyDelegatedProofOfStake(const CBlock& block, const CBlockIndex* pIndexPrev,
                                               const CDelegateAgreement& agreement) override;
     virtual Errno VerifySubsidiary(const CBlock& block, const CBlockIndex* pIndexPrev, const CBlockIndex* pIndexRef,
@@ -45,12 +68,30 @@ public:
 
 protected:
     bool HandleInitialize() override;
+    bool HandleInvoke() override;
+    void HandleHalt() override;
+    void PrevalidateThreadFunc();
+    bool StartPrevalidateThreads();
     Errno Debug(const Errno& err, const char* pszFunc, const char* pszFormat, ...);
     bool CheckBlockSignature(const CBlock& block);
     Errno ValidateVacantBlock(const CBlock& block);
     bool VerifyDestRecorded(const CTransaction& tx, vector<uint8>& vchSigOut);
     Errno VerifyCertTx(const CTransaction& tx, const CDestination& destIn, const uint256& fork);
     Errno VerifyVoteTx(const CTransaction& tx, const CDestination& destIn, const uint256& fork);
+    bool VerifyTxSignature(const CTransaction& tx, const CDestination& destIn, const std::vector<uint8>& vchSig,
+                           int nForkHeight, const uint256& fork);
+    static uint256 GetSignatureCacheKey(const uint256& hashSig, const CDestination& destIn, const std::vector<uint8>& vchSig,
+                                        int nForkHeight, const uint256& fork);
+
+protected:
+    class CSigCacheHasher
+    {
+    public:
+        std::size_t operator()(const uint256& key) const
+        {
+            return key.Get64(0);
+        }
+    };
 
 protected:
     uint256 hashGenesisBlock;
@@ -62,6 +103,11 @@ protected:
     int64 nProofOfWorkUpperTargetOfDpos;
     int64 nProofOfWorkLowerTargetOfDpos;
     IBlockChain* pBlockChain;
+    xengine::CShardedLRUCache<uint256, bool, 16, CSigCacheHasher> cacheSignature;
+    CPowHashPrevalidator powPrevalidator;
+    boost::mutex mtxPrevalidate;
+    unsigned int nPrevalidateThreads;
+    std::vector<std::unique_ptr<xengine::CThread>> vThrPrevalidate;
 };
 
 class CTestNetCoreProtocol : public CCoreProtocol
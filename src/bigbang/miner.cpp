@@ -16,6 +16,8 @@ using namespace json_spirit;
 using boost::asio::ip::tcp;
 using namespace bigbang::rpc;
 
+#define MINER_SEARCH_SLICE 1000
+
 extern void Shutdown();
 
 namespace bigbang
@@ -33,11 +35,16 @@ CMiner::CMiner(const vector<string>& vArgsIn)
     nNonceSubmitWork = 2;
     nMinerStatus = -1;
     pHttpGet = nullptr;
+    nMinerThreads = 1;
     if (vArgsIn.size() >= 2)
     {
         strAddrSpent = vArgsIn[0];
         strMintKey = vArgsIn[1];
     }
+    if (vArgsIn.size() >= 3)
+    {
+        nMinerThreads = strtoul(vArgsIn[2].c_str(), nullptr, 10);
+    }
 }
 
 CMiner::~CMiner()
@@ -71,6 +78,12 @@ bool CMiner::HandleInvoke()
         cerr << "Invalid mint key\n";
         return false;
     }
+    if (!powEngine.Start(nMinerThreads))
+    {
+        cerr << "Failed to start hash threads\n";
+        return false;
+    }
+    cout << "Mining with " << powEngine.GetThreadCount() << " threads\n";
     if (!ThreadDelayStart(thrFetcher))
     {
         return false;
@@ -93,6 +106,7 @@ void CMiner::HandleHalt()
     }
     condFetcher.notify_all();
     condMiner.notify_all();
+    powEngine.Cancel();
 
     if (thrFetcher.IsRunning())
     {
@@ -108,6 +122,8 @@ void CMiner::HandleHalt()
     }
     thrMiner.Interrupt();
     ThreadExit(thrMiner);
+
+    powEngine.Stop();
 }
 
 const CRPCClientConfig* CMiner::Config()
@@ -188,6 +204,7 @@ bool CMiner::HandleEvent(CEventHttpGetRsp& event)
                         nMinerStatus = MINER_HOLD;
                     }
                     condMiner.notify_all();
+                    powEngine.Cancel();
                 }
                 else
                 {
@@ -204,6 +221,7 @@ bool CMiner::HandleEvent(CEventHttpGetRsp& event)
                         nMinerStatus = MINER_RESET;
                     }
                     condMiner.notify_all();
+                    powEngine.Cancel();
                 }
             }
             else
@@ -366,6 +384,7 @@ void CMiner::LaunchMiner()
     while (nMinerStatus != MINER_EXIT)
     {
         CMinerWork work;
+        uint64 nCancelGeneration = 0;
         {
             boost::unique_lock<boost::mutex> lock(mutex);
             while (nMinerStatus == MINER_HOLD)
@@ -381,12 +400,12 @@ void CMiner::LaunchMiner()
                 nMinerStatus = MINER_HOLD;
                 continue;
             }
+            nCancelGeneration = powEngine.GetCancelGeneration();
             work = workCurrent;
             nMinerStatus = MINER_RUN;
         }
 
         uint32& nTime = *((uint32*)&work.vchWorkData[4]);
-        uint64_t& nNonce = *(uint64_t*)&work.vchWorkData[work.vchWorkData.size() - sizeof(uint64_t)];
 
         if (work.nAlgo == CM_CRYPTONIGHT)
         {
@@ -399,23 +418,27 @@ void CMiner::LaunchMiner()
                 {
                     nTime = t;
                 }
-                for (int i = 0; i < 100 * 1024; i++, nNonce++)
+                uint256 hash;
+                uint64 nHashCount = 0;
+                int nResult = powEngine.Search(work.vchWorkData, hashTarget, MINER_SEARCH_SLICE, nCancelGeneration, hash, nHashCount);
+                if (nResult == CPowMiningEngine::SEARCH_CANCELLED)
                 {
-                    uint256 hash = crypto::CryptoPowHash(&work.vchWorkData[0], work.vchWorkData.size());
-                    if (hash <= hashTarget)
+                    // work changed, pick it up again
+                    break;
+                }
+                if (nResult == CPowMiningEngine::SEARCH_FOUND)
+                {
+                    cout << "Proof-of-work found\n hash : " << hash.GetHex() << "\ntarget : " << hashTarget.GetHex() << "\n";
+                    if (!SubmitWork(work.vchWorkData))
                     {
-                        cout << "Proof-of-work found\n hash : " << hash.GetHex() << "\ntarget : " << hashTarget.GetHex() << "\n";
-                        if (!SubmitWork(work.vchWorkData))
-                        {
-                            cerr << "Failed to submit work\n";
-                        }
-                        boost::unique_lock<boost::mutex> lock(mutex);
-                        if (nMinerStatus == MINER_RUN)
-                        {
-                            nMinerStatus = MINER_HOLD;
-                        }
-                        break;
+                        cerr << "Failed to submit work\n";
                     }
+                    boost::unique_lock<boost::mutex> lock(mutex);
+                    if (nMinerStatus == MINER_RUN)
+                    {
+                        nMinerStatus = MINER_HOLD;
+                    }
+                    break;
                 }
             }
             condFetcher.notify_all();
@@ -10,6 +10,7 @@
 #include <vector>
 
 #include "base.h"
+#include "powengine.h"
 #include "xengine.h"
 
 namespace bigbang
@@ -91,6 +92,8 @@ protected:
     CMinerWork workCurrent;
     uint64 nNonceGetWork;
     uint64 nNonceSubmitWork;
+    std::size_t nMinerThreads;
+    CPowMiningEngine powEngine;
 };
 
 } // namespace bigbang
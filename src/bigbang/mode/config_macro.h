@@ -16,6 +16,11 @@
 #define DEFAULT_TESTNET_RPCPORT 9904
 #define DEFAULT_RPC_MAX_CONNECTIONS 5
 #define DEFAULT_RPC_CONNECT_TIMEOUT 600 //120
+#define DEFAULT_RPC_THREAD_NUMBER 4
+
+// mint config
+#define DEFAULT_POW_THREAD_NUMBER 1
+#define DEFAULT_POW_CHECK_THREAD_NUMBER 2
 
 // network config
 #define DEFAULT_P2PPORT 9901
@@ -866,13 +866,23 @@ bool CNetChannel::HandleEvent(network::CEventPeerGetData& eventGetData)
                     return true;
                 }
             }
-            if (!fGetRet && pBlockChain->GetBlock(inv.nHash, eventBlock.data))
+            if (fGetRet)
             {
-                fGetRet = true;
+                pPeerNet->DispatchEvent(&eventBlock);
+            }
+            else
+            {
+                // stored blocks are relayed as raw bytes, skip deserializing and reserializing
+                network::CEventPeerRawBlock eventRawBlock(nNonce, hashFork);
+                eventRawBlock.data.hashBlock = inv.nHash;
+                if (pBlockChain->GetRawBlock(inv.nHash, eventRawBlock.data.vchBlock))
+                {
+                    pPeerNet->DispatchEvent(&eventRawBlock);
+                    fGetRet = true;
+                }
             }
             if (fGetRet)
             {
-                pPeerNet->DispatchEvent(&eventBlock);
                 StdTrace("NetChannel", "CEventPeerGetData: get block success, peer: %s, height: %d, block: %s",
                          GetPeerAddressInfo(nNonce).c_str(), CBlock::GetBlockHeightByHash(inv.nHash), inv.nHash.GetHex().c_str());
             }
@@ -882,6 +892,29 @@ bool CNetChannel::HandleEvent(network::CEventPeerGetData& eventGetData)
                 eventGetFail.data.push_back(inv);
             }
         }
+        else if (inv.nType == network::CInv::MSG_CMPCTBLOCK)
+        {
+            CBlock block;
+            try
+            {
+                if (!GetPeerBlock(hashFork, inv.nHash, block))
+                {
+                    StdError("NetChannel", "CEventPeerGetData: Get compact block fail, block hash: %s", inv.nHash.GetHex().c_str());
+                    eventGetFail.data.push_back(inv);
+                    continue;
+                }
+            }
+            catch (exception& e)
+            {
+                DispatchMisbehaveEvent(nNonce, CEndpointManager::DDOS_ATTACK, string("eventGetData: ") + e.what());
+                return true;
+            }
+            network::CEventPeerCmpctBlock eventCmpctBlock(nNonce, hashFork);
+            eventCmpctBlock.data = network::CCmpctBlock(block, crypto::CryptoGetRand64());
+            pPeerNet->DispatchEvent(&eventCmpctBlock);
+            StdTrace("NetChannel", "CEventPeerGetData: get compact block success, peer: %s, height: %d, block: %s",
+                     GetPeerAddressInfo(nNonce).c_str(), CBlock::GetBlockHeightByHash(inv.nHash), inv.nHash.GetHex().c_str());
+        }
         else
         {
             StdError("NetChannel", "CEventPeerGetData: inv.nType error, nType: %s, nHash: %s", inv.nType, inv.nHash.GetHex().c_str());
@@ -1035,6 +1068,11 @@ bool CNetChannel::HandleEvent(network::CEventPeerBlock& eventBlock)
         StdTrace("NetChannel", "CEventPeerBlock: receive block success, peer: %s, height: %d, block hash: %s",
                  GetPeerAddressInfo(nNonce).c_str(), CBlock::GetBlockHeightByHash(hash), hash.GetHex().c_str());
 
+        if (block.IsPrimary() && block.IsProofOfWork())
+        {
+            pCoreProtocol->PrevalidateProofOfWork(block);
+        }
+
         if (Config()->nMagicNum == MAINNET_MAGICNUM)
         {
             if (!block.IsExtended() && !pBlockChain->VerifyCheckPoint(hashFork, (int)nBlockHeight, hash))
@@ -1141,7 +1179,14 @@ bool CNetChannel::HandleEvent(network::CEventPeerGetFail& eventGetFail)
         {
             StdTrace("NetChannel", "CEventPeerGetFail: get data fail, peer: %s, inv: [%d] %s",
                      GetPeerAddressInfo(nNonce).c_str(), inv.nType, inv.nHash.GetHex().c_str());
-            sched.CancelAssignedInv(nNonce, inv);
+            if (inv.nType == network::CInv::MSG_CMPCTBLOCK)
+            {
+                sched.CancelAssignedInv(nNonce, network::CInv(network::CInv::MSG_BLOCK, inv.nHash));
+            }
+            else
+            {
+                sched.CancelAssignedInv(nNonce, inv);
+            }
         }
     }
     catch (exception& e)
@@ -1248,6 +1293,134 @@ bool CNetChannel::HandleEvent(network::CEventPeerMsgRsp& eventMsgRsp)
     return true;
 }
 
+bool CNetChannel::HandleEvent(network::CEventPeerCmpctBlock& eventCmpctBlock)
+{
+    uint64 nNonce = eventCmpctBlock.nNonce;
+    uint256& hashFork = eventCmpctBlock.hashFork;
+    network::CCmpctBlock& cmpctBlock = eventCmpctBlock.data;
+    uint256 hash = cmpctBlock.header.GetHash();
+    CBlock block;
+    try
+    {
+        {
+            boost::recursive_mutex::scoped_lock scoped_lock(mtxSched);
+            if (!GetSchedule(hashFork).CheckAssignedBlock(nNonce, hash))
+            {
+                StdLog("NetChannel", "CEventPeerCmpctBlock: block not assigned, peer: %s, block: %s",
+                       GetPeerAddressInfo(nNonce).c_str(), hash.GetHex().c_str());
+                return true;
+            }
+        }
+        if (!cmpctBlock.header.vtx.empty() || cmpctBlock.vShortTxId.size() > MAX_CMPCTBLOCK_TX_COUNT)
+        {
+            throw std::runtime_error("compact block format error");
+        }
+
+        // the pool is matched without mtxSched, the assignment is checked again when the block is kept
+        vector<uint32> vMissing;
+        if (!RebuildCmpctBlock(hashFork, cmpctBlock, block, vMissing))
+        {
+            StdLog("NetChannel", "CEventPeerCmpctBlock: short txid collision, get full block, peer: %s, block: %s",
+                   GetPeerAddressInfo(nNonce).c_str(), hash.GetHex().c_str());
+            RequestFullBlock(nNonce, hashFork, hash);
+            return true;
+        }
+        if (!vMissing.empty())
+        {
+            StdTrace("NetChannel", "CEventPeerCmpctBlock: get missing tx, peer: %s, tx count: %ld, missing count: %ld, block: %s",
+                     GetPeerAddressInfo(nNonce).c_str(), block.vtx.size(), vMissing.size(), hash.GetHex().c_str());
+            {
+                boost::recursive_mutex::scoped_lock scoped_lock(mtxSched);
+                if (!GetSchedule(hashFork).AddCmpctBlock(nNonce, hash, block, vMissing))
+                {
+                    StdLog("NetChannel", "CEventPeerCmpctBlock: block no longer assigned, peer: %s, block: %s",
+                           GetPeerAddressInfo(nNonce).c_str(), hash.GetHex().c_str());
+                    return true;
+                }
+            }
+            network::CEventPeerGetBlockTxn eventGetBlockTxn(nNonce, hashFork);
+            eventGetBlockTxn.data.hashBlock = hash;
+            eventGetBlockTxn.data.vIndex = vMissing;
+            pPeerNet->DispatchEvent(&eventGetBlockTxn);
+            return true;
+        }
+    }
+    catch (exception& e)
+    {
+        DispatchMisbehaveEvent(nNonce, CEndpointManager::DDOS_ATTACK, string("eventCmpctBlock: ") + e.what());
+        return true;
+    }
+    return AddCmpctBlock(nNonce, hashFork, block);
+}
+
+bool CNetChannel::HandleEvent(network::CEventPeerGetBlockTxn& eventGetBlockTxn)
+{
+    uint64 nNonce = eventGetBlockTxn.nNonce;
+    uint256& hashFork = eventGetBlockTxn.hashFork;
+    const uint256& hash = eventGetBlockTxn.data.hashBlock;
+    CBlock block;
+    try
+    {
+        if (!GetPeerBlock(hashFork, hash, block))
+        {
+            StdError("NetChannel", "CEventPeerGetBlockTxn: Get block fail, block hash: %s", hash.GetHex().c_str());
+            network::CEventPeerGetFail eventGetFail(nNonce, hashFork);
+            eventGetFail.data.push_back(network::CInv(network::CInv::MSG_CMPCTBLOCK, hash));
+            pPeerNet->DispatchEvent(&eventGetFail);
+            return true;
+        }
+    }
+    catch (exception& e)
+    {
+        DispatchMisbehaveEvent(nNonce, CEndpointManager::DDOS_ATTACK, string("eventGetBlockTxn: ") + e.what());
+        return true;
+    }
+
+    network::CEventPeerBlockTxn eventBlockTxn(nNonce, hashFork);
+    eventBlockTxn.data.hashBlock = hash;
+    for (uint32 nIndex : eventGetBlockTxn.data.vIndex)
+    {
+        if (nIndex >= block.vtx.size())
+        {
+            DispatchMisbehaveEvent(nNonce, CEndpointManager::DDOS_ATTACK, "eventGetBlockTxn: tx index error");
+            return true;
+        }
+        eventBlockTxn.data.vtx.push_back(block.vtx[nIndex]);
+    }
+    pPeerNet->DispatchEvent(&eventBlockTxn);
+    return true;
+}
+
+bool CNetChannel::HandleEvent(network::CEventPeerBlockTxn& eventBlockTxn)
+{
+    uint64 nNonce = eventBlockTxn.nNonce;
+    uint256& hashFork = eventBlockTxn.hashFork;
+    const uint256& hash = eventBlockTxn.data.hashBlock;
+    CBlock block;
+    try
+    {
+        boost::recursive_mutex::scoped_lock scoped_lock(mtxSched);
+        CSchedule& sched = GetSchedule(hashFork);
+
+        if (!sched.FillCmpctBlock(nNonce, hash, eventBlockTxn.data.vtx, block))
+        {
+            if (sched.CheckAssignedBlock(nNonce, hash))
+            {
+                StdLog("NetChannel", "CEventPeerBlockTxn: fill compact block fail, get full block, peer: %s, block: %s",
+                       GetPeerAddressInfo(nNonce).c_str(), hash.GetHex().c_str());
+                RequestFullBlock(nNonce, hashFork, hash);
+            }
+            return true;
+        }
+    }
+    catch (exception& e)
+    {
+        DispatchMisbehaveEvent(nNonce, CEndpointManager::DDOS_ATTACK, string("eventBlockTxn: ") + e.what());
+        return true;
+    }
+    return AddCmpctBlock(nNonce, hashFork, block);
+}
+
 CSchedule& CNetChannel::GetSchedule(const uint256& hashFork)
 {
     map<uint256, CSchedule>::iterator it = mapSched.find(hashFork);
@@ -1337,6 +1510,16 @@ void CNetChannel::SchedulePeerInv(uint64 nNonce, const uint256& hashFork, CSched
     network::CEventPeerGetData eventGetData(nNonce, hashFork);
     bool fMissingPrev = false;
     bool fEmpty = true;
+    bool fCmpctBlock = false;
+    {
+        boost::shared_lock<boost::shared_mutex> rlock(rwNetPeer);
+        map<uint64, CNetChannelPeer>::iterator it = mapPeer.find(nNonce);
+        if (it != mapPeer.end())
+        {
+            // new blocks from a synchronized peer are mostly made of txs already in txpool
+            fCmpctBlock = ((it->second.nService & network::NODE_CMPCTBLOCK) && it->second.IsSynchronized(hashFork));
+        }
+    }
     if (sched.ScheduleBlockInv(nNonce, eventGetData.data, 1, fMissingPrev, fEmpty))
     {
         if (fMissingPrev)
@@ -1380,6 +1563,13 @@ void CNetChannel::SchedulePeerInv(uint64 nNonce, const uint256& hashFork, CSched
         else
         {
             sched.SetNextGetBlocksTime(nNonce, 0);
+            if (fCmpctBlock)
+            {
+                for (network::CInv& inv : eventGetData.data)
+                {
+                    inv.nType = network::CInv::MSG_CMPCTBLOCK;
+                }
+            }
         }
         SetPeerSyncStatus(nNonce, hashFork, fEmpty);
     }
@@ -2067,4 +2257,70 @@ void CNetChannel::GetNextRefBlock(const uint256& hashRefBlock, vector<pair<uint2
     }
 }
 
+bool CNetChannel::GetPeerBlock(const uint256& hashFork, const uint256& hashBlock, CBlock& block)
+{
+    if (hashFork == pCoreProtocol->GetGenesisBlockHash())
+    {
+        boost::recursive_mutex::scoped_lock scoped_lock(mtxSched);
+        if (GetSchedule(hashFork).GetCachePowBlock(hashBlock, block))
+        {
+            return true;
+        }
+    }
+    return pBlockChain->GetBlock(hashBlock, block);
+}
+
+bool CNetChannel::RebuildCmpctBlock(const uint256& hashFork, const network::CCmpctBlock& cmpctBlock, CBlock& block, vector<uint32>& vMissing)
+{
+    const uint256 hashSalt = cmpctBlock.GetSalt();
+    map<uint64, uint32> mapIndex;
+    for (uint32 i = 0; i < cmpctBlock.vShortTxId.size(); i++)
+    {
+        if (!mapIndex.insert(make_pair(cmpctBlock.vShortTxId[i], i)).second)
+        {
+            return false;
+        }
+    }
+
+    block = cmpctBlock.header;
+    block.vtx.resize(cmpctBlock.vShortTxId.size());
+    vector<bool> vFilled(block.vtx.size(), false);
+    if (!pTxPool->FetchCmpctTx(hashFork, hashSalt, mapIndex, block.vtx, vFilled))
+    {
+        return false;
+    }
+
+    vMissing.clear();
+    for (uint32 i = 0; i < vFilled.size(); i++)
+    {
+        if (!vFilled[i])
+        {
+            vMissing.push_back(i);
+        }
+    }
+    return true;
+}
+
+void CNetChannel::RequestFullBlock(uint64 nNonce, const uint256& hashFork, const uint256& hashBlock)
+{
+    network::CEventPeerGetData eventGetData(nNonce, hashFork);
+    eventGetData.data.push_back(network::CInv(network::CInv::MSG_BLOCK, hashBlock));
+    pPeerNet->DispatchEvent(&eventGetData);
+}
+
+bool CNetChannel::AddCmpctBlock(uint64 nNonce, const uint256& hashFork, CBlock& block)
+{
+    if (block.CalcMerkleTreeRoot() != block.hashMerkle)
+    {
+        // a pool tx matched the short txid of a different block tx
+        StdLog("NetChannel", "AddCmpctBlock: merkle root mismatch, get full block, peer: %s, block: %s",
+               GetPeerAddressInfo(nNonce).c_str(), block.GetHash().GetHex().c_str());
+        RequestFullBlock(nNonce, hashFork, block.GetHash());
+        return true;
+    }
+    network::CEventPeerBlock eventBlock(nNonce, hashFork);
+    eventBlock.data = std::move(block);
+    return HandleEvent(eventBlock);
+}
+
 } // namespace bigbang
@@ -268,6 +268,10 @@ protected:
         MAX_PEER_SCHED_COUNT = 8
     };
     enum
+    {
+        MAX_CMPCTBLOCK_TX_COUNT = MAX_BLOCK_SIZE / 64
+    };
+    enum
     {
         MSGRSP_SUBTYPE_NON = 0,
         MSGRSP_SUBTYPE_TXINV = 1
@@ -297,6 +301,9 @@ protected:
     bool HandleEvent(network::CEventPeerBlock& eventBlock) override;
     bool HandleEvent(network::CEventPeerGetFail& eventGetFail) override;
     bool HandleEvent(network::CEventPeerMsgRsp& eventMsgRsp) override;
+    bool HandleEvent(network::CEventPeerCmpctBlock& eventCmpctBlock) override;
+    bool HandleEvent(network::CEventPeerGetBlockTxn& eventGetBlockTxn) override;
+    bool HandleEvent(network::CEventPeerBlockTxn& eventBlockTxn) override;
 
     CSchedule& GetSchedule(const uint256& hashFork);
     void NotifyPeerUpdate(uint64 nNonce, bool fActive, const network::CAddress& addrPeer);
@@ -321,6 +328,10 @@ protected:
     void InnerBroadcastBlockInv(const uint256& hashFork, const uint256& hashBlock);
     void InnerSubmitCachePowBlock();
     void GetNextRefBlock(const uint256& hashRefBlock, std::vector<std::pair<uint256, uint256>>& vNext);
+    bool GetPeerBlock(const uint256& hashFork, const uint256& hashBlock, CBlock& block);
+    bool RebuildCmpctBlock(const uint256& hashFork, const network::CCmpctBlock& cmpctBlock, CBlock& block, std::vector<uint32>& vMissing);
+    void RequestFullBlock(uint64 nNonce, const uint256& hashFork, const uint256& hashBlock);
+    bool AddCmpctBlock(uint64 nNonce, const uint256& hashFork, CBlock& block);
 
     const CBasicConfig* Config()
     {
@@ -0,0 +1,251 @@
+// Copyright (c) 2019-2020 The Bigbang developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "powengine.h"
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "crypto.h"
+
+using namespace std;
+using namespace xengine;
+
+namespace bigbang
+{
+
+// Cores the process may run on, honoring taskset and cgroup cpusets
+static vector<int> GetAllowedCores()
+{
+    vector<int> vCore;
+#if defined(__linux__)
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    if (sched_getaffinity(0, sizeof(cpu_set_t), &cpuset) == 0)
+    {
+        for (int i = 0; i < CPU_SETSIZE; i++)
+        {
+            if (CPU_ISSET(i, &cpuset))
+            {
+                vCore.push_back(i);
+            }
+        }
+    }
+#endif
+    return vCore;
+}
+
+static void PinThreadToCore(int nCore)
+{
+#if defined(__linux__)
+    if (nCore >= 0)
+    {
+        cpu_set_t cpuset;
+        CPU_ZERO(&cpuset);
+        CPU_SET(nCore, &cpuset);
+        pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuset);
+    }
+#else
+    (void)nCore;
+#endif
+}
+
+//////////////////////////////
+// CPowMiningEngine
+
+CPowMiningEngine::CPowMiningEngine()
+  : fExit(false), nJobId(0), nRunningJobId(0), nThreadRunning(0),
+    fFound(false), nCancelGeneration(0), nFoundNonce(0), nJobHashCount(0), nJobMaxStep(0)
+{
+}
+
+CPowMiningEngine::~CPowMiningEngine()
+{
+    Stop();
+}
+
+bool CPowMiningEngine::Start(size_t nThreadCount)
+{
+    Stop();
+
+    vector<int> vCore = GetAllowedCores();
+    if (nThreadCount == 0)
+    {
+        nThreadCount = (vCore.empty() ? max(1u, thread::hardware_concurrency()) : vCore.size());
+    }
+    nThreadCount = min(nThreadCount, (size_t)(1 << (64 - NONCE_RANGE_BITS - 24)));
+
+    {
+        boost::unique_lock<boost::mutex> lock(mtxJob);
+        fExit = false;
+    }
+    try
+    {
+        for (size_t i = 0; i < nThreadCount; i++)
+        {
+            int nCore = (vCore.empty() ? -1 : vCore[i % vCore.size()]);
+            vThread.push_back(thread(&CPowMiningEngine::HashThreadFunc, this, i, nCore));
+        }
+    }
+    catch (exception& e)
+    {
+        StdError("PowEngine", "Start: create hash thread fail: %s", e.what());
+        Stop();
+        return false;
+    }
+    return true;
+}
+
+void CPowMiningEngine::Stop()
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mtxJob);
+        fExit = true;
+        nRunningJobId = 0;
+    }
+    condJob.notify_all();
+    condDone.notify_all();
+
+    for (thread& t : vThread)
+    {
+        if (t.joinable())
+        {
+            t.join();
+        }
+    }
+    vThread.clear();
+}
+
+uint64 CPowMiningEngine::GetCancelGeneration()
+{
+    boost::unique_lock<boost::mutex> lock(mtxJob);
+    return nCancelGeneration;
+}
+
+int CPowMiningEngine::Search(vector<unsigned char>& vchWorkData, const uint256& hashTarget, int64 nTimeout,
+                             uint64 nSearchGeneration, uint256& hashFound, uint64& nHashCount)
+{
+    nHashCount = 0;
+    uint64& nNonce = *((uint64*)&vchWorkData[vchWorkData.size() - sizeof(uint64)]);
+
+    boost::unique_lock<boost::mutex> lock(mtxJob);
+    if (fExit || vThread.empty() || nCancelGeneration != nSearchGeneration)
+    {
+        return SEARCH_CANCELLED;
+    }
+
+    vchJobData = vchWorkData;
+    hashJobTarget = hashTarget;
+    fFound = false;
+    nJobHashCount = 0;
+    nJobMaxStep = 0;
+    nThreadRunning = vThread.size();
+    nRunningJobId = ++nJobId;
+    condJob.notify_all();
+
+    boost::system_time const timeout = boost::get_system_time() + boost::posix_time::milliseconds(nTimeout);
+    while (!fFound && nCancelGeneration == nSearchGeneration && !fExit && nThreadRunning > 0)
+    {
+        if (!condDone.timed_wait(lock, timeout))
+        {
+            break;
+        }
+    }
+
+    // stop the job and wait for every thread to account its hashes
+    nRunningJobId = 0;
+    while (nThreadRunning > 0 && !fExit)
+    {
+        condDone.wait(lock);
+    }
+
+    nHashCount = nJobHashCount;
+    if (fFound)
+    {
+        nNonce = nFoundNonce;
+        hashFound = hashJobFound;
+        return SEARCH_FOUND;
+    }
+    nNonce += nJobMaxStep;
+    return ((nCancelGeneration != nSearchGeneration || fExit) ? SEARCH_CANCELLED : SEARCH_TIMEOUT);
+}
+
+void CPowMiningEngine::Cancel()
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mtxJob);
+        ++nCancelGeneration;
+        nRunningJobId = 0;
+    }
+    condDone.notify_all();
+}
+
+void CPowMiningEngine::HashThreadFunc(size_t nIndex, int nCore)
+{
+    SetThreadName(("powhash" + to_string(nIndex)).c_str());
+    PinThreadToCore(nCore);
+
+    // the cryptonight scratchpad is thread local, take it from huge pages up front
+    crypto::CryptoPowHashAllocState();
+
+    uint64 nLastJobId = 0;
+    while (true)
+    {
+        vector<unsigned char> vchData;
+        uint256 hashTarget;
+        uint64 nJob;
+        {
+            boost::unique_lock<boost::mutex> lock(mtxJob);
+            while (!fExit && nJobId == nLastJobId)
+            {
+                condJob.wait(lock);
+            }
+            if (fExit)
+            {
+                break;
+            }
+            nJob = nLastJobId = nJobId;
+            vchData = vchJobData;
+            hashTarget = hashJobTarget;
+        }
+
+        uint64& nNonce = *((uint64*)&vchData[vchData.size() - sizeof(uint64)]);
+        const uint64 nBase = nNonce + ((uint64)nIndex << NONCE_RANGE_BITS);
+        uint64 nStep = 0;
+        bool fHit = false;
+        uint256 hash;
+        while (nRunningJobId == nJob)
+        {
+            nNonce = nBase + nStep;
+            hash = crypto::CryptoPowHash(&vchData[0], vchData.size());
+            nStep++;
+            if (hash <= hashTarget)
+            {
+                fHit = true;
+                break;
+            }
+        }
+
+        {
+            boost::unique_lock<boost::mutex> lock(mtxJob);
+            nJobHashCount += nStep;
+            nJobMaxStep = max(nJobMaxStep, nStep);
+            if (fHit && !fFound && nJobId == nJob)
+            {
+                fFound = true;
+                nFoundNonce = nNonce;
+                hashJobFound = hash;
+                nRunningJobId = 0;
+            }
+            --nThreadRunning;
+        }
+        condDone.notify_all();
+    }
+
+    crypto::CryptoPowHashFreeState();
+}
+
+} // namespace bigbang
@@ -0,0 +1,78 @@
+// Copyright (c) 2019-2020 The Bigbang developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BIGBANG_POWENGINE_H
+#define BIGBANG_POWENGINE_H
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "uint256.h"
+#include "xengine.h"
+
+namespace bigbang
+{
+
+// Proof-of-work nonce search on a pool of hashing threads.
+// Thread i walks nonces nBase + (i << NONCE_RANGE_BITS) + k, where nBase is the nonce
+// found in the work data, so the threads never overlap inside one search.
+// Every thread is pinned to a core of the process affinity set and owns its cryptonight scratchpad.
+// Cancel() bumps the cancel generation. A search started with an older generation returns
+// SEARCH_CANCELLED, so a cancel issued before the caller reaches Search() is never lost.
+class CPowMiningEngine
+{
+public:
+    enum
+    {
+        NONCE_RANGE_BITS = 32
+    };
+    enum
+    {
+        SEARCH_FOUND = 0,
+        SEARCH_TIMEOUT = 1,
+        SEARCH_CANCELLED = 2
+    };
+
+    CPowMiningEngine();
+    ~CPowMiningEngine();
+    bool Start(std::size_t nThreadCount = 1);
+    void Stop();
+    std::size_t GetThreadCount() const
+    {
+        return vThread.size();
+    }
+    // Take the generation before reading the state that Cancel() callers update
+    uint64 GetCancelGeneration();
+    // Search at most nTimeout milliseconds. On SEARCH_FOUND the work data holds the
+    // winning nonce, otherwise it holds the base nonce to continue from.
+    int Search(std::vector<unsigned char>& vchWorkData, const uint256& hashTarget, int64 nTimeout,
+               uint64 nCancelGeneration, uint256& hashFound, uint64& nHashCount);
+    void Cancel();
+
+protected:
+    void HashThreadFunc(std::size_t nIndex, int nCore);
+
+protected:
+    boost::mutex mtxJob;
+    boost::condition_variable condJob;
+    boost::condition_variable condDone;
+    std::vector<std::thread> vThread;
+    bool fExit;
+    uint64 nJobId;
+    std::atomic<uint64> nRunningJobId;
+    std::vector<unsigned char> vchJobData;
+    uint256 hashJobTarget;
+    std::size_t nThreadRunning;
+    bool fFound;
+    uint64 nCancelGeneration;
+    uint64 nFoundNonce;
+    uint256 hashJobFound;
+    uint64 nJobHashCount;
+    uint64 nJobMaxStep;
+};
+
+} // namespace bigbang
+
+#endif //BIGBANG_POWENGINE_H
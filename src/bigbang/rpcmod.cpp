@@ -160,6 +160,16 @@ static CUnspentData UnspentToJSON(const CTxUnspent& unspent)
     return data;
 }
 
+static string MaskSensitiveData(const string& data)
+{
+    //remove all sensible information such as private key
+    // or passphrass from log content
+
+    //log for debug mode
+    boost::regex ptnSec(R"raw(("privkey"|"passphrase"|"oldpassphrase")(\s*:\s*)(".*?"))raw", boost::regex::perl);
+    return boost::regex_replace(data, ptnSec, string(R"raw($1$2"***")raw"));
+}
+
 namespace bigbang
 {
 
@@ -167,7 +177,10 @@ namespace bigbang
 // CRPCMod
 
 CRPCMod::CRPCMod()
-  : IIOModule("rpcmod")
+  : IIOModule("rpcmod"),
+    thrSerial("rpcserial", boost::bind(&CRPCMod::SerialThreadFunc, this)),
+    fResyncThread(false),
+    thrResync("rpcresync", boost::bind(&CRPCMod::ResyncThreadFunc, this))
 {
     pHttpServer = nullptr;
     pCoreProtocol = nullptr;
@@ -247,6 +260,10 @@ CRPCMod::CRPCMod()
         //
         ("resyncwallet", &CRPCMod::RPCResyncWallet)
         //
+        ("getresyncstatus", &CRPCMod::RPCGetResyncStatus)
+        //
+        ("cancelresync", &CRPCMod::RPCCancelResync)
+        //
         ("getbalance", &CRPCMod::RPCGetBalance)
         //
         ("listtransaction", &CRPCMod::RPCListTransaction)
@@ -293,6 +310,23 @@ CRPCMod::CRPCMod()
         /* tool */
         ("querystat", &CRPCMod::RPCQueryStat);
     mapRPCFunc = temp_map;
+
+    // methods changing wallet, network or chain state run one by one in arrival order,
+    // others are served by the worker pool concurrently. stop is run as it is dispatched,
+    // it must not wait behind a long serial method. A full resyncwallet only starts the
+    // rescan on its own thread, so it never holds the serial queue
+    setSerialRPC = boost::assign::list_of
+        /* Network */
+        ("addnode")("removenode")
+        /* Blockchain & TxPool */
+        ("sendtransaction")
+        /* Wallet */
+        ("getnewkey")("encryptkey")("lockkey")("unlockkey")("importprivkey")("importpubkey")
+        ("importkey")("addnewtemplate")("importtemplate")("resyncwallet")("sendfrom")
+        ("createtransaction")("signtransaction")("importwallet")("makeorigin")
+        ("signrawtransactionwithwallet")("sendrawtransaction")
+        /* Mint */
+        ("getwork")("submitwork");
     fWriteRPCLog = true;
 }
 
@@ -344,17 +378,53 @@ void CRPCMod::HandleDeinitialize()
     pForkManager = nullptr;
 }
 
-bool CRPCMod::HandleEvent(CEventHttpReq& eventHttpReq)
+bool CRPCMod::HandleInvoke()
 {
-    auto lmdMask = [](const string& data) -> string {
-        //remove all sensible information such as private key
-        // or passphrass from log content
+    queSerial.Reset();
+    queWorker.Reset();
+    mapMethodStat.clear();
 
-        //log for debug mode
-        boost::regex ptnSec(R"raw(("privkey"|"passphrase"|"oldpassphrase")(\s*:\s*)(".*?"))raw", boost::regex::perl);
-        return boost::regex_replace(data, ptnSec, string(R"raw($1$2"***")raw"));
-    };
+    unsigned int nThreadNumber = RPCServerConfig()->nRPCThreadNumber;
+    if (nThreadNumber > 0)
+    {
+        if (!ThreadStart(thrSerial))
+        {
+            return false;
+        }
+        for (unsigned int i = 0; i < nThreadNumber; i++)
+        {
+            vThrWorker.push_back(unique_ptr<CThread>(new CThread("rpcworker" + to_string(i),
+                                                                 boost::bind(&CRPCMod::WorkerThreadFunc, this))));
+            if (!ThreadStart(*vThrWorker.back()))
+            {
+                return false;
+            }
+        }
+    }
+    return IIOModule::HandleInvoke();
+}
+
+void CRPCMod::HandleHalt()
+{
+    IIOModule::HandleHalt();
+
+    queSerial.Interrupt();
+    queWorker.Interrupt();
+
+    ThreadExit(thrSerial);
+    for (auto& spThread : vThrWorker)
+    {
+        ThreadExit(*spThread);
+    }
+    vThrWorker.clear();
 
+    // no resync is started any more, a running one would keep its thread busy until it finished
+    pService->CancelWalletResync();
+    ThreadExit(thrResync);
+}
+
+bool CRPCMod::HandleEvent(CEventHttpReq& eventHttpReq)
+{
     uint64 nNonce = eventHttpReq.nNonce;
 
     string strResult;
@@ -374,61 +444,16 @@ bool CRPCMod::HandleEvent(CEventHttpReq& eventHttpReq)
 
         bool fArray;
         CRPCReqVec vecReq = DeserializeCRPCReq(eventHttpReq.data.strContent, fArray);
-        CRPCRespVec vecResp;
-        for (auto& spReq : vecReq)
+        CRPCJobPtr spJob(new CRPCJob(nNonce, fArray, vecReq));
+        if (vecReq.empty())
         {
-            CRPCErrorPtr spError;
-            CRPCResultPtr spResult;
-            try
-            {
-                map<string, RPCFunc>::iterator it = mapRPCFunc.find(spReq->strMethod);
-                if (it == mapRPCFunc.end())
-                {
-                    throw CRPCException(RPC_METHOD_NOT_FOUND, "Method not found");
-                }
-
-                if (fWriteRPCLog)
-                {
-                    Debug("request : %s ", lmdMask(spReq->Serialize()).c_str());
-                }
-
-                spResult = (this->*(*it).second)(spReq->spParam);
-            }
-            catch (CRPCException& e)
-            {
-                spError = CRPCErrorPtr(new CRPCError(e));
-            }
-            catch (exception& e)
-            {
-                spError = CRPCErrorPtr(new CRPCError(RPC_MISC_ERROR, e.what()));
-            }
-
-            if (spError)
-            {
-                vecResp.push_back(MakeCRPCRespPtr(spReq->valID, spError));
-            }
-            else if (spResult)
-            {
-                vecResp.push_back(MakeCRPCRespPtr(spReq->valID, spResult));
-            }
-            else
-            {
-                // no result means no return
-            }
+            ReplyJob(spJob);
         }
-
-        if (fArray)
+        for (size_t i = 0; i < vecReq.size(); i++)
         {
-            strResult = SerializeCRPCResp(vecResp);
-        }
-        else if (vecResp.size() > 0)
-        {
-            strResult = vecResp[0]->Serialize();
-        }
-        else
-        {
-            // no result means no return
+            PostTask(spJob, i);
         }
+        return true;
     }
     catch (CRPCException& e)
     {
@@ -446,14 +471,10 @@ bool CRPCMod::HandleEvent(CEventHttpReq& eventHttpReq)
 
     if (fWriteRPCLog)
     {
-        Debug("response : %s ", lmdMask(strResult).c_str());
+        Debug("response : %s ", MaskSensitiveData(strResult).c_str());
     }
 
-    // no result means no return
-    if (!strResult.empty())
-    {
-        JsonReply(nNonce, strResult);
-    }
+    JsonReply(nNonce, strResult);
 
     return true;
 }
@@ -476,6 +497,181 @@ void CRPCMod::JsonReply(uint64 nNonce, const std::string& result)
     pHttpServer->DispatchEvent(&eventHttpRsp);
 }
 
+int CRPCMod::GetExecMode(const string& strMethod) const
+{
+    if (strMethod == "stop")
+    {
+        return RPC_EXEC_DISPATCHER;
+    }
+    return (setSerialRPC.count(strMethod) ? RPC_EXEC_SERIAL : RPC_EXEC_WORKER);
+}
+
+void CRPCMod::PostTask(const CRPCJobPtr& spJob, size_t nIndex)
+{
+    CRPCTask task(spJob, nIndex);
+    int nMode = GetExecMode(spJob->vecReq[nIndex]->strMethod);
+    if (vThrWorker.empty() || nMode == RPC_EXEC_DISPATCHER)
+    {
+        ExecuteTask(task);
+    }
+    else if (nMode == RPC_EXEC_SERIAL)
+    {
+        queSerial.AddNew(task);
+    }
+    else
+    {
+        queWorker.AddNew(task);
+    }
+}
+
+void CRPCMod::ExecuteTask(const CRPCTask& task)
+{
+    const CRPCJobPtr& spJob = task.spJob;
+    const CRPCReqPtr& spReq = spJob->vecReq[task.nIndex];
+    int64 nStartTime = GetTimeMillis();
+    bool fFound = false;
+
+    CRPCErrorPtr spError;
+    CRPCResultPtr spResult;
+    try
+    {
+        map<string, RPCFunc>::iterator it = mapRPCFunc.find(spReq->strMethod);
+        if (it == mapRPCFunc.end())
+        {
+            throw CRPCException(RPC_METHOD_NOT_FOUND, "Method not found");
+        }
+        fFound = true;
+
+        if (fWriteRPCLog)
+        {
+            Debug("request : %s ", MaskSensitiveData(spReq->Serialize()).c_str());
+        }
+
+        spResult = (this->*(*it).second)(spReq->spParam);
+    }
+    catch (CRPCException& e)
+    {
+        spError = CRPCErrorPtr(new CRPCError(e));
+    }
+    catch (exception& e)
+    {
+        spError = CRPCErrorPtr(new CRPCError(RPC_MISC_ERROR, e.what()));
+    }
+
+    if (spError)
+    {
+        spJob->vecResp[task.nIndex] = MakeCRPCRespPtr(spReq->valID, spError);
+    }
+    else if (spResult)
+    {
+        spJob->vecResp[task.nIndex] = MakeCRPCRespPtr(spReq->valID, spResult);
+    }
+    else
+    {
+        // no result means no return
+    }
+
+    if (fFound)
+    {
+        int64 nQueue = nStartTime - task.nQueueTime;
+        int64 nExec = GetTimeMillis() - nStartTime;
+        {
+            boost::unique_lock<boost::mutex> lock(mtxStat);
+            mapMethodStat[spReq->strMethod].AddCall(nQueue, nExec);
+        }
+        if (fWriteRPCLog)
+        {
+            Debug("method %s : queue %ld ms, execute %ld ms", spReq->strMethod.c_str(), nQueue, nExec);
+        }
+    }
+
+    if (--spJob->nPending == 0)
+    {
+        ReplyJob(spJob);
+    }
+}
+
+void CRPCMod::ReplyJob(const CRPCJobPtr& spJob)
+{
+    string strResult;
+    try
+    {
+        CRPCRespVec vecResp;
+        for (const CRPCRespPtr& spResp : spJob->vecResp)
+        {
+            if (spResp)
+            {
+                vecResp.push_back(spResp);
+            }
+        }
+
+        if (spJob->fArray)
+        {
+            strResult = SerializeCRPCResp(vecResp);
+        }
+        else if (vecResp.size() > 0)
+        {
+            strResult = vecResp[0]->Serialize();
+        }
+        else
+        {
+            // no result means no return
+        }
+    }
+    catch (exception& e)
+    {
+        auto spError = MakeCRPCErrorPtr(RPC_MISC_ERROR, e.what());
+        CRPCResp resp(Value(), spError);
+        strResult = resp.Serialize();
+    }
+
+    if (fWriteRPCLog)
+    {
+        Debug("response : %s ", MaskSensitiveData(strResult).c_str());
+    }
+
+    // no result means no return
+    if (!strResult.empty())
+    {
+        JsonReply(spJob->nNonce, strResult);
+    }
+}
+
+void CRPCMod::SerialThreadFunc()
+{
+    CRPCTask task(nullptr, 0);
+    while (queSerial.Fetch(task))
+    {
+        ExecuteTask(task);
+    }
+}
+
+void CRPCMod::WorkerThreadFunc()
+{
+    CRPCTask task(nullptr, 0);
+    while (queWorker.Fetch(task))
+    {
+        ExecuteTask(task);
+    }
+}
+
+void CRPCMod::ResyncThreadFunc()
+{
+    try
+    {
+        if (!pService->ResynchronizeWalletTx())
+        {
+            Error("Failed to resync wallet tx");
+        }
+    }
+    catch (exception& e)
+    {
+        Error("Failed to resync wallet tx : %s", e.what());
+    }
+    boost::unique_lock<boost::mutex> lock(mtxResync);
+    fResyncThread = false;
+}
+
 bool CRPCMod::CheckWalletError(Errno err)
 {
     switch (err)
@@ -632,6 +828,28 @@ CRPCResultPtr CRPCMod::RPCListPeer(CRPCParamPtr param)
                     peer.strServices = peer.strServices + ",NODE_DELEGATED";
                 }
             }
+            if (info.nService & network::NODE_CMPCTBLOCK)
+            {
+                if (peer.strServices.empty())
+                {
+                    peer.strServices = "NODE_CMPCTBLOCK";
+                }
+                else
+                {
+                    peer.strServices = peer.strServices + ",NODE_CMPCTBLOCK";
+                }
+            }
+            if (info.nService & network::NODE_SNAPPY)
+            {
+                if (peer.strServices.empty())
+                {
+                    peer.strServices = "NODE_SNAPPY";
+                }
+                else
+                {
+                    peer.strServices = peer.strServices + ",NODE_SNAPPY";
+                }
+            }
             if (peer.strServices.empty())
             {
                 peer.strServices = string("OTHER:") + to_string(info.nService);
@@ -646,6 +864,8 @@ CRPCResultPtr CRPCMod::RPCListPeer(CRPCParamPtr param)
         peer.fInbound = info.fInBound;
         peer.nHeight = info.nStartingHeight;
         peer.nBanscore = info.nScore;
+        peer.nCompresssaved = info.nCompressSaved;
+        peer.nCompresstime = info.nCompressTime;
         spResult->vecPeer.push_back(peer);
     }
 
@@ -1500,14 +1720,52 @@ CRPCResultPtr CRPCMod::RPCResyncWallet(CRPCParamPtr param)
     }
     else
     {
-        if (!pService->ResynchronizeWalletTx())
+        // the full rescan can take hours, it runs on its own thread and is followed by getresyncstatus
+        boost::unique_lock<boost::mutex> lock(mtxResync);
+        if (fResyncThread)
+        {
+            throw CRPCException(RPC_WALLET_ERROR, "Resync is running");
+        }
+        ThreadExit(thrResync);
+        fResyncThread = true;
+        if (!ThreadStart(thrResync))
         {
+            fResyncThread = false;
             throw CRPCException(RPC_WALLET_ERROR, "Failed to resync wallet tx");
         }
+        return MakeCResyncWalletResultPtr("Resync wallet started.");
     }
     return MakeCResyncWalletResultPtr("Resync wallet successfully.");
 }
 
+CRPCResultPtr CRPCMod::RPCGetResyncStatus(CRPCParamPtr param)
+{
+    uint256 hashFork;
+    int nHeight = 0;
+    int nLastHeight = 0;
+    size_t nTxCount = 0;
+    bool fIncomplete = false;
+    bool fRunning = pService->GetWalletResyncProgress(hashFork, nHeight, nLastHeight, nTxCount, fIncomplete);
+
+    auto spResult = MakeCGetResyncStatusResultPtr();
+    spResult->fRunning = fRunning;
+    spResult->strFork = hashFork.GetHex();
+    spResult->nHeight = nHeight;
+    spResult->nLastheight = nLastHeight;
+    spResult->nFound = nTxCount;
+    spResult->fIncomplete = fIncomplete;
+    return spResult;
+}
+
+CRPCResultPtr CRPCMod::RPCCancelResync(CRPCParamPtr param)
+{
+    if (!pService->CancelWalletResync())
+    {
+        throw CRPCException(RPC_WALLET_ERROR, "No running resync");
+    }
+    return MakeCCancelResyncResultPtr("Resync wallet canceled.");
+}
+
 CRPCResultPtr CRPCMod::RPCGetBalance(CRPCParamPtr param)
 {
     auto spParam = CastParamPtr<CGetBalanceParam>(param);
@@ -2741,7 +2999,8 @@ CRPCResultPtr CRPCMod::RPCQueryStat(rpc::CRPCParamPtr param)
     {
         TYPE_NON,
         TYPE_MAKER,
-        TYPE_P2PSYN
+        TYPE_P2PSYN,
+        TYPE_RPC
     } eType
         = TYPE_NON;
     uint32 nDefQueryCount = 20;
@@ -2763,6 +3022,10 @@ CRPCResultPtr CRPCMod::RPCQueryStat(rpc::CRPCParamPtr param)
     {
         eType = TYPE_P2PSYN;
     }
+    else if (spParam->strType == "rpc")
+    {
+        eType = TYPE_RPC;
+    }
     else
     {
         throw CRPCException(RPC_INVALID_PARAMETER, "Invalid type");
@@ -2983,6 +3246,44 @@ CRPCResultPtr CRPCMod::RPCQueryStat(rpc::CRPCParamPtr param)
         }
         return MakeCQueryStatResultPtr(strResult);
     }
+    case TYPE_RPC:
+    {
+        std::map<std::string, CRPCMethodStat> mapStat;
+        {
+            boost::unique_lock<boost::mutex> lock(mtxStat);
+            mapStat = mapMethodStat;
+        }
+
+        int nMethodWidth = string("method").size() + 2; //+ two spaces
+        int nCallsWidth = string("calls").size() + 2;
+        int nAvgQueueWidth = string("avgqueue(ms)").size() + 2;
+        int nMaxQueueWidth = string("maxqueue(ms)").size() + 2;
+        int nAvgExecWidth = string("avgexec(ms)").size() + 2;
+        for (const auto& stat : mapStat)
+        {
+            nMethodWidth = std::max(nMethodWidth, int(stat.first.size() + 2));
+            nCallsWidth = std::max(nCallsWidth, int(to_string(stat.second.nCallCount).size() + 2));
+        }
+
+        string strResult;
+        strResult += GetWidthString("method", nMethodWidth);
+        strResult += GetWidthString("calls", nCallsWidth);
+        strResult += GetWidthString("avgqueue(ms)", nAvgQueueWidth);
+        strResult += GetWidthString("maxqueue(ms)", nMaxQueueWidth);
+        strResult += GetWidthString("avgexec(ms)", nAvgExecWidth);
+        strResult += string("\r\n");
+        for (const auto& stat : mapStat)
+        {
+            const CRPCMethodStat& item = stat.second;
+            strResult += GetWidthString(stat.first, nMethodWidth);
+            strResult += GetWidthString(to_string(item.nCallCount), nCallsWidth);
+            strResult += GetWidthString(uint64(item.nQueueTime * 100 / item.nCallCount), nAvgQueueWidth);
+            strResult += GetWidthString(to_string(item.nMaxQueueTime), nMaxQueueWidth);
+            strResult += GetWidthString(uint64(item.nExecTime * 100 / item.nCallCount), nAvgExecWidth);
+            strResult += string("\r\n");
+        }
+        return MakeCQueryStatResultPtr(strResult);
+    }
     default:
         break;
     }
@@ -6,7 +6,12 @@
 #define BIGBANG_RPCMOD_H
 
 #include "json/json_spirit.h"
+#include <atomic>
 #include <boost/function.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <memory>
+#include <queue>
 
 #include "base.h"
 #include "rpc/rpc.h"
@@ -15,18 +20,130 @@
 namespace bigbang
 {
 
+class CRPCJob
+{
+public:
+    CRPCJob(uint64 nNonceIn, bool fArrayIn, const rpc::CRPCReqVec& vecReqIn)
+      : nNonce(nNonceIn), fArray(fArrayIn), vecReq(vecReqIn), vecResp(vecReqIn.size()), nPending(vecReqIn.size())
+    {
+    }
+
+public:
+    uint64 nNonce;
+    bool fArray;
+    rpc::CRPCReqVec vecReq;
+    rpc::CRPCRespVec vecResp;
+    std::atomic<std::size_t> nPending;
+};
+typedef std::shared_ptr<CRPCJob> CRPCJobPtr;
+
+class CRPCTask
+{
+public:
+    CRPCTask(const CRPCJobPtr& spJobIn, std::size_t nIndexIn)
+      : spJob(spJobIn), nIndex(nIndexIn), nQueueTime(xengine::GetTimeMillis())
+    {
+    }
+
+public:
+    CRPCJobPtr spJob;
+    std::size_t nIndex;
+    int64 nQueueTime;
+};
+
+class CRPCTaskQueue
+{
+public:
+    CRPCTaskQueue()
+      : fAbort(false) {}
+    void AddNew(const CRPCTask& task)
+    {
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            que.push(task);
+        }
+        cond.notify_one();
+    }
+    bool Fetch(CRPCTask& task)
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        while (!fAbort && que.empty())
+        {
+            cond.wait(lock);
+        }
+        if (fAbort)
+        {
+            return false;
+        }
+        task = que.front();
+        que.pop();
+        return true;
+    }
+    void Reset()
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        que = std::queue<CRPCTask>();
+        fAbort = false;
+    }
+    void Interrupt()
+    {
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            que = std::queue<CRPCTask>();
+            fAbort = true;
+        }
+        cond.notify_all();
+    }
+
+protected:
+    boost::condition_variable cond;
+    boost::mutex mutex;
+    std::queue<CRPCTask> que;
+    bool fAbort;
+};
+
+class CRPCMethodStat
+{
+public:
+    CRPCMethodStat()
+      : nCallCount(0), nQueueTime(0), nMaxQueueTime(0), nExecTime(0) {}
+    void AddCall(int64 nQueue, int64 nExec)
+    {
+        nCallCount++;
+        nQueueTime += nQueue;
+        nMaxQueueTime = std::max(nMaxQueueTime, nQueue);
+        nExecTime += nExec;
+    }
+
+public:
+    uint64 nCallCount;
+    int64 nQueueTime;
+    int64 nMaxQueueTime;
+    int64 nExecTime;
+};
+
 class CRPCMod : public xengine::IIOModule, virtual public xengine::CHttpEventListener
 {
 public:
     typedef rpc::CRPCResultPtr (CRPCMod::*RPCFunc)(rpc::CRPCParamPtr param);
+    enum
+    {
+        RPC_EXEC_WORKER,
+        RPC_EXEC_SERIAL,
+        RPC_EXEC_DISPATCHER
+    };
     CRPCMod();
     ~CRPCMod();
     bool HandleEvent(xengine::CEventHttpReq& eventHttpReq) override;
     bool HandleEvent(xengine::CEventHttpBroken& eventHttpBroken) override;
+    // Where a method runs: the worker pool, the serial thread in arrival order or the dispatching thread
+    int GetExecMode(const std::string& strMethod) const;
 
 protected:
     bool HandleInitialize() override;
     void HandleDeinitialize() override;
+    bool HandleInvoke() override;
+    void HandleHalt() override;
     const CNetworkConfig* Config()
     {
         return dynamic_cast<const CNetworkConfig*>(xengine::IBase::Config());
@@ -37,6 +154,12 @@ protected:
     }
 
     void JsonReply(uint64 nNonce, const std::string& result);
+    void PostTask(const CRPCJobPtr& spJob, std::size_t nIndex);
+    void ExecuteTask(const CRPCTask& task);
+    void ReplyJob(const CRPCJobPtr& spJob);
+    void SerialThreadFunc();
+    void WorkerThreadFunc();
+    void ResyncThreadFunc();
 
     int GetInt(const rpc::CRPCInt64& i, int valDefault)
     {
@@ -109,6 +232,8 @@ private:
     rpc::CRPCResultPtr RPCExportTemplate(rpc::CRPCParamPtr param);
     rpc::CRPCResultPtr RPCValidateAddress(rpc::CRPCParamPtr param);
     rpc::CRPCResultPtr RPCResyncWallet(rpc::CRPCParamPtr param);
+    rpc::CRPCResultPtr RPCGetResyncStatus(rpc::CRPCParamPtr param);
+    rpc::CRPCResultPtr RPCCancelResync(rpc::CRPCParamPtr param);
     rpc::CRPCResultPtr RPCGetBalance(rpc::CRPCParamPtr param);
     rpc::CRPCResultPtr RPCListTransaction(rpc::CRPCParamPtr param);
     rpc::CRPCResultPtr RPCSendFrom(rpc::CRPCParamPtr param);
@@ -144,7 +269,17 @@ protected:
 
 private:
     std::map<std::string, RPCFunc> mapRPCFunc;
+    std::set<std::string> setSerialRPC;
     bool fWriteRPCLog;
+    xengine::CThread thrSerial;
+    std::vector<std::unique_ptr<xengine::CThread>> vThrWorker;
+    CRPCTaskQueue queSerial;
+    CRPCTaskQueue queWorker;
+    boost::mutex mtxResync;
+    bool fResyncThread;
+    xengine::CThread thrResync;
+    boost::mutex mtxStat;
+    std::map<std::string, CRPCMethodStat> mapMethodStat;
 };
 
 } // namespace bigbang
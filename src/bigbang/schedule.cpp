@@ -135,6 +135,17 @@ void CSchedule::RemovePeer(uint64 nPeerNonce, set<uint64>& setSchedPeer)
         }
         mapPeer.erase(it);
     }
+    for (auto mt = mapCmpctBlock.begin(); mt != mapCmpctBlock.end();)
+    {
+        if (mt->second.nPeerNonce == nPeerNonce)
+        {
+            mapCmpctBlock.erase(mt++);
+        }
+        else
+        {
+            ++mt;
+        }
+    }
 }
 
 bool CSchedule::CheckAddInvIdleLocation(uint64 nPeerNonce, uint32 nInvType)
@@ -190,6 +201,7 @@ void CSchedule::RemoveInvState(const network::CInv& inv)
     {
         RemoveHeightBlock(CBlock::GetBlockHeightByHash(inv.nHash), inv.nHash);
         RemoveRefBlock(inv.nHash);
+        mapCmpctBlock.erase(inv.nHash);
     }
     mapState.erase(inv);
 }
@@ -204,6 +216,7 @@ bool CSchedule::ReceiveBlock(uint64 nPeerNonce, const uint256& hash, const CBloc
         {
             state.objReceived = block;
             state.nRecvObjTime = GetTime();
+            mapCmpctBlock.erase(hash);
             state.nClearObjTime = GetTime() + MAX_OBJ_WAIT_TIME;
             setSchedPeer.insert(state.setKnownPeer.begin(), state.setKnownPeer.end());
             mapPeer[nPeerNonce].Completed((*it).first);
@@ -379,6 +392,10 @@ bool CSchedule::CancelAssignedInv(uint64 nPeerNonce, const network::CInv& inv)
     }
     if (!state.IsReceived())
     {
+        if (inv.nType == network::CInv::MSG_BLOCK)
+        {
+            mapCmpctBlock.erase(inv.nHash);
+        }
         state.nAssigned = 0;
         state.setKnownPeer.erase(nPeerNonce);
         if (state.setKnownPeer.empty())
@@ -877,4 +894,45 @@ bool CSchedule::ScheduleKnownInv(uint64 nPeerNonce, CInvPeer& peer, uint32 type,
     return (!vInv.empty() || listKnown.empty());
 }
 
+bool CSchedule::CheckAssignedBlock(uint64 nPeerNonce, const uint256& hash)
+{
+    map<network::CInv, CInvState>::iterator it = mapState.find(network::CInv(network::CInv::MSG_BLOCK, hash));
+    return (it != mapState.end() && it->second.nAssigned == nPeerNonce && !it->second.IsReceived());
+}
+
+bool CSchedule::AddCmpctBlock(uint64 nPeerNonce, const uint256& hash, const CBlock& block, const vector<uint32>& vMissing)
+{
+    if (!CheckAssignedBlock(nPeerNonce, hash))
+    {
+        return false;
+    }
+    CCmpctBlockState& state = mapCmpctBlock[hash];
+    state.nPeerNonce = nPeerNonce;
+    state.block = block;
+    state.vMissing = vMissing;
+    return true;
+}
+
+bool CSchedule::FillCmpctBlock(uint64 nPeerNonce, const uint256& hash, const vector<CTransaction>& vtx, CBlock& block)
+{
+    map<uint256, CCmpctBlockState>::iterator it = mapCmpctBlock.find(hash);
+    if (it == mapCmpctBlock.end() || it->second.nPeerNonce != nPeerNonce)
+    {
+        return false;
+    }
+    CCmpctBlockState& state = it->second;
+    if (vtx.size() != state.vMissing.size())
+    {
+        mapCmpctBlock.erase(it);
+        return false;
+    }
+    for (size_t i = 0; i < vtx.size(); i++)
+    {
+        state.block.vtx[state.vMissing[i]] = vtx[i];
+    }
+    block = std::move(state.block);
+    mapCmpctBlock.erase(it);
+    return true;
+}
+
 } // namespace bigbang
@@ -220,6 +220,17 @@ class CSchedule
         bool fVerifyPowBlock;
         uint256 hashRefBlock;
     };
+    class CCmpctBlockState
+    {
+    public:
+        CCmpctBlockState()
+          : nPeerNonce(0) {}
+
+    public:
+        uint64 nPeerNonce;
+        CBlock block;
+        std::vector<uint32> vMissing;
+    };
 
 public:
     enum
@@ -288,6 +299,9 @@ public:
     void RemoveHeightBlock(int nHeight, const uint256& hash);
     bool GetPowBlockState(const uint256& hash, bool& fVerifyPowBlockOut);
     void SetPowBlockVerifyState(const uint256& hash, bool fVerifyPowBlockIn);
+    bool CheckAssignedBlock(uint64 nPeerNonce, const uint256& hash);
+    bool AddCmpctBlock(uint64 nPeerNonce, const uint256& hash, const CBlock& block, const std::vector<uint32>& vMissing);
+    bool FillCmpctBlock(uint64 nPeerNonce, const uint256& hash, const std::vector<CTransaction>& vtx, CBlock& block);
 
 protected:
     void RemoveOrphan(const network::CInv& inv);
@@ -303,6 +317,7 @@ protected:
     std::map<uint256, std::map<uint256, uint256>> mapRefBlock;
     std::map<int, std::vector<std::pair<uint256, int>>> mapHeightBlock;
     std::map<int, CBlock> mapKcPowBlock;
+    std::map<uint256, CCmpctBlockState> mapCmpctBlock;
 };
 
 } // namespace bigbang
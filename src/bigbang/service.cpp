@@ -343,44 +343,13 @@ bool CService::GetTransaction(const uint256& txid, CTransaction& tx, uint256& ha
     }
     else
     {
-        if (!pBlockChain->GetTransaction(txid, tx, hashFork, nHeight))
+        CTxContxt txContxt;
+        if (!pBlockChain->GetTransaction(txid, tx, txContxt, hashFork, hashBlock, nHeight))
         {
             StdLog("CService", "GetTransaction: BlockChain GetTransaction fail, txid: %s", txid.GetHex().c_str());
             return false;
         }
-
-        std::vector<uint256> vHashBlock;
-        if (!GetBlockHash(hashFork, nHeight, vHashBlock))
-        {
-            StdLog("CService", "GetTransaction: GetBlockHash fail, txid: %s, fork: %s, height: %d",
-                   txid.GetHex().c_str(), hashFork.GetHex().c_str(), nHeight);
-            return false;
-        }
-        for (const auto& hash : vHashBlock)
-        {
-            CBlockEx block;
-            uint256 tempHashFork;
-            int tempHeight = 0;
-            if (!GetBlockEx(hash, block, tempHashFork, tempHeight))
-            {
-                StdLog("CService", "GetTransaction: GetBlockEx fail, txid: %s, block: %s",
-                       txid.GetHex().c_str(), hash.GetHex().c_str());
-                return false;
-            }
-            for (int i = 0; i < block.vtx.size(); i++)
-            {
-                if (txid == block.vtx[i].GetHash())
-                {
-                    hashBlock = hash;
-                    destIn = block.vTxContxt[i].destIn;
-                    break;
-                }
-            }
-            if (hashBlock != 0)
-            {
-                break;
-            }
-        }
+        destIn = txContxt.destIn;
     }
     return true;
 }
@@ -660,6 +629,16 @@ bool CService::ResynchronizeWalletTx()
     return pWallet->ResynchronizeWalletTx();
 }
 
+bool CService::GetWalletResyncProgress(uint256& hashFork, int& nHeight, int& nLastHeight, std::size_t& nTxCount, bool& fIncomplete)
+{
+    return pWallet->GetResyncProgress(hashFork, nHeight, nLastHeight, nTxCount, fIncomplete);
+}
+
+bool CService::CancelWalletResync()
+{
+    return pWallet->CancelResync();
+}
+
 bool CService::SignOfflineTransaction(const CDestination& destIn, CTransaction& tx, bool& fCompleted)
 {
     uint256 hashFork;
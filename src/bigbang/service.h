@@ -75,6 +75,8 @@ public:
                                                    const std::vector<unsigned char>& vchData, CTransaction& txNew) override;
     bool SynchronizeWalletTx(const CDestination& destNew) override;
     bool ResynchronizeWalletTx() override;
+    bool GetWalletResyncProgress(uint256& hashFork, int& nHeight, int& nLastHeight, std::size_t& nTxCount, bool& fIncomplete) override;
+    bool CancelWalletResync() override;
     bool SignOfflineTransaction(const CDestination& destIn, CTransaction& tx, bool& fCompleted) override;
     Errno SendOfflineSignedTransaction(CTransaction& tx) override;
     /* Mint */
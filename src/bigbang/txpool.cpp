@@ -8,9 +8,16 @@
 #include <boost/range/adaptor/reversed.hpp>
 #include <deque>
 
+#include "peerevent.h"
+
 using namespace std;
 using namespace xengine;
 
+// Packages that do not fit are skipped, arranging stops after this many in a row once the block is nearly full
+#define MAX_CONSECUTIVE_ARRANGE_FAILED 1000
+#define MIN_ARRANGE_BLOCK_SPACE 4000
+#define MAX_PUSH_HEIGHT_RETRY 3
+
 namespace bigbang
 {
 
@@ -50,6 +57,29 @@ class CTxPoolCandidate
     map<uint256, CPooledTx*> mapPoolTx;
 };
 
+//////////////////////////////
+// CTxPoolPackageScore
+class CTxPoolPackageScore
+{
+public:
+    CTxPoolPackageScore(CPooledTx* ptxIn)
+      : ptx(ptxIn)
+    {
+        nTxFeePerKB = (ptx->nPackageSize != 0 ? (ptx->nPackageTxFee << 10) / ptx->nPackageSize : 0);
+    }
+    CTxPoolPackageScore(int64 nTxFeePerKBIn, CPooledTx* ptxIn)
+      : nTxFeePerKB(nTxFeePerKBIn), ptx(ptxIn) {}
+    bool operator<(const CTxPoolPackageScore& score) const
+    {
+        return (nTxFeePerKB > score.nTxFeePerKB
+                || (nTxFeePerKB == score.nTxFeePerKB && ptx->nSequenceNumber < score.ptx->nSequenceNumber));
+    }
+
+public:
+    int64 nTxFeePerKB;
+    CPooledTx* ptx;
+};
+
 //////////////////////////////
 // CTxPoolView
 
@@ -157,19 +187,19 @@ bool CTxPoolView::AddNew(const uint256& txid, CPooledTx& tx)
 
     for (std::size_t i = 0; i < tx.vInput.size(); i++)
     {
-        mapSpent[tx.vInput[i].prevout].SetSpent(txid);
+        SetOutputSpent(tx.vInput[i].prevout, txid);
     }
 
     CTxOut output;
     output = tx.GetOutput(0);
     if (!output.IsNull())
     {
-        mapSpent[CTxOutPoint(txid, 0)].SetUnspent(output);
+        SetOutputUnspent(CTxOutPoint(txid, 0), output);
     }
     output = tx.GetOutput(1);
     if (!output.IsNull())
     {
-        mapSpent[CTxOutPoint(txid, 1)].SetUnspent(output);
+        SetOutputUnspent(CTxOutPoint(txid, 1), output);
     }
 
     vector<pair<uint256, uint64>> vPrevTxid;
@@ -199,6 +229,21 @@ bool CTxPoolView::AddNew(const uint256& txid, CPooledTx& tx)
         }
     }
 
+    bool fDirty = false;
+    for (const CTxIn& txin : tx.vInput)
+    {
+        fDirty = (fDirty || setDirtyPackage.count(txin.prevout.hash));
+    }
+    if (fDirty)
+    {
+        setDirtyPackage.insert(txid);
+    }
+    else
+    {
+        UpdatePackage(txid);
+    }
+    SetDescendantPackageDirty(txid);
+
     return true;
 }
 
@@ -223,7 +268,7 @@ void CTxPoolView::InvalidateSpent(const CTxOutPoint& out, CTxPoolView& viewInvol
             }
             else
             {
-                mapSpent.erase(out0);
+                EraseOutput(out0);
             }
             CTxOutPoint out1(txidNextTx, 1);
             if (IsSpent(out1))
@@ -232,14 +277,60 @@ void CTxPoolView::InvalidateSpent(const CTxOutPoint& out, CTxPoolView& viewInvol
             }
             else
             {
-                mapSpent.erase(out1);
+                EraseOutput(out1);
             }
             viewInvolvedTx.AddNew(txidNextTx, *pNextTx);
+            setDirtyPackage.erase(txidNextTx);
+            RemoveTemplateTx(txidNextTx);
             setTxLinkIndex.erase(txidNextTx);
         }
         else
         {
-            mapSpent.erase(vOutPoint[i]);
+            EraseOutput(vOutPoint[i]);
+        }
+    }
+}
+
+void CTxPoolView::SetOutputSpent(const CTxOutPoint& out, const uint256& txidNextTx)
+{
+    CSpent& spent = mapSpent[out];
+    EraseDestUnspent(out, spent);
+    spent.SetSpent(txidNextTx);
+}
+
+void CTxPoolView::SetOutputUnspent(const CTxOutPoint& out, const CTxOut& output)
+{
+    CSpent& spent = mapSpent[out];
+    EraseDestUnspent(out, spent);
+    spent.SetUnspent(output);
+    if (!output.IsNull())
+    {
+        mapDestUnspent[output.destTo].insert(out);
+    }
+}
+
+void CTxPoolView::EraseOutput(const CTxOutPoint& out)
+{
+    map<CTxOutPoint, CSpent>::iterator it = mapSpent.find(out);
+    if (it != mapSpent.end())
+    {
+        EraseDestUnspent(out, it->second);
+        mapSpent.erase(it);
+    }
+}
+
+void CTxPoolView::EraseDestUnspent(const CTxOutPoint& out, const CSpent& spent)
+{
+    if (!spent.IsSpent() && !spent.IsNull())
+    {
+        map<CDestination, set<CTxOutPoint>>::iterator it = mapDestUnspent.find(spent.destTo);
+        if (it != mapDestUnspent.end())
+        {
+            it->second.erase(out);
+            if (it->second.empty())
+            {
+                mapDestUnspent.erase(it);
+            }
         }
     }
 }
@@ -281,7 +372,135 @@ void CTxPoolView::GetAllPrevTxLink(const CPooledTxLink& link, vector<CPooledTxLi
     }
 }
 
-bool CTxPoolView::AddArrangeBlockTx(vector<CTransaction>& vtx, int64& nTotalTxFee, int64 nBlockTime, size_t nMaxSize, size_t& nTotalSize,
+void CTxPoolView::SetDescendantPackageDirty(const uint256& txid)
+{
+    vector<uint256> vTxid;
+    vTxid.push_back(txid);
+    for (size_t i = 0; i < vTxid.size(); i++)
+    {
+        for (int n = 0; n < 2; n++)
+        {
+            // a dirty tx has its descendants marked already
+            uint256 txidNextTx;
+            if (GetSpent(CTxOutPoint(vTxid[i], n), txidNextTx) && Exists(txidNextTx)
+                && setDirtyPackage.insert(txidNextTx).second)
+            {
+                vTxid.push_back(txidNextTx);
+            }
+        }
+    }
+}
+
+void CTxPoolView::UpdatePackage(const uint256& txid)
+{
+    CPooledTxLinkSetByTxHash& idxTx = setTxLinkIndex.get<0>();
+    CPooledTxLinkSetByTxHash::iterator it = idxTx.find(txid);
+    if (it == idxTx.end() || (*it).ptx == nullptr)
+    {
+        return;
+    }
+    CPooledTx* ptx = (*it).ptx;
+
+    set<uint256> setParent;
+    for (const CTxIn& txin : ptx->vInput)
+    {
+        if (Exists(txin.prevout.hash))
+        {
+            setParent.insert(txin.prevout.hash);
+        }
+    }
+
+    int64 nPackageTxFee = ptx->nTxFee;
+    size_t nPackageSize = ptx->nSerializeSize;
+    if (setParent.size() == 1)
+    {
+        // the package of the only parent holds every ancestor
+        CPooledTx* pParent = Get(*setParent.begin());
+        nPackageTxFee += pParent->nPackageTxFee;
+        nPackageSize += pParent->nPackageSize;
+    }
+    else if (!setParent.empty())
+    {
+        // parents may share ancestors, each ancestor is counted once
+        set<uint256> setAncestor(setParent);
+        vector<uint256> vAncestor(setParent.begin(), setParent.end());
+        for (size_t i = 0; i < vAncestor.size(); i++)
+        {
+            CPooledTx* pAncestor = Get(vAncestor[i]);
+            nPackageTxFee += pAncestor->nTxFee;
+            nPackageSize += pAncestor->nSerializeSize;
+            for (const CTxIn& txin : pAncestor->vInput)
+            {
+                if (Exists(txin.prevout.hash) && setAncestor.insert(txin.prevout.hash).second)
+                {
+                    vAncestor.push_back(txin.prevout.hash);
+                }
+            }
+        }
+    }
+
+    ptx->nPackageTxFee = nPackageTxFee;
+    ptx->nPackageSize = nPackageSize;
+    idxTx.modify(it, [nPackageTxFee, nPackageSize](CPooledTxLink& link) {
+        link.nPackageTxFee = nPackageTxFee;
+        link.nPackageSize = nPackageSize;
+    });
+}
+
+void CTxPoolView::UpdateDirtyPackage()
+{
+    vector<CPooledTx*> vDirtyTx;
+    for (const uint256& txid : setDirtyPackage)
+    {
+        CPooledTx* ptx = Get(txid);
+        if (ptx != nullptr)
+        {
+            vDirtyTx.push_back(ptx);
+        }
+    }
+    setDirtyPackage.clear();
+
+    // parents are sequenced before their children, so are updated first
+    sort(vDirtyTx.begin(), vDirtyTx.end(), [](const CPooledTx* a, const CPooledTx* b) {
+        return a->nSequenceNumber < b->nSequenceNumber;
+    });
+    for (CPooledTx* ptx : vDirtyTx)
+    {
+        UpdatePackage(ptx->GetHash());
+    }
+}
+
+bool CTxPoolView::GetArrangePackage(CPooledTx* ptx, const set<uint256>& setArranged, const set<uint256>& setUnTx,
+                                    size_t nMaxPackageSize, CTxPoolCandidate& candidate)
+{
+    vector<CPooledTx*> vPackageTx;
+    vPackageTx.push_back(ptx);
+    candidate.AddNewTx(make_pair(ptx->GetHash(), ptx));
+    for (size_t i = 0; i < vPackageTx.size() && candidate.nTotalSize <= nMaxPackageSize; i++)
+    {
+        for (const CTxIn& txin : vPackageTx[i]->vInput)
+        {
+            const uint256& txidPrev = txin.prevout.hash;
+            if (setUnTx.count(txidPrev))
+            {
+                return false;
+            }
+            if (setArranged.count(txidPrev) || candidate.Have(txidPrev))
+            {
+                continue;
+            }
+            CPooledTx* pPrevTx = Get(txidPrev);
+            if (pPrevTx != nullptr)
+            {
+                candidate.AddNewTx(make_pair(txidPrev, pPrevTx));
+                vPackageTx.push_back(pPrevTx);
+            }
+        }
+    }
+    return true;
+}
+
+bool CTxPoolView::AddArrangeBlockTx(vector<CPooledTx*>& vArrangedTx, int64& nTotalTxFee, int64 nBlockTime, size_t nMaxSize, size_t& nTotalSize,
                                     map<CDestination, int>& mapVoteCert, set<uint256>& setUnTx, CPooledTx* ptx, map<CDestination, int64>& mapVote, int64 nMinEnrollAmount, bool fIsDposHeight)
 {
     if (ptx->GetTxTime() <= nBlockTime)
@@ -340,7 +559,7 @@ bool CTxPoolView::AddArrangeBlockTx(vector<CTransaction>& vtx, int64& nTotalTxFe
 
         if (!fIsDposHeight)
         {
-            vtx.push_back(*static_cast<CTransaction*>(ptx));
+            vArrangedTx.push_back(ptx);
             nTotalSize += ptx->nSerializeSize;
             nTotalTxFee += ptx->nTxFee;
         }
@@ -348,7 +567,7 @@ bool CTxPoolView::AddArrangeBlockTx(vector<CTransaction>& vtx, int64& nTotalTxFe
         {
             if (ptx->nType == CTransaction::TX_CERT || ptx->nTxFee >= CalcMinTxFee(ptx->vchData.size(), NEW_MIN_TX_FEE))
             {
-                vtx.push_back(*static_cast<CTransaction*>(ptx));
+                vArrangedTx.push_back(ptx);
                 nTotalSize += ptx->nSerializeSize;
                 nTotalTxFee += ptx->nTxFee;
             }
@@ -367,12 +586,300 @@ bool CTxPoolView::AddArrangeBlockTx(vector<CTransaction>& vtx, int64& nTotalTxFe
 
 void CTxPoolView::ArrangeBlockTx(vector<CTransaction>& vtx, int64& nTotalTxFee, int64 nBlockTime, size_t nMaxSize, map<CDestination, int>& mapVoteCert, map<CDestination, int64>& mapVote, int64 nMinEnrollAmount, bool fIsDposHeight)
 {
+    vector<CPooledTx*> vArrangedTx;
     size_t nTotalSize = 0;
+    ArrangeTx(vArrangedTx, nTotalTxFee, nTotalSize, nBlockTime, nMaxSize, mapVoteCert, mapVote, nMinEnrollAmount, fIsDposHeight);
+
+    vtx.reserve(vtx.size() + vArrangedTx.size());
+    for (const CPooledTx* ptx : vArrangedTx)
+    {
+        vtx.push_back(*static_cast<const CTransaction*>(ptx));
+    }
+}
+
+void CTxPoolView::ArrangeTemplate(const map<CDestination, int>& mapVoteCert, const map<CDestination, int64>& mapVote, int64 nMinEnrollAmount, bool fIsDposHeight)
+{
+    mapTemplateVoteCert = mapVoteCert;
+    mapTemplateVote = mapVote;
+    nTemplateMinEnrollAmount = nMinEnrollAmount;
+    fTemplateDposHeight = fIsDposHeight;
+
+    // the whole pool is ranked again by package fee rate, tx time is checked against
+    // the block time as the template is read
+    vector<CPooledTx*> vArrangedTx;
+    int64 nTotalTxFee = 0;
+    nTemplateSize = 0;
+    ArrangeTx(vArrangedTx, nTotalTxFee, nTemplateSize, numeric_limits<int64>::max(), MAX_BLOCK_SIZE,
+              mapTemplateVoteCert, mapTemplateVote, nTemplateMinEnrollAmount, fTemplateDposHeight);
+
+    setTemplateTxLink.clear();
+    for (CPooledTx* ptx : vArrangedTx)
+    {
+        setTemplateTxLink.push_back(CPooledTxLink(ptx));
+    }
+    fTemplateArranged = true;
+}
+
+void CTxPoolView::UpdateTemplate(const map<CDestination, int>& mapVoteCert, const map<CDestination, int64>& mapVote, int64 nMinEnrollAmount, bool fIsDposHeight)
+{
+    if (!fTemplateArranged)
+    {
+        ArrangeTemplate(mapVoteCert, mapVote, nMinEnrollAmount, fIsDposHeight);
+        return;
+    }
+
+    mapTemplateVoteCert = mapVoteCert;
+    mapTemplateVote = mapVote;
+    nTemplateMinEnrollAmount = nMinEnrollAmount;
+    fTemplateDposHeight = fIsDposHeight;
+
+    // confirmed and invalidated txs have left the template already. What is left is checked in its
+    // order against the limits of the next block, a tx is dropped with its template descendants
+    vector<CPooledTx*> vArrangedTx;
+    int64 nTotalTxFee = 0;
+    set<uint256> setArranged;
+    set<uint256> setUnTx;
+    nTemplateSize = 0;
+    for (const CPooledTxLink& link : setTemplateTxLink)
+    {
+        CPooledTx* ptx = link.ptx;
+        bool fMissPrev = false;
+        for (size_t i = 0; i < ptx->vInput.size() && !fMissPrev; i++)
+        {
+            const uint256& txidPrev = ptx->vInput[i].prevout.hash;
+            fMissPrev = (Exists(txidPrev) && !setArranged.count(txidPrev));
+        }
+        if (fMissPrev)
+        {
+            setUnTx.insert(link.hashTX);
+            continue;
+        }
+        size_t nCount = vArrangedTx.size();
+        AddArrangeBlockTx(vArrangedTx, nTotalTxFee, numeric_limits<int64>::max(), MAX_BLOCK_SIZE, nTemplateSize, mapTemplateVoteCert,
+                          setUnTx, ptx, mapTemplateVote, nTemplateMinEnrollAmount, fTemplateDposHeight);
+        if (vArrangedTx.size() > nCount)
+        {
+            setArranged.insert(link.hashTX);
+        }
+    }
+
+    setTemplateTxLink.clear();
+    for (CPooledTx* ptx : vArrangedTx)
+    {
+        setTemplateTxLink.push_back(CPooledTxLink(ptx));
+    }
+
+    FillTemplate(setArranged, setUnTx);
+}
+
+void CTxPoolView::FillTemplate(set<uint256>& setArranged, set<uint256>& setUnTx)
+{
+    UpdateDirtyPackage();
+
+    // cert txs go first as in ArrangeTx, they are few
+    const CPooledTxLinkSetByTxType& idxTxLinkType = setTxLinkIndex.get<2>();
+    const auto iterBegin = idxTxLinkType.lower_bound((uint16)(CTransaction::TX_CERT));
+    const auto iterEnd = idxTxLinkType.upper_bound((uint16)(CTransaction::TX_CERT));
+    for (auto iter = iterBegin; iter != iterEnd; ++iter)
+    {
+        if ((*iter).ptx != nullptr && !setArranged.count((*iter).hashTX) && !setUnTx.count((*iter).hashTX)
+            && !AddTemplatePackage((*iter).ptx, setArranged, setUnTx))
+        {
+            break;
+        }
+    }
+
+    // the freed space is filled by package fee rate. The template txs rank ahead of the cut and are
+    // skipped, the pooled txs ahead of it are those which did not fit or gained by a confirmed parent
+    size_t nConsecutiveFailed = 0;
+    const CPooledTxLinkSetByTxScore& idxTxLinkScore = setTxLinkIndex.get<tx_score>();
+    for (CPooledTxLinkSetByTxScore::const_iterator it = idxTxLinkScore.begin();
+         it != idxTxLinkScore.end() && nTemplateSize + MIN_ARRANGE_BLOCK_SPACE <= MAX_BLOCK_SIZE; ++it)
+    {
+        if ((*it).ptx == nullptr || setArranged.count((*it).hashTX) || setUnTx.count((*it).hashTX))
+        {
+            continue;
+        }
+        if (AddTemplatePackage((*it).ptx, setArranged, setUnTx))
+        {
+            nConsecutiveFailed = 0;
+        }
+        else if (++nConsecutiveFailed > MAX_CONSECUTIVE_ARRANGE_FAILED)
+        {
+            break;
+        }
+    }
+}
+
+bool CTxPoolView::AddTemplatePackage(CPooledTx* ptx, set<uint256>& setArranged, set<uint256>& setUnTx)
+{
+    // ptx joins the template with its pooled ancestors which are not in it yet, false if they do not fit
+    CTxPoolCandidate candidate;
+    if (!GetArrangePackage(ptx, setArranged, setUnTx, MAX_BLOCK_SIZE - nTemplateSize, candidate))
+    {
+        setUnTx.insert(ptx->GetHash());
+        return true;
+    }
+    if (candidate.nTotalSize > MAX_BLOCK_SIZE - nTemplateSize)
+    {
+        return false;
+    }
+
+    vector<pair<uint256, CPooledTx*>> vPackageTx(candidate.mapPoolTx.begin(), candidate.mapPoolTx.end());
+    sort(vPackageTx.begin(), vPackageTx.end(), [](const pair<uint256, CPooledTx*>& a, const pair<uint256, CPooledTx*>& b) {
+        return a.second->nSequenceNumber < b.second->nSequenceNumber;
+    });
+    vector<CPooledTx*> vArrangedTx;
+    int64 nTotalTxFee = 0;
+    for (const auto& tx : vPackageTx)
+    {
+        size_t nCount = vArrangedTx.size();
+        if (!AddArrangeBlockTx(vArrangedTx, nTotalTxFee, numeric_limits<int64>::max(), MAX_BLOCK_SIZE, nTemplateSize, mapTemplateVoteCert,
+                               setUnTx, tx.second, mapTemplateVote, nTemplateMinEnrollAmount, fTemplateDposHeight))
+        {
+            return false;
+        }
+        if (vArrangedTx.size() > nCount)
+        {
+            setArranged.insert(tx.first);
+            setTemplateTxLink.push_back(CPooledTxLink(tx.second));
+        }
+    }
+    return true;
+}
+
+void CTxPoolView::AddTemplateTx(const uint256& txid)
+{
+    CPooledTx* ptx = Get(txid);
+    CPooledTemplateTxLinkSetByTxHash& idxTemplateTx = setTemplateTxLink.get<1>();
+    if (!fTemplateArranged || ptx == nullptr || idxTemplateTx.count(txid))
+    {
+        return;
+    }
+
+    // a tx is appended only after its pooled parents, the rest waits for the next arrangement
+    for (const CTxIn& txin : ptx->vInput)
+    {
+        if (Exists(txin.prevout.hash) && !idxTemplateTx.count(txin.prevout.hash))
+        {
+            return;
+        }
+    }
+    if (nTemplateSize + ptx->nSerializeSize > MAX_BLOCK_SIZE && !EvictTemplateTx(ptx))
+    {
+        return;
+    }
+
+    vector<CPooledTx*> vArrangedTx;
+    int64 nTotalTxFee = 0;
+    set<uint256> setUnTx;
+    AddArrangeBlockTx(vArrangedTx, nTotalTxFee, numeric_limits<int64>::max(), MAX_BLOCK_SIZE, nTemplateSize, mapTemplateVoteCert,
+                      setUnTx, ptx, mapTemplateVote, nTemplateMinEnrollAmount, fTemplateDposHeight);
+    if (!vArrangedTx.empty())
+    {
+        setTemplateTxLink.push_back(CPooledTxLink(ptx));
+    }
+}
+
+void CTxPoolView::GetTemplateTx(int64 nBlockTime, size_t nMaxSize, vector<CTransaction>& vtx, int64& nTotalTxFee) const
+{
+    size_t nTotalSize = 0;
+    set<uint256> setUnTx;
+    nTotalTxFee = 0;
+    vtx.reserve(vtx.size() + setTemplateTxLink.size());
+    for (const CPooledTxLink& link : setTemplateTxLink)
+    {
+        const CPooledTx* ptx = link.ptx;
+        bool fMissPrev = (ptx->GetTxTime() > nBlockTime || nTotalSize + ptx->nSerializeSize > nMaxSize);
+        for (size_t i = 0; i < ptx->vInput.size() && !fMissPrev && !setUnTx.empty(); i++)
+        {
+            fMissPrev = (setUnTx.count(ptx->vInput[i].prevout.hash) != 0);
+        }
+        if (fMissPrev)
+        {
+            setUnTx.insert(link.hashTX);
+            continue;
+        }
+        vtx.push_back(*static_cast<const CTransaction*>(ptx));
+        nTotalSize += ptx->nSerializeSize;
+        nTotalTxFee += ptx->nTxFee;
+    }
+}
+
+void CTxPoolView::RemoveTemplateTx(const uint256& txid)
+{
+    CPooledTemplateTxLinkSetByTxHash& idxTemplateTx = setTemplateTxLink.get<1>();
+    CPooledTemplateTxLinkSetByTxHash::iterator it = idxTemplateTx.find(txid);
+    if (it != idxTemplateTx.end())
+    {
+        nTemplateSize -= (*it).ptx->nSerializeSize;
+        if ((*it).nType == CTransaction::TX_CERT)
+        {
+            map<CDestination, int>::iterator mi = mapTemplateVoteCert.find((*it).ptx->sendTo);
+            if (mi != mapTemplateVoteCert.end())
+            {
+                mi->second++;
+            }
+        }
+        idxTemplateTx.erase(it);
+    }
+}
+
+bool CTxPoolView::EvictTemplateTx(const CPooledTx* ptx)
+{
+    // make room for ptx with the template txs of the lowest fee rate, as long as they pay less than ptx.
+    // Only txs without children in the template leave it, cert txs are kept.
+    const CPooledTemplateTxLinkSetByTxHash& idxTemplateTx = setTemplateTxLink.get<1>();
+    const CPooledTemplateTxLinkSetByTxFeeRate& idxTemplateFeeRate = setTemplateTxLink.get<2>();
+    const int64 nTxFeePerKB = ComparePooledTxLinkByTxFeeRate::GetTxFeePerKB(ptx);
+    vector<uint256> vEvict;
+    size_t nEvictSize = 0;
+    for (CPooledTemplateTxLinkSetByTxFeeRate::const_reverse_iterator it = idxTemplateFeeRate.rbegin();
+         it != idxTemplateFeeRate.rend() && nTemplateSize - nEvictSize + ptx->nSerializeSize > MAX_BLOCK_SIZE; ++it)
+    {
+        if (ComparePooledTxLinkByTxFeeRate::GetTxFeePerKB((*it).ptx) >= nTxFeePerKB)
+        {
+            break;
+        }
+        if ((*it).nType == CTransaction::TX_CERT)
+        {
+            continue;
+        }
+        bool fHasChild = false;
+        for (int n = 0; n < 2 && !fHasChild; n++)
+        {
+            uint256 txidNextTx;
+            fHasChild = (GetSpent(CTxOutPoint((*it).hashTX, n), txidNextTx) && idxTemplateTx.count(txidNextTx));
+        }
+        if (!fHasChild)
+        {
+            vEvict.push_back((*it).hashTX);
+            nEvictSize += (*it).ptx->nSerializeSize;
+        }
+    }
+    if (nTemplateSize - nEvictSize + ptx->nSerializeSize > MAX_BLOCK_SIZE)
+    {
+        return false;
+    }
+
+    // the evicted txs stay pooled and are ranked again by the next arrangement
+    for (const uint256& txid : vEvict)
+    {
+        RemoveTemplateTx(txid);
+    }
+    return true;
+}
+
+void CTxPoolView::ArrangeTx(vector<CPooledTx*>& vArrangedTx, int64& nTotalTxFee, size_t& nTotalSize, int64 nBlockTime, size_t nMaxSize,
+                            map<CDestination, int>& mapVoteCert, map<CDestination, int64>& mapVote, int64 nMinEnrollAmount, bool fIsDposHeight)
+{
     set<uint256> setUnTx;
     CPooledCertTxLinkSet setCertRelativesIndex;
     std::vector<CPooledTxLink> prevLinks;
     nTotalTxFee = 0;
 
+    UpdateDirtyPackage();
+
     // Collect all cert related tx
     const CPooledTxLinkSetByTxType& idxTxLinkType = setTxLinkIndex.get<2>();
     const auto iterBegin = idxTxLinkType.lower_bound((uint16)(CTransaction::TX_CERT));
@@ -387,34 +894,102 @@ void CTxPoolView::ArrangeBlockTx(vector<CTransaction>& vtx, int64& nTotalTxFee,
     }
 
     // process all cert related tx by seqnum
+    set<uint256> setArranged;
     const CPooledCertTxLinkSetBySequenceNumber& idxCertTxLinkSeq = setCertRelativesIndex.get<1>();
     for (auto& i : idxCertTxLinkSeq)
     {
         if (i.ptx)
         {
-            if (!AddArrangeBlockTx(vtx, nTotalTxFee, nBlockTime, nMaxSize, nTotalSize, mapVoteCert, setUnTx, i.ptx, mapVote, nMinEnrollAmount, fIsDposHeight))
+            if (!AddArrangeBlockTx(vArrangedTx, nTotalTxFee, nBlockTime, nMaxSize, nTotalSize, mapVoteCert, setUnTx, i.ptx, mapVote, nMinEnrollAmount, fIsDposHeight))
             {
                 return;
             }
+            if (!setUnTx.count(i.hashTX))
+            {
+                setArranged.insert(i.hashTX);
+            }
         }
     }
 
-    // process all tx in tx pool by seqnum
-    const CPooledTxLinkSetBySequenceNumber& idxTxLinkSeq = setTxLinkIndex.get<1>();
-    for (auto& i : idxTxLinkSeq)
-    {
-        // skip cert related tx
-        if (setCertRelativesIndex.find(i.hashTX) != setCertRelativesIndex.end())
+    // process the rest by fee rate of ancestor packages. Arranging a package lowers or raises
+    // the rate of what is left of its descendants' packages, a package is scored again when
+    // it comes up and goes back to setModified if its rate has dropped.
+    set<uint256> setFailed;
+    set<uint256> setModifiedTx;
+    set<CTxPoolPackageScore> setModified;
+    size_t nConsecutiveFailed = 0;
+    const CPooledTxLinkSetByTxScore& idxTxLinkScore = setTxLinkIndex.get<tx_score>();
+    CPooledTxLinkSetByTxScore::const_iterator it = idxTxLinkScore.begin();
+    while (true)
+    {
+        while (it != idxTxLinkScore.end()
+               && ((*it).ptx == nullptr || setCertRelativesIndex.find((*it).hashTX) != setCertRelativesIndex.end()
+                   || setModifiedTx.count((*it).hashTX) || setArranged.count((*it).hashTX)
+                   || setUnTx.count((*it).hashTX) || setFailed.count((*it).hashTX)))
+        {
+            ++it;
+        }
+
+        CTxPoolPackageScore score(0, nullptr);
+        if (!setModified.empty() && (it == idxTxLinkScore.end() || *setModified.begin() < CTxPoolPackageScore((*it).ptx)))
+        {
+            score = *setModified.begin();
+            setModified.erase(setModified.begin());
+            const uint256 txid = score.ptx->GetHash();
+            if (setArranged.count(txid) || setUnTx.count(txid))
+            {
+                continue;
+            }
+        }
+        else if (it != idxTxLinkScore.end())
+        {
+            score = CTxPoolPackageScore((*it).ptx);
+            ++it;
+        }
+        else
         {
+            break;
+        }
+
+        CPooledTx* ptx = score.ptx;
+        CTxPoolCandidate candidate;
+        if (!GetArrangePackage(ptx, setArranged, setUnTx, nMaxSize - nTotalSize, candidate))
+        {
+            setUnTx.insert(ptx->GetHash());
             continue;
         }
-        if (i.ptx)
+        if (candidate.nTotalSize > nMaxSize - nTotalSize)
+        {
+            setFailed.insert(ptx->GetHash());
+            if (++nConsecutiveFailed > MAX_CONSECUTIVE_ARRANGE_FAILED && nTotalSize + MIN_ARRANGE_BLOCK_SPACE > nMaxSize)
+            {
+                break;
+            }
+            continue;
+        }
+        if (candidate.GetTxFeePerKB() < score.nTxFeePerKB)
+        {
+            setModified.insert(CTxPoolPackageScore(candidate.GetTxFeePerKB(), ptx));
+            setModifiedTx.insert(ptx->GetHash());
+            continue;
+        }
+
+        vector<pair<uint256, CPooledTx*>> vPackageTx(candidate.mapPoolTx.begin(), candidate.mapPoolTx.end());
+        sort(vPackageTx.begin(), vPackageTx.end(), [](const pair<uint256, CPooledTx*>& a, const pair<uint256, CPooledTx*>& b) {
+            return a.second->nSequenceNumber < b.second->nSequenceNumber;
+        });
+        for (const auto& tx : vPackageTx)
         {
-            if (!AddArrangeBlockTx(vtx, nTotalTxFee, nBlockTime, nMaxSize, nTotalSize, mapVoteCert, setUnTx, i.ptx, mapVote, nMinEnrollAmount, fIsDposHeight))
+            if (!AddArrangeBlockTx(vArrangedTx, nTotalTxFee, nBlockTime, nMaxSize, nTotalSize, mapVoteCert, setUnTx, tx.second, mapVote, nMinEnrollAmount, fIsDposHeight))
             {
                 return;
             }
+            if (!setUnTx.count(tx.first))
+            {
+                setArranged.insert(tx.first);
+            }
         }
+        nConsecutiveFailed = 0;
     }
 }
 
@@ -494,6 +1069,52 @@ bool CCertTxDestCache::IsOverMaxCertCount(const CDestination& dest)
     return true;
 }
 
+//////////////////////////////
+// CPooledTxForkIndex
+
+bool CPooledTxForkIndex::Insert(const uint256& txid, const uint256& hashFork)
+{
+    CShard& shard = GetShard(txid);
+    boost::unique_lock<boost::shared_mutex> wlock(shard.rwAccess);
+    return shard.mapFork.insert(make_pair(txid, hashFork)).second;
+}
+
+bool CPooledTxForkIndex::Get(const uint256& txid, uint256& hashFork) const
+{
+    const CShard& shard = GetShard(txid);
+    boost::shared_lock<boost::shared_mutex> rlock(shard.rwAccess);
+    auto it = shard.mapFork.find(txid);
+    if (it == shard.mapFork.end())
+    {
+        return false;
+    }
+    hashFork = it->second;
+    return true;
+}
+
+bool CPooledTxForkIndex::Exists(const uint256& txid) const
+{
+    const CShard& shard = GetShard(txid);
+    boost::shared_lock<boost::shared_mutex> rlock(shard.rwAccess);
+    return (!!shard.mapFork.count(txid));
+}
+
+void CPooledTxForkIndex::Erase(const uint256& txid)
+{
+    CShard& shard = GetShard(txid);
+    boost::unique_lock<boost::shared_mutex> wlock(shard.rwAccess);
+    shard.mapFork.erase(txid);
+}
+
+void CPooledTxForkIndex::Clear()
+{
+    for (int i = 0; i < SHARD_COUNT; i++)
+    {
+        boost::unique_lock<boost::shared_mutex> wlock(vShard[i].rwAccess);
+        vShard[i].mapFork.clear();
+    }
+}
+
 //////////////////////////////
 // CTxPool
 
@@ -559,34 +1180,32 @@ void CTxPool::HandleHalt()
 
 bool CTxPool::Exists(const uint256& txid)
 {
-    boost::shared_lock<boost::shared_mutex> rlock(rwAccess);
-    return (!!mapTx.count(txid));
+    return indexTxFork.Exists(txid);
 }
 
 void CTxPool::Clear()
 {
     boost::unique_lock<boost::shared_mutex> wlock(rwAccess);
-    mapPoolView.clear();
-    mapTx.clear();
+    mapPoolFork.clear();
+    indexTxFork.Clear();
 }
 
 size_t CTxPool::Count(const uint256& fork) const
 {
-    boost::shared_lock<boost::shared_mutex> rlock(rwAccess);
-    map<uint256, CTxPoolView>::const_iterator it = mapPoolView.find(fork);
-    if (it != mapPoolView.end())
+    CTxPoolForkPtr spFork = GetPoolFork(fork);
+    if (spFork != nullptr)
     {
-        return ((*it).second.Count());
+        boost::shared_lock<boost::shared_mutex> rlock(spFork->rwAccess);
+        return spFork->view.Count();
     }
     return 0;
 }
 
 Errno CTxPool::Push(const CTransaction& tx, uint256& hashFork, CDestination& destIn, int64& nValueIn)
 {
-    boost::unique_lock<boost::shared_mutex> wlock(rwAccess);
     uint256 txid = tx.GetHash();
 
-    if (mapTx.count(txid))
+    if (indexTxFork.Exists(txid))
     {
         StdError("CTxPool", "Push: tx existed, txid: %s", txid.GetHex().c_str());
         return ERR_ALREADY_HAVE;
@@ -598,26 +1217,46 @@ Errno CTxPool::Push(const CTransaction& tx, uint256& hashFork, CDestination& des
         return ERR_TRANSACTION_INVALID;
     }
 
-    int nHeight;
-    if (!pBlockChain->GetBlockLocation(tx.hashAnchor, hashFork, nHeight))
+    if (!GetPushFork(tx, hashFork))
     {
-        StdError("CTxPool", "Push: GetBlockLocation fail, txid: %s, hashAnchor: %s",
-                 txid.GetHex().c_str(), tx.hashAnchor.GetHex().c_str());
         return ERR_TRANSACTION_INVALID;
     }
 
+    CTxPoolForkPtr spFork = GetOrCreatePoolFork(hashFork);
+
+    // the height is read out of the fork lock, it must belong to the block the pool view is at
+    int nHeight;
     uint256 hashLast;
-    int64 nTime;
-    uint16 nMintType;
-    if (!pBlockChain->GetLastBlock(hashFork, hashLast, nHeight, nTime, nMintType))
+    boost::unique_lock<boost::shared_mutex> wlock(spFork->rwAccess, boost::defer_lock);
+    for (int i = 0;; i++)
     {
-        StdError("CTxPool", "Push: GetLastBlock fail, txid: %s, hashFork: %s",
-                 txid.GetHex().c_str(), hashFork.GetHex().c_str());
-        return ERR_TRANSACTION_INVALID;
+        if (!GetPushHeight(hashFork, hashLast, nHeight))
+        {
+            return ERR_TRANSACTION_INVALID;
+        }
+        wlock.lock();
+        const uint256& hashViewLast = spFork->view.hashLastBlock;
+        if (hashViewLast == hashLast || hashViewLast == 0)
+        {
+            break;
+        }
+        if (i + 1 >= MAX_PUSH_HEIGHT_RETRY)
+        {
+            // the view lags the chain until the block update reaches the pool
+            nHeight = CBlock::GetBlockHeightByHash(hashViewLast);
+            break;
+        }
+        wlock.unlock();
     }
 
-    CTxPoolView& txView = mapPoolView[hashFork];
-    Errno err = AddNew(txView, txid, tx, hashFork, nHeight);
+    if (spFork->mapTx.count(txid))
+    {
+        StdError("CTxPool", "Push: tx existed, txid: %s", txid.GetHex().c_str());
+        return ERR_ALREADY_HAVE;
+    }
+
+    CTxPoolView& txView = spFork->view;
+    Errno err = AddNew(*spFork, txid, tx, hashFork, nHeight);
     if (err == OK)
     {
         CPooledTx* pPooledTx = txView.Get(txid);
@@ -628,6 +1267,7 @@ Errno CTxPool::Push(const CTransaction& tx, uint256& hashFork, CDestination& des
         }
         destIn = pPooledTx->destIn;
         nValueIn = pPooledTx->nValueIn;
+        txView.AddTemplateTx(txid);
         StdTrace("CTxPool", "Push success, txid: %s", txid.GetHex().c_str());
     }
     else
@@ -640,15 +1280,30 @@ Errno CTxPool::Push(const CTransaction& tx, uint256& hashFork, CDestination& des
 
 void CTxPool::Pop(const uint256& txid)
 {
-    boost::unique_lock<boost::shared_mutex> wlock(rwAccess);
-    RemoveTx(txid);
+    uint256 hashFork;
+    CTxPoolForkPtr spFork;
+    if (!indexTxFork.Get(txid, hashFork) || (spFork = GetPoolFork(hashFork)) == nullptr)
+    {
+        StdError("CTxPool", "Pop: find fail, txid: %s", txid.GetHex().c_str());
+        return;
+    }
+
+    boost::unique_lock<boost::shared_mutex> wlock(spFork->rwAccess);
+    RemoveTx(*spFork, txid);
 }
 
 bool CTxPool::Get(const uint256& txid, CTransaction& tx) const
 {
-    boost::shared_lock<boost::shared_mutex> rlock(rwAccess);
-    map<uint256, CPooledTx>::const_iterator it = mapTx.find(txid);
-    if (it != mapTx.end())
+    uint256 hashFork;
+    CTxPoolForkPtr spFork;
+    if (!indexTxFork.Get(txid, hashFork) || (spFork = GetPoolFork(hashFork)) == nullptr)
+    {
+        return false;
+    }
+
+    boost::shared_lock<boost::shared_mutex> rlock(spFork->rwAccess);
+    map<uint256, CPooledTx>::const_iterator it = spFork->mapTx.find(txid);
+    if (it != spFork->mapTx.end())
     {
         tx = (*it).second;
         return true;
@@ -658,9 +1313,16 @@ bool CTxPool::Get(const uint256& txid, CTransaction& tx) const
 
 bool CTxPool::Get(const uint256& txid, CAssembledTx& tx) const
 {
-    boost::shared_lock<boost::shared_mutex> rlock(rwAccess);
-    map<uint256, CPooledTx>::const_iterator it = mapTx.find(txid);
-    if (it != mapTx.end())
+    uint256 hashFork;
+    CTxPoolForkPtr spFork;
+    if (!indexTxFork.Get(txid, hashFork) || (spFork = GetPoolFork(hashFork)) == nullptr)
+    {
+        return false;
+    }
+
+    boost::shared_lock<boost::shared_mutex> rlock(spFork->rwAccess);
+    map<uint256, CPooledTx>::const_iterator it = spFork->mapTx.find(txid);
+    if (it != spFork->mapTx.end())
     {
         tx = (*it).second;
         return true;
@@ -670,11 +1332,11 @@ bool CTxPool::Get(const uint256& txid, CAssembledTx& tx) const
 
 void CTxPool::ListTx(const uint256& hashFork, vector<pair<uint256, size_t>>& vTxPool)
 {
-    boost::shared_lock<boost::shared_mutex> rlock(rwAccess);
-    map<uint256, CTxPoolView>::const_iterator it = mapPoolView.find(hashFork);
-    if (it != mapPoolView.end())
+    CTxPoolForkPtr spFork = GetPoolFork(hashFork);
+    if (spFork != nullptr)
     {
-        const CPooledTxLinkSetBySequenceNumber& idxTx = (*it).second.setTxLinkIndex.get<1>();
+        boost::shared_lock<boost::shared_mutex> rlock(spFork->rwAccess);
+        const CPooledTxLinkSetBySequenceNumber& idxTx = spFork->view.setTxLinkIndex.get<1>();
         for (CPooledTxLinkSetBySequenceNumber::iterator mi = idxTx.begin(); mi != idxTx.end(); ++mi)
         {
             vTxPool.push_back(make_pair((*mi).hashTX, (*mi).ptx->nSerializeSize));
@@ -684,11 +1346,11 @@ void CTxPool::ListTx(const uint256& hashFork, vector<pair<uint256, size_t>>& vTx
 
 void CTxPool::ListTx(const uint256& hashFork, vector<uint256>& vTxPool)
 {
-    boost::shared_lock<boost::shared_mutex> rlock(rwAccess);
-    map<uint256, CTxPoolView>::const_iterator it = mapPoolView.find(hashFork);
-    if (it != mapPoolView.end())
+    CTxPoolForkPtr spFork = GetPoolFork(hashFork);
+    if (spFork != nullptr)
     {
-        const CPooledTxLinkSetBySequenceNumber& idxTx = (*it).second.setTxLinkIndex.get<1>();
+        boost::shared_lock<boost::shared_mutex> rlock(spFork->rwAccess);
+        const CPooledTxLinkSetBySequenceNumber& idxTx = spFork->view.setTxLinkIndex.get<1>();
         for (CPooledTxLinkSetBySequenceNumber::const_iterator mi = idxTx.begin(); mi != idxTx.end(); ++mi)
         {
             vTxPool.push_back((*mi).hashTX);
@@ -698,12 +1360,11 @@ void CTxPool::ListTx(const uint256& hashFork, vector<uint256>& vTxPool)
 
 bool CTxPool::ListForkUnspent(const uint256& hashFork, const CDestination& dest, uint32 nMax, const std::vector<CTxUnspent>& vUnspentOnChain, std::vector<CTxUnspent>& vUnspent)
 {
-    boost::shared_lock<boost::shared_mutex> rlock(rwAccess);
-    map<uint256, CTxPoolView>::const_iterator it = mapPoolView.find(hashFork);
-    if (it != mapPoolView.end())
+    CTxPoolForkPtr spFork = GetPoolFork(hashFork);
+    if (spFork != nullptr)
     {
-        const CTxPoolView& txPoolView = it->second;
-        ListUnspent(txPoolView, dest, nMax, vUnspentOnChain, vUnspent);
+        boost::shared_lock<boost::shared_mutex> rlock(spFork->rwAccess);
+        ListUnspent(spFork->view, dest, nMax, vUnspentOnChain, vUnspent);
         return true;
     }
 
@@ -712,11 +1373,11 @@ bool CTxPool::ListForkUnspent(const uint256& hashFork, const CDestination& dest,
 
 bool CTxPool::ListForkUnspentBatch(const uint256& hashFork, uint32 nMax, const std::map<CDestination, std::vector<CTxUnspent>>& mapUnspentOnChain, std::map<CDestination, std::vector<CTxUnspent>>& mapUnspent)
 {
-    boost::shared_lock<boost::shared_mutex> rlock(rwAccess);
-    map<uint256, CTxPoolView>::const_iterator it = mapPoolView.find(hashFork);
-    if (it != mapPoolView.end())
+    CTxPoolForkPtr spFork = GetPoolFork(hashFork);
+    if (spFork != nullptr)
     {
-        const CTxPoolView& txPoolView = it->second;
+        boost::shared_lock<boost::shared_mutex> rlock(spFork->rwAccess);
+        const CTxPoolView& txPoolView = spFork->view;
         for (const auto& kv : mapUnspentOnChain)
         {
             const CDestination& dest = kv.first;
@@ -759,15 +1420,14 @@ void CTxPool::ListUnspent(const CTxPoolView& txPoolView, const CDestination& des
 
 bool CTxPool::FilterTx(const uint256& hashFork, CTxFilter& filter)
 {
-    boost::shared_lock<boost::shared_mutex> rlock(rwAccess);
-
-    map<uint256, CTxPoolView>::const_iterator it = mapPoolView.find(hashFork);
-    if (it == mapPoolView.end())
+    CTxPoolForkPtr spFork = GetPoolFork(hashFork);
+    if (spFork == nullptr)
     {
         return true;
     }
 
-    const CPooledTxLinkSetByTxHash& idxTx = (*it).second.setTxLinkIndex.get<0>();
+    boost::shared_lock<boost::shared_mutex> rlock(spFork->rwAccess);
+    const CPooledTxLinkSetByTxHash& idxTx = spFork->view.setTxLinkIndex.get<0>();
     for (CPooledTxLinkSetByTxHash::const_iterator mi = idxTx.begin(); mi != idxTx.end(); ++mi)
     {
         if ((*mi).ptx && (filter.setDest.count((*mi).ptx->sendTo) || filter.setDest.count((*mi).ptx->destIn)))
@@ -783,18 +1443,47 @@ bool CTxPool::FilterTx(const uint256& hashFork, CTxFilter& filter)
     return true;
 }
 
+bool CTxPool::FetchCmpctTx(const uint256& hashFork, const uint256& hashSalt, const map<uint64, uint32>& mapShortTxId,
+                           vector<CTransaction>& vtx, vector<bool>& vFilled)
+{
+    CTxPoolForkPtr spFork = GetPoolFork(hashFork);
+    if (spFork == nullptr)
+    {
+        return true;
+    }
+
+    // one pass over the pool under the fork read lock, the SipHash short ids are cheap to compute per tx
+    size_t nFilled = count(vFilled.begin(), vFilled.end(), true);
+    boost::shared_lock<boost::shared_mutex> rlock(spFork->rwAccess);
+    for (map<uint256, CPooledTx>::const_iterator it = spFork->mapTx.begin(); it != spFork->mapTx.end() && nFilled < vFilled.size(); ++it)
+    {
+        map<uint64, uint32>::const_iterator mi = mapShortTxId.find(network::CCmpctBlock::GetShortTxId(hashSalt, (*it).first));
+        if (mi != mapShortTxId.end())
+        {
+            if (vFilled[(*mi).second])
+            {
+                return false;
+            }
+            vtx[(*mi).second] = (*it).second;
+            vFilled[(*mi).second] = true;
+            nFilled++;
+        }
+    }
+    return true;
+}
+
 bool CTxPool::ArrangeBlockTx(const uint256& hashFork, const uint256& hashPrev, int64 nBlockTime, size_t nMaxSize,
                              vector<CTransaction>& vtx, int64& nTotalTxFee)
 {
-    boost::shared_lock<boost::shared_mutex> rlock(rwAccess);
-
-    auto it = mapTxCache.find(hashFork);
-    if (it == mapTxCache.end())
+    CTxPoolForkPtr spFork = GetPoolFork(hashFork);
+    if (spFork == nullptr)
     {
         StdError("CTxPool", "ArrangeBlockTx: find hashFork failed");
         return false;
     }
-    CTxCache& cache = it->second;
+
+    boost::shared_lock<boost::shared_mutex> rlock(spFork->rwAccess);
+    const CTxCache& cache = spFork->cache;
 
     std::vector<CTransaction> vCacheTx;
     if (!cache.Retrieve(hashPrev, vCacheTx))
@@ -803,11 +1492,10 @@ bool CTxPool::ArrangeBlockTx(const uint256& hashFork, const uint256& hashPrev, i
         return false;
     }
 
-    const CTxPoolView& viewTx = mapPoolView[hashFork];
+    const CTxPoolView& viewTx = spFork->view;
     if (hashPrev == viewTx.hashLastBlock)
     {
-        ArrangeBlockTx(hashFork, nBlockTime /*viewTx.nLastBlockTime*/, viewTx.hashLastBlock, nMaxSize, vtx, nTotalTxFee, CBlock::GetBlockHeightByHash(viewTx.hashLastBlock) + 1);
-        //cache.AddNew(viewTx.hashLastBlock, vtx);
+        viewTx.GetTemplateTx(nBlockTime, nMaxSize, vtx, nTotalTxFee);
         StdDebug("CTxPool", "ArrangeBlockTx: hashPrev is last block, target height: %d, new vtx size: %ld, old vtx size: %ld, view tx count: %ld",
                  CBlock::GetBlockHeightByHash(viewTx.hashLastBlock) + 1, vtx.size(), vCacheTx.size(), viewTx.Count());
     }
@@ -831,9 +1519,9 @@ bool CTxPool::ArrangeBlockTx(const uint256& hashFork, const uint256& hashPrev, i
     return true;
 }
 
-void CTxPool::ArrangeBlockTx(const uint256& hashFork, int64 nBlockTime, const uint256& hashBlock, std::size_t nMaxSize,
-                             std::vector<CTransaction>& vtx, int64& nTotalTxFee, int nHeight)
+void CTxPool::ArrangeTemplate(CTxPoolFork& fork, const uint256& hashFork, const uint256& hashBlock, int nHeight, bool fRearrange)
 {
+    CTxPoolView& txView = fork.view;
     map<CDestination, int> mapVoteCert;
     std::map<CDestination, int64> mapVote;
     int64 nMinEnrollAmount = 0;
@@ -841,43 +1529,56 @@ void CTxPool::ArrangeBlockTx(const uint256& hashFork, int64 nBlockTime, const ui
     {
         if (!pBlockChain->GetDelegateCertTxCount(hashBlock, mapVoteCert))
         {
-            StdError("CTxPool", "ArrangeBlockTx: GetDelegateCertTxCount fail");
+            StdError("CTxPool", "ArrangeTemplate: GetDelegateCertTxCount fail");
+            txView.ClearTemplate();
             return;
         }
 
         if (!pBlockChain->GetBlockDelegateVote(hashBlock, mapVote))
         {
-            StdError("CTxPool", "ArrangeBlockTx: GetBlockDelegateVote fail");
+            StdError("CTxPool", "ArrangeTemplate: GetBlockDelegateVote fail");
+            txView.ClearTemplate();
             return;
         }
 
         nMinEnrollAmount = pBlockChain->GetDelegateMinEnrollAmount(hashBlock);
         if (nMinEnrollAmount < 0)
         {
-            StdError("CTxPool", "ArrangeBlockTx: GetDelegateMinEnrollAmount fail");
+            StdError("CTxPool", "ArrangeTemplate: GetDelegateMinEnrollAmount fail");
+            txView.ClearTemplate();
             return;
         }
     }
 
-    mapPoolView[hashFork].ArrangeBlockTx(vtx, nTotalTxFee, nBlockTime, nMaxSize, mapVoteCert, mapVote, nMinEnrollAmount, pCoreProtocol->IsDposHeight(nHeight));
+    if (fRearrange)
+    {
+        txView.ArrangeTemplate(mapVoteCert, mapVote, nMinEnrollAmount, pCoreProtocol->IsDposHeight(nHeight));
+    }
+    else
+    {
+        txView.UpdateTemplate(mapVoteCert, mapVote, nMinEnrollAmount, pCoreProtocol->IsDposHeight(nHeight));
+    }
 }
 
 bool CTxPool::FetchInputs(const uint256& hashFork, const CTransaction& tx, vector<CTxOut>& vUnspent)
 {
-    boost::shared_lock<boost::shared_mutex> rlock(rwAccess);
-    CTxPoolView& txView = mapPoolView[hashFork];
-
     vUnspent.resize(tx.vInput.size());
 
-    for (std::size_t i = 0; i < tx.vInput.size(); i++)
+    CTxPoolForkPtr spFork = GetPoolFork(hashFork);
+    if (spFork != nullptr)
     {
-        if (txView.IsSpent(tx.vInput[i].prevout))
+        boost::shared_lock<boost::shared_mutex> rlock(spFork->rwAccess);
+        const CTxPoolView& txView = spFork->view;
+        for (std::size_t i = 0; i < tx.vInput.size(); i++)
         {
-            StdError("CTxPool", "FetchInputs: prevout is spent, txid: %s, prevout: [%d]:%s",
-                     tx.GetHash().GetHex().c_str(), tx.vInput[i].prevout.n, tx.vInput[i].prevout.hash.GetHex().c_str());
-            return false;
+            if (txView.IsSpent(tx.vInput[i].prevout))
+            {
+                StdError("CTxPool", "FetchInputs: prevout is spent, txid: %s, prevout: [%d]:%s",
+                         tx.GetHash().GetHex().c_str(), tx.vInput[i].prevout.n, tx.vInput[i].prevout.hash.GetHex().c_str());
+                return false;
+            }
+            txView.GetUnspent(tx.vInput[i].prevout, vUnspent[i]);
         }
-        txView.GetUnspent(tx.vInput[i].prevout, vUnspent[i]);
     }
 
     if (!pBlockChain->GetTxUnspent(hashFork, tx.vInput, vUnspent))
@@ -915,10 +1616,11 @@ bool CTxPool::SynchronizeBlockChain(const CBlockChainUpdate& update, CTxSetChang
 {
     change.hashFork = update.hashFork;
 
-    boost::unique_lock<boost::shared_mutex> wlock(rwAccess);
+    CTxPoolForkPtr spFork = GetOrCreatePoolFork(update.hashFork);
+    boost::unique_lock<boost::shared_mutex> wlock(spFork->rwAccess);
 
     CTxPoolView viewInvolvedTx;
-    CTxPoolView& txView = mapPoolView[update.hashFork];
+    CTxPoolView& txView = spFork->view;
 
     for (const CBlockEx& block : boost::adaptors::reverse(update.vBlockAddNew))
     {
@@ -937,11 +1639,7 @@ bool CTxPool::SynchronizeBlockChain(const CBlockChainUpdate& update, CTxSetChang
                 if (txView.Exists(txid))
                 {
                     txView.Remove(txid);
-                    if (tx.nType == CTransaction::TX_CERT)
-                    {
-                        certTxDest.RemoveCertTx(tx.sendTo, txid);
-                    }
-                    mapTx.erase(txid);
+                    ErasePooledTx(*spFork, txid);
                     change.mapTxUpdate.insert(make_pair(txid, nBlockHeight));
                 }
                 else
@@ -973,7 +1671,7 @@ bool CTxPool::SynchronizeBlockChain(const CBlockChainUpdate& update, CTxSetChang
 
                 txView.GetSpent(CTxOutPoint(txid, 0), spent0);
                 txView.GetSpent(CTxOutPoint(txid, 1), spent1);
-                if (AddNew(txView, txid, tx, update.hashFork, update.nLastBlockHeight) == OK)
+                if (AddNew(*spFork, txid, tx, update.hashFork, update.nLastBlockHeight) == OK)
                 {
                     if (spent0 != 0)
                         txView.SetSpent(CTxOutPoint(txid, 0), spent0);
@@ -1004,46 +1702,36 @@ bool CTxPool::SynchronizeBlockChain(const CBlockChainUpdate& update, CTxSetChang
     change.vTxRemove.reserve(idxInvolvedTx.size() + vTxRemove.size());
     for (const auto& txseq : boost::adaptors::reverse(idxInvolvedTx))
     {
-        map<uint256, CPooledTx>::iterator it = mapTx.find(txseq.hashTX);
-        if (it != mapTx.end())
+        map<uint256, CPooledTx>::iterator it = spFork->mapTx.find(txseq.hashTX);
+        if (it != spFork->mapTx.end())
         {
             change.vTxRemove.push_back(make_pair(txseq.hashTX, (*it).second.vInput));
-            if (it->second.nType == CTransaction::TX_CERT)
-            {
-                certTxDest.RemoveCertTx(it->second.sendTo, txseq.hashTX);
-            }
-            mapTx.erase(it);
+            ErasePooledTx(*spFork, txseq.hashTX);
         }
     }
     change.vTxRemove.insert(change.vTxRemove.end(), vTxRemove.rbegin(), vTxRemove.rend());
 
     // ArrangeBlockTx to cache
-    if (mapTxCache.find(update.hashFork) == mapTxCache.end())
-    {
-        mapTxCache.insert(std::make_pair(update.hashFork, CTxCache(CACHE_HEIGHT_INTERVAL)));
-    }
-
     std::vector<CTransaction> vtx;
     int64 nTotalFee = 0;
-    ArrangeBlockTx(update.hashFork, update.nLastBlockTime, update.hashLastBlock, MAX_BLOCK_SIZE, vtx, nTotalFee, update.nLastBlockHeight + 1);
+    ArrangeTemplate(*spFork, update.hashFork, update.hashLastBlock, update.nLastBlockHeight + 1, false);
+    txView.GetTemplateTx(update.nLastBlockTime, MAX_BLOCK_SIZE, vtx, nTotalFee);
 
-    auto& cache = mapTxCache[update.hashFork];
-    cache.AddNew(update.hashLastBlock, vtx);
+    spFork->cache.AddNew(update.hashLastBlock, vtx);
 
-    mapPoolView[update.hashFork].SetLastBlock(update.hashLastBlock, update.nLastBlockTime);
+    txView.SetLastBlock(update.hashLastBlock, update.nLastBlockTime);
 
     return true;
 }
 
 void CTxPool::AddDestDelegate(const CDestination& destDeleage)
 {
+    boost::unique_lock<boost::mutex> lock(mtxCertTx);
     certTxDest.AddDelegate(destDeleage);
 }
 
 bool CTxPool::LoadData()
 {
-    boost::unique_lock<boost::shared_mutex> wlock(rwAccess);
-
     vector<pair<uint256, pair<uint256, CAssembledTx>>> vTx;
     if (!datTxPool.Load(vTx))
     {
@@ -1057,11 +1745,16 @@ bool CTxPool::LoadData()
         const uint256& txid = vTx[i].second.first;
         const CAssembledTx& tx = vTx[i].second.second;
 
-        map<uint256, CPooledTx>::iterator mi = mapTx.insert(make_pair(txid, CPooledTx(tx, GetSequenceNumber()))).first;
-        mapPoolView[hashFork].AddNew(txid, (*mi).second);
+        CTxPoolForkPtr spFork = GetOrCreatePoolFork(hashFork);
+        boost::unique_lock<boost::shared_mutex> wlock(spFork->rwAccess);
+        map<uint256, CPooledTx>::iterator mi = spFork->mapTx.insert(make_pair(txid, CPooledTx(tx, GetSequenceNumber()))).first;
+        (*mi).second.UpdateHash();
+        spFork->view.AddNew(txid, (*mi).second);
+        indexTxFork.Insert(txid, hashFork);
 
         if (tx.nType == CTransaction::TX_CERT)
         {
+            boost::unique_lock<boost::mutex> lock(mtxCertTx);
             certTxDest.AddCertTx(tx.sendTo, txid);
         }
     }
@@ -1072,7 +1765,6 @@ bool CTxPool::LoadData()
     for (const auto& kv : mapForkStatus)
     {
         const uint256& hashFork = kv.first;
-        mapTxCache.insert(make_pair(hashFork, CTxCache(CACHE_HEIGHT_INTERVAL)));
 
         uint256 hashBlock;
         int nHeight = 0;
@@ -1083,24 +1775,33 @@ bool CTxPool::LoadData()
             return false;
         }
 
+        CTxPoolForkPtr spFork = GetOrCreatePoolFork(hashFork);
+        boost::unique_lock<boost::shared_mutex> wlock(spFork->rwAccess);
+
         std::vector<CTransaction> vtx;
         int64 nTotalFee = 0;
-        ArrangeBlockTx(hashFork, nTime, hashBlock, MAX_BLOCK_SIZE, vtx, nTotalFee, nHeight + 1);
-        mapTxCache[hashFork].AddNew(hashBlock, vtx);
+        ArrangeTemplate(*spFork, hashFork, hashBlock, nHeight + 1, true);
+        spFork->view.GetTemplateTx(nTime, MAX_BLOCK_SIZE, vtx, nTotalFee);
+        spFork->cache.AddNew(hashBlock, vtx);
 
-        mapPoolView[hashFork].SetLastBlock(hashBlock, nTime);
+        spFork->view.SetLastBlock(hashBlock, nTime);
     }
     return true;
 }
 
 bool CTxPool::SaveData()
 {
-    boost::shared_lock<boost::shared_mutex> rlock(rwAccess);
+    map<uint256, CTxPoolForkPtr> mapFork;
+    {
+        boost::shared_lock<boost::shared_mutex> rlock(rwAccess);
+        mapFork = mapPoolFork;
+    }
 
     map<size_t, pair<uint256, pair<uint256, CAssembledTx>>> mapSortTx;
-    for (map<uint256, CTxPoolView>::iterator it = mapPoolView.begin(); it != mapPoolView.end(); ++it)
+    for (map<uint256, CTxPoolForkPtr>::iterator it = mapFork.begin(); it != mapFork.end(); ++it)
     {
-        CPooledTxLinkSetByTxHash& idxTx = (*it).second.setTxLinkIndex.get<0>();
+        boost::shared_lock<boost::shared_mutex> rlock((*it).second->rwAccess);
+        CPooledTxLinkSetByTxHash& idxTx = (*it).second->view.setTxLinkIndex.get<0>();
         for (CPooledTxLinkSetByTxHash::iterator mi = idxTx.begin(); mi != idxTx.end(); ++mi)
         {
             mapSortTx[(*mi).nSequenceNumber] = make_pair((*it).first, make_pair((*mi).hashTX, static_cast<CAssembledTx&>(*(*mi).ptx)));
@@ -1118,17 +1819,60 @@ bool CTxPool::SaveData()
     return datTxPool.Save(vTx);
 }
 
-Errno CTxPool::AddNew(CTxPoolView& txView, const uint256& txid, const CTransaction& tx, const uint256& hashFork, int nForkHeight)
+CTxPoolForkPtr CTxPool::GetPoolFork(const uint256& hashFork) const
 {
-    if (tx.nType == CTransaction::TX_CERT)
+    boost::shared_lock<boost::shared_mutex> rlock(rwAccess);
+    map<uint256, CTxPoolForkPtr>::const_iterator it = mapPoolFork.find(hashFork);
+    if (it == mapPoolFork.end())
     {
-        uint256 txidRemove;
-        if (certTxDest.GetTimeoutCertTx(tx.sendTo, txidRemove))
+        return nullptr;
+    }
+    return it->second;
+}
+
+CTxPoolForkPtr CTxPool::GetOrCreatePoolFork(const uint256& hashFork)
+{
+    CTxPoolForkPtr spFork = GetPoolFork(hashFork);
+    if (spFork == nullptr)
+    {
+        boost::unique_lock<boost::shared_mutex> wlock(rwAccess);
+        CTxPoolForkPtr& spNewFork = mapPoolFork[hashFork];
+        if (spNewFork == nullptr)
         {
-            RemoveTx(txidRemove);
+            spNewFork = std::make_shared<CTxPoolFork>();
         }
+        spFork = spNewFork;
     }
+    return spFork;
+}
+
+bool CTxPool::GetPushFork(const CTransaction& tx, uint256& hashFork)
+{
+    int nAnchorHeight;
+    if (!pBlockChain->GetBlockLocation(tx.hashAnchor, hashFork, nAnchorHeight))
+    {
+        StdError("CTxPool", "Push: GetBlockLocation fail, txid: %s, hashAnchor: %s",
+                 tx.GetHash().GetHex().c_str(), tx.hashAnchor.GetHex().c_str());
+        return false;
+    }
+    return true;
+}
+
+bool CTxPool::GetPushHeight(const uint256& hashFork, uint256& hashLast, int& nHeight)
+{
+    int64 nTime;
+    uint16 nMintType;
+    if (!pBlockChain->GetLastBlock(hashFork, hashLast, nHeight, nTime, nMintType))
+    {
+        StdError("CTxPool", "Push: GetLastBlock fail, hashFork: %s", hashFork.GetHex().c_str());
+        return false;
+    }
+    return true;
+}
 
+Errno CTxPool::VerifyPooledTx(const CTxPoolView& txView, const uint256& txid, const CTransaction& tx, const uint256& hashFork, int nForkHeight,
+                              CDestination& destIn, int64& nValueIn)
+{
     vector<CTxOut> vPrevOutput;
     vPrevOutput.resize(tx.vInput.size());
     for (int i = 0; i < tx.vInput.size(); i++)
@@ -1149,7 +1893,7 @@ Errno CTxPool::AddNew(CTxPoolView& txView, const uint256& txid, const CTransacti
         return ERR_SYS_STORAGE_ERROR;
     }
 
-    int64 nValueIn = 0;
+    nValueIn = 0;
     for (int i = 0; i < tx.vInput.size(); i++)
     {
         if (vPrevOutput[i].IsNull())
@@ -1168,8 +1912,37 @@ Errno CTxPool::AddNew(CTxPoolView& txView, const uint256& txid, const CTransacti
         return err;
     }
 
+    destIn = vPrevOutput[0].destTo;
+    return OK;
+}
+
+Errno CTxPool::AddNew(CTxPoolFork& fork, const uint256& txid, const CTransaction& tx, const uint256& hashFork, int nForkHeight)
+{
+    if (tx.nType == CTransaction::TX_CERT)
+    {
+        uint256 txidRemove;
+        bool fTimeout = false;
+        {
+            boost::unique_lock<boost::mutex> lock(mtxCertTx);
+            fTimeout = certTxDest.GetTimeoutCertTx(tx.sendTo, txidRemove);
+        }
+        if (fTimeout)
+        {
+            RemoveTx(fork, txidRemove);
+        }
+    }
+
+    CDestination destIn;
+    int64 nValueIn = 0;
+    Errno err = VerifyPooledTx(fork.view, txid, tx, hashFork, nForkHeight, destIn, nValueIn);
+    if (err != OK)
+    {
+        return err;
+    }
+
     if (tx.nType == CTransaction::TX_CERT)
     {
+        boost::unique_lock<boost::mutex> lock(mtxCertTx);
         if (!certTxDest.IsOverMaxCertCount(tx.sendTo))
         {
             StdLog("CTxPool", "AddNew: too many certtx, txid: %s, sendto: %s", txid.GetHex().c_str(), CAddress(tx.sendTo).ToString().c_str());
@@ -1177,39 +1950,32 @@ Errno CTxPool::AddNew(CTxPoolView& txView, const uint256& txid, const CTransacti
         }
     }
 
-    CDestination destIn = vPrevOutput[0].destTo;
-    map<uint256, CPooledTx>::iterator mi = mapTx.insert(make_pair(txid, CPooledTx(tx, -1, GetSequenceNumber(), destIn, nValueIn))).first;
-    if (!txView.AddNew(txid, (*mi).second))
+    map<uint256, CPooledTx>::iterator mi = fork.mapTx.insert(make_pair(txid, CPooledTx(tx, -1, GetSequenceNumber(), destIn, nValueIn))).first;
+    // pooled txs are never changed, their hashes are memoized once here
+    (*mi).second.UpdateHash();
+    if (!fork.view.AddNew(txid, (*mi).second))
     {
         StdTrace("CTxPool", "AddNew: txView AddNew fail, txid: %s", txid.GetHex().c_str());
         return ERR_NOT_FOUND;
     }
+    indexTxFork.Insert(txid, hashFork);
     if (tx.nType == CTransaction::TX_CERT)
     {
+        boost::unique_lock<boost::mutex> lock(mtxCertTx);
         certTxDest.AddCertTx(tx.sendTo, txid);
     }
     return OK;
 }
 
-void CTxPool::RemoveTx(const uint256& txid)
+void CTxPool::RemoveTx(CTxPoolFork& fork, const uint256& txid)
 {
-    map<uint256, CPooledTx>::iterator it = mapTx.find(txid);
-    if (it == mapTx.end())
+    if (!fork.mapTx.count(txid))
     {
         StdError("CTxPool", "RemoveTx: find fail, txid: %s", txid.GetHex().c_str());
         return;
     }
 
-    CPooledTx& tx = (*it).second;
-    uint256 hashFork;
-    int nHeight;
-    if (!pBlockChain->GetBlockLocation(tx.hashAnchor, hashFork, nHeight))
-    {
-        StdError("CTxPool", "RemoveTx: GetBlockLocation fail, txid: %s", txid.GetHex().c_str());
-        return;
-    }
-
-    CTxPoolView& txView = mapPoolView[hashFork];
+    CTxPoolView& txView = fork.view;
     txView.Remove(txid);
 
     CTxPoolView viewInvolvedTx;
@@ -1219,14 +1985,26 @@ void CTxPool::RemoveTx(const uint256& txid)
     const CPooledTxLinkSetBySequenceNumber& idxTx = viewInvolvedTx.setTxLinkIndex.get<1>();
     for (CPooledTxLinkSetBySequenceNumber::const_iterator mi = idxTx.begin(); mi != idxTx.end(); ++mi)
     {
-        if (mi->ptx && mi->ptx->nType == CTransaction::TX_CERT)
-        {
-            certTxDest.RemoveCertTx(mi->ptx->sendTo, mi->hashTX);
-        }
-        mapTx.erase(mi->hashTX);
+        ErasePooledTx(fork, mi->hashTX);
     }
+    ErasePooledTx(fork, txid);
 
     StdTrace("CTxPool", "RemoveTx success, txid: %s", txid.GetHex().c_str());
 }
 
+void CTxPool::ErasePooledTx(CTxPoolFork& fork, const uint256& txid)
+{
+    map<uint256, CPooledTx>::iterator it = fork.mapTx.find(txid);
+    if (it != fork.mapTx.end())
+    {
+        if (it->second.nType == CTransaction::TX_CERT)
+        {
+            boost::unique_lock<boost::mutex> lock(mtxCertTx);
+            certTxDest.RemoveCertTx(it->second.sendTo, txid);
+        }
+        indexTxFork.Erase(txid);
+        fork.mapTx.erase(it);
+    }
+}
+
 } // namespace bigbang
@@ -5,6 +5,9 @@
 #ifndef BIGBANG_TXPOOL_H
 #define BIGBANG_TXPOOL_H
 
+#include <atomic>
+#include <unordered_map>
+
 #include "base.h"
 #include "txpooldata.h"
 #include "util.h"
@@ -23,6 +26,9 @@ public:
     uint64 nSequenceNumber;
     std::size_t nSerializeSize;
     uint64 nNextSequenceNumber;
+    // fee and size of the tx together with its pooled ancestors
+    int64 nPackageTxFee;
+    std::size_t nPackageSize;
 
 public:
     CPooledTx()
@@ -33,11 +39,15 @@ public:
       : CAssembledTx(tx), nSequenceNumber(nSequenceNumberIn), nNextSequenceNumber(0)
     {
         nSerializeSize = xengine::GetSerializeSize(static_cast<const CTransaction&>(tx));
+        nPackageTxFee = nTxFee;
+        nPackageSize = nSerializeSize;
     }
     CPooledTx(const CTransaction& tx, int nBlockHeightIn, uint64 nSequenceNumberIn, const CDestination& destInIn = CDestination(), int64 nValueInIn = 0)
       : CAssembledTx(tx, nBlockHeightIn, destInIn, nValueInIn), nSequenceNumber(nSequenceNumberIn), nNextSequenceNumber(0)
     {
         nSerializeSize = xengine::GetSerializeSize(tx);
+        nPackageTxFee = nTxFee;
+        nPackageSize = nSerializeSize;
     }
     void SetNull() override
     {
@@ -45,6 +55,8 @@ public:
         nSequenceNumber = 0;
         nSerializeSize = 0;
         nNextSequenceNumber = 0;
+        nPackageTxFee = 0;
+        nPackageSize = 0;
     }
 };
 
@@ -52,19 +64,23 @@ class CPooledTxLink
 {
 public:
     CPooledTxLink()
-      : nSequenceNumber(0), ptx(nullptr) {}
+      : nSequenceNumber(0), nPackageTxFee(0), nPackageSize(0), ptx(nullptr) {}
     CPooledTxLink(CPooledTx* ptxin)
       : ptx(ptxin)
     {
         hashTX = ptx->GetHash();
         nSequenceNumber = ptx->nSequenceNumber;
         nType = ptx->nType;
+        nPackageTxFee = ptx->nPackageTxFee;
+        nPackageSize = ptx->nPackageSize;
     }
 
 public:
     uint256 hashTX;
     uint64 nSequenceNumber;
     uint16 nType;
+    int64 nPackageTxFee;
+    std::size_t nPackageSize;
     CPooledTx* ptx;
 };
 
@@ -73,13 +89,16 @@ class ComparePooledTxLinkByTxScore
 public:
     bool operator()(const CPooledTxLink& a, const CPooledTxLink& b) const
     {
-        return GetScore(a) > GetScore(b);
+        int64 nScoreA = GetScore(a);
+        int64 nScoreB = GetScore(b);
+        return (nScoreA > nScoreB || (nScoreA == nScoreB && a.nSequenceNumber < b.nSequenceNumber));
     }
 
 private:
-    double GetScore(const CPooledTxLink& link) const
+    // fee per KB of the ancestor package
+    int64 GetScore(const CPooledTxLink& link) const
     {
-        return (double)((double)link.nType + (double)(1.0f / (double)(link.nSequenceNumber + 1)));
+        return (link.nPackageSize != 0 ? (link.nPackageTxFee << 10) / link.nPackageSize : 0);
     }
 };
 
@@ -87,6 +106,22 @@ struct tx_score
 {
 };
 
+class ComparePooledTxLinkByTxFeeRate
+{
+public:
+    bool operator()(const CPooledTxLink& a, const CPooledTxLink& b) const
+    {
+        int64 nFeeRateA = GetTxFeePerKB(a.ptx);
+        int64 nFeeRateB = GetTxFeePerKB(b.ptx);
+        return (nFeeRateA > nFeeRateB || (nFeeRateA == nFeeRateB && a.nSequenceNumber < b.nSequenceNumber));
+    }
+    // fee per KB of the tx alone
+    static int64 GetTxFeePerKB(const CPooledTx* ptx)
+    {
+        return (ptx->nSerializeSize != 0 ? (ptx->nTxFee << 10) / ptx->nSerializeSize : 0);
+    }
+};
+
 typedef boost::multi_index_container<
     CPooledTxLink,
     boost::multi_index::indexed_by<
@@ -120,6 +155,23 @@ typedef boost::multi_index_container<
 typedef CPooledCertTxLinkSet::nth_index<0>::type CPooledCertTxLinkSetByTxHash;
 typedef CPooledCertTxLinkSet::nth_index<1>::type CPooledCertTxLinkSetBySequenceNumber;
 
+typedef boost::multi_index_container<
+    CPooledTxLink,
+    boost::multi_index::indexed_by<
+        // in arranged order
+        boost::multi_index::sequenced<>,
+        // sorted by Tx ID
+        boost::multi_index::ordered_unique<boost::multi_index::member<CPooledTxLink, uint256, &CPooledTxLink::hashTX>>,
+        // sorted by fee rate of the tx
+        boost::multi_index::ordered_non_unique<boost::multi_index::identity<CPooledTxLink>, ComparePooledTxLinkByTxFeeRate>>>
+
+    CPooledTemplateTxLinkSet;
+typedef CPooledTemplateTxLinkSet::nth_index<0>::type CPooledTemplateTxLinkSetByOrder;
+typedef CPooledTemplateTxLinkSet::nth_index<1>::type CPooledTemplateTxLinkSetByTxHash;
+typedef CPooledTemplateTxLinkSet::nth_index<2>::type CPooledTemplateTxLinkSetByTxFeeRate;
+
+class CTxPoolCandidate;
+
 class CTxPoolView
 {
 public:
@@ -150,6 +202,8 @@ public:
     };
 
 public:
+    CTxPoolView()
+      : nLastBlockTime(0), nTemplateSize(0), fTemplateArranged(false), nTemplateMinEnrollAmount(0), fTemplateDposHeight(false) {}
     std::size_t Count() const
     {
         return setTxLinkIndex.size();
@@ -212,16 +266,21 @@ public:
         CPooledTx* pTx = Get(out.hash);
         if (pTx != nullptr)
         {
-            mapSpent[out].SetUnspent(pTx->GetOutput(out.n));
+            SetOutputUnspent(out, pTx->GetOutput(out.n));
         }
         else
         {
-            mapSpent.erase(out);
+            EraseOutput(out);
         }
     }
     void SetSpent(const CTxOutPoint& out, const uint256& txidNextTxIn)
     {
-        mapSpent[out].SetSpent(txidNextTxIn);
+        SetOutputSpent(out, txidNextTxIn);
+        if (Exists(out.hash) && Exists(txidNextTxIn) && setDirtyPackage.insert(txidNextTxIn).second)
+        {
+            // the next tx has gained pooled ancestors
+            SetDescendantPackageDirty(txidNextTxIn);
+        }
     }
     bool AddTxIndex(const uint256& txid, CPooledTx& tx);
     bool AddNew(const uint256& txid, CPooledTx& tx);
@@ -236,6 +295,9 @@ public:
             }
             xengine::StdTrace("CTxPoolView", "Remove: setTxLinkIndex erase, txid: %s, seq: %ld",
                               txid.GetHex().c_str(), pTx->nSequenceNumber);
+            SetDescendantPackageDirty(txid);
+            setDirtyPackage.erase(txid);
+            RemoveTemplateTx(txid);
             setTxLinkIndex.erase(txid);
         }
     }
@@ -243,6 +305,9 @@ public:
     {
         setTxLinkIndex.clear();
         mapSpent.clear();
+        mapDestUnspent.clear();
+        setDirtyPackage.clear();
+        ClearTemplate();
     }
     void SetLastBlock(const uint256& hash, int64 nTime)
     {
@@ -251,17 +316,20 @@ public:
     }
     void ListUnspent(const CDestination& dest, const std::set<CTxUnspent>& setTxUnspent, uint32 nMax, std::vector<CTxUnspent>& vTxUnspent) const
     {
+        std::map<CDestination, std::set<CTxOutPoint>>::const_iterator it = mapDestUnspent.find(dest);
+        if (it == mapDestUnspent.end())
+        {
+            return;
+        }
         uint32 nCount = 0;
-        for (const auto& kv : mapSpent)
+        for (const CTxOutPoint& outpoint : it->second)
         {
-            const CTxOutPoint& outpoint = kv.first;
-            const CSpent& spent = kv.second;
             CTxOut out;
             if (nMax != 0 && nCount >= nMax)
             {
                 break;
             }
-            if (!spent.IsSpent() && GetUnspent(outpoint, out) && out.destTo == dest)
+            if (GetUnspent(outpoint, out))
             {
                 CTxUnspent txUnSpent(outpoint, out);
                 if (setTxUnspent.count(txUnSpent) == 0)
@@ -275,17 +343,58 @@ public:
     void InvalidateSpent(const CTxOutPoint& out, CTxPoolView& viewInvolvedTx);
     void ArrangeBlockTx(std::vector<CTransaction>& vtx, int64& nTotalTxFee, int64 nBlockTime, std::size_t nMaxSize, std::map<CDestination, int>& mapVoteCert,
                         std::map<CDestination, int64>& mapVote, int64 nMinEnrollAmount, bool fIsDposHeight);
+    // The template holds the candidate txs of the block after hashLastBlock. It is arranged by package
+    // fee rate once at loading, then patched as txs are pushed and removed. A pushed tx that does not
+    // fit evicts template txs paying a lower fee rate. After each block, UpdateTemplate checks what is
+    // left against the limits of the next block and fills the freed space from the pool.
+    void ArrangeTemplate(const std::map<CDestination, int>& mapVoteCert, const std::map<CDestination, int64>& mapVote, int64 nMinEnrollAmount, bool fIsDposHeight);
+    void UpdateTemplate(const std::map<CDestination, int>& mapVoteCert, const std::map<CDestination, int64>& mapVote, int64 nMinEnrollAmount, bool fIsDposHeight);
+    void AddTemplateTx(const uint256& txid);
+    void GetTemplateTx(int64 nBlockTime, std::size_t nMaxSize, std::vector<CTransaction>& vtx, int64& nTotalTxFee) const;
+    void ClearTemplate()
+    {
+        setTemplateTxLink.clear();
+        nTemplateSize = 0;
+        fTemplateArranged = false;
+    }
 
 private:
     void GetAllPrevTxLink(const CPooledTxLink& link, std::vector<CPooledTxLink>& prevLinks, CPooledCertTxLinkSet& setCertTxLink);
-    bool AddArrangeBlockTx(std::vector<CTransaction>& vtx, int64& nTotalTxFee, int64 nBlockTime, std::size_t nMaxSize, std::size_t& nTotalSize,
+    void SetDescendantPackageDirty(const uint256& txid);
+    void UpdatePackage(const uint256& txid);
+    void UpdateDirtyPackage();
+    bool GetArrangePackage(CPooledTx* ptx, const std::set<uint256>& setArranged, const std::set<uint256>& setUnTx,
+                           std::size_t nMaxPackageSize, CTxPoolCandidate& candidate);
+    void ArrangeTx(std::vector<CPooledTx*>& vArrangedTx, int64& nTotalTxFee, std::size_t& nTotalSize, int64 nBlockTime, std::size_t nMaxSize,
+                   std::map<CDestination, int>& mapVoteCert, std::map<CDestination, int64>& mapVote, int64 nMinEnrollAmount, bool fIsDposHeight);
+    bool AddArrangeBlockTx(std::vector<CPooledTx*>& vArrangedTx, int64& nTotalTxFee, int64 nBlockTime, std::size_t nMaxSize, std::size_t& nTotalSize,
                            std::map<CDestination, int>& mapVoteCert, std::set<uint256>& setUnTx, CPooledTx* ptx, std::map<CDestination, int64>& mapVote, int64 nMinEnrollAmount, bool fIsDposHeight);
+    void FillTemplate(std::set<uint256>& setArranged, std::set<uint256>& setUnTx);
+    bool AddTemplatePackage(CPooledTx* ptx, std::set<uint256>& setArranged, std::set<uint256>& setUnTx);
+    void RemoveTemplateTx(const uint256& txid);
+    bool EvictTemplateTx(const CPooledTx* ptx);
+    void SetOutputSpent(const CTxOutPoint& out, const uint256& txidNextTx);
+    void SetOutputUnspent(const CTxOutPoint& out, const CTxOut& output);
+    void EraseOutput(const CTxOutPoint& out);
+    void EraseDestUnspent(const CTxOutPoint& out, const CSpent& spent);
 
 public:
     CPooledTxLinkSet setTxLinkIndex;
     std::map<CTxOutPoint, CSpent> mapSpent;
+    // unspent outputs of mapSpent by destination
+    std::map<CDestination, std::set<CTxOutPoint>> mapDestUnspent;
     uint256 hashLastBlock;
     int64 nLastBlockTime;
+    // txs whose package has lost or gained ancestors, the descendants of a dirty tx are dirty as well
+    std::set<uint256> setDirtyPackage;
+    CPooledTemplateTxLinkSet setTemplateTxLink;
+    std::size_t nTemplateSize;
+    bool fTemplateArranged;
+    // delegate limits of the template block, less what the template has used
+    std::map<CDestination, int> mapTemplateVoteCert;
+    std::map<CDestination, int64> mapTemplateVote;
+    int64 nTemplateMinEnrollAmount;
+    bool fTemplateDposHeight;
 };
 
 class CTxCache
@@ -333,11 +442,12 @@ public:
             }
         }
     }
-    bool Retrieve(const uint256& hash, std::vector<CTransaction>& vtx)
+    bool Retrieve(const uint256& hash, std::vector<CTransaction>& vtx) const
     {
-        if (mapCache.find(hash) != mapCache.end())
+        std::map<uint256, std::vector<CTransaction>>::const_iterator it = mapCache.find(hash);
+        if (it != mapCache.end())
         {
-            vtx = mapCache[hash];
+            vtx = it->second;
             return true;
         }
         return false;
@@ -378,6 +488,63 @@ protected:
     std::map<CDestination, std::map<uint256, int64>> mapCertTxDest;
 };
 
+class CPooledTxForkIndex
+{
+public:
+    enum
+    {
+        SHARD_COUNT = 64
+    };
+
+    bool Insert(const uint256& txid, const uint256& hashFork);
+    bool Get(const uint256& txid, uint256& hashFork) const;
+    bool Exists(const uint256& txid) const;
+    void Erase(const uint256& txid);
+    void Clear();
+
+protected:
+    class CTxIdHash
+    {
+    public:
+        std::size_t operator()(const uint256& txid) const
+        {
+            return txid.Get64(1);
+        }
+    };
+    class CShard
+    {
+    public:
+        mutable boost::shared_mutex rwAccess;
+        std::unordered_map<uint256, uint256, CTxIdHash> mapFork;
+    };
+    CShard& GetShard(const uint256& txid)
+    {
+        return vShard[txid.Get32(0) % SHARD_COUNT];
+    }
+    const CShard& GetShard(const uint256& txid) const
+    {
+        return vShard[txid.Get32(0) % SHARD_COUNT];
+    }
+
+protected:
+    CShard vShard[SHARD_COUNT];
+};
+
+class CTxPoolFork
+{
+public:
+    CTxPoolFork()
+      : cache(CACHE_HEIGHT_INTERVAL) {}
+
+public:
+    mutable boost::shared_mutex rwAccess;
+    CTxPoolView view;
+    std::map<uint256, CPooledTx> mapTx;
+    CTxCache cache;
+};
+
+typedef std::shared_ptr<CTxPoolFork> CTxPoolForkPtr;
+
 class CTxPool : public ITxPool
 {
 public:
@@ -395,6 +562,8 @@ public:
     bool ListForkUnspent(const uint256& hashFork, const CDestination& dest, uint32 nMax, const std::vector<CTxUnspent>& vUnspentOnChain, std::vector<CTxUnspent>& vUnspent) override;
     bool ListForkUnspentBatch(const uint256& hashFork, uint32 nMax, const std::map<CDestination, std::vector<CTxUnspent>>& mapUnspentOnChain, std::map<CDestination, std::vector<CTxUnspent>>& mapUnspent) override;
     bool FilterTx(const uint256& hashFork, CTxFilter& filter) override;
+    bool FetchCmpctTx(const uint256& hashFork, const uint256& hashSalt, const std::map<uint64, uint32>& mapShortTxId,
+                      std::vector<CTransaction>& vtx, std::vector<bool>& vFilled) override;
     bool ArrangeBlockTx(const uint256& hashFork, const uint256& hashPrev, int64 nBlockTime, std::size_t nMaxSize,
                         std::vector<CTransaction>& vtx, int64& nTotalTxFee) override;
     bool FetchInputs(const uint256& hashFork, const CTransaction& tx, std::vector<CTxOut>& vUnspent) override;
@@ -408,30 +577,33 @@ protected:
     void HandleHalt() override;
     bool LoadData();
     bool SaveData();
-    Errno AddNew(CTxPoolView& txView, const uint256& txid, const CTransaction& tx, const uint256& hashFork, int nForkHeight);
-    void RemoveTx(const uint256& txid);
+    CTxPoolForkPtr GetPoolFork(const uint256& hashFork) const;
+    CTxPoolForkPtr GetOrCreatePoolFork(const uint256& hashFork);
+    virtual bool GetPushFork(const CTransaction& tx, uint256& hashFork);
+    virtual bool GetPushHeight(const uint256& hashFork, uint256& hashLast, int& nHeight);
+    virtual Errno VerifyPooledTx(const CTxPoolView& txView, const uint256& txid, const CTransaction& tx, const uint256& hashFork, int nForkHeight,
+                                 CDestination& destIn, int64& nValueIn);
+    Errno AddNew(CTxPoolFork& fork, const uint256& txid, const CTransaction& tx, const uint256& hashFork, int nForkHeight);
+    void RemoveTx(CTxPoolFork& fork, const uint256& txid);
+    void ErasePooledTx(CTxPoolFork& fork, const uint256& txid);
     uint64 GetSequenceNumber()
     {
-        if (mapTx.empty())
-        {
-            nLastSequenceNumber = 0;
-        }
         return ((++nLastSequenceNumber) << 24);
     }
-    void ArrangeBlockTx(const uint256& hashFork, int64 nBlockTime, const uint256& hashBlock, std::size_t nMaxSize,
-                        std::vector<CTransaction>& vtx, int64& nTotalTxFee, int nHeight);
+    void ArrangeTemplate(CTxPoolFork& fork, const uint256& hashFork, const uint256& hashBlock, int nHeight, bool fRearrange);
 
     void ListUnspent(const CTxPoolView& txPoolView, const CDestination& dest, uint32 nMax, const std::vector<CTxUnspent>& vUnspentOnChain, std::vector<CTxUnspent>& vUnspent);
 
 protected:
     storage::CTxPoolData datTxPool;
+    // guards mapPoolFork, the txs, view and cache of a fork are guarded by the lock of the fork
     mutable boost::shared_mutex rwAccess;
     ICoreProtocol* pCoreProtocol;
     IBlockChain* pBlockChain;
-    std::map<uint256, CTxPoolView> mapPoolView;
-    std::map<uint256, CPooledTx> mapTx;
-    uint64 nLastSequenceNumber;
-    std::map<uint256, CTxCache> mapTxCache;
+    std::map<uint256, CTxPoolForkPtr> mapPoolFork;
+    CPooledTxForkIndex indexTxFork;
+    std::atomic<uint64> nLastSequenceNumber;
+    boost::mutex mtxCertTx;
     CCertTxDestCache certTxDest;
 };
 
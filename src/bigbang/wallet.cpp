@@ -19,6 +19,7 @@ namespace bigbang
 {
 
 #define MAX_TXIN_SELECTIONS 128
+#define RESYNC_CATCHUP_SLACK 16
 //#define MAX_SIGNATURE_SIZE 2048
 
 //////////////////////////////
@@ -101,6 +102,34 @@ class CWalletTxFilter : public CTxFilter
     CWallet* pWallet;
 };
 
+//////////////////////////////
+// CWalletResyncFilter
+
+// Collects the wallet txs of the chain aside, the wallet is left as it is until they are swapped in
+class CWalletResyncFilter : public CTxFilter
+{
+public:
+    CWalletResyncFilter(CWallet* pWalletIn, const set<CDestination>& setDestIn)
+      : CTxFilter(setDestIn), pWallet(pWalletIn)
+    {
+    }
+    bool FoundTx(const uint256& hashFork, const CAssembledTx& tx) override
+    {
+        mapForkTx[hashFork].push_back(tx);
+        nTxFound++;
+        return true;
+    }
+    bool ScanProgress(const uint256& hashFork, int nHeight, int nLastHeight) override
+    {
+        return pWallet->UpdateResyncProgress(hashFork, nHeight, nLastHeight, nTxFound);
+    }
+
+public:
+    CWallet* pWallet;
+    std::size_t nTxFound = 0;
+    std::map<uint256, std::vector<CAssembledTx>> mapForkTx;
+};
+
 //////////////////////////////
 // CInspectWtxFilter
 
@@ -152,6 +181,12 @@ CWallet::CWallet()
     pCoreProtocol = nullptr;
     pBlockChain = nullptr;
     pTxPool = nullptr;
+    fResyncRunning = false;
+    fResyncCancel = false;
+    fResyncIncomplete = false;
+    nResyncHeight = 0;
+    nResyncLastHeight = 0;
+    nResyncTxCount = 0;
 }
 
 CWallet::~CWallet()
@@ -202,6 +237,13 @@ bool CWallet::HandleInvoke()
         return false;
     }
 
+    if (dbWallet.IsResyncIncomplete())
+    {
+        boost::unique_lock<boost::mutex> lock(mtxResync);
+        fResyncIncomplete = true;
+        Warn("The last wallet resync did not finish, wallet tx is incomplete until the next resyncwallet");
+    }
+
     /*if (!InspectWalletTx(StorageConfig()->nCheckDepth))
     {
         Log("Failed to inspect wallet transactions");
@@ -622,6 +664,7 @@ bool CWallet::SignTransaction(const CDestination& destIn, CTransaction& tx, cons
                     votes.push_back(d.second);
                 }
                 tx.sendTo = votes[n];
+                tx.ResetHash();
             }
         }
         else
@@ -691,11 +734,13 @@ bool CWallet::SignTransaction(const CDestination& destIn, CTransaction& tx, cons
     {
         tx.vchSig = move(vchSig);
     }
+    tx.ResetHash();
     return true;
 }
 
 bool CWallet::ArrangeInputs(const CDestination& destIn, const uint256& hashFork, int nForkHeight, CTransaction& tx)
 {
+    tx.ResetHash();
     tx.vInput.clear();
     //int nMaxInput = (MAX_TX_SIZE - MAX_SIGNATURE_SIZE - 4) / 33;
     int64 nTargetValue = tx.nAmount + tx.nTxFee;
@@ -908,18 +953,14 @@ bool CWallet::AddNewFork(const uint256& hashFork, const uint256& hashParent, int
 
 bool CWallet::ResynchronizeWalletTx()
 {
-    boost::unique_lock<boost::shared_mutex> wlock(rwWalletTx);
-
-    if (!ClearTx())
+    if (!SetResyncRunning(true))
     {
+        StdLog("CWallet", "ResynchronizeWalletTx: Resync is running.");
         return false;
     }
-    set<CDestination> setDest;
-    GetDestinations(setDest);
-
-    CWalletTxFilter txFilter(this, setDest);
-
-    return SyncWalletTx(txFilter);
+    bool fRet = ResyncWalletTx();
+    SetResyncRunning(false);
+    return fRet;
 }
 
 bool CWallet::SynchronizeWalletTx(const CDestination& destNew)
@@ -931,9 +972,190 @@ bool CWallet::SynchronizeWalletTx(const CDestination& destNew)
     return SyncWalletTx(txFilter);
 }
 
-bool CWallet::SyncWalletTx(CTxFilter& txFilter)
+bool CWallet::GetResyncProgress(uint256& hashFork, int& nHeight, int& nLastHeight, size_t& nTxCount, bool& fIncomplete)
+{
+    boost::unique_lock<boost::mutex> lock(mtxResync);
+    hashFork = hashResyncFork;
+    nHeight = nResyncHeight;
+    nLastHeight = nResyncLastHeight;
+    nTxCount = nResyncTxCount;
+    fIncomplete = fResyncIncomplete;
+    return fResyncRunning;
+}
+
+bool CWallet::CancelResync()
 {
+    boost::unique_lock<boost::mutex> lock(mtxResync);
+    if (!fResyncRunning)
+    {
+        return false;
+    }
+    fResyncCancel = true;
+    return true;
+}
+
+bool CWallet::UpdateResyncProgress(const uint256& hashFork, int nHeight, int nLastHeight, size_t nTxFound)
+{
+    boost::unique_lock<boost::mutex> lock(mtxResync);
+    hashResyncFork = hashFork;
+    nResyncHeight = nHeight;
+    nResyncLastHeight = nLastHeight;
+    nResyncTxCount = nTxFound;
+    return !fResyncCancel;
+}
+
+bool CWallet::SetResyncRunning(bool fRunning)
+{
+    boost::unique_lock<boost::mutex> lock(mtxResync);
+    if (fRunning)
+    {
+        if (fResyncRunning)
+        {
+            return false;
+        }
+        hashResyncFork = 0;
+        nResyncHeight = 0;
+        nResyncLastHeight = 0;
+        nResyncTxCount = 0;
+    }
+    fResyncRunning = fRunning;
+    fResyncCancel = false;
+    return true;
+}
+
+bool CWallet::SetResyncIncomplete(bool fIncomplete)
+{
+    if (!dbWallet.SetResyncIncomplete(fIncomplete))
+    {
+        return false;
+    }
+    boost::unique_lock<boost::mutex> lock(mtxResync);
+    fResyncIncomplete = fIncomplete;
+    return true;
+}
+
+bool CWallet::ResyncWalletTx()
+{
+    set<CDestination> setDest;
+    GetDestinations(setDest);
+
     vector<uint256> vFork;
+    {
+        boost::shared_lock<boost::shared_mutex> rlock(rwWalletTx);
+        if (!ListSyncFork(vFork))
+        {
+            return false;
+        }
+    }
+
+    // The chain is scanned without the wallet lock, the wallet keeps serving the txs it has.
+    // A canceled or failed scan leaves the wallet untouched
+    CWalletResyncFilter txFilter(this, setDest);
+    map<uint256, pair<uint256, int>> mapScanned;
+    for (const uint256& hashFork : vFork)
+    {
+        uint256 hashLast;
+        int nLastHeight;
+        int64 nLastTime;
+        uint16 nMintType;
+        if (!pBlockChain->GetLastBlock(hashFork, hashLast, nLastHeight, nLastTime, nMintType))
+        {
+            StdLog("CWallet", "ResyncWalletTx: Get last block fail, fork: %s.", hashFork.GetHex().c_str());
+            return false;
+        }
+        if (!pBlockChain->FilterTx(hashFork, txFilter))
+        {
+            StdLog("CWallet", "ResyncWalletTx: BlockChain filter fail or canceled, fork: %s.", hashFork.GetHex().c_str());
+            return false;
+        }
+        mapScanned[hashFork] = make_pair(hashLast, nLastHeight);
+    }
+
+    // Swap the scanned txs in, then catch up with the blocks added since the scan
+    boost::unique_lock<boost::shared_mutex> wlock(rwWalletTx);
+
+    if (!SetResyncIncomplete(true) || !ClearTx())
+    {
+        StdLog("CWallet", "ResyncWalletTx: Clear wallet tx fail.");
+        return false;
+    }
+
+    vFork.clear();
+    if (!ListSyncFork(vFork))
+    {
+        return false;
+    }
+    CWalletTxFilter txCatchUp(this, setDest);
+    for (const uint256& hashFork : vFork)
+    {
+        // a fork reorganized or created since the scan is scanned again
+        map<uint256, pair<uint256, int>>::iterator it = mapScanned.find(hashFork);
+        uint256 hashBlock;
+        if (it == mapScanned.end() || !pBlockChain->GetBlockHash(hashFork, (*it).second.second, hashBlock)
+            || hashBlock != (*it).second.first)
+        {
+            if (!pBlockChain->FilterTx(hashFork, txCatchUp))
+            {
+                StdLog("CWallet", "ResyncWalletTx: BlockChain filter fail, fork: %s.", hashFork.GetHex().c_str());
+                return false;
+            }
+        }
+        else
+        {
+            const int nScanHeight = (*it).second.second;
+            for (const CAssembledTx& tx : txFilter.mapForkTx[hashFork])
+            {
+                if (tx.nBlockHeight <= nScanHeight && !UpdateTx(hashFork, tx))
+                {
+                    StdLog("CWallet", "ResyncWalletTx: Update tx fail, txid: %s.", tx.GetHash().GetHex().c_str());
+                    return false;
+                }
+            }
+            // the depth is counted from the tip, the slack covers blocks added meanwhile, wallet txs apply idempotently
+            uint256 hashLast;
+            int nLastHeight;
+            int64 nLastTime;
+            uint16 nMintType;
+            if (!pBlockChain->GetLastBlock(hashFork, hashLast, nLastHeight, nLastTime, nMintType))
+            {
+                StdLog("CWallet", "ResyncWalletTx: Get last block fail, fork: %s.", hashFork.GetHex().c_str());
+                return false;
+            }
+            if (nLastHeight > nScanHeight
+                && !pBlockChain->FilterTx(hashFork, nLastHeight - nScanHeight + RESYNC_CATCHUP_SLACK, txCatchUp))
+            {
+                StdLog("CWallet", "ResyncWalletTx: BlockChain catch up fail, fork: %s.", hashFork.GetHex().c_str());
+                return false;
+            }
+        }
+        if (!pTxPool->FilterTx(hashFork, txCatchUp))
+        {
+            StdLog("CWallet", "ResyncWalletTx: TxPool filter fail, fork: %s.", hashFork.GetHex().c_str());
+            return false;
+        }
+    }
+
+    // addresses imported during the scan are synced as the import would
+    set<CDestination> setDestNew;
+    GetDestinations(setDestNew);
+    for (const CDestination& dest : setDest)
+    {
+        setDestNew.erase(dest);
+    }
+    if (!setDestNew.empty())
+    {
+        CWalletTxFilter txFilterNew(this, setDestNew);
+        if (!SyncWalletTx(txFilterNew))
+        {
+            return false;
+        }
+    }
+
+    return SetResyncIncomplete(false);
+}
+
+bool CWallet::ListSyncFork(vector<uint256>& vFork)
+{
     vFork.reserve(mapFork.size());
 
     vFork.push_back(pCoreProtocol->GetGenesisBlockHash());
@@ -945,7 +1167,7 @@ bool CWallet::SyncWalletTx(CTxFilter& txFilter)
         map<uint256, CWalletFork>::iterator it = mapFork.find(hashFork);
         if (it == mapFork.end())
         {
-            StdLog("CWallet", "SyncWalletTx: Find fork fail, fork: %s.", hashFork.GetHex().c_str());
+            StdLog("CWallet", "ListSyncFork: Find fork fail, fork: %s.", hashFork.GetHex().c_str());
             return false;
         }
 
@@ -954,7 +1176,20 @@ bool CWallet::SyncWalletTx(CTxFilter& txFilter)
         {
             vFork.push_back((*mi).second);
         }
+    }
+    return true;
+}
 
+bool CWallet::SyncWalletTx(CTxFilter& txFilter)
+{
+    vector<uint256> vFork;
+    if (!ListSyncFork(vFork))
+    {
+        return false;
+    }
+
+    for (const uint256& hashFork : vFork)
+    {
         if (!pBlockChain->FilterTx(hashFork, txFilter))
         {
             StdLog("CWallet", "SyncWalletTx: BlockChain filter fail, fork: %s.", hashFork.GetHex().c_str());
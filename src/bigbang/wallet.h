@@ -169,6 +169,9 @@ public:
     /* Resync */
     bool SynchronizeWalletTx(const CDestination& destNew) override;
     bool ResynchronizeWalletTx() override;
+    bool GetResyncProgress(uint256& hashFork, int& nHeight, int& nLastHeight, std::size_t& nTxCount, bool& fIncomplete) override;
+    bool CancelResync() override;
+    bool UpdateResyncProgress(const uint256& hashFork, int nHeight, int nLastHeight, std::size_t nTxFound);
     bool CompareWithTxOrPool(const CAssembledTx& tx);
     bool CompareWithPoolOrTx(const CWalletTx& wtx, const std::set<CDestination>& setAddr);
 
@@ -200,7 +203,11 @@ protected:
     void RemoveWalletTxOut(const CTxOutPoint& txout);
     void AddNewWalletTx(std::shared_ptr<CWalletTx>& spWalletTx, std::vector<uint256>& vFork);
     void RemoveWalletTx(std::shared_ptr<CWalletTx>& spWalletTx, const uint256& hashFork);
+    bool ListSyncFork(std::vector<uint256>& vFork);
     bool SyncWalletTx(CTxFilter& txFilter);
+    bool ResyncWalletTx();
+    bool SetResyncRunning(bool fRunning);
+    bool SetResyncIncomplete(bool fIncomplete);
     bool InspectWalletTx(int nCheckDepth);
 
 protected:
@@ -216,6 +223,15 @@ protected:
     std::map<CDestination, CWalletUnspent> mapWalletUnspent;
     std::map<uint256, CWalletFork> mapFork;
     std::set<CTxOutPoint> setWalletTxOut;
+    // progress of the running resync, read by status queries without the wallet lock
+    boost::mutex mtxResync;
+    bool fResyncRunning;
+    bool fResyncCancel;
+    uint256 hashResyncFork;
+    int nResyncHeight;
+    int nResyncLastHeight;
+    std::size_t nResyncTxCount;
+    bool fResyncIncomplete;
 };
 
 // dummy wallet for on wallet server
@@ -342,6 +358,16 @@ public:
     {
         return true;
     }
+
+    virtual bool GetResyncProgress(uint256& hashFork, int& nHeight, int& nLastHeight, std::size_t& nTxCount, bool& fIncomplete) override
+    {
+        return false;
+    }
+
+    virtual bool CancelResync() override
+    {
+        return false;
+    }
 };
 
 } // namespace bigbang
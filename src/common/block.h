@@ -5,6 +5,7 @@
 #ifndef COMMON_BLOCK_H
 #define COMMON_BLOCK_H
 
+#include <cstring>
 #include <stream/datastream.h>
 #include <stream/stream.h>
 #include <vector>
@@ -44,6 +45,7 @@ public:
     }
     void SetNull()
     {
+        memoHash.fValid = false;
         nVersion = 1;
         nType = 0;
         nTimeStamp = 0;
@@ -88,10 +90,18 @@ public:
     }
     uint256 GetHash() const
     {
-        xengine::CBufStream ss;
-        ss << nVersion << nType << nTimeStamp << hashPrev << hashMerkle << vchProof << txMint;
-        uint256 hash = bigbang::crypto::CryptoHash(ss.GetData(), ss.GetSize());
-        return uint256(GetBlockHeight(), uint224(hash));
+        return (memoHash.fValid ? memoHash.hash : CalcHash());
+    }
+    // Memoize block hash, filled at deserialization. Copies are hashed again,
+    // a loaded block whose header or txMint is changed in place must ResetHash()
+    void UpdateHash()
+    {
+        memoHash.hash = CalcHash();
+        memoHash.fValid = true;
+    }
+    void ResetHash()
+    {
+        memoHash.fValid = false;
     }
     std::size_t GetTxSerializedOffset() const
     {
@@ -169,8 +179,83 @@ public:
     {
         return hash.Get32(7);
     }
+    // Get the size of serialized CBlock at the beginning of data (such as stored CBlockEx),
+    // by skipping over its fields without deserializing
+    static bool GetSerializedSize(const unsigned char* pData, std::size_t nLength, std::size_t& nSize)
+    {
+        std::size_t nPos = 0;
+        auto fnSkip = [&](std::size_t n) -> bool {
+            if (n > nLength - nPos)
+            {
+                return false;
+            }
+            nPos += n;
+            return true;
+        };
+        auto fnReadVarInt = [&](uint64& n) -> bool {
+            if (nPos >= nLength)
+            {
+                return false;
+            }
+            uint8 ch = pData[nPos++];
+            if (ch < 0xFD)
+            {
+                n = ch;
+                return true;
+            }
+            std::size_t nBytes = (2 << (ch - 0xFD));
+            if (nBytes > nLength - nPos)
+            {
+                return false;
+            }
+            n = 0;
+            memcpy(&n, pData + nPos, nBytes);
+            nPos += nBytes;
+            return true;
+        };
+        auto fnSkipVector = [&](std::size_t nElemSize) -> bool {
+            uint64 n;
+            return (fnReadVarInt(n) && n <= (nLength - nPos) / nElemSize && fnSkip(n * nElemSize));
+        };
+        // nVersion ... hashAnchor, vInput, sendTo ... nTxFee, vchData, vchSig
+        auto fnSkipTx = [&]() -> bool {
+            return (fnSkip(2 + 2 + 4 + 4 + 32) && fnSkipVector(32 + 1) && fnSkip(33 + 8 + 8)
+                    && fnSkipVector(1) && fnSkipVector(1));
+        };
+
+        // nVersion ... hashMerkle, vchProof, txMint, vtx, vchSig
+        if (!fnSkip(2 + 2 + 4 + 32 + 32) || !fnSkipVector(1) || !fnSkipTx())
+        {
+            return false;
+        }
+        uint64 nTx;
+        if (!fnReadVarInt(nTx))
+        {
+            return false;
+        }
+        for (uint64 i = 0; i < nTx; i++)
+        {
+            if (!fnSkipTx())
+            {
+                return false;
+            }
+        }
+        if (!fnSkipVector(1))
+        {
+            return false;
+        }
+        nSize = nPos;
+        return true;
+    }
 
 protected:
+    uint256 CalcHash() const
+    {
+        xengine::CBufStream ss;
+        ss << nVersion << nType << nTimeStamp << hashPrev << hashMerkle << vchProof << txMint;
+        uint256 hash = bigbang::crypto::CryptoHash(ss.GetData(), ss.GetSize());
+        return uint256(GetBlockHeight(), uint224(hash));
+    }
     template <typename O>
     void Serialize(xengine::CStream& s, O& opt)
     {
@@ -183,7 +268,14 @@ protected:
         s.Serialize(txMint, opt);
         s.Serialize(vtx, opt);
         s.Serialize(vchSig, opt);
+        if (boost::is_same<O, xengine::LoadType>::value)
+        {
+            UpdateHash();
+        }
     }
+
+protected:
+    CMemoHash memoHash;
 };
 
 class CBlockEx : public CBlock
@@ -87,6 +87,27 @@ protected:
     }
 };
 
+// Hashes memoized by their owner. A copy or an assignment starts without them,
+// only the object loaded from a stream carries its hashes
+class CMemoHash
+{
+public:
+    CMemoHash()
+      : fValid(false) {}
+    CMemoHash(const CMemoHash&)
+      : fValid(false) {}
+    CMemoHash& operator=(const CMemoHash&)
+    {
+        fValid = false;
+        return *this;
+    }
+
+public:
+    bool fValid;
+    uint256 hash;
+    uint256 hashSig;
+};
+
 class CTransaction
 {
     friend class xengine::CStream;
@@ -118,6 +139,7 @@ public:
     virtual ~CTransaction() = default;
     virtual void SetNull()
     {
+        memoHash.fValid = false;
         nVersion = 1;
         nType = 0;
         nTimeStamp = 0;
@@ -158,18 +180,23 @@ public:
     }
     uint256 GetHash() const
     {
-        xengine::CBufStream ss;
-        ss << (*this);
-
-        uint256 hash = bigbang::crypto::CryptoHash(ss.GetData(), ss.GetSize());
-
-        return uint256(nTimeStamp, uint224(hash));
+        return (memoHash.fValid ? memoHash.hash : CalcHash());
     }
     uint256 GetSignatureHash() const
     {
-        xengine::CBufStream ss;
-        ss << nVersion << nType << nTimeStamp << nLockUntil << hashAnchor << vInput << sendTo << nAmount << nTxFee << vchData;
-        return bigbang::crypto::CryptoHash(ss.GetData(), ss.GetSize());
+        return (memoHash.fValid ? memoHash.hashSig : CalcSignatureHash());
+    }
+    // Memoize hashes, filled at deserialization and by holders that never change the transaction.
+    // Copies are hashed again, a loaded transaction changed in place must ResetHash()
+    void UpdateHash()
+    {
+        memoHash.hash = CalcHash();
+        memoHash.hashSig = CalcSignatureHash();
+        memoHash.fValid = true;
+    }
+    void ResetHash()
+    {
+        memoHash.fValid = false;
     }
 
     int64 GetChange(int64 nValueIn) const
@@ -203,6 +230,21 @@ public:
     }
 
 protected:
+    uint256 CalcHash() const
+    {
+        xengine::CBufStream ss;
+        ss << nVersion << nType << nTimeStamp << nLockUntil << hashAnchor << vInput << sendTo << nAmount << nTxFee << vchData << vchSig;
+
+        uint256 hash = bigbang::crypto::CryptoHash(ss.GetData(), ss.GetSize());
+
+        return uint256(nTimeStamp, uint224(hash));
+    }
+    uint256 CalcSignatureHash() const
+    {
+        xengine::CBufStream ss;
+        ss << nVersion << nType << nTimeStamp << nLockUntil << hashAnchor << vInput << sendTo << nAmount << nTxFee << vchData;
+        return bigbang::crypto::CryptoHash(ss.GetData(), ss.GetSize());
+    }
     template <typename O>
     void Serialize(xengine::CStream& s, O& opt)
     {
@@ -217,7 +259,14 @@ protected:
         s.Serialize(nTxFee, opt);
         s.Serialize(vchData, opt);
         s.Serialize(vchSig, opt);
+        if (boost::is_same<O, xengine::LoadType>::value)
+        {
+            UpdateHash();
+        }
     }
+
+protected:
+    CMemoHash memoHash;
 };
 
 class CTxOut
@@ -433,29 +482,42 @@ protected:
     }
 };
 
+// Stored as raw bytes by the tx index, bump TXINDEX_VERSION in txindexdb.cpp on layout change
 class CTxIndex
 {
 public:
     int nBlockHeight;
     uint32 nFile;
     uint32 nOffset;
+    // the block holding the tx, in the same file
+    uint32 nBlockOffset;
+    // the mint tx is 0, vtx[i] is i + 1
+    uint32 nTxOrdinal;
 
 public:
     CTxIndex()
     {
         SetNull();
     }
-    CTxIndex(int nBlockHeightIn, uint32 nFileIn, uint32 nOffsetIn)
+    CTxIndex(int nBlockHeightIn, uint32 nFileIn, uint32 nOffsetIn, uint32 nBlockOffsetIn, uint32 nTxOrdinalIn)
     {
         nBlockHeight = nBlockHeightIn;
         nFile = nFileIn;
         nOffset = nOffsetIn;
+        nBlockOffset = nBlockOffsetIn;
+        nTxOrdinal = nTxOrdinalIn;
     }
     void SetNull()
     {
         nBlockHeight = 0;
         nFile = 0;
         nOffset = 0;
+        nBlockOffset = 0;
+        nTxOrdinal = 0;
+    }
+    bool IsMintTx() const
+    {
+        return (nTxOrdinal == 0);
     }
     bool IsNull() const
     {
@@ -476,6 +538,11 @@ public:
     CTxFilter(const std::set<CDestination>& setDestIn)
       : setDest(setDestIn) {}
     virtual bool FoundTx(const uint256& hashFork, const CAssembledTx& tx) = 0;
+    // Called as a block scan reaches nHeight, return false to cancel the scan
+    virtual bool ScanProgress(const uint256& hashFork, int nHeight, int nLastHeight)
+    {
+        return true;
+    }
 };
 
 class CTxId : public uint256
@@ -113,6 +113,18 @@ uint256 CryptoHash(const uint256& h1, const uint256& h2)
     return hash;
 }
 
+uint64 CryptoShortHash(const uint256& key, const uint256& h)
+{
+    uint8 hash[crypto_shorthash_siphash24_BYTES];
+    crypto_shorthash_siphash24(hash, h.begin(), sizeof(h), key.begin());
+    uint64 n = 0;
+    for (int i = sizeof(hash) - 1; i >= 0; i--)
+    {
+        n = (n << 8) | hash[i];
+    }
+    return n;
+}
+
 uint256 CryptoPowHash(const void* msg, size_t len)
 {
     uint256 hash;
@@ -120,6 +132,16 @@ uint256 CryptoPowHash(const void* msg, size_t len)
     return hash;
 }
 
+void CryptoPowHashAllocState()
+{
+    cn_slow_hash_allocate_state();
+}
+
+void CryptoPowHashFreeState()
+{
+    cn_slow_hash_free_state();
+}
+
 //////////////////////////////
 // Sign & verify
 
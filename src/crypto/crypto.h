@@ -86,7 +86,11 @@ void CryptoGetRand256(uint256& u);
 // Hash
 uint256 CryptoHash(const void* msg, std::size_t len);
 uint256 CryptoHash(const uint256& h1, const uint256& h2);
+// SipHash-2-4 of h keyed by the low 128 bits of key, a fast keyed hash for short ids
+uint64 CryptoShortHash(const uint256& key, const uint256& h);
 uint256 CryptoPowHash(const void* msg, size_t len);
+void CryptoPowHashAllocState();
+void CryptoPowHashFreeState();
 
 // Sign & verify
 struct CCryptoKey
@@ -4,6 +4,8 @@
 
 #include "ed25519.h"
 
+#include <algorithm>
+
 #include "base25519.h"
 
 namespace curve25519
@@ -25,6 +27,9 @@ const CFP25519 CEdwards25519::ecd2 = CFP25519(_ecd2);
 
 const CEdwards25519 CEdwards25519::base = CEdwards25519(CFP25519(_base_x), CFP25519(_base_y), true);
 
+// Straus needs 64 additions per point against about 253 / c per point for Pippenger
+static const std::size_t STRAUS_MAX_COUNT = 128;
+
 CEdwards25519::CEdwards25519()
   : fX(uint64_t(0)), fY(uint64_t(1)), fZ(uint64_t(1)), fT(uint64_t(0))
 {
@@ -162,10 +167,7 @@ void CEdwards25519::AddPrescalar(const CEdwards25519& q)
 
 const CEdwards25519 CEdwards25519::ScalarMult(const uint8_t* u8, std::size_t size, const bool fPreComputation) const
 {
-    if (preScalar.size() != 16 || preScalar[1].fX != fX || preScalar[1].fY != fY)
-    {
-        CalcPrescalar();
-    }
+    const std::vector<CEdwards25519>& vPrescalar = GetPrescalar();
 
     CEdwards25519 r;
     int i;
@@ -173,12 +175,127 @@ const CEdwards25519 CEdwards25519::ScalarMult(const uint8_t* u8, std::size_t siz
         ;
     for (; i > 0; i--)
     {
-        r.AddPrescalar(preScalar[u8[i] >> 4]);
-        r.AddPrescalar(preScalar[u8[i] & 15]);
+        r.AddPrescalar(vPrescalar[u8[i] >> 4]);
+        r.AddPrescalar(vPrescalar[u8[i] & 15]);
+    }
+    r.AddPrescalar(vPrescalar[u8[0] >> 4]);
+    r.Add(vPrescalar[u8[0] & 15]);
+
+    return r;
+}
+
+const CEdwards25519 CEdwards25519::MultiScalarMult(const std::vector<CSC25519>& vScalar, const std::vector<CEdwards25519>& vPoint)
+{
+    const std::size_t n = std::min(vScalar.size(), vPoint.size());
+    if (n <= STRAUS_MAX_COUNT)
+    {
+        return StrausMult(vScalar, vPoint, n);
+    }
+    return PippengerMult(vScalar, vPoint, n);
+}
+
+const CEdwards25519 CEdwards25519::StrausMult(const std::vector<CSC25519>& vScalar, const std::vector<CEdwards25519>& vPoint, std::size_t n)
+{
+    // the 16 multiples of each point are kept in the point, so they are shared by later calls
+    std::vector<const CEdwards25519*> vTable(n);
+    for (std::size_t i = 0; i < n; i++)
+    {
+        vTable[i] = &vPoint[i].GetPrescalar()[0];
+    }
+
+    CEdwards25519 r;
+    bool fStarted = false;
+    for (int j = 63; j >= 0; j--)
+    {
+        if (fStarted)
+        {
+            r.Double().Double().Double().Double();
+        }
+        for (std::size_t i = 0; i < n; i++)
+        {
+            const uint64_t digit = (vScalar[i].Data()[j >> 4] >> ((j & 15) << 2)) & 15;
+            if (digit != 0)
+            {
+                r.Add(vTable[i][digit]);
+                fStarted = true;
+            }
+        }
+    }
+    return r;
+}
+
+const CEdwards25519 CEdwards25519::PippengerMult(const std::vector<CSC25519>& vScalar, const std::vector<CEdwards25519>& vPoint, std::size_t n)
+{
+    // window width about 2/3 * log2(n) balances bucket additions against bucket summing
+    int nLog = 0;
+    while ((std::size_t(1) << (nLog + 1)) <= n)
+    {
+        nLog++;
     }
-    r.AddPrescalar(preScalar[u8[0] >> 4]);
-    r.Add(preScalar[u8[0] & 15]);
+    const int c = std::min(16, nLog * 2 / 3 + 1);
+    const int nBucket = (1 << c);
+    const int nWindow = (256 + c - 1) / c;
+
+    CEdwards25519 r;
+    std::vector<CEdwards25519> vBucket(nBucket);
+    std::vector<bool> vUsed(nBucket);
+    for (int w = nWindow - 1; w >= 0; w--)
+    {
+        for (int i = 0; i < c && w != nWindow - 1; i++)
+        {
+            r.Double();
+        }
+
+        std::fill(vUsed.begin(), vUsed.end(), false);
+        const int nBit = w * c;
+        for (std::size_t i = 0; i < n; i++)
+        {
+            const uint64_t* u64 = vScalar[i].Data();
+            uint64_t digit = u64[nBit >> 6] >> (nBit & 63);
+            if ((nBit & 63) + c > 64 && (nBit >> 6) < 3)
+            {
+                digit |= u64[(nBit >> 6) + 1] << (64 - (nBit & 63));
+            }
+            digit &= (nBucket - 1);
+            if (digit != 0)
+            {
+                if (vUsed[digit])
+                {
+                    vBucket[digit].Add(vPoint[i]);
+                }
+                else
+                {
+                    const CEdwards25519& p = vPoint[i];
+                    vBucket[digit] = CEdwards25519(p.fX, p.fY, p.fZ, p.fT);
+                    vUsed[digit] = true;
+                }
+            }
+        }
 
+        // sum(k * bucket[k]) = sum of the running sums from the highest bucket down
+        CEdwards25519 sum, acc;
+        bool fSum = false;
+        for (int k = nBucket - 1; k > 0; k--)
+        {
+            if (vUsed[k])
+            {
+                if (fSum)
+                {
+                    sum.Add(vBucket[k]);
+                }
+                else
+                {
+                    sum = vBucket[k];
+                    fSum = true;
+                }
+            }
+            if (fSum)
+            {
+                acc.Add(sum);
+            }
+        }
+        r.Add(acc);
+    }
     return r;
 }
 
@@ -190,6 +307,15 @@ void CEdwards25519::FromP1P1(const CFP25519& x, const CFP25519& y, const CFP2551
     fT = x * y;
 }
 
+const std::vector<CEdwards25519>& CEdwards25519::GetPrescalar() const
+{
+    if (preScalar.size() != 16 || preScalar[1].fX != fX || preScalar[1].fY != fY)
+    {
+        CalcPrescalar();
+    }
+    return preScalar;
+}
+
 void CEdwards25519::CalcPrescalar() const
 {
     preScalar.resize(16);
@@ -44,6 +44,12 @@ public:
     {
         return ScalarMult((const uint8_t*)s.Data(), 32, fPreComputation);
     }
+    // sum(vScalar[i] * vPoint[i]), interleaved windows (Straus) for a few points, bucket method (Pippenger) for many
+    static const CEdwards25519 MultiScalarMult(const std::vector<CSC25519>& vScalar, const std::vector<CEdwards25519>& vPoint);
+    static const CEdwards25519& Base()
+    {
+        return base;
+    }
     const CEdwards25519 operator-() const
     {
         return CEdwards25519(-fX, fY, fZ, -fT);
@@ -78,6 +84,9 @@ protected:
     CEdwards25519& Double();
     void FromP1P1(const CFP25519& x, const CFP25519& y, const CFP25519& z, const CFP25519& t);
     void CalcPrescalar() const;
+    const std::vector<CEdwards25519>& GetPrescalar() const;
+    static const CEdwards25519 StrausMult(const std::vector<CSC25519>& vScalar, const std::vector<CEdwards25519>& vPoint, std::size_t n);
+    static const CEdwards25519 PippengerMult(const std::vector<CSC25519>& vScalar, const std::vector<CEdwards25519>& vPoint, std::size_t n);
     void AddPrescalar(const CEdwards25519& q);
 
 public:
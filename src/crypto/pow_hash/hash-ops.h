@@ -91,6 +91,8 @@ enum
 
 void cn_fast_hash(const void* data, size_t length, char* hash);
 void cn_slow_hash(const void* data, size_t length, char* hash, int variant, int prehashed, uint64_t height);
+void cn_slow_hash_allocate_state(void);
+void cn_slow_hash_free_state(void);
 
 void hash_extra_blake(const void* data, size_t length, char* hash);
 void hash_extra_groestl(const void* data, size_t length, char* hash);
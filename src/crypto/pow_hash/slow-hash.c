@@ -1694,3 +1694,13 @@ static void cn_slow_hash(const void *data, size_t length, char *hash, int varian
 }
 
 #endif
+
+void cn_slow_hash_allocate_state(void)
+{
+    slow_hash_allocate_state();
+}
+
+void cn_slow_hash_free_state(void)
+{
+    slow_hash_free_state();
+}
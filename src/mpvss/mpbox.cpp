@@ -37,11 +37,15 @@ static inline const uint256 MPEccSign(const uint256& key, const uint256& r, cons
 
 static inline bool MPEccVerify(const uint256& pubkey, const uint256& rG, const uint256& signature, const uint256& hash)
 {
-    CEdwards25519 P, R, S;
+    CEdwards25519 P, R;
     if (P.Unpack(pubkey.begin()) && R.Unpack(rG.begin()))
     {
-        S.Generate(signature);
-        return (S == (P + R.ScalarMult(hash)));
+        // signature * G + hash * (-R) == P, sharing the doublings of both multiplications.
+        // Scalars are not reduced, so small order components of R are multiplied exactly as ScalarMult does
+        const uint64_t* s64 = (const uint64_t*)signature.begin();
+        const uint64_t* h64 = (const uint64_t*)hash.begin();
+        return (P == CEdwards25519::MultiScalarMult({ CSC25519({ s64[0], s64[1], s64[2], s64[3] }), CSC25519({ h64[0], h64[1], h64[2], h64[3] }) },
+                                                    { CEdwards25519::Base(), -R }));
     }
     return false;
 }
@@ -191,21 +195,28 @@ bool CMPSealedBox::VerifyPolynomial(uint32_t nX, const uint256& v)
 
 void CMPSealedBox::PrecalcPolynomial(size_t nThresh, size_t nLastIndex)
 {
+    if (nThresh == 0)
+    {
+        return;
+    }
+
+    CEdwards25519 P0;
     vector<CEdwards25519> vP;
-    vP.resize(nThresh);
+    vP.resize(nThresh - 1);
     vEncryptedShare.resize(nLastIndex);
-    for (int i = 0; i < nThresh; i++)
+    P0.Unpack(vEncryptedCoeff[0].begin());
+    for (int i = 1; i < nThresh; i++)
     {
-        vP[i].Unpack(vEncryptedCoeff[i].begin());
+        vP[i - 1].Unpack(vEncryptedCoeff[i].begin());
     }
 
+    // coefficient tables are built by the first evaluation and reused for every nX
+    vector<CSC25519> vPow(nThresh - 1);
     for (uint32_t nX = 1; nX < nLastIndex; nX++)
     {
-        CEdwards25519 P = vP[0];
-        for (size_t i = 1; i < nThresh; i++)
-        {
-            P += vP[i].ScalarMult(CSC25519::naturalPowTable[nX - 1][i - 1]);
-        }
+        copy(CSC25519::naturalPowTable[nX - 1], CSC25519::naturalPowTable[nX - 1] + nThresh - 1, vPow.begin());
+        CEdwards25519 P = CEdwards25519::MultiScalarMult(vPow, vP);
+        P += P0;
         P.Pack(vEncryptedShare[nX].begin());
     }
 }
@@ -4,9 +4,14 @@
 
 #include "peer.h"
 
+#include <boost/timer/timer.hpp>
+#include <snappy.h>
+
 #include "crypto.h"
 #include "peernet.h"
 
+#define MESSAGE_COMPRESS_MIN_SIZE 1024
+
 using namespace std;
 using namespace xengine;
 
@@ -42,6 +47,8 @@ void CBbPeer::Activate()
     nPingPongTimeDelta = 0;
     nPingMillisTime = 0;
     nPingSeq = 0;
+    nCompressSaved = 0;
+    nCompressTime = 0;
 
     Read(MESSAGE_HEADER_SIZE, boost::bind(&CBbPeer::HandshakeReadHeader, this));
     if (!fInBound)
@@ -57,20 +64,64 @@ bool CBbPeer::IsHandshaked()
 
 bool CBbPeer::SendMessage(int nChannel, int nCommand, CBufStream& ssPayload)
 {
+    return SendMessage(nChannel, nCommand, ssPayload,
+                       bigbang::crypto::CryptoHash(ssPayload.GetData(), ssPayload.GetSize()).Get32());
+}
+
+bool CBbPeer::SendMessage(int nChannel, int nCommand, CBufStream& ssPayload, uint32 nPayloadChecksum)
+{
+    const size_t nSize = ssPayload.GetSize();
+    const bool fCompress = (IsCompressible(nService, nChannel, nCommand, nSize)
+                            && (static_cast<CBbPeerNet*>(pPeerNet))->IsCompressEnabled());
+
+    boost::timer::cpu_timer timer;
     CPeerMessageHeader hdrSend;
-    hdrSend.nMagic = nMsgMagic;
-    hdrSend.nType = CPeerMessageHeader::GetMessageType(nChannel, nCommand);
-    hdrSend.nPayloadSize = ssPayload.GetSize();
-    hdrSend.nPayloadChecksum = bigbang::crypto::CryptoHash(ssPayload.GetData(), ssPayload.GetSize()).Get32();
-    hdrSend.nHeaderChecksum = hdrSend.GetHeaderChecksum();
+    if (!EncodeMessage(nMsgMagic, nChannel, nCommand, ssPayload, nPayloadChecksum, fCompress, hdrSend, WriteStream()))
+    {
+        return false;
+    }
+    if (fCompress)
+    {
+        boost::timer::cpu_times elapsed = timer.elapsed();
+        nCompressTime += (elapsed.user + elapsed.system) / 1000;
+        nCompressSaved += (nSize - hdrSend.nPayloadSize);
+    }
+    Write();
+    return true;
+}
+
+bool CBbPeer::EncodeMessage(uint32 nMagic, int nChannel, int nCommand, CBufStream& ssPayload, uint32 nPayloadChecksum,
+                            bool fCompress, CPeerMessageHeader& hdr, CBufStream& ssMessage)
+{
+    hdr.nMagic = nMagic;
+    hdr.nType = CPeerMessageHeader::GetMessageType(nChannel, nCommand);
+    hdr.nPayloadSize = ssPayload.GetSize();
+    hdr.nPayloadChecksum = nPayloadChecksum;
+    hdr.nFlags = 0;
+    hdr.nHeaderChecksum = hdr.GetHeaderChecksum();
 
-    if (!hdrSend.Verify())
+    if (!hdr.Verify())
     {
         return false;
     }
 
-    WriteStream() << hdrSend << ssPayload;
-    Write();
+    if (fCompress)
+    {
+        string strCompressed;
+        snappy::Compress(ssPayload.GetData(), ssPayload.GetSize(), &strCompressed);
+        if (strCompressed.size() < ssPayload.GetSize())
+        {
+            hdr.nPayloadSize = strCompressed.size();
+            hdr.nFlags = MESSAGE_FLAG_SNAPPY;
+            hdr.nHeaderChecksum = hdr.GetHeaderChecksum();
+
+            ssMessage << hdr;
+            ssMessage.Write(strCompressed.data(), strCompressed.size());
+            return true;
+        }
+    }
+
+    ssMessage << hdr << ssPayload;
     return true;
 }
 
@@ -259,6 +310,10 @@ bool CBbPeer::HandshakeCompleted()
 bool CBbPeer::HandleReadCompleted()
 {
     CBufStream& ss = ReadStream();
+    if ((hdrRecv.nFlags & MESSAGE_FLAG_SNAPPY) && !UncompressPayload(ss))
+    {
+        return false;
+    }
     uint256 hash = bigbang::crypto::CryptoHash(ss.GetData(), ss.GetSize());
     if (hdrRecv.nPayloadChecksum == hash.Get32())
     {
@@ -278,5 +333,48 @@ bool CBbPeer::HandleReadCompleted()
     return false;
 }
 
+bool CBbPeer::IsCompressible(uint64 nPeerService, int nChannel, int nCommand, size_t nSize)
+{
+    if (nSize < MESSAGE_COMPRESS_MIN_SIZE || nChannel != PROTO_CHN_DATA || !(nPeerService & NODE_SNAPPY))
+    {
+        return false;
+    }
+    return (nCommand == PROTO_CMD_BLOCK || nCommand == PROTO_CMD_INV
+            || nCommand == PROTO_CMD_TX || nCommand == PROTO_CMD_BLOCKTXN);
+}
+
+bool CBbPeer::DecodePayload(CBufStream& ss)
+{
+    // the claimed length is checked before any buffer is allocated for it
+    size_t nSize = 0;
+    if (!snappy::GetUncompressedLength(ss.GetData(), ss.GetSize(), &nSize) || nSize > MESSAGE_PAYLOAD_MAX_SIZE)
+    {
+        return false;
+    }
+    string strPayload;
+    if (!snappy::Uncompress(ss.GetData(), ss.GetSize(), &strPayload))
+    {
+        return false;
+    }
+    ss.Clear();
+    ss.Write(strPayload.data(), strPayload.size());
+    return true;
+}
+
+bool CBbPeer::UncompressPayload(CBufStream& ss)
+{
+    boost::timer::cpu_timer timer;
+    const size_t nCompressedSize = ss.GetSize();
+    if (!DecodePayload(ss))
+    {
+        StdError("CBbPeer", "UncompressPayload: invalid payload, peer: %s", GetRemote().address().to_string().c_str());
+        return false;
+    }
+    nCompressSaved += (ss.GetSize() - nCompressedSize);
+    boost::timer::cpu_times elapsed = timer.elapsed();
+    nCompressTime += (elapsed.user + elapsed.system) / 1000;
+    return true;
+}
+
 } // namespace network
 } // namespace bigbang
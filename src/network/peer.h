@@ -25,6 +25,7 @@ public:
     void Activate() override;
     bool IsHandshaked();
     bool SendMessage(int nChannel, int nCommand, xengine::CBufStream& ssPayload);
+    bool SendMessage(int nChannel, int nCommand, xengine::CBufStream& ssPayload, uint32 nPayloadChecksum);
     bool SendMessage(int nChannel, int nCommand)
     {
         xengine::CBufStream ssPayload;
@@ -35,6 +36,12 @@ public:
     void AskFor(const uint256& hashFork, const std::vector<CInv>& vInv);
     bool FetchAskFor(uint256& hashFork, CInv& inv);
     bool PingTimer(uint32 nTimerId) override;
+    // Write the header and payload of a message. The payload is snappy-compressed when fCompress
+    // and it gets smaller, the payload checksum always covers the uncompressed payload
+    static bool EncodeMessage(uint32 nMagic, int nChannel, int nCommand, xengine::CBufStream& ssPayload, uint32 nPayloadChecksum,
+                              bool fCompress, CPeerMessageHeader& hdr, xengine::CBufStream& ssMessage);
+    static bool DecodePayload(xengine::CBufStream& ss);
+    static bool IsCompressible(uint64 nPeerService, int nChannel, int nCommand, std::size_t nSize);
 
 protected:
     void SendHello();
@@ -46,6 +53,7 @@ protected:
     virtual bool HandshakeCompleted();
     bool HandleReadHeader();
     bool HandleReadCompleted();
+    bool UncompressPayload(xengine::CBufStream& ss);
 
 public:
     int nVersion;
@@ -62,6 +70,9 @@ public:
     int64 nPingMillisTime;
     uint32 nPingSeq;
 
+    int64 nCompressSaved;
+    int64 nCompressTime;
+
 protected:
     uint32 nMsgMagic;
     uint32 nHsTimerId;
@@ -79,6 +90,8 @@ public:
     std::string strSubVer;
     int nStartingHeight;
     int nPingPongTimeDelta;
+    int64 nCompressSaved; // bytes saved by snappy in both directions
+    int64 nCompressTime;  // cpu time of compression and uncompression in microseconds
 };
 
 } // namespace network
@@ -36,6 +36,10 @@ enum
     EVENT_PEER_GETDELEGATED,
     EVENT_PEER_DISTRIBUTE,
     EVENT_PEER_PUBLISH,
+    EVENT_PEER_RAWBLOCK,
+    EVENT_PEER_CMPCTBLOCK,
+    EVENT_PEER_GETBLOCKTXN,
+    EVENT_PEER_BLOCKTXN,
     EVENT_PEER_MAX,
 };
 
@@ -196,6 +200,97 @@ public:
     std::vector<unsigned char> vchData;
 };
 
+class CRawBlock
+{
+    friend class xengine::CStream;
+
+protected:
+    void Serialize(xengine::CStream& s, xengine::SaveType&)
+    {
+        s.Write((const char*)vchBlock.data(), vchBlock.size());
+    }
+
+public:
+    uint256 hashBlock;
+    std::vector<unsigned char> vchBlock; // serialized CBlock
+};
+
+class CCmpctBlock
+{
+    friend class xengine::CStream;
+
+public:
+    CCmpctBlock()
+      : nSaltNonce(0) {}
+    CCmpctBlock(const CBlock& block, uint64 nSaltNonceIn)
+      : header(block), nSaltNonce(nSaltNonceIn)
+    {
+        header.vtx.clear();
+        uint256 hashSalt = GetSalt();
+        vShortTxId.reserve(block.vtx.size());
+        for (const CTransaction& tx : block.vtx)
+        {
+            vShortTxId.push_back(GetShortTxId(hashSalt, tx.GetHash()));
+        }
+    }
+    uint256 GetSalt() const
+    {
+        return crypto::CryptoHash(header.GetHash(), uint256(nSaltNonce));
+    }
+    static uint64 GetShortTxId(const uint256& hashSalt, const uint256& txid)
+    {
+        return crypto::CryptoShortHash(hashSalt, txid);
+    }
+
+protected:
+    template <typename O>
+    void Serialize(xengine::CStream& s, O& opt)
+    {
+        s.Serialize(header, opt);
+        s.Serialize(nSaltNonce, opt);
+        s.Serialize(vShortTxId, opt);
+    }
+
+public:
+    CBlock header; // block without vtx
+    uint64 nSaltNonce;
+    std::vector<uint64> vShortTxId;
+};
+
+class CBlockTxnReq
+{
+    friend class xengine::CStream;
+
+protected:
+    template <typename O>
+    void Serialize(xengine::CStream& s, O& opt)
+    {
+        s.Serialize(hashBlock, opt);
+        s.Serialize(vIndex, opt);
+    }
+
+public:
+    uint256 hashBlock;
+    std::vector<uint32> vIndex;
+};
+
+class CBlockTxn
+{
+    friend class xengine::CStream;
+
+protected:
+    template <typename O>
+    void Serialize(xengine::CStream& s, O& opt)
+    {
+        s.Serialize(hashBlock, opt);
+        s.Serialize(vtx, opt);
+    }
+
+public:
+    uint256 hashBlock;
+    std::vector<CTransaction> vtx;
+};
+
 class CBbPeerEventListener;
 
 #define TYPE_PEEREVENT(type, body) \
@@ -218,6 +313,10 @@ typedef TYPE_PEERDATAEVENT(EVENT_PEER_TX, CTransaction) CEventPeerTx;
 typedef TYPE_PEERDATAEVENT(EVENT_PEER_BLOCK, CBlock) CEventPeerBlock;
 typedef TYPE_PEERDATAEVENT(EVENT_PEER_GETFAIL, std::vector<CInv>) CEventPeerGetFail;
 typedef TYPE_PEERDATAEVENT(EVENT_PEER_MSGRSP, CMsgRsp) CEventPeerMsgRsp;
+typedef TYPE_PEERDATAEVENT(EVENT_PEER_RAWBLOCK, CRawBlock) CEventPeerRawBlock;
+typedef TYPE_PEERDATAEVENT(EVENT_PEER_CMPCTBLOCK, CCmpctBlock) CEventPeerCmpctBlock;
+typedef TYPE_PEERDATAEVENT(EVENT_PEER_GETBLOCKTXN, CBlockTxnReq) CEventPeerGetBlockTxn;
+typedef TYPE_PEERDATAEVENT(EVENT_PEER_BLOCKTXN, CBlockTxn) CEventPeerBlockTxn;
 
 typedef TYPE_PEERDELEGATEDEVENT(EVENT_PEER_BULLETIN, CEventPeerDelegatedBulletin) CEventPeerBulletin;
 typedef TYPE_PEERDELEGATEDEVENT(EVENT_PEER_GETDELEGATED, CEventPeerDelegatedGetData) CEventPeerGetDelegated;
@@ -243,6 +342,10 @@ public:
     DECLARE_EVENTHANDLER(CEventPeerGetDelegated);
     DECLARE_EVENTHANDLER(CEventPeerDistribute);
     DECLARE_EVENTHANDLER(CEventPeerPublish);
+    DECLARE_EVENTHANDLER(CEventPeerRawBlock);
+    DECLARE_EVENTHANDLER(CEventPeerCmpctBlock);
+    DECLARE_EVENTHANDLER(CEventPeerGetBlockTxn);
+    DECLARE_EVENTHANDLER(CEventPeerBlockTxn);
 };
 
 } // namespace network
@@ -18,6 +18,8 @@
 
 #define NODE_DEFAULT_GATEWAY "0.0.0.0"
 
+#define BLOCK_CHECKSUM_CACHE_COUNT (8192)
+
 using namespace std;
 using namespace xengine;
 using boost::asio::ip::tcp;
@@ -31,7 +33,7 @@ namespace network
 // CBbPeerNet
 
 CBbPeerNet::CBbPeerNet()
-  : CPeerNet("peernet")
+  : CPeerNet("peernet"), cacheBlockChecksum(BLOCK_CHECKSUM_CACHE_COUNT)
 {
     nMagicNum = 0;
     nVersion = 0;
@@ -129,6 +131,55 @@ bool CBbPeerNet::HandleEvent(CEventPeerBlock& eventBlock)
     return SendDataMessage(eventBlock.nNonce, PROTO_CMD_BLOCK, ssPayload);
 }
 
+bool CBbPeerNet::HandleEvent(CEventPeerRawBlock& eventRawBlock)
+{
+    CBufStream ssPayload;
+    ssPayload << eventRawBlock;
+
+    // the same block is served to every syncing peer, so payload checksum is calculated once
+    pair<uint256, uint256> key(eventRawBlock.hashFork, eventRawBlock.data.hashBlock);
+    uint32 nChecksum;
+    if (!cacheBlockChecksum.Retrieve(key, nChecksum))
+    {
+        nChecksum = crypto::CryptoHash(ssPayload.GetData(), ssPayload.GetSize()).Get32();
+        cacheBlockChecksum.AddNew(key, nChecksum);
+    }
+    return SendDataMessage(eventRawBlock.nNonce, PROTO_CMD_BLOCK, ssPayload, nChecksum);
+}
+
+bool CBbPeerNet::HandleEvent(CEventPeerCmpctBlock& eventCmpctBlock)
+{
+    CBufStream ssPayload;
+    ssPayload << eventCmpctBlock;
+    return SendDataMessage(eventCmpctBlock.nNonce, PROTO_CMD_CMPCTBLOCK, ssPayload);
+}
+
+bool CBbPeerNet::HandleEvent(CEventPeerGetBlockTxn& eventGetBlockTxn)
+{
+    CBufStream ssPayload;
+    ssPayload << eventGetBlockTxn;
+    vector<CInv> vInv;
+    vInv.push_back(CInv(CInv::MSG_CMPCTBLOCK, eventGetBlockTxn.data.hashBlock));
+    if (SendDataMessage(eventGetBlockTxn.nNonce, PROTO_CMD_GETBLOCKTXN, ssPayload))
+    {
+        if (SetInvTimer(eventGetBlockTxn.nNonce, vInv))
+        {
+            return true;
+        }
+    }
+    CEventPeerGetFail* pEvent = new CEventPeerGetFail(eventGetBlockTxn.nNonce, eventGetBlockTxn.hashFork);
+    pEvent->data.assign(vInv.begin(), vInv.end());
+    pNetChannel->PostEvent(pEvent);
+    return false;
+}
+
+bool CBbPeerNet::HandleEvent(CEventPeerBlockTxn& eventBlockTxn)
+{
+    CBufStream ssPayload;
+    ssPayload << eventBlockTxn;
+    return SendDataMessage(eventBlockTxn.nNonce, PROTO_CMD_BLOCKTXN, ssPayload);
+}
+
 bool CBbPeerNet::HandleEvent(CEventPeerGetFail& eventGetFail)
 {
     CBufStream ssPayload;
@@ -231,6 +282,8 @@ CPeerInfo* CBbPeerNet::GetPeerInfo(CPeer* pPeer, CPeerInfo* pInfo)
         pBbInfo->strSubVer = pBbPeer->strSubVer;
         pBbInfo->nStartingHeight = pBbPeer->nStartingHeight;
         pBbInfo->nPingPongTimeDelta = pBbPeer->nPingPongTimeDelta;
+        pBbInfo->nCompressSaved = pBbPeer->nCompressSaved;
+        pBbInfo->nCompressTime = pBbPeer->nCompressTime;
     }
     return pInfo;
 }
@@ -262,6 +315,16 @@ bool CBbPeerNet::SendDataMessage(uint64 nNonce, int nCommand, CBufStream& ssPayl
     return pBbPeer->SendMessage(PROTO_CHN_DATA, nCommand, ssPayload);
 }
 
+bool CBbPeerNet::SendDataMessage(uint64 nNonce, int nCommand, CBufStream& ssPayload, uint32 nPayloadChecksum)
+{
+    CBbPeer* pBbPeer = static_cast<CBbPeer*>(GetPeer(nNonce));
+    if (pBbPeer == nullptr)
+    {
+        return false;
+    }
+    return pBbPeer->SendMessage(PROTO_CHN_DATA, nCommand, ssPayload, nPayloadChecksum);
+}
+
 bool CBbPeerNet::SendDelegatedMessage(uint64 nNonce, int nCommand, xengine::CBufStream& ssPayload)
 {
     CBbPeer* pBbPeer = static_cast<CBbPeer*>(GetPeer(nNonce));
@@ -275,14 +338,14 @@ bool CBbPeerNet::SendDelegatedMessage(uint64 nNonce, int nCommand, xengine::CBuf
 bool CBbPeerNet::SetInvTimer(uint64 nNonce, vector<CInv>& vInv)
 {
     const int64 nTimeout[] = { 0, RESPONSE_TX_TIMEOUT, RESPONSE_BLOCK_TIMEOUT,
-                               RESPONSE_DISTRIBUTE_TIMEOUT, RESPONSE_PUBLISH_TIMEOUT };
+                               RESPONSE_DISTRIBUTE_TIMEOUT, RESPONSE_PUBLISH_TIMEOUT, RESPONSE_BLOCK_TIMEOUT };
     CBbPeer* pBbPeer = static_cast<CBbPeer*>(GetPeer(nNonce));
     if (pBbPeer != nullptr)
     {
         int64 nElapse = 0;
         for (const CInv& inv : vInv)
         {
-            if (inv.nType >= CInv::MSG_TX && inv.nType <= CInv::MSG_PUBLISH)
+            if (inv.nType >= CInv::MSG_TX && inv.nType <= CInv::MSG_CMPCTBLOCK)
             {
                 nElapse += nTimeout[inv.nType];
                 string strFunc = string("InvTimer: nNonce: ") + to_string(nNonce) + ", Inv: [" + to_string(inv.nType) + "] " + inv.nHash.GetHex();
@@ -586,6 +649,43 @@ bool CBbPeerNet::HandlePeerRecvMessage(CPeer* pPeer, int nChannel, int nCommand,
             }
         }
         break;
+        case PROTO_CMD_CMPCTBLOCK:
+        {
+            CEventPeerCmpctBlock* pEvent = new CEventPeerCmpctBlock(pBbPeer->GetNonce(), hashFork);
+            if (pEvent != nullptr)
+            {
+                ssPayload >> pEvent->data;
+                CInv inv(CInv::MSG_CMPCTBLOCK, pEvent->data.header.GetHash());
+                CancelTimer(pBbPeer->Responded(inv));
+                pNetChannel->PostEvent(pEvent);
+                return true;
+            }
+        }
+        break;
+        case PROTO_CMD_GETBLOCKTXN:
+        {
+            CEventPeerGetBlockTxn* pEvent = new CEventPeerGetBlockTxn(pBbPeer->GetNonce(), hashFork);
+            if (pEvent != nullptr)
+            {
+                ssPayload >> pEvent->data;
+                pNetChannel->PostEvent(pEvent);
+                return true;
+            }
+        }
+        break;
+        case PROTO_CMD_BLOCKTXN:
+        {
+            CEventPeerBlockTxn* pEvent = new CEventPeerBlockTxn(pBbPeer->GetNonce(), hashFork);
+            if (pEvent != nullptr)
+            {
+                ssPayload >> pEvent->data;
+                CInv inv(CInv::MSG_CMPCTBLOCK, pEvent->data.hashBlock);
+                CancelTimer(pBbPeer->Responded(inv));
+                pNetChannel->PostEvent(pEvent);
+                return true;
+            }
+        }
+        break;
         case PROTO_CMD_GETFAIL:
         {
             CEventPeerGetFail* pEvent = new CEventPeerGetFail(pBbPeer->GetNonce(), hashFork);
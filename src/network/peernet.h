@@ -55,6 +55,10 @@ public:
     virtual bool HandlePeerRecvMessage(xengine::CPeer* pPeer, int nChannel, int nCommand,
                                        xengine::CBufStream& ssPayload);
     uint32 SetPingTimer(uint32 nOldTimerId, uint64 nNonce, int64 nElapse);
+    bool IsCompressEnabled() const
+    {
+        return (nService & NODE_SNAPPY);
+    }
 
 protected:
     bool HandleInitialize() override;
@@ -72,11 +76,16 @@ protected:
     bool HandleEvent(CEventPeerGetDelegated& eventGetDelegated) override;
     bool HandleEvent(CEventPeerDistribute& eventDistribute) override;
     bool HandleEvent(CEventPeerPublish& eventPublish) override;
+    bool HandleEvent(CEventPeerRawBlock& eventRawBlock) override;
+    bool HandleEvent(CEventPeerCmpctBlock& eventCmpctBlock) override;
+    bool HandleEvent(CEventPeerGetBlockTxn& eventGetBlockTxn) override;
+    bool HandleEvent(CEventPeerBlockTxn& eventBlockTxn) override;
     xengine::CPeer* CreatePeer(xengine::CIOClient* pClient, uint64 nNonce, bool fInBound) override;
     void DestroyPeer(xengine::CPeer* pPeer) override;
     xengine::CPeerInfo* GetPeerInfo(xengine::CPeer* pPeer, xengine::CPeerInfo* pInfo) override;
     CAddress GetGateWayAddress(const CNetHost& gateWayAddr);
     bool SendDataMessage(uint64 nNonce, int nCommand, xengine::CBufStream& ssPayload);
+    bool SendDataMessage(uint64 nNonce, int nCommand, xengine::CBufStream& ssPayload, uint32 nPayloadChecksum);
     bool SendDelegatedMessage(uint64 nNonce, int nCommand, xengine::CBufStream& ssPayload);
     bool SetInvTimer(uint64 nNonce, std::vector<CInv>& vInv);
     virtual void ProcessAskFor(xengine::CPeer* pPeer);
@@ -104,6 +113,7 @@ protected:
     uint256 hashGenesis;
     std::set<boost::asio::ip::tcp::endpoint> setDNSeed;
     uint64 nSeqCreate;
+    xengine::CCache<std::pair<uint256, uint256>, uint32> cacheBlockChecksum;
 };
 
 } // namespace network
@@ -19,6 +19,8 @@ enum
 {
     NODE_NETWORK = (1 << 0),
     NODE_DELEGATED = (1 << 1),
+    NODE_CMPCTBLOCK = (1 << 2),
+    NODE_SNAPPY = (1 << 3),
 };
 
 enum
@@ -50,6 +52,9 @@ enum
     PROTO_CMD_BLOCK = 7,
     PROTO_CMD_GETFAIL = 8,
     PROTO_CMD_MSGRSP = 9,
+    PROTO_CMD_CMPCTBLOCK = 10,
+    PROTO_CMD_GETBLOCKTXN = 11,
+    PROTO_CMD_BLOCKTXN = 12,
 };
 
 enum
@@ -62,6 +67,7 @@ enum
 
 #define MESSAGE_HEADER_SIZE 16
 #define MESSAGE_PAYLOAD_MAX_SIZE 0x400000
+#define MESSAGE_FLAG_SNAPPY 0x01
 #define PING_TIMER_DURATION 120
 
 class CPeerMessageHeader
@@ -74,6 +80,7 @@ public:
     uint32 nPayloadSize;
     uint32 nPayloadChecksum;
     uint32 nHeaderChecksum;
+    uint8 nFlags; // high byte of the payload size field, payloads never exceed 24 bits
 
 public:
     int GetChannel() const
@@ -89,7 +96,7 @@ public:
         unsigned char buf[MESSAGE_HEADER_SIZE];
         *(uint32*)&buf[0] = nMagic;
         *(uint8*)&buf[4] = nType;
-        *(uint32*)&buf[5] = nPayloadSize;
+        *(uint32*)&buf[5] = (nPayloadSize & 0xFFFFFF) | ((uint32)nFlags << 24);
         *(uint32*)&buf[9] = nPayloadChecksum;
         return bigbang::crypto::crc24q(buf, 13);
     }
@@ -108,7 +115,7 @@ protected:
         char buf[MESSAGE_HEADER_SIZE + 1];
         *(uint32*)&buf[0] = nMagic;
         *(uint8*)&buf[4] = nType;
-        *(uint32*)&buf[5] = nPayloadSize;
+        *(uint32*)&buf[5] = (nPayloadSize & 0xFFFFFF) | ((uint32)nFlags << 24);
         *(uint32*)&buf[9] = nPayloadChecksum;
         *(uint32*)&buf[13] = nHeaderChecksum;
         s.Write(buf, MESSAGE_HEADER_SIZE);
@@ -119,7 +126,8 @@ protected:
         s.Read(buf, MESSAGE_HEADER_SIZE);
         nMagic = *(uint32*)&buf[0];
         nType = *(uint8*)&buf[4];
-        nPayloadSize = *(uint32*)&buf[5];
+        nPayloadSize = *(uint32*)&buf[5] & 0xFFFFFF;
+        nFlags = (uint8)(*(uint32*)&buf[5] >> 24);
         nPayloadChecksum = *(uint32*)&buf[9];
         nHeaderChecksum = *(uint32*)&buf[13] & 0xFFFFFF;
     }
@@ -168,6 +176,7 @@ public:
         MSG_BLOCK,
         MSG_DISTRIBUTE,
         MSG_PUBLISH,
+        MSG_CMPCTBLOCK,
     };
     enum
     {
@@ -6,9 +6,11 @@
 
 #include <boost/timer/timer.hpp>
 #include <cstdio>
+#include <future>
 
 #include "../bigbang/address.h"
 #include "delegatecomm.h"
+#include "parallel.h"
 #include "template/template.h"
 #include "util.h"
 
@@ -18,6 +20,10 @@ using namespace xengine;
 
 #define BLOCKFILE_PREFIX "block"
 #define LOGFILE_NAME "storage.log"
+#define INDEX_JOURNAL_COMPACT_COUNT 0x10000
+#define FILTER_SCAN_WINDOW 256
+#define TXINDEX_REBUILD_BATCH 0x10000
+#define TXINDEX_REBUILD_LOG_BLOCKS 10000
 
 namespace bigbang
 {
@@ -41,6 +47,24 @@ class CBlockWalker : public CBlockDBWalker
     CBlockBase* pBase;
 };
 
+class CBlockSnapshotWalker : public CBlockIndexSnapshotWalker
+{
+public:
+    CBlockSnapshotWalker(CBlockBase* pBaseIn)
+      : pBase(pBaseIn) {}
+    bool Walk(CBlockOutline& outline) override
+    {
+        return pBase->LoadIndex(outline);
+    }
+    bool Remove(const uint256& hashBlock) override
+    {
+        return pBase->UnloadIndex(hashBlock);
+    }
+
+public:
+    CBlockBase* pBase;
+};
+
 //////////////////////////////
 // CBlockView
 
@@ -353,6 +377,14 @@ bool CBlockBase::Initialize(const path& pathDataLocation, bool fDebug, bool fRen
         return false;
     }
 
+    if (!snapshotIndex.Initialize(pathDataLocation))
+    {
+        dbBlock.Deinitialize();
+        tsBlock.Deinitialize();
+        Error("B", "Failed to initialize block index snapshot");
+        return false;
+    }
+
     if (fRenewDB)
     {
         Clear();
@@ -375,6 +407,12 @@ bool CBlockBase::Initialize(const path& pathDataLocation, bool fDebug, bool fRen
 
 void CBlockBase::Deinitialize()
 {
+    {
+        CWriteLock wlock(rwAccess);
+
+        SaveIndexSnapshot();
+        snapshotIndex.Deinitialize();
+    }
     dbBlock.Deinitialize();
     tsBlock.Deinitialize();
     {
@@ -389,7 +427,7 @@ bool CBlockBase::Exists(const uint256& hash) const
 {
     CReadLock rlock(rwAccess);
 
-    return (!!mapIndex.count(hash));
+    return (!!mapIndex.Count(hash));
 }
 
 bool CBlockBase::ExistsTx(const uint256& txid)
@@ -403,7 +441,7 @@ bool CBlockBase::IsEmpty() const
 {
     CReadLock rlock(rwAccess);
 
-    return mapIndex.empty();
+    return mapIndex.Empty();
 }
 
 void CBlockBase::Clear()
@@ -411,6 +449,7 @@ void CBlockBase::Clear()
     CWriteLock wlock(rwAccess);
 
     dbBlock.RemoveAll();
+    snapshotIndex.Remove();
     ClearCache();
 }
 
@@ -432,7 +471,7 @@ bool CBlockBase::Initiate(const uint256& hashGenesis, const CBlock& blockGenesis
     uint256 txidMintTx = blockGenesis.txMint.GetHash();
 
     vector<pair<uint256, CTxIndex>> vTxNew;
-    vTxNew.push_back(make_pair(txidMintTx, CTxIndex(0, nFile, nTxOffset)));
+    vTxNew.push_back(make_pair(txidMintTx, CTxIndex(0, nFile, nTxOffset, nOffset, 0)));
 
     vector<CTxUnspent> vAddNew;
     vAddNew.push_back(CTxUnspent(CTxOutPoint(txidMintTx, 0), CTxOut(blockGenesis.txMint)));
@@ -446,9 +485,11 @@ bool CBlockBase::Initiate(const uint256& hashGenesis, const CBlock& blockGenesis
             return false;
         }
 
+        snapshotIndex.AddNewBlock(CBlockOutline(pIndexNew));
         if (!dbBlock.AddNewBlock(CBlockOutline(pIndexNew)))
         {
             StdTrace("BlockBase", "Add New genesis Block %s block failed", hashGenesis.ToString().c_str());
+            snapshotIndex.RemoveBlock(hashGenesis);
             return false;
         }
 
@@ -536,12 +577,14 @@ bool CBlockBase::AddNew(const uint256& hash, CBlockEx& block, CBlockIndex** ppIn
             return false;
         }
 
+        // the journal goes ahead of the block db, LoadIndexSnapshot checks its tail against the db
+        snapshotIndex.AddNewBlock(CBlockOutline(pIndexNew));
         if (!dbBlock.AddNewBlock(CBlockOutline(pIndexNew)))
         {
             StdError("BlockBase", "Add new block: AddNewBlock failed, block: %s", hash.ToString().c_str());
+            snapshotIndex.RemoveBlock(hash);
             //mapIndex.erase(hash);
             RemoveBlockIndex(pIndexNew->GetOriginHash(), hash);
-            delete pIndexNew;
             return false;
         }
 
@@ -550,10 +593,10 @@ bool CBlockBase::AddNew(const uint256& hash, CBlockEx& block, CBlockIndex** ppIn
             if (!UpdateDelegate(hash, block, CDiskPos(nFile, nOffset), ctxtDelegate))
             {
                 StdTrace("BlockBase", "Add new block: Update delegate failed, block: %s", hash.ToString().c_str());
+                snapshotIndex.RemoveBlock(hash);
                 dbBlock.RemoveBlock(hash);
                 //mapIndex.erase(hash);
                 RemoveBlockIndex(pIndexNew->GetOriginHash(), hash);
-                delete pIndexNew;
                 return false;
             }
         }
@@ -647,6 +690,38 @@ bool CBlockBase::Retrieve(const CBlockIndex* pIndex, CBlockEx& block)
     return true;
 }
 
+bool CBlockBase::RetrieveRaw(const uint256& hash, vector<unsigned char>& vchBlock)
+{
+    vchBlock.clear();
+
+    CBlockIndex* pIndex;
+    {
+        CReadLock rlock(rwAccess);
+
+        if (!(pIndex = GetIndex(hash)))
+        {
+            StdTrace("BlockBase", "RetrieveRaw::GetIndex %s block failed", hash.ToString().c_str());
+            return false;
+        }
+    }
+    if (!tsBlock.ReadRaw(vchBlock, pIndex->nFile, pIndex->nOffset))
+    {
+        StdTrace("BlockBase", "RetrieveRaw::Read %s block failed", hash.ToString().c_str());
+        return false;
+    }
+
+    // block is stored as CBlockEx, drop the tx contexts following CBlock
+    size_t nSize = 0;
+    if (!CBlock::GetSerializedSize(vchBlock.data(), vchBlock.size(), nSize))
+    {
+        StdError("BlockBase", "RetrieveRaw: Parse %s block failed", hash.ToString().c_str());
+        vchBlock.clear();
+        return false;
+    }
+    vchBlock.resize(nSize);
+    return true;
+}
+
 bool CBlockBase::RetrieveIndex(const uint256& hash, CBlockIndex** ppIndex)
 {
     CReadLock rlock(rwAccess);
@@ -689,6 +764,14 @@ bool CBlockBase::RetrieveFork(const string& strName, CBlockIndex** ppIndex)
     return false;
 }
 
+bool CBlockBase::RetrieveAncestor(CBlockIndex* pIndex, int nHeight, CBlockIndex** ppIndex)
+{
+    CReadLock rlock(rwAccess);
+
+    *ppIndex = GetAncestor(pIndex, nHeight);
+    return (*ppIndex != nullptr);
+}
+
 bool CBlockBase::RetrieveProfile(const uint256& hash, CProfile& profile)
 {
     CReadLock rlock(rwAccess);
@@ -821,6 +904,48 @@ bool CBlockBase::RetrieveTx(const uint256& hashFork, const uint256& txid, CTrans
     return true;
 }
 
+bool CBlockBase::RetrieveTxInBlock(const uint256& txid, CTransaction& tx, CTxContxt& txContxt, uint256& hashFork,
+                                   uint256& hashBlock, int& nHeight, uint32& nTxOrdinal)
+{
+    tx.SetNull();
+    txContxt.SetNull();
+    CTxIndex txIndex;
+    if (!dbBlock.RetrieveTxIndex(txid, txIndex, hashFork))
+    {
+        StdTrace("BlockBase", "RetrieveTxInBlock::RetrieveTxIndex %s tx failed", txid.ToString().c_str());
+        return false;
+    }
+
+    CBlockEx block;
+    if (!tsBlock.Read(block, txIndex.nFile, txIndex.nBlockOffset))
+    {
+        StdTrace("BlockBase", "RetrieveTxInBlock::Read %s block failed", txid.ToString().c_str());
+        return false;
+    }
+    if (txIndex.IsMintTx())
+    {
+        tx = block.txMint;
+        txContxt.destIn.SetNull();
+    }
+    else if (txIndex.nTxOrdinal <= block.vtx.size() && txIndex.nTxOrdinal <= block.vTxContxt.size())
+    {
+        tx = block.vtx[txIndex.nTxOrdinal - 1];
+        txContxt = block.vTxContxt[txIndex.nTxOrdinal - 1];
+    }
+    if (tx.GetHash() != txid)
+    {
+        StdTrace("BlockBase", "RetrieveTxInBlock::Position of %s tx mismatch", txid.ToString().c_str());
+        tx.SetNull();
+        txContxt.SetNull();
+        return false;
+    }
+
+    hashBlock = block.GetHash();
+    nHeight = txIndex.nBlockHeight;
+    nTxOrdinal = txIndex.nTxOrdinal;
+    return true;
+}
+
 bool CBlockBase::RetrieveTxLocation(const uint256& txid, uint256& hashFork, int& nHeight)
 {
     CTxIndex txIndex;
@@ -1134,26 +1259,18 @@ bool CBlockBase::CommitBlockView(CBlockView& view, CBlockIndex* pIndexNew)
 bool CBlockBase::LoadIndex(CBlockOutline& outline)
 {
     uint256 hash = outline.GetBlockHash();
-    CBlockIndex* pIndexNew = nullptr;
-
-    map<uint256, CBlockIndex*>::iterator mi = mapIndex.find(hash);
-    if (mi != mapIndex.end())
+    CBlockIndex* pIndexNew = mapIndex.Find(hash);
+    if (pIndexNew != nullptr)
     {
-        pIndexNew = (*mi).second;
+        const uint256* phashBlock = pIndexNew->phashBlock;
         *pIndexNew = static_cast<CBlockIndex&>(outline);
+        pIndexNew->phashBlock = phashBlock;
     }
     else
     {
-        pIndexNew = new CBlockIndex(static_cast<CBlockIndex&>(outline));
-        if (pIndexNew == nullptr)
-        {
-            Log("B", "LoadIndex: new CBlockIndex fail");
-            return false;
-        }
-        mi = mapIndex.insert(make_pair(hash, pIndexNew)).first;
+        pIndexNew = mapIndex.Insert(hash, static_cast<CBlockIndex&>(outline));
     }
 
-    pIndexNew->phashBlock = &((*mi).first);
     pIndexNew->pPrev = nullptr;
     pIndexNew->pOrigin = pIndexNew;
 
@@ -1181,6 +1298,17 @@ bool CBlockBase::LoadIndex(CBlockOutline& outline)
     return true;
 }
 
+bool CBlockBase::UnloadIndex(const uint256& hash)
+{
+    CBlockIndex* pIndex = GetIndex(hash);
+    if (pIndex == nullptr)
+    {
+        return false;
+    }
+    RemoveBlockIndex(pIndex->GetOriginHash(), hash);
+    return true;
+}
+
 bool CBlockBase::LoadTx(CTransaction& tx, uint32 nTxFile, uint32 nTxOffset, uint256& hashFork)
 {
     tx.SetNull();
@@ -1211,39 +1339,12 @@ bool CBlockBase::FilterTx(const uint256& hashFork, CTxFilter& filter)
 
     CReadLock rForkLock(spFork->GetRWAccess());
 
+    vector<CBlockIndex*> vIndex;
     for (CBlockIndex* pIndex = spFork->GetOrigin(); pIndex != nullptr; pIndex = pIndex->pNext)
     {
-        CBlockEx block;
-        if (!tsBlock.Read(block, pIndex->nFile, pIndex->nOffset))
-        {
-            StdLog("BlockBase", "FilterTx: Block read fail, nFile: %d, nOffset: %d.", pIndex->nFile, pIndex->nOffset);
-            return false;
-        }
-        int nBlockHeight = pIndex->GetBlockHeight();
-        if (block.txMint.nAmount > 0 && filter.setDest.count(block.txMint.sendTo))
-        {
-            if (!filter.FoundTx(hashFork, CAssembledTx(block.txMint, nBlockHeight)))
-            {
-                StdLog("BlockBase", "FilterTx: FoundTx mint tx fail, txid: %s.", block.txMint.GetHash().GetHex().c_str());
-                return false;
-            }
-        }
-        for (int i = 0; i < block.vtx.size(); i++)
-        {
-            CTransaction& tx = block.vtx[i];
-            CTxContxt& ctxt = block.vTxContxt[i];
-
-            if (filter.setDest.count(tx.sendTo) || filter.setDest.count(ctxt.destIn))
-            {
-                if (!filter.FoundTx(hashFork, CAssembledTx(tx, nBlockHeight, ctxt.destIn, ctxt.GetValueIn())))
-                {
-                    StdLog("BlockBase", "FilterTx: FoundTx tx fail, txid: %s.", tx.GetHash().GetHex().c_str());
-                    return false;
-                }
-            }
-        }
+        vIndex.push_back(pIndex);
     }
-    return true;
+    return ScanBlockTx(hashFork, vIndex, filter);
 }
 
 bool CBlockBase::FilterTx(const uint256& hashFork, int nDepth, CTxFilter& filter)
@@ -1259,43 +1360,15 @@ bool CBlockBase::FilterTx(const uint256& hashFork, int nDepth, CTxFilter& filter
 
     CReadLock rForkLock(spFork->GetRWAccess());
 
+    vector<CBlockIndex*> vIndex;
     int nCount = 0;
     for (CBlockIndex* pIndex = spFork->GetLast(); pIndex != nullptr && nCount++ < nDepth; pIndex = pIndex->pPrev)
     {
-        CBlockEx block;
-        if (!tsBlock.Read(block, pIndex->nFile, pIndex->nOffset))
-        {
-            StdLog("BlockBase", "FilterTx2: Block read fail, nFile: %d, nOffset: %d, block: %s.",
-                   pIndex->nFile, pIndex->nOffset, pIndex->GetBlockHash().GetHex().c_str());
-            return false;
-        }
-        int nBlockHeight = pIndex->GetBlockHeight();
-        if (block.txMint.nAmount > 0 && filter.setDest.count(block.txMint.sendTo))
-        {
-            if (!filter.FoundTx(hashFork, CAssembledTx(block.txMint, nBlockHeight)))
-            {
-                StdLog("BlockBase", "FilterTx2: FoundTx mint tx fail, height: %d, txid: %s, block: %s, fork: %s.",
-                       nBlockHeight, block.txMint.GetHash().GetHex().c_str(), pIndex->GetBlockHash().GetHex().c_str(), pIndex->GetOriginHash().GetHex().c_str());
-                return false;
-            }
-        }
-        for (int i = 0; i < block.vtx.size(); i++)
-        {
-            CTransaction& tx = block.vtx[i];
-            CTxContxt& ctxt = block.vTxContxt[i];
-
-            if (filter.setDest.count(tx.sendTo) || filter.setDest.count(ctxt.destIn))
-            {
-                if (!filter.FoundTx(hashFork, CAssembledTx(tx, nBlockHeight, ctxt.destIn, ctxt.GetValueIn())))
-                {
-                    StdLog("BlockBase", "FilterTx2: FoundTx tx fail, height: %d, txid: %s, block: %s, fork: %s.",
-                           nBlockHeight, tx.GetHash().GetHex().c_str(), pIndex->GetBlockHash().GetHex().c_str(), pIndex->GetOriginHash().GetHex().c_str());
-                    return false;
-                }
-            }
-        }
+        vIndex.push_back(pIndex);
     }
-    return true;
+    // txs are delivered in chain order, a spend after the tx it spends
+    reverse(vIndex.begin(), vIndex.end());
+    return ScanBlockTx(hashFork, vIndex, filter);
 }
 
 bool CBlockBase::ListForkContext(std::vector<CForkContext>& vForkCtxt)
@@ -1850,15 +1923,19 @@ bool CBlockBase::ListForkUnspent(const uint256& hashFork, const CDestination& de
 {
     vUnspent.clear();
     CListUnspentWalker walker(hashFork, dest, nMax);
-    dbBlock.WalkThroughUnspent(hashFork, walker);
+    dbBlock.WalkThroughUnspent(hashFork, dest, walker);
     vUnspent = walker.vUnspent;
     return true;
 }
 
 bool CBlockBase::ListForkUnspentBatch(const uint256& hashFork, uint32 nMax, std::map<CDestination, std::vector<CTxUnspent>>& mapUnspent)
 {
-    CListUnspentBatchWalker walker(hashFork, mapUnspent, nMax);
-    dbBlock.WalkThroughUnspent(hashFork, walker);
+    for (auto& unspent : mapUnspent)
+    {
+        CListUnspentWalker walker(hashFork, unspent.first, nMax);
+        dbBlock.WalkThroughUnspent(hashFork, unspent.first, walker);
+        unspent.second = walker.vUnspent;
+    }
     return true;
 }
 
@@ -2110,7 +2187,11 @@ bool CBlockBase::VerifySameChain(const uint256& hashPrevBlock, const uint256& ha
     {
         return false;
     }
-    while (pAfterIndex->GetBlockHeight() >= pPrevIndex->GetBlockHeight())
+    if (pAfterIndex->GetBlockHeight() > pPrevIndex->GetBlockHeight())
+    {
+        pAfterIndex = GetAncestor(pAfterIndex, pPrevIndex->GetBlockHeight());
+    }
+    while (pAfterIndex != nullptr && pAfterIndex->GetBlockHeight() >= pPrevIndex->GetBlockHeight())
     {
         if (pAfterIndex == pPrevIndex)
         {
@@ -2194,24 +2275,12 @@ bool CBlockBase::GetPrimaryHeightBlockTime(const uint256& hashLastBlock, int nHe
 
 CBlockIndex* CBlockBase::GetIndex(const uint256& hash) const
 {
-    map<uint256, CBlockIndex*>::const_iterator mi = mapIndex.find(hash);
-    return (mi != mapIndex.end() ? (*mi).second : nullptr);
+    return mapIndex.Find(hash);
 }
 
 CBlockIndex* CBlockBase::GetOrCreateIndex(const uint256& hash)
 {
-    map<uint256, CBlockIndex*>::const_iterator mi = mapIndex.find(hash);
-    if (mi == mapIndex.end())
-    {
-        CBlockIndex* pIndexNew = new CBlockIndex();
-        mi = mapIndex.insert(make_pair(hash, pIndexNew)).first;
-        if (mi == mapIndex.end())
-        {
-            return nullptr;
-        }
-        pIndexNew->phashBlock = &((*mi).first);
-    }
-    return ((*mi).second);
+    return mapIndex.Insert(hash);
 }
 
 CBlockIndex* CBlockBase::GetBranch(CBlockIndex* pIndexRef, CBlockIndex* pIndex, vector<CBlockIndex*>& vPath)
@@ -2238,6 +2307,32 @@ CBlockIndex* CBlockBase::GetBranch(CBlockIndex* pIndexRef, CBlockIndex* pIndex,
     return pIndex;
 }
 
+CBlockIndex* CBlockBase::GetAncestor(CBlockIndex* pIndex, int nHeight)
+{
+    // Returns the first block not higher than nHeight on the way back from pIndex.
+    // Blocks on the main chain of a fork jump by its height index, side branches are walked
+    while (pIndex != nullptr && pIndex->GetBlockHeight() > nHeight)
+    {
+        boost::shared_ptr<CBlockFork> spFork = GetFork(pIndex->GetOriginHash());
+        if (spFork != nullptr)
+        {
+            CReadLock rForkLock(spFork->GetRWAccess());
+            if (spFork->IsOnMainChain(pIndex))
+            {
+                CBlockIndex* pOrigin = spFork->GetOrigin();
+                if (nHeight >= pOrigin->GetBlockHeight())
+                {
+                    return spFork->GetIndexOfHeight(nHeight);
+                }
+                pIndex = pOrigin->pPrev;
+                continue;
+            }
+        }
+        pIndex = pIndex->pPrev;
+    }
+    return pIndex;
+}
+
 CBlockIndex* CBlockBase::GetOriginIndex(const uint256& txidMint) const
 {
     for (map<uint256, boost::shared_ptr<CBlockFork>>::const_iterator mi = mapFork.begin(); mi != mapFork.end(); ++mi)
@@ -2263,7 +2358,7 @@ void CBlockBase::RemoveBlockIndex(const uint256& hashFork, const uint256& hashBl
     {
         it->second.RemoveHeightIndex(CBlock::GetBlockHeightByHash(hashBlock), hashBlock);
     }
-    mapIndex.erase(hashBlock);
+    mapIndex.Erase(hashBlock);
 }
 
 void CBlockBase::UpdateBlockRef(const uint256& hashFork, const uint256& hashBlock, const uint256& hashRefBlock)
@@ -2277,19 +2372,14 @@ void CBlockBase::UpdateBlockRef(const uint256& hashFork, const uint256& hashBloc
 
 CBlockIndex* CBlockBase::AddNewIndex(const uint256& hash, const CBlock& block, uint32 nFile, uint32 nOffset, uint256 nChainTrust)
 {
-    CBlockIndex* pIndexNew = new CBlockIndex(block, nFile, nOffset);
+    CBlockIndex* pIndexNew = mapIndex.Insert(hash, CBlockIndex(block, nFile, nOffset));
     if (pIndexNew != nullptr)
     {
-        map<uint256, CBlockIndex*>::iterator mi = mapIndex.insert(make_pair(hash, pIndexNew)).first;
-        pIndexNew->phashBlock = &((*mi).first);
-
         int64 nMoneySupply = block.GetBlockMint();
         uint64 nRandBeacon = block.GetBlockBeacon();
-        CBlockIndex* pIndexPrev = nullptr;
-        map<uint256, CBlockIndex*>::iterator miPrev = mapIndex.find(block.hashPrev);
-        if (miPrev != mapIndex.end())
+        CBlockIndex* pIndexPrev = mapIndex.Find(block.hashPrev);
+        if (pIndexPrev != nullptr)
         {
-            pIndexPrev = (*miPrev).second;
             pIndexNew->pPrev = pIndexPrev;
             if (!pIndexNew->IsOrigin())
             {
@@ -2511,7 +2601,6 @@ bool CBlockBase::GetTxNewIndex(CBlockView& view, CBlockIndex* pIndexNew, vector<
         vPath.push_back(pIndexNew);
     }
 
-    CBufStream ss;
     for (int i = vPath.size() - 1; i >= 0; i--)
     {
         CBlockIndex* pIndex = vPath[i];
@@ -2520,28 +2609,33 @@ bool CBlockBase::GetTxNewIndex(CBlockView& view, CBlockIndex* pIndexNew, vector<
         {
             return false;
         }
-        int nHeight = pIndex->GetBlockHeight();
-        uint32 nOffset = pIndex->nOffset + block.GetTxSerializedOffset();
+        GetBlockTxIndex(block, pIndex->GetBlockHeight(), pIndex->nFile, pIndex->nOffset, vTxNew);
+    }
+    return true;
+}
 
-        if (!block.txMint.sendTo.IsNull())
-        {
-            CTxIndex txIndex(nHeight, pIndex->nFile, nOffset);
-            vTxNew.push_back(make_pair(block.txMint.GetHash(), txIndex));
-        }
-        nOffset += ss.GetSerializeSize(block.txMint);
+void CBlockBase::GetBlockTxIndex(const CBlockEx& block, int nHeight, uint32 nFile, uint32 nOffset,
+                                 vector<pair<uint256, CTxIndex>>& vTxNew)
+{
+    CBufStream ss;
+    uint32 nTxOffset = nOffset + block.GetTxSerializedOffset();
 
-        CVarInt var(block.vtx.size());
-        nOffset += ss.GetSerializeSize(var);
-        for (int i = 0; i < block.vtx.size(); i++)
-        {
-            CTransaction& tx = block.vtx[i];
-            uint256 txid = tx.GetHash();
-            CTxIndex txIndex(nHeight, pIndex->nFile, nOffset);
-            vTxNew.push_back(make_pair(txid, txIndex));
-            nOffset += ss.GetSerializeSize(tx);
-        }
+    if (!block.txMint.sendTo.IsNull())
+    {
+        CTxIndex txIndex(nHeight, nFile, nTxOffset, nOffset, 0);
+        vTxNew.push_back(make_pair(block.txMint.GetHash(), txIndex));
+    }
+    nTxOffset += ss.GetSerializeSize(block.txMint);
+
+    CVarInt var(block.vtx.size());
+    nTxOffset += ss.GetSerializeSize(var);
+    for (int i = 0; i < block.vtx.size(); i++)
+    {
+        const CTransaction& tx = block.vtx[i];
+        CTxIndex txIndex(nHeight, nFile, nTxOffset, nOffset, i + 1);
+        vTxNew.push_back(make_pair(tx.GetHash(), txIndex));
+        nTxOffset += ss.GetSerializeSize(tx);
     }
-    return true;
 }
 
 bool CBlockBase::IsValidBlock(CBlockIndex* pForkLast, const uint256& hashBlock)
@@ -2658,12 +2752,7 @@ CBlockIndex* CBlockBase::GetLongChainLastBlock(const uint256& hashFork, int nSta
 
 void CBlockBase::ClearCache()
 {
-    map<uint256, CBlockIndex*>::iterator mi;
-    for (mi = mapIndex.begin(); mi != mapIndex.end(); ++mi)
-    {
-        delete (*mi).second;
-    }
-    mapIndex.clear();
+    mapIndex.Clear();
     mapForkHeightIndex.clear();
     mapFork.clear();
 }
@@ -2673,19 +2762,26 @@ bool CBlockBase::LoadDB()
     CWriteLock wlock(rwAccess);
 
     ClearCache();
-    CBlockWalker walker(this);
-    if (!dbBlock.WalkThroughBlock(walker))
+    vector<pair<uint256, uint256>> vFork;
+    if (!dbBlock.ListFork(vFork))
     {
         ClearCache();
         return false;
     }
 
-    vector<pair<uint256, uint256>> vFork;
-    if (!dbBlock.ListFork(vFork))
+    if (!LoadIndexSnapshot(vFork))
     {
+        Log("B", "Block index snapshot is not usable, walk through block db");
         ClearCache();
-        return false;
+        CBlockWalker walker(this);
+        if (!dbBlock.WalkThroughBlock(walker))
+        {
+            ClearCache();
+            return false;
+        }
+        SaveIndexSnapshot();
     }
+
     for (int i = 0; i < vFork.size(); i++)
     {
         CBlockIndex* pIndex = GetIndex(vFork[i].second);
@@ -2706,6 +2802,249 @@ bool CBlockBase::LoadDB()
         }
     }
 
+    if (dbBlock.IsTxIndexRebuildRequired() && !RebuildTxIndex())
+    {
+        return false;
+    }
+
+    return true;
+}
+
+bool CBlockBase::RebuildTxIndex()
+{
+    int64 nStartTime = GetTime();
+    size_t nTxCount = 0;
+    StdLog("BlockBase", "Tx index layout is outdated, rebuild from block files of %lu forks", mapFork.size());
+
+    for (map<uint256, boost::shared_ptr<CBlockFork>>::iterator it = mapFork.begin(); it != mapFork.end(); ++it)
+    {
+        const uint256& hashFork = (*it).first;
+        CBlockIndex* pLast = (*it).second->GetLast();
+        const int nBlockTotal = pLast->GetBlockHeight() - pLast->pOrigin->GetBlockHeight() + 1;
+        int nBlockCount = 0;
+        StdLog("BlockBase", "Rebuild tx index: fork %s, blocks: %d", hashFork.GetHex().c_str(), nBlockTotal);
+
+        vector<pair<uint256, CTxIndex>> vTxNew;
+        for (CBlockIndex* pIndex = pLast; pIndex != nullptr; pIndex = pIndex->pPrev)
+        {
+            CBlockEx block;
+            if (!tsBlock.Read(block, pIndex->nFile, pIndex->nOffset))
+            {
+                Error("B", "Rebuild tx index: read block %s failed", pIndex->GetBlockHash().GetHex().c_str());
+                return false;
+            }
+            GetBlockTxIndex(block, pIndex->GetBlockHeight(), pIndex->nFile, pIndex->nOffset, vTxNew);
+
+            bool fOrigin = (pIndex == pIndex->pOrigin);
+            if (vTxNew.size() >= TXINDEX_REBUILD_BATCH || fOrigin || pIndex->pPrev == nullptr)
+            {
+                if (!dbBlock.RebuildTxIndex(hashFork, vTxNew))
+                {
+                    Error("B", "Rebuild tx index: update fork %s failed", hashFork.GetHex().c_str());
+                    return false;
+                }
+                nTxCount += vTxNew.size();
+                vTxNew.clear();
+            }
+            if (++nBlockCount % TXINDEX_REBUILD_LOG_BLOCKS == 0)
+            {
+                StdLog("BlockBase", "Rebuild tx index: fork %s, blocks: %d/%d, height: %d, time: %lds",
+                       hashFork.GetHex().c_str(), nBlockCount, nBlockTotal, pIndex->GetBlockHeight(), GetTime() - nStartTime);
+            }
+            if (fOrigin)
+            {
+                break;
+            }
+        }
+    }
+
+    if (!dbBlock.SetTxIndexRebuilt())
+    {
+        return false;
+    }
+    StdLog("BlockBase", "Tx index rebuilt, tx count: %lu, time: %lds", nTxCount, GetTime() - nStartTime);
+    return true;
+}
+
+bool CBlockBase::LoadIndexSnapshot(const vector<pair<uint256, uint256>>& vFork)
+{
+    int64 nStartTime = GetTime();
+    CBlockSnapshotWalker walker(this);
+    vector<pair<uint256, uint256>> vSnapshotFork;
+    if (!snapshotIndex.Load(walker, vSnapshotFork))
+    {
+        return false;
+    }
+
+    // a change lost from the journal shows up as a missing fork tip
+    for (const pair<uint256, uint256>& fork : vFork)
+    {
+        if (GetIndex(fork.second) == nullptr)
+        {
+            Log("B", "Block index snapshot: miss fork last block %s", fork.second.GetHex().c_str());
+            return false;
+        }
+    }
+    // a block referenced but never loaded is left with a bare index
+    bool fComplete = true;
+    mapIndex.ForEach([&](const uint256& hash, const CBlockIndex* pIndex) {
+        fComplete = fComplete && (pIndex->nTimeStamp != 0);
+    });
+    if (!fComplete)
+    {
+        Log("B", "Block index snapshot: incomplete index");
+        return false;
+    }
+    // a crash between the journal and the block db write leaves the journal ahead of the db
+    vector<pair<uint8, uint256>> vTail;
+    snapshotIndex.GetJournalTail(vTail);
+    map<uint256, uint8> mapTail;
+    for (const pair<uint8, uint256>& entry : vTail)
+    {
+        mapTail[entry.second] = entry.first;
+    }
+    for (const pair<const uint256, uint8>& entry : mapTail)
+    {
+        if (dbBlock.ExistsBlock(entry.first) != (entry.second == CBlockIndexSnapshot::JOURNAL_ADDNEW))
+        {
+            Log("B", "Block index snapshot: journal does not match block db at %s", entry.first.GetHex().c_str());
+            return false;
+        }
+    }
+
+    Log("B", "Block index snapshot loaded, index count: %lu, journal count: %lu, time: %lds",
+        mapIndex.Size(), snapshotIndex.GetJournalCount(), GetTime() - nStartTime);
+
+    // the snapshot is written at shutdown only, fold a long journal in here so it does not keep growing
+    if (snapshotIndex.GetJournalCount() >= INDEX_JOURNAL_COMPACT_COUNT)
+    {
+        SaveIndexSnapshot();
+    }
+    return true;
+}
+
+void CBlockBase::SaveIndexSnapshot()
+{
+    int64 nStartTime = GetTime();
+    if (mapIndex.Empty())
+    {
+        return;
+    }
+
+    vector<pair<uint256, uint256>> vFork;
+    if (!dbBlock.ListFork(vFork) || !snapshotIndex.Save(mapIndex, vFork))
+    {
+        Error("B", "Failed to save block index snapshot");
+        snapshotIndex.Remove();
+        return;
+    }
+    Log("B", "Block index snapshot saved, index count: %lu, time: %lds", mapIndex.Size(), GetTime() - nStartTime);
+}
+
+bool CBlockBase::ScanBlockTx(const uint256& hashFork, const vector<CBlockIndex*>& vIndex, CTxFilter& filter)
+{
+    class CScannedBlock
+    {
+    public:
+        bool fRead = false;
+        vector<CAssembledTx> vTx;
+    };
+
+    // Blocks of a window are read and matched by a worker pool while the window before is
+    // handed to the filter in chain order, the file pages of the window after are read ahead
+    auto fnPrefetch = [&](size_t nBegin) {
+        const size_t nEnd = min(nBegin + FILTER_SCAN_WINDOW, vIndex.size());
+        for (size_t i = nBegin; i < nEnd;)
+        {
+            const uint32 nFile = vIndex[i]->nFile;
+            uint32 nLow = vIndex[i]->nOffset, nLast = vIndex[i]->nOffset;
+            for (; i < nEnd && vIndex[i]->nFile == nFile; i++)
+            {
+                nLow = min(nLow, vIndex[i]->nOffset);
+                nLast = max(nLast, vIndex[i]->nOffset);
+            }
+            tsBlock.Prefetch(nFile, nLow, nLast);
+        }
+    };
+    auto fnScan = [&](size_t nBegin) {
+        const size_t nEnd = min(nBegin + FILTER_SCAN_WINDOW, vIndex.size());
+        if (nEnd < vIndex.size())
+        {
+            fnPrefetch(nEnd);
+        }
+        vector<CScannedBlock> vBlock(nEnd - nBegin);
+        ParallelComputer computer;
+        computer.Execute(
+            nEnd - nBegin, [](const uint32 n) { return n; }, [&](const uint32 n) {
+                const CBlockIndex* pIndex = vIndex[nBegin + n];
+                CScannedBlock& scanned = vBlock[n];
+                CBlockEx block;
+                if (!tsBlock.ReadDirect(block, pIndex->nFile, pIndex->nOffset))
+                {
+                    return;
+                }
+                scanned.fRead = true;
+                int nBlockHeight = pIndex->GetBlockHeight();
+                if (block.txMint.nAmount > 0 && filter.setDest.count(block.txMint.sendTo))
+                {
+                    scanned.vTx.push_back(CAssembledTx(block.txMint, nBlockHeight));
+                }
+                for (int i = 0; i < block.vtx.size(); i++)
+                {
+                    const CTransaction& tx = block.vtx[i];
+                    const CTxContxt& ctxt = block.vTxContxt[i];
+                    if (filter.setDest.count(tx.sendTo) || filter.setDest.count(ctxt.destIn))
+                    {
+                        scanned.vTx.push_back(CAssembledTx(tx, nBlockHeight, ctxt.destIn, ctxt.GetValueIn()));
+                    }
+                }
+            });
+        return vBlock;
+    };
+
+    if (vIndex.empty())
+    {
+        return true;
+    }
+    const int nLastHeight = max(vIndex.front()->GetBlockHeight(), vIndex.back()->GetBlockHeight());
+    fnPrefetch(0);
+    std::future<vector<CScannedBlock>> futureScan = std::async(std::launch::async, fnScan, 0);
+    for (size_t nBegin = 0; nBegin < vIndex.size(); nBegin += FILTER_SCAN_WINDOW)
+    {
+        vector<CScannedBlock> vBlock = futureScan.get();
+        if (nBegin + FILTER_SCAN_WINDOW < vIndex.size())
+        {
+            futureScan = std::async(std::launch::async, fnScan, nBegin + FILTER_SCAN_WINDOW);
+        }
+
+        // an early return waits for the scan in flight, it refers to the locals
+        for (size_t i = 0; i < vBlock.size(); i++)
+        {
+            const CBlockIndex* pIndex = vIndex[nBegin + i];
+            if (!filter.ScanProgress(hashFork, pIndex->GetBlockHeight(), nLastHeight))
+            {
+                StdLog("BlockBase", "FilterTx: Scan canceled, height: %d, fork: %s.", pIndex->GetBlockHeight(), hashFork.GetHex().c_str());
+                return false;
+            }
+            if (!vBlock[i].fRead)
+            {
+                StdLog("BlockBase", "FilterTx: Block read fail, nFile: %d, nOffset: %d, block: %s.",
+                       pIndex->nFile, pIndex->nOffset, pIndex->GetBlockHash().GetHex().c_str());
+                return false;
+            }
+            for (const CAssembledTx& tx : vBlock[i].vTx)
+            {
+                if (!filter.FoundTx(hashFork, tx))
+                {
+                    StdLog("BlockBase", "FilterTx: FoundTx tx fail, height: %d, txid: %s, block: %s.",
+                           tx.nBlockHeight, tx.GetHash().GetHex().c_str(), pIndex->GetBlockHash().GetHex().c_str());
+                    return false;
+                }
+            }
+        }
+    }
+    // the scan is complete, a cancel coming now has nothing to stop
+    filter.ScanProgress(hashFork, nLastHeight, nLastHeight);
     return true;
 }
 
@@ -13,6 +13,8 @@
 
 #include "block.h"
 #include "blockdb.h"
+#include "blockindexmap.h"
+#include "blockindexsnapshot.h"
 #include "forkcontext.h"
 #include "profile.h"
 #include "timeseries.h"
@@ -31,6 +33,7 @@ public:
     CBlockFork(const CProfile& profileIn, CBlockIndex* pIndexLastIn)
       : forkProfile(profileIn), pIndexLast(pIndexLastIn), pIndexOrigin(pIndexLast->pOrigin)
     {
+        UpdateHeightIndex();
     }
     void ReadLock()
     {
@@ -80,6 +83,48 @@ public:
     {
         pIndexLast = pIndexLastIn;
         UpdateNext();
+        UpdateHeightIndex();
+    }
+    CBlockIndex* GetIndexOfHeight(int nHeight) const
+    {
+        int nPos = nHeight - pIndexOrigin->GetBlockHeight();
+        return ((nPos >= 0 && nPos < vHeightIndex.size()) ? vHeightIndex[nPos] : nullptr);
+    }
+    bool IsOnMainChain(const CBlockIndex* pIndex) const
+    {
+        // extended blocks share the height of their primary block
+        const CBlockIndex* p = GetIndexOfHeight(pIndex->GetBlockHeight());
+        while (p != nullptr && p->GetBlockHeight() == pIndex->GetBlockHeight())
+        {
+            if (p == pIndex)
+            {
+                return true;
+            }
+            p = p->pPrev;
+        }
+        return false;
+    }
+    void UpdateHeightIndex()
+    {
+        // vHeightIndex[n] is the last block of height (origin height + n) on the main chain,
+        // only the part replaced by a reorg is walked
+        const int nOriginHeight = pIndexOrigin->GetBlockHeight();
+        vHeightIndex.resize(pIndexLast->GetBlockHeight() - nOriginHeight + 1, nullptr);
+        CBlockIndex* pIndex = pIndexLast;
+        while (pIndex != nullptr && pIndex->GetBlockHeight() >= nOriginHeight)
+        {
+            const int nHeight = pIndex->GetBlockHeight();
+            CBlockIndex*& pEntry = vHeightIndex[nHeight - nOriginHeight];
+            if (pEntry == pIndex)
+            {
+                break;
+            }
+            pEntry = pIndex;
+            while (pIndex != nullptr && pIndex->GetBlockHeight() == nHeight)
+            {
+                pIndex = pIndex->pPrev;
+            }
+        }
     }
     void UpdateNext()
     {
@@ -119,6 +164,7 @@ protected:
     CProfile forkProfile;
     CBlockIndex* pIndexLast;
     CBlockIndex* pIndexOrigin;
+    std::vector<CBlockIndex*> vHeightIndex;
 };
 
 class CBlockView
@@ -247,9 +293,11 @@ public:
     bool Retrieve(const CBlockIndex* pIndex, CBlock& block);
     bool Retrieve(const uint256& hash, CBlockEx& block);
     bool Retrieve(const CBlockIndex* pIndex, CBlockEx& block);
+    bool RetrieveRaw(const uint256& hash, std::vector<unsigned char>& vchBlock);
     bool RetrieveIndex(const uint256& hash, CBlockIndex** ppIndex);
     bool RetrieveFork(const uint256& hash, CBlockIndex** ppIndex);
     bool RetrieveFork(const std::string& strName, CBlockIndex** ppIndex);
+    bool RetrieveAncestor(CBlockIndex* pIndex, int nHeight, CBlockIndex** ppIndex);
     bool RetrieveProfile(const uint256& hash, CProfile& profile);
     bool RetrieveForkContext(const uint256& hash, CForkContext& ctxt);
     bool RetrieveAncestry(const uint256& hash, std::vector<std::pair<uint256, uint256>> vAncestry);
@@ -258,6 +306,8 @@ public:
     bool RetrieveTx(const uint256& txid, CTransaction& tx, uint256& hashFork, int& nHeight);
     bool RetrieveTx(const uint256& hashFork, const uint256& txid, CTransaction& tx);
     bool RetrieveTxLocation(const uint256& txid, uint256& hashFork, int& nHeight);
+    bool RetrieveTxInBlock(const uint256& txid, CTransaction& tx, CTxContxt& txContxt, uint256& hashFork,
+                           uint256& hashBlock, int& nHeight, uint32& nTxOrdinal);
     bool RetrieveAvailDelegate(const uint256& hash, int height, const std::vector<uint256>& vBlockRange,
                                int64 nMinEnrollAmount,
                                std::map<CDestination, std::size_t>& mapWeight,
@@ -269,6 +319,7 @@ public:
     bool GetForkBlockView(const uint256& hashFork, CBlockView& view);
     bool CommitBlockView(CBlockView& view, CBlockIndex* pIndexNew);
     bool LoadIndex(CBlockOutline& diskIndex);
+    bool UnloadIndex(const uint256& hash);
     bool LoadTx(CTransaction& tx, uint32 nTxFile, uint32 nTxOffset, uint256& hashFork);
     bool FilterTx(const uint256& hashFork, CTxFilter& filter);
     bool FilterTx(const uint256& hashFork, int nDepth, CTxFilter& filter);
@@ -297,6 +348,7 @@ protected:
     CBlockIndex* GetIndex(const uint256& hash) const;
     CBlockIndex* GetOrCreateIndex(const uint256& hash);
     CBlockIndex* GetBranch(CBlockIndex* pIndexRef, CBlockIndex* pIndex, std::vector<CBlockIndex*>& vPath);
+    CBlockIndex* GetAncestor(CBlockIndex* pIndex, int nHeight);
     CBlockIndex* GetOriginIndex(const uint256& txidMint) const;
     void UpdateBlockHeightIndex(const uint256& hashFork, const uint256& hashBlock, uint32 nBlockTimeStamp, const CDestination& destMint, const uint256& hashRefBlock);
     void RemoveBlockIndex(const uint256& hashFork, const uint256& hashBlock);
@@ -310,11 +362,17 @@ protected:
     bool UpdateDelegate(const uint256& hash, CBlockEx& block, const CDiskPos& posBlock, CDelegateContext& ctxtDelegate);
     bool GetTxUnspent(const uint256 fork, const CTxOutPoint& out, CTxOut& unspent);
     bool GetTxNewIndex(CBlockView& view, CBlockIndex* pIndexNew, std::vector<std::pair<uint256, CTxIndex>>& vTxNew);
+    void GetBlockTxIndex(const CBlockEx& block, int nHeight, uint32 nFile, uint32 nOffset,
+                         std::vector<std::pair<uint256, CTxIndex>>& vTxNew);
     bool IsValidBlock(CBlockIndex* pForkLast, const uint256& hashBlock);
     bool VerifyValidBlock(CBlockIndex* pIndexGenesisLast, const CBlockIndex* pIndex);
     CBlockIndex* GetLongChainLastBlock(const uint256& hashFork, int nStartHeight, CBlockIndex* pIndexGenesisLast, const std::set<uint256>& setInvalidHash);
     void ClearCache();
     bool LoadDB();
+    bool RebuildTxIndex();
+    bool LoadIndexSnapshot(const std::vector<std::pair<uint256, uint256>>& vFork);
+    void SaveIndexSnapshot();
+    bool ScanBlockTx(const uint256& hashFork, const std::vector<CBlockIndex*>& vIndex, CTxFilter& filter);
     bool SetupLog(const boost::filesystem::path& pathDataLocation, bool fDebug);
     void Log(const char* pszIdent, const char* pszFormat, ...)
     {
@@ -354,7 +412,8 @@ protected:
     bool fDebugLog;
     CBlockDB dbBlock;
     CTimeSeriesCached tsBlock;
-    std::map<uint256, CBlockIndex*> mapIndex;
+    CBlockIndexMap mapIndex;
+    CBlockIndexSnapshot snapshotIndex;
     std::map<uint256, CForkHeightIndex> mapForkHeightIndex;
     std::map<uint256, boost::shared_ptr<CBlockFork>> mapFork;
 };
@@ -178,6 +178,11 @@ bool CBlockDB::RemoveBlock(const uint256& hash)
     return dbBlockIndex.RemoveBlock(hash);
 }
 
+bool CBlockDB::ExistsBlock(const uint256& hash)
+{
+    return dbBlockIndex.ExistsBlock(hash);
+}
+
 bool CBlockDB::UpdateDelegateContext(const uint256& hash, const CDelegateContext& ctxtDelegate)
 {
     return dbDelegate.AddNew(hash, ctxtDelegate);
@@ -200,6 +205,21 @@ bool CBlockDB::RetrieveTxIndex(const uint256& fork, const uint256& txid, CTxInde
     return dbTxIndex.Retrieve(fork, txid, txIndex);
 }
 
+bool CBlockDB::IsTxIndexRebuildRequired() const
+{
+    return dbTxIndex.IsRebuildRequired();
+}
+
+bool CBlockDB::RebuildTxIndex(const uint256& fork, const vector<pair<uint256, CTxIndex>>& vTxNew)
+{
+    return dbTxIndex.Update(fork, vTxNew, vector<uint256>());
+}
+
+bool CBlockDB::SetTxIndexRebuilt()
+{
+    return dbTxIndex.SetRebuilt();
+}
+
 bool CBlockDB::RetrieveTxUnspent(const uint256& fork, const CTxOutPoint& out, CTxOut& unspent)
 {
     return dbUnspent.Retrieve(fork, out, unspent);
@@ -210,6 +230,11 @@ bool CBlockDB::WalkThroughUnspent(const uint256& hashFork, CForkUnspentDBWalker&
     return dbUnspent.WalkThrough(hashFork, walker);
 }
 
+bool CBlockDB::WalkThroughUnspent(const uint256& hashFork, const CDestination& dest, CForkUnspentDBWalker& walker)
+{
+    return dbUnspent.WalkThrough(hashFork, dest, walker);
+}
+
 bool CBlockDB::RetrieveDelegate(const uint256& hash, map<CDestination, int64>& mapDelegate)
 {
     return dbDelegate.RetrieveDelegatedVote(hash, mapDelegate);
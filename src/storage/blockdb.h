@@ -38,12 +38,17 @@ public:
                     const std::vector<CTxUnspent>& vAddNew, const std::vector<CTxOutPoint>& vRemove);
     bool AddNewBlock(const CBlockOutline& outline);
     bool RemoveBlock(const uint256& hash);
+    bool ExistsBlock(const uint256& hash);
     bool UpdateDelegateContext(const uint256& hash, const CDelegateContext& ctxtDelegate);
     bool WalkThroughBlock(CBlockDBWalker& walker);
     bool RetrieveTxIndex(const uint256& txid, CTxIndex& txIndex, uint256& fork);
     bool RetrieveTxIndex(const uint256& fork, const uint256& txid, CTxIndex& txIndex);
+    bool IsTxIndexRebuildRequired() const;
+    bool RebuildTxIndex(const uint256& fork, const std::vector<std::pair<uint256, CTxIndex>>& vTxNew);
+    bool SetTxIndexRebuilt();
     bool RetrieveTxUnspent(const uint256& fork, const CTxOutPoint& out, CTxOut& unspent);
     bool WalkThroughUnspent(const uint256& hashFork, CForkUnspentDBWalker& walker);
+    bool WalkThroughUnspent(const uint256& hashFork, const CDestination& dest, CForkUnspentDBWalker& walker);
     bool RetrieveDelegate(const uint256& hash, std::map<CDestination, int64>& mapDelegate);
     bool RetrieveEnroll(const uint256& hash, std::map<int, std::map<CDestination, CDiskPos>>& mapEnrollTxPos);
     bool RetrieveEnroll(int height, const std::vector<uint256>& vBlockRange,
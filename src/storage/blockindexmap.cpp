@@ -0,0 +1,173 @@
+// Copyright (c) 2019-2020 The Bigbang developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockindexmap.h"
+
+using namespace std;
+
+namespace bigbang
+{
+namespace storage
+{
+
+//////////////////////////////
+// CBlockIndexMap
+
+CBlockIndexMap::CBlockIndexMap()
+  : nCount(0), nSlabUsed(SLAB_NODE_COUNT)
+{
+}
+
+CBlockIndexMap::~CBlockIndexMap()
+{
+    Clear();
+}
+
+CBlockIndex* CBlockIndexMap::Find(const uint256& hash) const
+{
+    if (vSlot.empty())
+    {
+        return nullptr;
+    }
+    const CSlot& slot = vSlot[FindSlot(hash, GetKey(hash))];
+    return (slot.pNode != nullptr ? &slot.pNode->index : nullptr);
+}
+
+CBlockIndex* CBlockIndexMap::Insert(const uint256& hash, const CBlockIndex& index)
+{
+    // keep the load factor under 1/2, probe chains stay short
+    if ((nCount + 1) * 2 > vSlot.size())
+    {
+        Rehash(max((size_t)MIN_SLOT_COUNT, vSlot.size() * 2));
+    }
+
+    const uint64 nKey = GetKey(hash);
+    CSlot& slot = vSlot[FindSlot(hash, nKey)];
+    if (slot.pNode == nullptr)
+    {
+        CNode* pNode = AllocNode();
+        pNode->hash = hash;
+        pNode->index = index;
+        pNode->index.phashBlock = &pNode->hash;
+        if (index.pOrigin == &index)
+        {
+            pNode->index.pOrigin = &pNode->index;
+        }
+        slot.nKey = nKey;
+        slot.pNode = pNode;
+        nCount++;
+    }
+    return &slot.pNode->index;
+}
+
+bool CBlockIndexMap::Erase(const uint256& hash)
+{
+    if (vSlot.empty())
+    {
+        return false;
+    }
+    const size_t nMask = vSlot.size() - 1;
+    size_t nHole = FindSlot(hash, GetKey(hash));
+    if (vSlot[nHole].pNode == nullptr)
+    {
+        return false;
+    }
+    FreeNode(vSlot[nHole].pNode);
+    vSlot[nHole].pNode = nullptr;
+    nCount--;
+
+    // backward shift the rest of the probe chain, no tombstones are left behind
+    size_t i = nHole;
+    while (true)
+    {
+        i = (i + 1) & nMask;
+        if (vSlot[i].pNode == nullptr)
+        {
+            break;
+        }
+        size_t nHome = vSlot[i].nKey & nMask;
+        if (((i - nHome) & nMask) >= ((i - nHole) & nMask))
+        {
+            vSlot[nHole] = vSlot[i];
+            vSlot[i].pNode = nullptr;
+            nHole = i;
+        }
+    }
+    return true;
+}
+
+void CBlockIndexMap::Clear()
+{
+    for (CNode* pSlab : vSlab)
+    {
+        delete[] pSlab;
+    }
+    vSlab.clear();
+    vFreeNode.clear();
+    nSlabUsed = SLAB_NODE_COUNT;
+    vSlot.clear();
+    nCount = 0;
+}
+
+size_t CBlockIndexMap::GetMemoryUsage() const
+{
+    return (vSlot.capacity() * sizeof(CSlot) + vSlab.size() * SLAB_NODE_COUNT * sizeof(CNode)
+            + vFreeNode.capacity() * sizeof(CNode*));
+}
+
+size_t CBlockIndexMap::FindSlot(const uint256& hash, uint64 nKey) const
+{
+    const size_t nMask = vSlot.size() - 1;
+    size_t i = nKey & nMask;
+    while (vSlot[i].pNode != nullptr && (vSlot[i].nKey != nKey || vSlot[i].pNode->hash != hash))
+    {
+        i = (i + 1) & nMask;
+    }
+    return i;
+}
+
+CBlockIndexMap::CNode* CBlockIndexMap::AllocNode()
+{
+    if (!vFreeNode.empty())
+    {
+        CNode* pNode = vFreeNode.back();
+        vFreeNode.pop_back();
+        return pNode;
+    }
+    if (nSlabUsed == SLAB_NODE_COUNT)
+    {
+        vSlab.push_back(new CNode[SLAB_NODE_COUNT]);
+        nSlabUsed = 0;
+    }
+    return &vSlab.back()[nSlabUsed++];
+}
+
+void CBlockIndexMap::FreeNode(CNode* pNode)
+{
+    vFreeNode.push_back(pNode);
+}
+
+void CBlockIndexMap::Rehash(size_t nNewSlotCount)
+{
+    vector<CSlot> vOld;
+    vOld.swap(vSlot);
+    vSlot.assign(nNewSlotCount, CSlot{ 0, nullptr });
+
+    const size_t nMask = nNewSlotCount - 1;
+    for (const CSlot& slot : vOld)
+    {
+        if (slot.pNode != nullptr)
+        {
+            size_t i = slot.nKey & nMask;
+            while (vSlot[i].pNode != nullptr)
+            {
+                i = (i + 1) & nMask;
+            }
+            vSlot[i] = slot;
+        }
+    }
+}
+
+} // namespace storage
+} // namespace bigbang
@@ -0,0 +1,93 @@
+// Copyright (c) 2019-2020 The Bigbang developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef STORAGE_BLOCKINDEXMAP_H
+#define STORAGE_BLOCKINDEXMAP_H
+
+#include <vector>
+
+#include "block.h"
+#include "uint256.h"
+
+namespace bigbang
+{
+namespace storage
+{
+
+// Block index nodes are carved out of fixed size slabs, so they never move and their
+// block hash can be referenced by CBlockIndex::phashBlock. Lookup is a linear probing
+// table over the low 64 bits of the block hash, the high word holds the block height.
+class CBlockIndexMap
+{
+public:
+    CBlockIndexMap();
+    ~CBlockIndexMap();
+    std::size_t Size() const
+    {
+        return nCount;
+    }
+    bool Empty() const
+    {
+        return (nCount == 0);
+    }
+    std::size_t Count(const uint256& hash) const
+    {
+        return (Find(hash) != nullptr ? 1 : 0);
+    }
+    CBlockIndex* Find(const uint256& hash) const;
+    // Add a node copied from index, returns the existing node if the hash is already present
+    CBlockIndex* Insert(const uint256& hash, const CBlockIndex& index = CBlockIndex());
+    bool Erase(const uint256& hash);
+    void Clear();
+    std::size_t GetMemoryUsage() const;
+    template <typename F>
+    void ForEach(F f) const
+    {
+        for (const CSlot& slot : vSlot)
+        {
+            if (slot.pNode != nullptr)
+            {
+                f(slot.pNode->hash, &slot.pNode->index);
+            }
+        }
+    }
+
+protected:
+    enum
+    {
+        SLAB_NODE_COUNT = 4096,
+        MIN_SLOT_COUNT = 1024
+    };
+    struct CNode
+    {
+        uint256 hash;
+        CBlockIndex index;
+    };
+    struct CSlot
+    {
+        uint64 nKey;
+        CNode* pNode;
+    };
+
+    static uint64 GetKey(const uint256& hash)
+    {
+        return hash.Get64(0);
+    }
+    std::size_t FindSlot(const uint256& hash, uint64 nKey) const;
+    CNode* AllocNode();
+    void FreeNode(CNode* pNode);
+    void Rehash(std::size_t nNewSlotCount);
+
+protected:
+    std::vector<CSlot> vSlot;
+    std::size_t nCount;
+    std::vector<CNode*> vSlab;
+    std::size_t nSlabUsed;
+    std::vector<CNode*> vFreeNode;
+};
+
+} // namespace storage
+} // namespace bigbang
+
+#endif //STORAGE_BLOCKINDEXMAP_H
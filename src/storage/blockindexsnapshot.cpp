@@ -0,0 +1,389 @@
+// Copyright (c) 2019-2020 The Bigbang developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockindexsnapshot.h"
+
+#include <unistd.h>
+
+#include "crypto.h"
+#include "mappedfile.h"
+
+using namespace std;
+using namespace boost::filesystem;
+using namespace xengine;
+
+#define SNAPSHOT_CHECKSUM_CHUNK (1024 * 1024)
+#define JOURNAL_TAIL_SIZE 64
+
+namespace bigbang
+{
+namespace storage
+{
+
+static size_t GetOutlineSize()
+{
+    static size_t nSize = 0;
+    if (nSize == 0)
+    {
+        CBufStream ss;
+        ss << CBlockOutline();
+        nSize = ss.GetSize();
+    }
+    return nSize;
+}
+
+// The body checksum chains the hashes of fixed size chunks, so it can be computed while writing
+static uint256 UpdateChecksum(const uint256& hashChecksum, const char* pData, size_t nSize)
+{
+    return crypto::CryptoHash(hashChecksum, crypto::CryptoHash(pData, nSize));
+}
+
+//////////////////////////////
+// CBlockIndexSnapshot
+
+CBlockIndexSnapshot::CBlockIndexSnapshot()
+  : fpJournal(nullptr), nJournalCount(0)
+{
+}
+
+CBlockIndexSnapshot::~CBlockIndexSnapshot()
+{
+    Deinitialize();
+}
+
+bool CBlockIndexSnapshot::Initialize(const path& pathData)
+{
+    path pathBlock = pathData / "block";
+
+    if (!exists(pathBlock))
+    {
+        create_directories(pathBlock);
+    }
+
+    if (!is_directory(pathBlock))
+    {
+        return false;
+    }
+
+    pathSnapshot = pathBlock / "index.snapshot";
+    pathJournal = pathBlock / "index.journal";
+
+    return true;
+}
+
+void CBlockIndexSnapshot::Deinitialize()
+{
+    if (fpJournal != nullptr)
+    {
+        fclose(fpJournal);
+        fpJournal = nullptr;
+    }
+    nJournalCount = 0;
+    dqJournalTail.clear();
+}
+
+bool CBlockIndexSnapshot::Remove()
+{
+    Deinitialize();
+    try
+    {
+        if (is_regular_file(pathSnapshot))
+        {
+            remove(pathSnapshot);
+        }
+        if (is_regular_file(pathJournal))
+        {
+            remove(pathJournal);
+        }
+    }
+    catch (std::exception& e)
+    {
+        StdError(__PRETTY_FUNCTION__, e.what());
+        return false;
+    }
+    return true;
+}
+
+bool CBlockIndexSnapshot::Save(const CBlockIndexMap& mapIndex, const vector<pair<uint256, uint256>>& vFork)
+{
+    Deinitialize();
+
+    path pathTemp = pathSnapshot;
+    pathTemp += ".tmp";
+    FILE* fp = fopen(pathTemp.c_str(), "wb");
+    if (fp == nullptr)
+    {
+        return false;
+    }
+
+    uint256 hashChecksum;
+    bool fWrite = true;
+    try
+    {
+        // header, the checksum is written again at the end
+        CBufStream ss;
+        ss << (uint32)SNAPSHOT_MAGIC << (uint32)SNAPSHOT_VERSION << (uint64)mapIndex.Size() << (uint32)vFork.size() << hashChecksum;
+        const size_t nHeaderSize = ss.GetSize();
+        fWrite = (fwrite(ss.GetData(), 1, nHeaderSize, fp) == nHeaderSize);
+        ss.Clear();
+
+        auto fnFlush = [&](size_t nMinSize) {
+            while (fWrite && ss.GetSize() >= nMinSize && ss.GetSize() > 0)
+            {
+                size_t nChunk = min(ss.GetSize(), (size_t)SNAPSHOT_CHECKSUM_CHUNK);
+                hashChecksum = UpdateChecksum(hashChecksum, ss.GetData(), nChunk);
+                fWrite = (fwrite(ss.GetData(), 1, nChunk, fp) == nChunk);
+                ss.consume(nChunk);
+            }
+        };
+        mapIndex.ForEach([&](const uint256& hash, const CBlockIndex* pIndex) {
+            ss << CBlockOutline(pIndex);
+            fnFlush(SNAPSHOT_CHECKSUM_CHUNK);
+        });
+        for (const pair<uint256, uint256>& fork : vFork)
+        {
+            ss << fork.first << fork.second;
+        }
+        fnFlush(0);
+
+        ss.Clear();
+        ss << (uint32)SNAPSHOT_MAGIC << (uint32)SNAPSHOT_VERSION << (uint64)mapIndex.Size() << (uint32)vFork.size() << hashChecksum;
+        fWrite = fWrite && (fseek(fp, 0, SEEK_SET) == 0) && (fwrite(ss.GetData(), 1, nHeaderSize, fp) == nHeaderSize);
+        fWrite = fWrite && (fflush(fp) == 0) && (fsync(fileno(fp)) == 0);
+    }
+    catch (std::exception& e)
+    {
+        StdError(__PRETTY_FUNCTION__, e.what());
+        fWrite = false;
+    }
+    fclose(fp);
+
+    try
+    {
+        if (!fWrite)
+        {
+            remove(pathTemp);
+            return false;
+        }
+        rename(pathTemp, pathSnapshot);
+    }
+    catch (std::exception& e)
+    {
+        StdError(__PRETTY_FUNCTION__, e.what());
+        return false;
+    }
+
+    return OpenJournal(hashChecksum, true);
+}
+
+bool CBlockIndexSnapshot::Load(CBlockIndexSnapshotWalker& walker, vector<pair<uint256, uint256>>& vFork)
+{
+    Deinitialize();
+    vFork.clear();
+
+    uint256 hashChecksum;
+    if (!LoadSnapshot(walker, vFork, hashChecksum) || !LoadJournal(walker, hashChecksum))
+    {
+        return false;
+    }
+    return OpenJournal(hashChecksum, false);
+}
+
+void CBlockIndexSnapshot::AddNewBlock(const CBlockOutline& outline)
+{
+    if (fpJournal != nullptr)
+    {
+        CBufStream ss;
+        ss << outline;
+        AppendJournal(JOURNAL_ADDNEW, ss);
+    }
+}
+
+void CBlockIndexSnapshot::RemoveBlock(const uint256& hashBlock)
+{
+    if (fpJournal != nullptr)
+    {
+        CBufStream ss;
+        ss << hashBlock;
+        AppendJournal(JOURNAL_REMOVE, ss);
+    }
+}
+
+void CBlockIndexSnapshot::GetJournalTail(vector<pair<uint8, uint256>>& vTail) const
+{
+    vTail.assign(dqJournalTail.begin(), dqJournalTail.end());
+}
+
+bool CBlockIndexSnapshot::LoadSnapshot(CBlockIndexSnapshotWalker& walker, vector<pair<uint256, uint256>>& vFork, uint256& hashChecksum)
+{
+    CMappedFile file;
+    if (!is_regular_file(pathSnapshot) || !file.Open(pathSnapshot.string()))
+    {
+        return false;
+    }
+
+    try
+    {
+        CMemoryStream ms(file.GetData(), file.GetSize());
+        uint32 nMagic, nVersion, nForkCount;
+        uint64 nIndexCount;
+        ms >> nMagic >> nVersion >> nIndexCount >> nForkCount >> hashChecksum;
+        if (nMagic != SNAPSHOT_MAGIC || nVersion != SNAPSHOT_VERSION)
+        {
+            StdLog("BlockIndexSnapshot", "Load: unknown snapshot version %u", nVersion);
+            return false;
+        }
+        const size_t nBodySize = ms.GetSize();
+        if (nBodySize != nIndexCount * GetOutlineSize() + nForkCount * 2 * sizeof(uint256))
+        {
+            StdLog("BlockIndexSnapshot", "Load: snapshot size mismatch");
+            return false;
+        }
+
+        uint256 hashCalc;
+        for (size_t nPos = 0; nPos < nBodySize; nPos += SNAPSHOT_CHECKSUM_CHUNK)
+        {
+            hashCalc = UpdateChecksum(hashCalc, ms.GetData() + nPos, min(nBodySize - nPos, (size_t)SNAPSHOT_CHECKSUM_CHUNK));
+        }
+        if (hashCalc != hashChecksum)
+        {
+            StdLog("BlockIndexSnapshot", "Load: snapshot checksum mismatch");
+            return false;
+        }
+
+        for (uint64 i = 0; i < nIndexCount; i++)
+        {
+            CBlockOutline outline;
+            ms >> outline;
+            if (!walker.Walk(outline))
+            {
+                return false;
+            }
+        }
+        vFork.resize(nForkCount);
+        for (uint32 i = 0; i < nForkCount; i++)
+        {
+            ms >> vFork[i].first >> vFork[i].second;
+        }
+    }
+    catch (std::exception& e)
+    {
+        StdError(__PRETTY_FUNCTION__, e.what());
+        return false;
+    }
+    return true;
+}
+
+bool CBlockIndexSnapshot::LoadJournal(CBlockIndexSnapshotWalker& walker, const uint256& hashChecksum)
+{
+    CMappedFile file;
+    if (!is_regular_file(pathJournal) || !file.Open(pathJournal.string()))
+    {
+        return false;
+    }
+
+    try
+    {
+        CMemoryStream ms(file.GetData(), file.GetSize());
+        uint256 hashSnapshot;
+        ms >> hashSnapshot;
+        if (hashSnapshot != hashChecksum)
+        {
+            StdLog("BlockIndexSnapshot", "Load: journal does not follow the snapshot");
+            return false;
+        }
+
+        while (ms.GetSize() > 0)
+        {
+            // an entry torn by a crash leaves the journal unusable
+            const char* pEntry = ms.GetData();
+            uint8 nOp;
+            uint32 nCheck;
+            ms >> nOp;
+            if (nOp == JOURNAL_ADDNEW)
+            {
+                CBlockOutline outline;
+                ms >> outline >> nCheck;
+                if (nCheck != crypto::CryptoHash(pEntry, ms.GetData() - pEntry - sizeof(nCheck)).Get32() || !walker.Walk(outline))
+                {
+                    return false;
+                }
+                dqJournalTail.push_back(make_pair(nOp, outline.GetBlockHash()));
+            }
+            else if (nOp == JOURNAL_REMOVE)
+            {
+                uint256 hashBlock;
+                ms >> hashBlock >> nCheck;
+                if (nCheck != crypto::CryptoHash(pEntry, ms.GetData() - pEntry - sizeof(nCheck)).Get32() || !walker.Remove(hashBlock))
+                {
+                    return false;
+                }
+                dqJournalTail.push_back(make_pair(nOp, hashBlock));
+            }
+            else
+            {
+                return false;
+            }
+            if (dqJournalTail.size() > JOURNAL_TAIL_SIZE)
+            {
+                dqJournalTail.pop_front();
+            }
+            nJournalCount++;
+        }
+    }
+    catch (std::exception& e)
+    {
+        StdLog("BlockIndexSnapshot", "Load: journal truncated, %s", e.what());
+        return false;
+    }
+    return true;
+}
+
+bool CBlockIndexSnapshot::OpenJournal(const uint256& hashChecksum, bool fReset)
+{
+    if (fpJournal != nullptr)
+    {
+        fclose(fpJournal);
+    }
+    fpJournal = fopen(pathJournal.c_str(), fReset ? "wb" : "ab");
+    if (fpJournal == nullptr)
+    {
+        return false;
+    }
+    if (fReset)
+    {
+        nJournalCount = 0;
+        CBufStream ss;
+        ss << hashChecksum;
+        if (fwrite(ss.GetData(), 1, ss.GetSize(), fpJournal) != ss.GetSize() || fflush(fpJournal) != 0
+            || fsync(fileno(fpJournal)) != 0)
+        {
+            fclose(fpJournal);
+            fpJournal = nullptr;
+            return false;
+        }
+    }
+    return true;
+}
+
+void CBlockIndexSnapshot::AppendJournal(uint8 nOp, CBufStream& ssPayload)
+{
+    CBufStream ss;
+    ss << nOp << ssPayload;
+    uint32 nCheck = crypto::CryptoHash(ss.GetData(), ss.GetSize()).Get32();
+    ss << nCheck;
+    // every entry is one block committed to the block db, it must reach the disk ahead of the db
+    if (fwrite(ss.GetData(), 1, ss.GetSize(), fpJournal) != ss.GetSize() || fflush(fpJournal) != 0
+        || fsync(fileno(fpJournal)) != 0)
+    {
+        // without the entry the journal no longer matches the index, drop it with the snapshot
+        StdError("BlockIndexSnapshot", "Append journal fail");
+        Remove();
+        return;
+    }
+    nJournalCount++;
+}
+
+} // namespace storage
+} // namespace bigbang
@@ -0,0 +1,80 @@
+// Copyright (c) 2019-2020 The Bigbang developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef STORAGE_BLOCKINDEXSNAPSHOT_H
+#define STORAGE_BLOCKINDEXSNAPSHOT_H
+
+#include <boost/filesystem.hpp>
+#include <deque>
+
+#include "block.h"
+#include "blockindexdb.h"
+#include "blockindexmap.h"
+#include "xengine.h"
+
+namespace bigbang
+{
+namespace storage
+{
+
+class CBlockIndexSnapshotWalker : public CBlockDBWalker
+{
+public:
+    virtual bool Remove(const uint256& hashBlock) = 0;
+};
+
+// Image of the block index for fast startup.
+// index.snapshot : header | CBlockOutline * nIndexCount | (fork, last block) * nForkCount
+//                  every outline has the same serialized size, the file is read through a mapping
+// index.journal  : snapshot checksum | (op, outline or hash, check) ...
+//                  block index changes since the snapshot, replayed after it on load
+class CBlockIndexSnapshot
+{
+public:
+    enum
+    {
+        SNAPSHOT_MAGIC = 0x53584942,
+        SNAPSHOT_VERSION = 1
+    };
+    enum
+    {
+        JOURNAL_ADDNEW = 1,
+        JOURNAL_REMOVE = 2
+    };
+
+    CBlockIndexSnapshot();
+    ~CBlockIndexSnapshot();
+    bool Initialize(const boost::filesystem::path& pathData);
+    void Deinitialize();
+    bool Remove();
+    bool Save(const CBlockIndexMap& mapIndex, const std::vector<std::pair<uint256, uint256>>& vFork);
+    // Walk the snapshot then replay the journal in order
+    bool Load(CBlockIndexSnapshotWalker& walker, std::vector<std::pair<uint256, uint256>>& vFork);
+    void AddNewBlock(const CBlockOutline& outline);
+    void RemoveBlock(const uint256& hashBlock);
+    std::size_t GetJournalCount() const
+    {
+        return nJournalCount;
+    }
+    // The last entries replayed by Load, (op, block hash) in journal order
+    void GetJournalTail(std::vector<std::pair<uint8, uint256>>& vTail) const;
+
+protected:
+    bool LoadSnapshot(CBlockIndexSnapshotWalker& walker, std::vector<std::pair<uint256, uint256>>& vFork, uint256& hashChecksum);
+    bool LoadJournal(CBlockIndexSnapshotWalker& walker, const uint256& hashChecksum);
+    bool OpenJournal(const uint256& hashChecksum, bool fReset);
+    void AppendJournal(uint8 nOp, xengine::CBufStream& ss);
+
+protected:
+    boost::filesystem::path pathSnapshot;
+    boost::filesystem::path pathJournal;
+    FILE* fpJournal;
+    std::size_t nJournalCount;
+    std::deque<std::pair<uint8, uint256>> dqJournalTail;
+};
+
+} // namespace storage
+} // namespace bigbang
+
+#endif //STORAGE_BLOCKINDEXSNAPSHOT_H
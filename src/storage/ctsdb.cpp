@@ -6,6 +6,7 @@
 
 #include <boost/bind.hpp>
 
+#include "leveldb/filter_policy.h"
 #include "leveldbeng.h"
 
 using namespace std;
@@ -48,9 +49,10 @@ void CCTSIndex::Deinitialize()
     Close();
 }
 
-bool CCTSIndex::Update(const vector<int64>& vTime, const vector<CDiskPos>& vPos, const vector<int64>& vDel)
+bool CCTSIndex::Update(const vector<int64>& vTime, const vector<CDiskPos>& vPos,
+                       const vector<string>& vFilter, const vector<int64>& vDel)
 {
-    if (vTime.size() != vPos.size())
+    if (vTime.size() != vPos.size() || vTime.size() != vFilter.size())
     {
         return false;
     }
@@ -63,11 +65,13 @@ bool CCTSIndex::Update(const vector<int64>& vTime, const vector<CDiskPos>& vPos,
     for (int i = 0; i < vTime.size(); i++)
     {
         Write(vTime[i], vPos[i]);
+        Write(make_pair(string("filter"), vTime[i]), vFilter[i]);
     }
 
     for (int i = 0; i < vDel.size(); i++)
     {
         Erase(vDel[i]);
+        Erase(make_pair(string("filter"), vDel[i]));
     }
 
     if (!TxnCommit())
@@ -83,5 +87,37 @@ bool CCTSIndex::Retrieve(const int64 nTime, CDiskPos& pos)
     return Read(nTime, pos);
 }
 
+bool CCTSIndex::RetrieveFilter(const int64 nTime, string& strFilter)
+{
+    return Read(make_pair(string("filter"), nTime), strFilter);
+}
+
+//////////////////////////////
+// CCTSFilter
+
+#define FILTER_BITS_PER_KEY (10)
+
+static const leveldb::FilterPolicy& GetFilterPolicy()
+{
+    static std::unique_ptr<const leveldb::FilterPolicy> policy(leveldb::NewBloomFilterPolicy(FILTER_BITS_PER_KEY));
+    return *policy;
+}
+
+void CCTSFilter::Create(const char* pKey, size_t nKeySize, size_t nStride, size_t nCount, string& strFilter)
+{
+    vector<leveldb::Slice> vKey;
+    vKey.reserve(nCount);
+    for (size_t i = 0; i < nCount; i++)
+    {
+        vKey.push_back(leveldb::Slice(pKey + i * nStride, nKeySize));
+    }
+    GetFilterPolicy().CreateFilter(vKey.data(), vKey.size(), &strFilter);
+}
+
+bool CCTSFilter::KeyMayMatch(const char* pKey, size_t nKeySize, const string& strFilter)
+{
+    return GetFilterPolicy().KeyMayMatch(leveldb::Slice(pKey, nKeySize), leveldb::Slice(strFilter));
+}
+
 } // namespace storage
 } // namespace bigbang
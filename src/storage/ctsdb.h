@@ -14,6 +14,8 @@
 #include "xengine.h"
 
 #define FLUSH_THRESH (1000)
+#define CHUNK_CACHE_SIZE (0x800000)
+#define FILTER_CACHE_SIZE (0x200000)
 
 namespace bigbang
 {
@@ -28,8 +30,17 @@ public:
     bool Initialize(const boost::filesystem::path& pathCTSDB);
     void Deinitialize();
     bool Update(const std::vector<int64>& vTime, const std::vector<CDiskPos>& vPos,
-                const std::vector<int64>& vDel);
+                const std::vector<std::string>& vFilter, const std::vector<int64>& vDel);
     bool Retrieve(const int64, CDiskPos& pos);
+    bool RetrieveFilter(const int64 nTime, std::string& strFilter);
+};
+
+class CCTSFilter
+{
+public:
+    static void Create(const char* pKey, std::size_t nKeySize, std::size_t nStride, std::size_t nCount,
+                       std::string& strFilter);
+    static bool KeyMayMatch(const char* pKey, std::size_t nKeySize, const std::string& strFilter);
 };
 
 template <typename K, typename V>
@@ -45,7 +56,7 @@ public:
       : basetype(first, last)
     {
     }
-    bool Find(const K& k, V& v)
+    bool Find(const K& k, V& v) const
     {
         int s = 0, m = 0, e = basetype::size() - 1;
         while (s <= e)
@@ -133,6 +144,8 @@ template <typename K, typename V, typename C = CCTSChunk<K, V>>
 class CCTSDB
 {
     typedef std::map<int64, std::map<K, V>> MapType;
+    typedef std::shared_ptr<const C> ChunkPtr;
+    typedef std::shared_ptr<const std::string> FilterPtr;
     class CDblMap
     {
     public:
@@ -165,6 +178,8 @@ class CCTSDB
     };
 
 public:
+    CCTSDB()
+      : cacheChunk(CHUNK_CACHE_SIZE), cacheFilter(FILTER_CACHE_SIZE) {}
     bool Initialize(const boost::filesystem::path& pathCTSDB)
     {
         if (!boost::filesystem::exists(pathCTSDB))
@@ -194,11 +209,15 @@ public:
         dbIndex.Deinitialize();
         tsChunk.Deinitialize();
         dblMeta.Clear();
+        cacheChunk.Clear();
+        cacheFilter.Clear();
     }
     void RemoveAll()
     {
         dbIndex.RemoveAll();
         dblMeta.Clear();
+        cacheChunk.Clear();
+        cacheFilter.Clear();
     }
     void Update(const int64 nTime, const K& key, const V& value)
     {
@@ -214,7 +233,6 @@ public:
     }
     bool Retrieve(const int64 nTime, const K& key, V& value)
     {
-        
         xengine::CReadLock rlock(rwMap);
         MapType& mapUpper = dblMeta.GetUpperMap();
         typename MapType::iterator it = mapUpper.find(nTime);
@@ -229,14 +247,16 @@ public:
             }
             return false;
         }
-        
-        C chunk;
-        if (LoadFromFile(nTime, chunk))
+
+        ChunkPtr spChunk;
+        if (!cacheChunk.Retrieve(nTime, spChunk))
         {
-            return chunk.Find(key, value);
+            if (!KeyMayMatch(nTime, key) || !LoadFromFile(nTime, spChunk))
+            {
+                return false;
+            }
         }
-
-        return false;
+        return spChunk->Find(key, value);
     }
 
     bool Flush(bool fAll = true)
@@ -245,6 +265,7 @@ public:
 
         std::vector<int64> vTime, vDel;
         std::vector<C> vChunk;
+        std::vector<std::string> vFilter;
         MapType& flushMap = dblMeta.GetUpperMap();
         if (!fAll && flushMap.size() < FLUSH_THRESH)
         {
@@ -262,6 +283,10 @@ public:
             {
                 vTime.push_back((*it).first);
                 vChunk.push_back(C(mapValue.begin(), mapValue.end()));
+
+                const C& chunk = vChunk.back();
+                vFilter.push_back(std::string());
+                CCTSFilter::Create((const char*)&chunk[0].first, sizeof(K), sizeof(std::pair<K, V>), chunk.size(), vFilter.back());
             }
         }
 
@@ -276,7 +301,7 @@ public:
 
         if (!vPos.empty() || !vDel.empty())
         {
-            if (!dbIndex.Update(vTime, vPos, vDel))
+            if (!dbIndex.Update(vTime, vPos, vFilter, vDel))
             {
                 return false;
             }
@@ -284,11 +309,24 @@ public:
 
         ulock.Upgrade();
         flushMap.clear();
-       
+
+        // Readers are excluded here, so no chunk loaded through the old index can be cached afterwards
+        for (std::size_t i = 0; i < vTime.size(); i++)
+        {
+            std::size_t nChunkSize = vChunk[i].size() * sizeof(std::pair<K, V>);
+            std::size_t nFilterCost = GetFilterCost(vFilter[i]);
+            cacheChunk.AddNew(vTime[i], ChunkPtr(new C(std::move(vChunk[i]))), nChunkSize);
+            cacheFilter.AddNew(vTime[i], FilterPtr(new std::string(std::move(vFilter[i]))), nFilterCost);
+        }
+        for (const int64 nTime : vDel)
+        {
+            cacheChunk.Remove(nTime);
+            cacheFilter.Remove(nTime);
+        }
+
         return true;
     }
 
-
 protected:
     std::map<K, V>& GetUpdateMap(const int64 nTime)
     {
@@ -300,29 +338,56 @@ protected:
             return (*it).second;
         }
 
-        C chunk;
-        if (LoadFromFile(nTime, chunk))
+        ChunkPtr spChunk;
+        if (cacheChunk.Retrieve(nTime, spChunk) || LoadFromFile(nTime, spChunk))
         {
-            mapUpdate[nTime].insert(chunk.begin(), chunk.end());
+            mapUpdate[nTime].insert(spChunk->begin(), spChunk->end());
         }
         return mapUpdate[nTime];
     }
-    
-    bool LoadFromFile(const int64 nTime, C& chunk)
+
+    bool LoadFromFile(const int64 nTime, ChunkPtr& spChunk)
     {
         CDiskPos pos;
         if (dbIndex.Retrieve(nTime, pos))
         {
-            return tsChunk.Read(chunk, pos);
+            C* pChunk = new C();
+            spChunk = ChunkPtr(pChunk);
+            if (tsChunk.Read(*pChunk, pos))
+            {
+                cacheChunk.AddNew(nTime, spChunk, pChunk->size() * sizeof(std::pair<K, V>));
+                return true;
+            }
         }
         return false;
     }
 
+    bool KeyMayMatch(const int64 nTime, const K& key)
+    {
+        FilterPtr spFilter;
+        if (!cacheFilter.Retrieve(nTime, spFilter))
+        {
+            // Chunks written before filters existed are cached with an empty filter
+            std::string* pFilter = new std::string();
+            spFilter = FilterPtr(pFilter);
+            dbIndex.RetrieveFilter(nTime, *pFilter);
+            cacheFilter.AddNew(nTime, spFilter, GetFilterCost(*pFilter));
+        }
+        return (spFilter->empty() || CCTSFilter::KeyMayMatch((const char*)&key, sizeof(K), *spFilter));
+    }
+    // An empty filter is still an entry, it must count for the cache to evict it
+    static std::size_t GetFilterCost(const std::string& strFilter)
+    {
+        return (sizeof(std::string) + strFilter.size());
+    }
+
 protected:
     xengine::CRWAccess rwMap;
     CCTSIndex dbIndex;
     CTimeSeriesChunk tsChunk;
     CDblMap dblMeta;
+    xengine::CShardedLRUCache<int64, ChunkPtr> cacheChunk;
+    xengine::CShardedLRUCache<int64, FilterPtr> cacheFilter;
 };
 
 } // namespace storage
@@ -38,7 +38,6 @@ CLevelDBEngine::CLevelDBEngine(CLevelDBArguments& arguments)
     options.max_open_files = arguments.files;
 
     pdb = nullptr;
-    piter = nullptr;
     pbatch = nullptr;
 
     readoptions.verify_checksums = true;
@@ -51,8 +50,6 @@ CLevelDBEngine::~CLevelDBEngine()
 {
     delete pbatch;
     pbatch = nullptr;
-    delete piter;
-    piter = nullptr;
     delete pdb;
     pdb = nullptr;
     delete options.filter_policy;
@@ -76,8 +73,6 @@ void CLevelDBEngine::Close()
 {
     delete pbatch;
     pbatch = nullptr;
-    delete piter;
-    piter = nullptr;
     delete pdb;
     pdb = nullptr;
 }
@@ -177,11 +172,37 @@ bool CLevelDBEngine::RemoveAll()
     return Open();
 }
 
-bool CLevelDBEngine::MoveFirst()
+CKVDBIterator* CLevelDBEngine::NewIterator()
+{
+    if (pdb == nullptr)
+    {
+        return nullptr;
+    }
+    return new CLevelDBIterator(pdb, readoptions);
+}
+
+//////////////////////////////
+// CLevelDBIterator
+
+CLevelDBIterator::CLevelDBIterator(leveldb::DB* pdbIn, const leveldb::ReadOptions& readoptionsIn)
+  : pdb(pdbIn)
+{
+    leveldb::ReadOptions options = readoptionsIn;
+    psnapshot = pdb->GetSnapshot();
+    options.snapshot = psnapshot;
+    piter = pdb->NewIterator(options);
+}
+
+CLevelDBIterator::~CLevelDBIterator()
 {
     delete piter;
+    piter = nullptr;
+    pdb->ReleaseSnapshot(psnapshot);
+}
 
-    if ((piter = pdb->NewIterator(readoptions)) == nullptr)
+bool CLevelDBIterator::MoveFirst()
+{
+    if (piter == nullptr)
     {
         return false;
     }
@@ -191,23 +212,20 @@ bool CLevelDBEngine::MoveFirst()
     return true;
 }
 
-bool CLevelDBEngine::MoveTo(CBufStream& ssKey)
+bool CLevelDBIterator::MoveTo(CBufStream& ssKey)
 {
-    delete piter;
-
-    leveldb::Slice slKey(ssKey.GetData(), ssKey.GetSize());
-
-    if ((piter = pdb->NewIterator(readoptions)) == nullptr)
+    if (piter == nullptr)
     {
         return false;
     }
 
+    leveldb::Slice slKey(ssKey.GetData(), ssKey.GetSize());
     piter->Seek(slKey);
 
     return true;
 }
 
-bool CLevelDBEngine::MoveNext(CBufStream& ssKey, CBufStream& ssValue)
+bool CLevelDBIterator::MoveNext(CBufStream& ssKey, CBufStream& ssValue)
 {
     if (piter == nullptr || !piter->Valid())
         return false;
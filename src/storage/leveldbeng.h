@@ -28,6 +28,22 @@ public:
     int files;
 };
 
+class CLevelDBIterator : public xengine::CKVDBIterator
+{
+public:
+    CLevelDBIterator(leveldb::DB* pdbIn, const leveldb::ReadOptions& readoptionsIn);
+    ~CLevelDBIterator();
+
+    bool MoveFirst() override;
+    bool MoveTo(xengine::CBufStream& ssKey) override;
+    bool MoveNext(xengine::CBufStream& ssKey, xengine::CBufStream& ssValue) override;
+
+protected:
+    leveldb::DB* pdb;
+    const leveldb::Snapshot* psnapshot;
+    leveldb::Iterator* piter;
+};
+
 class CLevelDBEngine : public xengine::CKVDBEngine
 {
 public:
@@ -43,14 +59,11 @@ public:
     bool Put(xengine::CBufStream& ssKey, xengine::CBufStream& ssValue, bool fOverwrite) override;
     bool Remove(xengine::CBufStream& ssKey) override;
     bool RemoveAll() override;
-    bool MoveFirst() override;
-    bool MoveTo(xengine::CBufStream& ssKey) override;
-    bool MoveNext(xengine::CBufStream& ssKey, xengine::CBufStream& ssValue) override;
+    xengine::CKVDBIterator* NewIterator() override;
 
 protected:
     std::string path;
     leveldb::DB* pdb;
-    leveldb::Iterator* piter;
     leveldb::WriteBatch* pbatch;
     leveldb::Options options;
     leveldb::ReadOptions readoptions;
@@ -0,0 +1,81 @@
+// Copyright (c) 2019-2020 The Bigbang developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "mappedfile.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace bigbang
+{
+namespace storage
+{
+
+//////////////////////////////
+// CMappedFile
+
+CMappedFile::CMappedFile()
+  : pData(nullptr), nSize(0)
+{
+}
+
+CMappedFile::~CMappedFile()
+{
+    Close();
+}
+
+bool CMappedFile::Open(const string& strPath)
+{
+    Close();
+
+    int fd = open(strPath.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0)
+    {
+        close(fd);
+        return false;
+    }
+    void* p = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED)
+    {
+        return false;
+    }
+    pData = (const char*)p;
+    nSize = (size_t)st.st_size;
+    return true;
+}
+
+void CMappedFile::WillNeed(size_t nOffset, size_t nLength) const
+{
+    if (pData == nullptr || nOffset >= nSize)
+    {
+        return;
+    }
+    const size_t nPageMask = (size_t)sysconf(_SC_PAGESIZE) - 1;
+    const size_t nBegin = nOffset & ~nPageMask;
+    const size_t nEnd = min(nOffset + nLength, nSize);
+    madvise((void*)(pData + nBegin), nEnd - nBegin, MADV_WILLNEED);
+}
+
+void CMappedFile::Close()
+{
+    if (pData != nullptr)
+    {
+        munmap((void*)pData, nSize);
+        pData = nullptr;
+        nSize = 0;
+    }
+}
+
+} // namespace storage
+} // namespace bigbang
@@ -0,0 +1,50 @@
+// Copyright (c) 2019-2020 The Bigbang developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef STORAGE_MAPPEDFILE_H
+#define STORAGE_MAPPEDFILE_H
+
+#include <string>
+
+namespace bigbang
+{
+namespace storage
+{
+
+// Read-only memory mapping of a whole file
+class CMappedFile
+{
+public:
+    CMappedFile();
+    ~CMappedFile();
+    bool Open(const std::string& strPath);
+    void Close();
+    bool IsOpen() const
+    {
+        return (pData != nullptr);
+    }
+    const char* GetData() const
+    {
+        return pData;
+    }
+    std::size_t GetSize() const
+    {
+        return nSize;
+    }
+    // Start reading the pages of a range ahead of use
+    void WillNeed(std::size_t nOffset, std::size_t nLength) const;
+
+protected:
+    CMappedFile(const CMappedFile&) = delete;
+    CMappedFile& operator=(const CMappedFile&) = delete;
+
+protected:
+    const char* pData;
+    std::size_t nSize;
+};
+
+} // namespace storage
+} // namespace bigbang
+
+#endif //STORAGE_MAPPEDFILE_H
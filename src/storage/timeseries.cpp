@@ -27,9 +27,12 @@ namespace storage
 //////////////////////////////
 // CTimeSeriesBase
 
+const uint32 CTimeSeriesBase::nMagicNum = 0x5E33A1EF;
+
 CTimeSeriesBase::CTimeSeriesBase()
 {
     nLastFile = 0;
+    nAppendFile = 0;
 }
 
 CTimeSeriesBase::~CTimeSeriesBase()
@@ -57,6 +60,8 @@ bool CTimeSeriesBase::Initialize(const path& pathLocationIn, const string& strPr
 
 void CTimeSeriesBase::Deinitialize()
 {
+    boost::unique_lock<boost::mutex> lock(mtxWriter);
+    ResetFilePool();
 }
 
 bool CTimeSeriesBase::CheckDiskSpace()
@@ -200,6 +205,8 @@ bool CTimeSeriesBase::TruncateFile(const string& pathFile, uint32 nOffset)
 
 bool CTimeSeriesBase::RepairFile(uint32 nFile, uint32 nOffset)
 {
+    ResetFilePool();
+
     if (nOffset > 0)
     {
         std::string pathFile;
@@ -221,11 +228,108 @@ bool CTimeSeriesBase::RepairFile(uint32 nFile, uint32 nOffset)
     }
 }
 
+CFileStream* CTimeSeriesBase::GetAppendStream(uint32& nFile)
+{
+    if (pAppendStream != nullptr)
+    {
+        pAppendStream->SeekToEnd();
+        if (pAppendStream->GetCurPos() < MAX_FILE_SIZE - MAX_CHUNK_SIZE - 8)
+        {
+            nFile = nAppendFile;
+            return pAppendStream.get();
+        }
+        pAppendStream.reset();
+    }
+
+    string strPath;
+    if (!GetLastFilePath(nFile, strPath))
+    {
+        return nullptr;
+    }
+    pAppendStream.reset(new CFileStream(strPath.c_str()));
+    if (!pAppendStream->IsValid())
+    {
+        StdError("TimeSeriesBase", "GetAppendStream: open fail, file: %s", strPath.c_str());
+        pAppendStream.reset();
+        return nullptr;
+    }
+    nAppendFile = nFile;
+    pAppendStream->SeekToEnd();
+    return pAppendStream.get();
+}
+
+shared_ptr<CMappedFile> CTimeSeriesBase::GetMappedFile(uint32 nFile, size_t nSize)
+{
+    boost::unique_lock<boost::mutex> lock(mtxMapped);
+
+    map<uint32, shared_ptr<CMappedFile>>::iterator it = mapMappedFile.find(nFile);
+    if (it != mapMappedFile.end() && it->second->GetSize() >= nSize)
+    {
+        return it->second;
+    }
+
+    string strPath;
+    if (!GetFilePath(nFile, strPath))
+    {
+        return nullptr;
+    }
+    shared_ptr<CMappedFile> spFile = make_shared<CMappedFile>();
+    if (!spFile->Open(strPath) || spFile->GetSize() < nSize)
+    {
+        return nullptr;
+    }
+
+    if (it != mapMappedFile.end())
+    {
+        // readers still holding the former mapping keep it alive
+        it->second = spFile;
+    }
+    else
+    {
+        if (mapMappedFile.size() >= MAX_MAPPED_FILE)
+        {
+            // the oldest files are the least read
+            mapMappedFile.erase(mapMappedFile.begin());
+        }
+        mapMappedFile.insert(make_pair(nFile, spFile));
+    }
+    return spFile;
+}
+
+size_t CTimeSeriesBase::Prefetch(uint32 nFile, uint32 nBegin, uint32 nLast)
+{
+    shared_ptr<CMappedFile> spFile = GetMappedFile(nFile, (size_t)nLast + 1);
+    if (spFile == nullptr || nLast < nBegin || nLast < sizeof(uint32) * 2)
+    {
+        return 0;
+    }
+    // the size of an object is stored right ahead of it
+    uint32 nSize = 0;
+    try
+    {
+        CMemoryStream ms(spFile->GetData() + nLast - sizeof(uint32), sizeof(uint32));
+        ms >> nSize;
+    }
+    catch (std::exception& e)
+    {
+        StdError(__PRETTY_FUNCTION__, e.what());
+        return 0;
+    }
+    const size_t nEnd = min((size_t)nLast + nSize, spFile->GetSize());
+    spFile->WillNeed(nBegin, nEnd - nBegin);
+    return (nEnd - nBegin);
+}
+
+void CTimeSeriesBase::ResetFilePool()
+{
+    pAppendStream.reset();
+    boost::unique_lock<boost::mutex> lock(mtxMapped);
+    mapMappedFile.clear();
+}
+
 //////////////////////////////
 // CTimeSeriesCached
 
-const uint32 CTimeSeriesCached::nMagicNum = 0x5E33A1EF;
-
 CTimeSeriesCached::CTimeSeriesCached()
   : cacheStream(FILE_CACHE_SIZE)
 {
@@ -253,6 +357,8 @@ bool CTimeSeriesCached::Initialize(const path& pathLocationIn, const string& str
 
 void CTimeSeriesCached::Deinitialize()
 {
+    CTimeSeriesBase::Deinitialize();
+
     boost::unique_lock<boost::mutex> lock(mtxCache);
 
     ResetCache();
@@ -290,11 +396,49 @@ bool CTimeSeriesCached::VacateCache(uint32 nNeeded)
     return true;
 }
 
+bool CTimeSeriesCached::ReadRaw(vector<unsigned char>& vchData, uint32 nFile, uint32 nOffset)
+{
+    if (nOffset < 8)
+    {
+        return false;
+    }
+    shared_ptr<CMappedFile> spFile = GetMappedFile(nFile, nOffset);
+    if (spFile == nullptr)
+    {
+        return false;
+    }
+    try
+    {
+        CMemoryStream ms(spFile->GetData() + nOffset - 8, 8);
+        uint32 nMagic, nSize;
+        ms >> nMagic >> nSize;
+        if (nMagic != nMagicNum || nSize > MAX_FILE_SIZE)
+        {
+            StdError("TimeSeriesCached", "ReadRaw: Data error, nFile: %d, nOffset: %d, nMagic: %x, nSize: %d",
+                     nFile, nOffset, nMagic, nSize);
+            return false;
+        }
+        if (spFile->GetSize() < (size_t)nOffset + nSize)
+        {
+            spFile = GetMappedFile(nFile, (size_t)nOffset + nSize);
+            if (spFile == nullptr)
+            {
+                return false;
+            }
+        }
+        vchData.assign(spFile->GetData() + nOffset, spFile->GetData() + nOffset + nSize);
+    }
+    catch (exception& e)
+    {
+        StdError(__PRETTY_FUNCTION__, e.what());
+        return false;
+    }
+    return true;
+}
+
 //////////////////////////////
 // CTimeSeriesChunk
 
-const uint32 CTimeSeriesChunk::nMagicNum = 0x5E33A1EF;
-
 CTimeSeriesChunk::CTimeSeriesChunk()
 {
 }
@@ -7,8 +7,10 @@
 
 #include <boost/filesystem.hpp>
 #include <boost/thread/thread.hpp>
+#include <memory>
 #include <xengine.h>
 
+#include "mappedfile.h"
 #include "uint256.h"
 
 namespace bigbang
@@ -67,6 +69,9 @@ public:
     ~CTimeSeriesBase();
     virtual bool Initialize(const boost::filesystem::path& pathLocationIn, const std::string& strPrefixIn);
     virtual void Deinitialize();
+    // Read ahead the objects of a file from the one at nBegin through the one at nLast,
+    // return the number of bytes advised
+    std::size_t Prefetch(uint32 nFile, uint32 nBegin, uint32 nLast);
 
 protected:
     bool CheckDiskSpace();
@@ -76,122 +81,127 @@ protected:
     bool RemoveFollowUpFile(uint32 nBeginFile);
     bool TruncateFile(const std::string& pathFile, uint32 nOffset);
     bool RepairFile(uint32 nFile, uint32 nOffset);
-
-protected:
-    enum
-    {
-        MAX_FILE_SIZE = 0x7F000000,
-        MAX_CHUNK_SIZE = 0x200000
-    };
-    boost::filesystem::path pathLocation;
-    std::string strPrefix;
-    uint32 nLastFile;
-};
-
-class CTimeSeriesCached : public CTimeSeriesBase
-{
-public:
-    CTimeSeriesCached();
-    ~CTimeSeriesCached();
-    bool Initialize(const boost::filesystem::path& pathLocationIn, const std::string& strPrefixIn);
-    void Deinitialize();
+    // Append stream of the last file, kept open between writes. Called with mtxWriter locked
+    xengine::CFileStream* GetAppendStream(uint32& nFile);
+    // Mapping of the whole file, remapped once the file has grown past nSize
+    std::shared_ptr<CMappedFile> GetMappedFile(uint32 nFile, std::size_t nSize);
+    void ResetFilePool();
     template <typename T>
-    bool Write(const T& t, uint32& nFile, uint32& nOffset, bool fWriteCache = true)
+    bool ReadMapped(T& t, uint32 nFile, uint32 nOffset)
     {
-        boost::unique_lock<boost::mutex> lock(mtxCache);
-
-        std::string pathFile;
-        if (!GetLastFilePath(nFile, pathFile))
+        std::shared_ptr<CMappedFile> spFile = GetMappedFile(nFile, (std::size_t)nOffset + 1);
+        if (spFile == nullptr)
         {
             return false;
         }
         try
         {
-            xengine::CFileStream fs(pathFile.c_str());
-            fs.SeekToEnd();
-            uint32 nSize = fs.GetSerializeSize(t);
-            fs << nMagicNum << nSize;
-            nOffset = fs.GetCurPos();
-            fs << t;
+            xengine::CMemoryStream ms(spFile->GetData() + nOffset, spFile->GetSize() - nOffset);
+            ms >> t;
+            return true;
         }
         catch (std::exception& e)
         {
-            xengine::StdError(__PRETTY_FUNCTION__, e.what());
-            return false;
-        }
-        if (fWriteCache)
-        {
-            if (!WriteToCache(t, CDiskPos(nFile, nOffset)))
+            // the object may have been appended after the file was mapped
+            spFile = GetMappedFile(nFile, spFile->GetSize() + 1);
+            if (spFile == nullptr)
             {
-                ResetCache();
+                xengine::StdError(__PRETTY_FUNCTION__, e.what());
+                return false;
             }
         }
-        return true;
-    }
-    template <typename T>
-    bool Write(const T& t, CDiskPos& pos, bool fWriteCache = true)
-    {
-        boost::unique_lock<boost::mutex> lock(mtxCache);
-
-        std::string pathFile;
-        if (!GetLastFilePath(pos.nFile, pathFile))
-        {
-            return false;
-        }
         try
         {
-            xengine::CFileStream fs(pathFile.c_str());
-            fs.SeekToEnd();
-            uint32 nSize = fs.GetSerializeSize(t);
-            fs << nMagicNum << nSize;
-            pos.nOffset = fs.GetCurPos();
-            fs << t;
+            xengine::CMemoryStream ms(spFile->GetData() + nOffset, spFile->GetSize() - nOffset);
+            ms >> t;
         }
         catch (std::exception& e)
         {
             xengine::StdError(__PRETTY_FUNCTION__, e.what());
             return false;
         }
-        if (fWriteCache)
-        {
-            if (!WriteToCache(t, pos))
-            {
-                ResetCache();
-            }
-        }
         return true;
     }
     template <typename T>
-    bool Read(T& t, uint32 nFile, uint32 nOffset, bool fWriteCache = true)
+    bool Append(const T& t, CDiskPos& pos, bool fSync = true)
     {
-        boost::unique_lock<boost::mutex> lock(mtxCache);
-
-        if (ReadFromCache(t, CDiskPos(nFile, nOffset)))
-        {
-            return true;
-        }
-
-        std::string pathFile;
-        if (!GetFilePath(nFile, pathFile))
+        xengine::CFileStream* pStream = GetAppendStream(pos.nFile);
+        if (pStream == nullptr)
         {
             return false;
         }
         try
         {
-            // Open history file to read
-            xengine::CFileStream fs(pathFile.c_str());
-            fs.Seek(nOffset);
-            fs >> t;
+            uint32 nSize = pStream->GetSerializeSize(t);
+            *pStream << nMagicNum << nSize;
+            pos.nOffset = pStream->GetCurPos();
+            *pStream << t;
+            // readers map the file, the object has to reach the page cache before its position is used
+            if (fSync)
+            {
+                pStream->Sync();
+            }
         }
         catch (std::exception& e)
         {
             xengine::StdError(__PRETTY_FUNCTION__, e.what());
+            pAppendStream.reset();
             return false;
         }
+        return true;
+    }
+
+protected:
+    enum
+    {
+        MAX_FILE_SIZE = 0x7F000000,
+        MAX_CHUNK_SIZE = 0x200000,
+        MAX_MAPPED_FILE = 64
+    };
+    boost::filesystem::path pathLocation;
+    std::string strPrefix;
+    uint32 nLastFile;
+    boost::mutex mtxWriter;
+    std::unique_ptr<xengine::CFileStream> pAppendStream;
+    uint32 nAppendFile;
+    boost::mutex mtxMapped;
+    std::map<uint32, std::shared_ptr<CMappedFile>> mapMappedFile;
+    static const uint32 nMagicNum;
+};
 
+class CTimeSeriesCached : public CTimeSeriesBase
+{
+public:
+    CTimeSeriesCached();
+    ~CTimeSeriesCached();
+    bool Initialize(const boost::filesystem::path& pathLocationIn, const std::string& strPrefixIn);
+    void Deinitialize();
+    template <typename T>
+    bool Write(const T& t, uint32& nFile, uint32& nOffset, bool fWriteCache = true)
+    {
+        CDiskPos pos;
+        if (!Write(t, pos, fWriteCache))
+        {
+            return false;
+        }
+        nFile = pos.nFile;
+        nOffset = pos.nOffset;
+        return true;
+    }
+    template <typename T>
+    bool Write(const T& t, CDiskPos& pos, bool fWriteCache = true)
+    {
+        {
+            boost::unique_lock<boost::mutex> lock(mtxWriter);
+            if (!Append(t, pos))
+            {
+                return false;
+            }
+        }
         if (fWriteCache)
         {
-            if (!WriteToCache(t, CDiskPos(nFile, nOffset)))
+            boost::unique_lock<boost::mutex> lock(mtxCache);
+            if (!WriteToCache(t, pos))
             {
                 ResetCache();
             }
@@ -199,35 +209,30 @@ public:
         return true;
     }
     template <typename T>
+    bool Read(T& t, uint32 nFile, uint32 nOffset, bool fWriteCache = true)
+    {
+        return Read(t, CDiskPos(nFile, nOffset), fWriteCache);
+    }
+    template <typename T>
     bool Read(T& t, const CDiskPos& pos, bool fWriteCache = true)
     {
-        boost::unique_lock<boost::mutex> lock(mtxCache);
-
-        if (ReadFromCache(t, pos))
         {
-            return true;
+            boost::unique_lock<boost::mutex> lock(mtxCache);
+            if (ReadFromCache(t, pos))
+            {
+                return true;
+            }
         }
 
-        std::string pathFile;
-        if (!GetFilePath(pos.nFile, pathFile))
-        {
-            return false;
-        }
-        try
-        {
-            // Open history file to read
-            xengine::CFileStream fs(pathFile.c_str());
-            fs.Seek(pos.nOffset);
-            fs >> t;
-        }
-        catch (std::exception& e)
+        // Deserialize straight from the file mapping, concurrent readers do not wait for each other
+        if (!ReadMapped(t, pos.nFile, pos.nOffset))
         {
-            xengine::StdError(__PRETTY_FUNCTION__, e.what());
             return false;
         }
 
         if (fWriteCache)
         {
+            boost::unique_lock<boost::mutex> lock(mtxCache);
             if (!WriteToCache(t, pos))
             {
                 ResetCache();
@@ -333,23 +338,9 @@ public:
     template <typename T>
     bool ReadDirect(T& t, uint32 nFile, uint32 nOffset)
     {
-        std::string pathFile;
-        if (!GetFilePath(nFile, pathFile))
-        {
-            return false;
-        }
-        try
-        {
-            xengine::CFileStream fs(pathFile.c_str());
-            fs.Seek(nOffset);
-            fs >> t;
-        }
-        catch (...)
-        {
-            return false;
-        }
-        return true;
+        return ReadMapped(t, nFile, nOffset);
     }
+    bool ReadRaw(std::vector<unsigned char>& vchData, uint32 nFile, uint32 nOffset);
     size_t GetSize(const uint32 nFile = -1)
     {
         uint32 nFileNo = (nFile == -1) ? 1 : nFile;
@@ -441,7 +432,6 @@ protected:
     boost::mutex mtxCache;
     xengine::CCircularStream cacheStream;
     std::map<CDiskPos, std::size_t> mapCachePos;
-    static const uint32 nMagicNum;
 };
 
 class CTimeSeriesChunk : public CTimeSeriesBase
@@ -453,91 +443,33 @@ public:
     bool Write(const T& t, CDiskPos& pos)
     {
         boost::unique_lock<boost::mutex> lock(mtxWriter);
-
-        std::string pathFile;
-        if (!GetLastFilePath(pos.nFile, pathFile))
-        {
-            return false;
-        }
-        try
-        {
-            xengine::CFileStream fs(pathFile.c_str());
-            fs.SeekToEnd();
-            uint32 nSize = fs.GetSerializeSize(t);
-            fs << nMagicNum << nSize;
-            pos.nOffset = fs.GetCurPos();
-            fs << t;
-        }
-        catch (std::exception& e)
-        {
-            xengine::StdError(__PRETTY_FUNCTION__, e.what());
-            return false;
-        }
-        return true;
+        return Append(t, pos);
     }
     template <typename T>
     bool WriteBatch(const typename std::vector<T>& vBatch, std::vector<CDiskPos>& vPos)
     {
         boost::unique_lock<boost::mutex> lock(mtxWriter);
 
-        size_t n = 0;
-
-        while (n < vBatch.size())
+        for (const T& t : vBatch)
         {
-            uint32 nFile, nOffset;
-            std::string pathFile;
-            if (!GetLastFilePath(nFile, pathFile))
-            {
-                return false;
-            }
-            try
-            {
-                xengine::CFileStream fs(pathFile.c_str());
-                fs.SeekToEnd();
-                do
-                {
-                    uint32 nSize = fs.GetSerializeSize(vBatch[n]);
-                    fs << nMagicNum << nSize;
-                    nOffset = fs.GetCurPos();
-                    fs << vBatch[n++];
-                    vPos.push_back(CDiskPos(nFile, nOffset));
-                } while (n < vBatch.size() && nOffset < MAX_FILE_SIZE - MAX_CHUNK_SIZE - 8);
-            }
-            catch (std::exception& e)
+            CDiskPos pos;
+            if (!Append(t, pos, false))
             {
-                xengine::StdError(__PRETTY_FUNCTION__, e.what());
                 return false;
             }
+            vPos.push_back(pos);
+        }
+        if (pAppendStream != nullptr)
+        {
+            pAppendStream->Sync();
         }
-
         return true;
     }
     template <typename T>
     bool Read(T& t, const CDiskPos& pos)
     {
-        std::string pathFile;
-        if (!GetFilePath(pos.nFile, pathFile))
-        {
-            return false;
-        }
-        try
-        {
-            // Open history file to read
-            xengine::CFileStream fs(pathFile.c_str());
-            fs.Seek(pos.nOffset);
-            fs >> t;
-        }
-        catch (std::exception& e)
-        {
-            xengine::StdError(__PRETTY_FUNCTION__, e.what());
-            return false;
-        }
-        return true;
+        return ReadMapped(t, pos.nFile, pos.nOffset);
     }
-
-protected:
-    boost::mutex mtxWriter;
-    static const uint32 nMagicNum;
 };
 
 } // namespace storage
@@ -6,6 +6,8 @@
 
 #include <boost/bind.hpp>
 
+#include "leveldbeng.h"
+
 using namespace std;
 using namespace xengine;
 
@@ -15,11 +17,336 @@ namespace storage
 {
 
 #define TXINDEX_FLUSH_INTERVAL (300) // 5 minutes check
+#define TXINDEX_VERSION (1)          // 1 : CTxIndex carries block offset and tx ordinal
+//////////////////////////////
+// CTxLocatorDB
+
+CTxLocatorDB::CTxLocatorDB()
+  : nCreatedTime(0), fLowerPending(false), cacheLocator(LOCATOR_CACHE_SIZE)
+{
+}
+
+bool CTxLocatorDB::Initialize(const boost::filesystem::path& pathTxIndex)
+{
+    boost::filesystem::path pathLocator = pathTxIndex / "locator";
+
+    // Fork indexes written before the locator existed are not covered by it
+    bool fLegacy = false;
+    if (!boost::filesystem::exists(pathLocator))
+    {
+        boost::filesystem::directory_iterator end;
+        for (boost::filesystem::directory_iterator it(pathTxIndex); it != end; ++it)
+        {
+            if (boost::filesystem::is_directory(*it))
+            {
+                fLegacy = true;
+                break;
+            }
+        }
+    }
+
+    CLevelDBArguments args;
+    args.path = pathLocator.string();
+    args.syncwrite = false;
+    CLevelDBEngine* engine = new CLevelDBEngine(args);
+
+    if (!Open(engine))
+    {
+        delete engine;
+        return false;
+    }
+
+    {
+        CWriteLock wlock(rwFork);
+
+        if (!Read(string("forks"), vFork))
+        {
+            vFork.clear();
+        }
+        mapOrdinal.clear();
+        for (uint32 i = 0; i < vFork.size(); i++)
+        {
+            mapOrdinal.insert(make_pair(vFork[i], i));
+        }
+
+        // A locator left open was not flushed at exit, the fork indexes may hold txs it misses
+        bool fOpen = false;
+        if (!Read(string("created"), nCreatedTime) || (Read(string("open"), fOpen) && fOpen))
+        {
+            nCreatedTime = ((fLegacy || fOpen) ? GetTime() : 0);
+            if (!Write(string("created"), nCreatedTime))
+            {
+                Close();
+                return false;
+            }
+        }
+    }
+
+    if (!Write(string("open"), true))
+    {
+        Close();
+        return false;
+    }
+    fLowerPending = false;
+
+    return true;
+}
+
+void CTxLocatorDB::Deinitialize()
+{
+    if (Flush())
+    {
+        Erase(string("open"));
+    }
+    Close();
+
+    {
+        CWriteLock wlock(rwFork);
+        vFork.clear();
+        mapOrdinal.clear();
+        nCreatedTime = 0;
+    }
+    cacheLocator.Clear();
+}
+
+bool CTxLocatorDB::AddFork(const uint256& hashFork)
+{
+    CWriteLock wlock(rwFork);
+
+    if (mapOrdinal.count(hashFork))
+    {
+        return true;
+    }
+
+    vFork.push_back(hashFork);
+    if (!Write(string("forks"), vFork))
+    {
+        vFork.pop_back();
+        return false;
+    }
+    mapOrdinal.insert(make_pair(hashFork, uint32(vFork.size() - 1)));
+    return true;
+}
+
+void CTxLocatorDB::Update(const uint256& hashFork, const vector<pair<uint256, CTxIndex>>& vTxNew,
+                          const vector<uint256>& vTxDel)
+{
+    uint32 nForkOrdinal = NULL_ORDINAL;
+    {
+        CReadLock rlock(rwFork);
+        map<uint256, uint32>::iterator it = mapOrdinal.find(hashFork);
+        if (it == mapOrdinal.end())
+        {
+            return;
+        }
+        nForkOrdinal = (*it).second;
+    }
+
+    vector<pair<uint224, uint32>> vOrdinal;
+    vOrdinal.reserve(vTxNew.size() + vTxDel.size());
+
+    set<uint224> setNew;
+    for (int i = 0; i < vTxNew.size(); i++)
+    {
+        uint224 hash = CTxId(vTxNew[i].first).GetTxHash();
+        vOrdinal.push_back(make_pair(hash, nForkOrdinal));
+        setNew.insert(hash);
+    }
+
+    // Erasing follows adding as in the fork index, but only drops entries pointing to this fork
+    for (int i = 0; i < vTxDel.size(); i++)
+    {
+        uint224 hash = CTxId(vTxDel[i]).GetTxHash();
+        uint32 nOrdinal;
+        if (setNew.count(hash) || (FindOrdinal(hash, nOrdinal) && nOrdinal == nForkOrdinal))
+        {
+            vOrdinal.push_back(make_pair(hash, uint32(NULL_ORDINAL)));
+        }
+    }
+
+    UpdateOrdinal(vOrdinal);
+}
+
+void CTxLocatorDB::AddNew(const uint256& txid, const uint256& hashFork)
+{
+    uint32 nForkOrdinal = NULL_ORDINAL;
+    {
+        CReadLock rlock(rwFork);
+        map<uint256, uint32>::iterator it = mapOrdinal.find(hashFork);
+        if (it == mapOrdinal.end())
+        {
+            return;
+        }
+        nForkOrdinal = (*it).second;
+    }
+
+    UpdateOrdinal(vector<pair<uint224, uint32>>(1, make_pair(CTxId(txid).GetTxHash(), nForkOrdinal)));
+}
+
+bool CTxLocatorDB::Retrieve(const uint256& txid, uint256& hashFork)
+{
+    uint32 nOrdinal;
+    if (!FindOrdinal(CTxId(txid).GetTxHash(), nOrdinal))
+    {
+        return false;
+    }
+
+    CReadLock rlock(rwFork);
+    if (nOrdinal >= vFork.size())
+    {
+        return false;
+    }
+    hashFork = vFork[nOrdinal];
+    return true;
+}
+
+bool CTxLocatorDB::IsComplete(const uint256& txid)
+{
+    CReadLock rlock(rwFork);
+    return (int64(CTxId(txid).GetTxTime()) > nCreatedTime + LOCATOR_TIME_MARGIN);
+}
+
+bool CTxLocatorDB::GetVersion(int& nVersion)
+{
+    return Read(string("version"), nVersion);
+}
+
+bool CTxLocatorDB::SetVersion(int nVersion)
+{
+    return Write(string("version"), nVersion);
+}
+
+void CTxLocatorDB::Clear()
+{
+    {
+        CWriteLock wlockLower(rwLower);
+        CWriteLock wlockUpper(rwUpper);
+        dblLocator.Clear();
+        fLowerPending = false;
+    }
+    {
+        CWriteLock wlock(rwFork);
+        vFork.clear();
+        mapOrdinal.clear();
+        nCreatedTime = 0;
+    }
+    cacheLocator.Clear();
+    RemoveAll();
+
+    Write(string("created"), int64(0));
+    Write(string("open"), true);
+    Write(string("version"), int(TXINDEX_VERSION));
+}
+
+bool CTxLocatorDB::Flush()
+{
+    // Everything queued so far is written by this call, so the locator never trails the fork indexes flushed after it.
+    // Entries of a failed write stay below and are written with the next ones
+    {
+        CWriteLock wlockLower(rwLower);
+        CWriteLock wlockUpper(rwUpper);
+        if (fLowerPending)
+        {
+            dblLocator.Merge();
+        }
+        else
+        {
+            dblLocator.Flip();
+        }
+        fLowerPending = true;
+    }
+
+    CUpgradeLock ulock(rwLower);
+
+    MapType& mapLower = dblLocator.GetLowerMap();
+    if (!mapLower.empty())
+    {
+        if (!TxnBegin())
+        {
+            return false;
+        }
+
+        for (MapType::iterator it = mapLower.begin(); it != mapLower.end(); ++it)
+        {
+            if ((*it).second == NULL_ORDINAL)
+            {
+                Erase((*it).first);
+            }
+            else
+            {
+                Write((*it).first, (*it).second);
+            }
+        }
+
+        if (!TxnCommit())
+        {
+            return false;
+        }
+    }
+
+    ulock.Upgrade();
+    fLowerPending = false;
+
+    return true;
+}
+
+bool CTxLocatorDB::FindOrdinal(const uint224& hash, uint32& nOrdinal)
+{
+    {
+        CReadLock rlock(rwUpper);
+
+        MapType& mapUpper = dblLocator.GetUpperMap();
+        MapType::iterator it = mapUpper.find(hash);
+        if (it != mapUpper.end())
+        {
+            nOrdinal = (*it).second;
+            return (nOrdinal != NULL_ORDINAL);
+        }
+    }
+
+    {
+        CReadLock rlock(rwLower);
+
+        MapType& mapLower = dblLocator.GetLowerMap();
+        MapType::iterator it = mapLower.find(hash);
+        if (it != mapLower.end())
+        {
+            nOrdinal = (*it).second;
+            return (nOrdinal != NULL_ORDINAL);
+        }
+    }
+
+    if (cacheLocator.Retrieve(hash, nOrdinal))
+    {
+        return true;
+    }
+
+    if (!Read(hash, nOrdinal))
+    {
+        return false;
+    }
+    cacheLocator.AddNew(hash, nOrdinal);
+    return true;
+}
+
+void CTxLocatorDB::UpdateOrdinal(const vector<pair<uint224, uint32>>& vOrdinal)
+{
+    CWriteLock wlock(rwUpper);
+
+    MapType& mapUpper = dblLocator.GetUpperMap();
+    for (int i = 0; i < vOrdinal.size(); i++)
+    {
+        mapUpper[vOrdinal[i].first] = vOrdinal[i].second;
+        cacheLocator.Remove(vOrdinal[i].first);
+    }
+}
+
 //////////////////////////////
 // CTxIndexDB
 
 CTxIndexDB::CTxIndexDB()
 {
+    fRebuild = false;
     pThreadFlush = nullptr;
     fStopFlush = true;
 }
@@ -38,11 +365,34 @@ bool CTxIndexDB::Initialize(const boost::filesystem::path& pathData)
         return false;
     }
 
+    if (!dbLocator.Initialize(pathTxIndex))
+    {
+        return false;
+    }
+
+    // Fork indexes of an older record layout are dropped and rebuilt from the block files
+    fRebuild = false;
+    int nVersion = 0;
+    if (!dbLocator.GetVersion(nVersion) || nVersion != TXINDEX_VERSION)
+    {
+        if (!RemoveStaleForks())
+        {
+            dbLocator.Deinitialize();
+            return false;
+        }
+        if (!fRebuild && !dbLocator.SetVersion(TXINDEX_VERSION))
+        {
+            dbLocator.Deinitialize();
+            return false;
+        }
+    }
+
     fStopFlush = false;
     pThreadFlush = new boost::thread(boost::bind(&CTxIndexDB::FlushProc, this));
     if (pThreadFlush == nullptr)
     {
         fStopFlush = true;
+        dbLocator.Deinitialize();
         return false;
     }
 
@@ -63,6 +413,8 @@ void CTxIndexDB::Deinitialize()
         pThreadFlush = nullptr;
     }
 
+    // The locator goes to disk ahead of the fork indexes it points into
+    dbLocator.Flush();
     {
         CWriteLock wlock(rwAccess);
 
@@ -76,6 +428,8 @@ void CTxIndexDB::Deinitialize()
         }
         mapTxDB.clear();
     }
+
+    dbLocator.Deinitialize();
 }
 
 bool CTxIndexDB::LoadFork(const uint256& hashFork)
@@ -88,6 +442,11 @@ bool CTxIndexDB::LoadFork(const uint256& hashFork)
         return true;
     }
 
+    if (!dbLocator.AddFork(hashFork))
+    {
+        return false;
+    }
+
     std::shared_ptr<CForkTxDB> spTxDB(new CForkTxDB());
     if (spTxDB == nullptr || !spTxDB->Initialize(pathTxIndex / hashFork.GetHex()))
     {
@@ -121,6 +480,8 @@ bool CTxIndexDB::Update(const uint256& hashFork, const vector<pair<uint256, CTxI
         CTxId txid(vTxDel[i]);
         spTxDB->Erase(txid.GetTxTime(), txid.GetTxHash());
     }
+
+    dbLocator.Update(hashFork, vTxNew, vTxDel);
     return true;
 }
 
@@ -147,6 +508,21 @@ bool CTxIndexDB::Retrieve(const uint256& txidIn, CTxIndex& txIndex, uint256& has
 
     CTxId txid(txidIn);
 
+    if (dbLocator.Retrieve(txidIn, hashFork))
+    {
+        map<uint256, std::shared_ptr<CForkTxDB>>::iterator it = mapTxDB.find(hashFork);
+        if (it != mapTxDB.end() && (*it).second->Retrieve(txid.GetTxTime(), txid.GetTxHash(), txIndex))
+        {
+            return true;
+        }
+    }
+
+    if (dbLocator.IsComplete(txidIn))
+    {
+        return false;
+    }
+
+    // The locator may not cover txs indexed before it was created, fall back to probing all forks
     for (map<uint256, std::shared_ptr<CForkTxDB>>::iterator it = mapTxDB.begin();
          it != mapTxDB.end(); ++it)
     {
@@ -154,6 +530,7 @@ bool CTxIndexDB::Retrieve(const uint256& txidIn, CTxIndex& txIndex, uint256& has
         if (spTxDB->Retrieve(txid.GetTxTime(), txid.GetTxHash(), txIndex))
         {
             hashFork = (*it).first;
+            dbLocator.AddNew(txidIn, hashFork);
             return true;
         }
     }
@@ -173,11 +550,16 @@ void CTxIndexDB::Clear()
         spTxDB->Deinitialize();
     }
     mapTxDB.clear();
+
+    dbLocator.Clear();
+    fRebuild = false;
 }
 
 void CTxIndexDB::Flush(const uint256& hashFork)
 {
     boost::unique_lock<boost::mutex> lock(mtxFlush);
+    dbLocator.Flush();
+
     CReadLock rlock(rwAccess);
 
     map<uint256, std::shared_ptr<CForkTxDB>>::iterator it = mapTxDB.find(hashFork);
@@ -190,6 +572,63 @@ void CTxIndexDB::Flush(const uint256& hashFork)
     spTxDB->Flush();
 }
 
+bool CTxIndexDB::IsRebuildRequired() const
+{
+    return fRebuild;
+}
+
+bool CTxIndexDB::SetRebuilt()
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mtxFlush);
+        if (!dbLocator.Flush())
+        {
+            return false;
+        }
+
+        CReadLock rlock(rwAccess);
+
+        for (map<uint256, std::shared_ptr<CForkTxDB>>::iterator it = mapTxDB.begin();
+             it != mapTxDB.end(); ++it)
+        {
+            (*it).second->Flush();
+        }
+    }
+
+    if (!dbLocator.SetVersion(TXINDEX_VERSION))
+    {
+        return false;
+    }
+    fRebuild = false;
+    return true;
+}
+
+bool CTxIndexDB::RemoveStaleForks()
+{
+    try
+    {
+        vector<boost::filesystem::path> vPath;
+        boost::filesystem::directory_iterator end;
+        for (boost::filesystem::directory_iterator it(pathTxIndex); it != end; ++it)
+        {
+            if (boost::filesystem::is_directory(*it) && (*it).path().filename() != "locator")
+            {
+                vPath.push_back((*it).path());
+            }
+        }
+        for (const boost::filesystem::path& path : vPath)
+        {
+            boost::filesystem::remove_all(path);
+        }
+        fRebuild = !vPath.empty();
+    }
+    catch (std::exception&)
+    {
+        return false;
+    }
+    return true;
+}
+
 void CTxIndexDB::FlushProc()
 {
     SetThreadName("TxIndexDB");
@@ -221,6 +660,10 @@ void CTxIndexDB::FlushProc()
                     vTxDB.push_back((*it).second);
                 }
             }
+            if (!dbLocator.Flush())
+            {
+                continue;
+            }
             for (int i = 0; i < vTxDB.size(); i++)
             {
                 vTxDB[i]->Flush(false);
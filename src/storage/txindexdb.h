@@ -16,6 +16,96 @@ namespace bigbang
 namespace storage
 {
 
+class CTxIdHasher
+{
+public:
+    std::size_t operator()(const uint224& hash) const
+    {
+        return hash.Get64(0);
+    }
+};
+
+class CTxLocatorDB : public xengine::CKVDB
+{
+    typedef std::map<uint224, uint32> MapType;
+    class CDblMap
+    {
+    public:
+        CDblMap()
+          : nIdxUpper(0) {}
+        MapType& GetUpperMap()
+        {
+            return mapCache[nIdxUpper];
+        }
+        MapType& GetLowerMap()
+        {
+            return mapCache[nIdxUpper ^ 1];
+        }
+        void Flip()
+        {
+            MapType& mapLower = mapCache[nIdxUpper ^ 1];
+            mapLower.clear();
+            nIdxUpper = nIdxUpper ^ 1;
+        }
+        void Merge()
+        {
+            MapType& mapUpper = mapCache[nIdxUpper];
+            MapType& mapLower = mapCache[nIdxUpper ^ 1];
+            for (MapType::iterator it = mapUpper.begin(); it != mapUpper.end(); ++it)
+            {
+                mapLower[(*it).first] = (*it).second;
+            }
+            mapUpper.clear();
+        }
+        void Clear()
+        {
+            mapCache[0].clear();
+            mapCache[1].clear();
+            nIdxUpper = 0;
+        }
+
+    protected:
+        MapType mapCache[2];
+        int nIdxUpper;
+    };
+
+public:
+    CTxLocatorDB();
+    bool Initialize(const boost::filesystem::path& pathTxIndex);
+    void Deinitialize();
+    bool AddFork(const uint256& hashFork);
+    void Update(const uint256& hashFork, const std::vector<std::pair<uint256, CTxIndex>>& vTxNew,
+                const std::vector<uint256>& vTxDel);
+    void AddNew(const uint256& txid, const uint256& hashFork);
+    bool Retrieve(const uint256& txid, uint256& hashFork);
+    bool IsComplete(const uint256& txid);
+    bool GetVersion(int& nVersion);
+    bool SetVersion(int nVersion);
+    void Clear();
+    bool Flush();
+
+protected:
+    bool FindOrdinal(const uint224& hash, uint32& nOrdinal);
+    void UpdateOrdinal(const std::vector<std::pair<uint224, uint32>>& vOrdinal);
+
+protected:
+    enum
+    {
+        NULL_ORDINAL = 0xFFFFFFFF,
+        LOCATOR_CACHE_SIZE = 0x40000,
+        LOCATOR_TIME_MARGIN = 3600
+    };
+    xengine::CRWAccess rwUpper;
+    xengine::CRWAccess rwLower;
+    CDblMap dblLocator;
+    xengine::CRWAccess rwFork;
+    std::vector<uint256> vFork;
+    std::map<uint256, uint32> mapOrdinal;
+    int64 nCreatedTime;
+    bool fLowerPending;
+    xengine::CShardedLRUCache<uint224, uint32, 16, CTxIdHasher> cacheLocator;
+};
+
 class CTxIndexDB
 {
     typedef CCTSDB<uint224, CTxIndex, CCTSChunkSnappy<uint224, CTxIndex>> CForkTxDB;
@@ -32,14 +122,19 @@ public:
 
     void Clear();
     void Flush(const uint256& hashFork);
+    bool IsRebuildRequired() const;
+    bool SetRebuilt();
 
 protected:
+    bool RemoveStaleForks();
     void FlushProc();
 
 protected:
     boost::filesystem::path pathTxIndex;
     xengine::CRWAccess rwAccess;
     std::map<uint256, std::shared_ptr<CForkTxDB>> mapTxDB;
+    CTxLocatorDB dbLocator;
+    bool fRebuild;
 
     boost::mutex mtxFlush;
     boost::condition_variable condFlush;
@@ -17,11 +17,111 @@ namespace storage
 {
 
 #define UNSPENT_FLUSH_INTERVAL (60)
+#define UNSPENT_ADDRESS_VERSION (1)
+#define UNSPENT_ADDRESS_REBUILD_BATCH (100000)
+
+//////////////////////////////
+// CForkUnspentAddressDB
+
+CForkUnspentAddressDB::CForkUnspentAddressDB(const boost::filesystem::path& pathDB)
+{
+    CLevelDBArguments args;
+    args.path = pathDB.string();
+    args.syncwrite = false;
+    CLevelDBEngine* engine = new CLevelDBEngine(args);
+
+    if (!CKVDB::Open(engine))
+    {
+        delete engine;
+    }
+}
+
+CForkUnspentAddressDB::~CForkUnspentAddressDB()
+{
+    Close();
+}
+
+// The null destination never owns an unspent output, so its first key holds the sync mark
+bool CForkUnspentAddressDB::IsSynced()
+{
+    uint32 nVersion = 0;
+    return (Read(make_pair(CDestination(), CTxOutPoint()), nVersion) && nVersion == UNSPENT_ADDRESS_VERSION);
+}
+
+bool CForkUnspentAddressDB::SetSynced(bool fSynced)
+{
+    if (fSynced)
+    {
+        return Write(make_pair(CDestination(), CTxOutPoint()), uint32(UNSPENT_ADDRESS_VERSION));
+    }
+    return Erase(make_pair(CDestination(), CTxOutPoint()));
+}
+
+bool CForkUnspentAddressDB::UpdateAddress(const vector<CTxUnspent>& vAddNew, const vector<CTxUnspent>& vRemove)
+{
+    if (!TxnBegin())
+    {
+        return false;
+    }
+
+    for (const CTxUnspent& unspent : vRemove)
+    {
+        Erase(make_pair(unspent.output.destTo, static_cast<const CTxOutPoint&>(unspent)));
+    }
+
+    for (const CTxUnspent& unspent : vAddNew)
+    {
+        Write(make_pair(unspent.output.destTo, static_cast<const CTxOutPoint&>(unspent)), unspent.output);
+    }
+
+    if (!TxnCommit())
+    {
+        return false;
+    }
+    return true;
+}
+
+bool CForkUnspentAddressDB::WriteAddress(const CTxOutPoint& txout, const CTxOut& output)
+{
+    return Write(make_pair(output.destTo, txout), output);
+}
+
+bool CForkUnspentAddressDB::WalkThroughAddress(const CDestination& dest, CForkUnspentDBWalker& walker,
+                                               const MapType& mapUpper, const MapType& mapLower)
+{
+    return WalkThrough(boost::bind(&CForkUnspentAddressDB::AddressWalker, this, _1, _2, boost::ref(dest),
+                                   boost::ref(walker), boost::ref(mapUpper), boost::ref(mapLower)),
+                       dest);
+}
+
+bool CForkUnspentAddressDB::AddressWalker(CBufStream& ssKey, CBufStream& ssValue, const CDestination& dest,
+                                          CForkUnspentDBWalker& walker, const MapType& mapUpper, const MapType& mapLower)
+{
+    CDestination destTo;
+    CTxOutPoint txout;
+    CTxOut output;
+    ssKey >> destTo >> txout;
+
+    if (destTo != dest)
+    {
+        return false;
+    }
+
+    if (mapUpper.count(txout) || mapLower.count(txout))
+    {
+        return true;
+    }
+
+    ssValue >> output;
+
+    return walker.Walk(txout, output);
+}
 
 //////////////////////////////
 // CForkUnspentDB
 
-CForkUnspentDB::CForkUnspentDB(const boost::filesystem::path& pathDB)
+CForkUnspentDB::CForkUnspentDB(const boost::filesystem::path& pathDB, const boost::filesystem::path& pathAddressDB)
+  : dbAddress(pathAddressDB)
 {
     CLevelDBArguments args;
     args.path = pathDB.string();
@@ -31,6 +131,12 @@ CForkUnspentDB::CForkUnspentDB(const boost::filesystem::path& pathDB)
     if (!CKVDB::Open(engine))
     {
         delete engine;
+        return;
+    }
+
+    if (!dbAddress.IsValid() || (!dbAddress.IsSynced() && !RebuildAddress()))
+    {
+        Close();
     }
 }
 
@@ -46,6 +152,10 @@ bool CForkUnspentDB::RemoveAll()
     {
         return false;
     }
+    if (!dbAddress.RemoveAll() || !dbAddress.SetSynced(true))
+    {
+        return false;
+    }
     dblCache.Clear();
     return true;
 }
@@ -71,6 +181,17 @@ bool CForkUnspentDB::UpdateUnspent(const vector<CTxUnspent>& vAddNew, const vect
 
 bool CForkUnspentDB::RepairUnspent(const std::vector<CTxUnspent>& vAddUpdate, const std::vector<CTxOutPoint>& vRemove)
 {
+    vector<CTxOutPoint> vTxOut(vRemove);
+    vTxOut.insert(vTxOut.end(), vAddUpdate.begin(), vAddUpdate.end());
+
+    vector<CTxUnspent> vRemoved;
+    RetrieveRemoved(vTxOut, vRemoved);
+
+    if (!dbAddress.SetSynced(false))
+    {
+        return false;
+    }
+
     if (!TxnBegin())
     {
         return false;
@@ -90,12 +211,17 @@ bool CForkUnspentDB::RepairUnspent(const std::vector<CTxUnspent>& vAddUpdate, co
     {
         return false;
     }
-    return true;
+
+    if (!dbAddress.UpdateAddress(vAddUpdate, vRemoved))
+    {
+        return false;
+    }
+    return dbAddress.SetSynced(true);
 }
 
 bool CForkUnspentDB::WriteUnspent(const CTxOutPoint& txout, const CTxOut& output)
 {
-    return Write(txout, output);
+    return (Write(txout, output) && dbAddress.WriteAddress(txout, output));
 }
 
 bool CForkUnspentDB::ReadUnspent(const CTxOutPoint& txout, CTxOut& output)
@@ -146,11 +272,21 @@ bool CForkUnspentDB::Copy(CForkUnspentDB& dbUnspent)
         xengine::CReadLock rulock(rwUpper);
         xengine::CReadLock rdlock(rwLower);
 
+        if (!dbUnspent.dbAddress.SetSynced(false))
+        {
+            return false;
+        }
+
         if (!WalkThrough(boost::bind(&CForkUnspentDB::CopyWalker, this, _1, _2, boost::ref(dbUnspent))))
         {
             return false;
         }
 
+        if (!dbUnspent.dbAddress.SetSynced(true))
+        {
+            return false;
+        }
+
         dbUnspent.SetCache(dblCache);
     }
     catch (exception& e)
@@ -210,6 +346,92 @@ bool CForkUnspentDB::WalkThroughUnspent(CForkUnspentDBWalker& walker)
     return true;
 }
 
+bool CForkUnspentDB::WalkThroughUnspent(const CDestination& dest, CForkUnspentDBWalker& walker)
+{
+    try
+    {
+        xengine::CReadLock rulock(rwUpper);
+        xengine::CReadLock rdlock(rwLower);
+
+        MapType& mapUpper = dblCache.GetUpperMap();
+        MapType& mapLower = dblCache.GetLowerMap();
+
+        if (!dbAddress.WalkThroughAddress(dest, walker, mapUpper, mapLower))
+        {
+            return false;
+        }
+
+        for (MapType::iterator it = mapLower.begin(); it != mapLower.end(); ++it)
+        {
+            const CTxOutPoint& txout = (*it).first;
+            const CTxOut& output = (*it).second;
+            if (output.destTo == dest && !mapUpper.count(txout) && !output.IsNull())
+            {
+                if (!walker.Walk(txout, output))
+                {
+                    return false;
+                }
+            }
+        }
+        for (MapType::iterator it = mapUpper.begin(); it != mapUpper.end(); ++it)
+        {
+            const CTxOutPoint& txout = (*it).first;
+            const CTxOut& output = (*it).second;
+            if (output.destTo == dest && !output.IsNull())
+            {
+                if (!walker.Walk(txout, output))
+                {
+                    return false;
+                }
+            }
+        }
+    }
+    catch (exception& e)
+    {
+        StdError(__PRETTY_FUNCTION__, e.what());
+        return false;
+    }
+    return true;
+}
+
+bool CForkUnspentDB::RebuildAddress()
+{
+    StdLog("CForkUnspentDB", "RebuildAddress: rebuild unspent address index");
+
+    if (!dbAddress.RemoveAll())
+    {
+        return false;
+    }
+
+    vector<CTxUnspent> vAddNew;
+    vAddNew.reserve(UNSPENT_ADDRESS_REBUILD_BATCH);
+    bool fCompleted = true;
+    if (!WalkThrough(boost::bind(&CForkUnspentDB::RebuildWalker, this, _1, _2, boost::ref(vAddNew), boost::ref(fCompleted)))
+        || !fCompleted)
+    {
+        return false;
+    }
+
+    if (!dbAddress.UpdateAddress(vAddNew, vector<CTxUnspent>()))
+    {
+        return false;
+    }
+    return dbAddress.SetSynced(true);
+}
+
+void CForkUnspentDB::RetrieveRemoved(const vector<CTxOutPoint>& vTxOut, vector<CTxUnspent>& vRemoved)
+{
+    vRemoved.reserve(vTxOut.size());
+    for (const CTxOutPoint& txout : vTxOut)
+    {
+        CTxOut output;
+        if (Read(txout, output))
+        {
+            vRemoved.push_back(CTxUnspent(txout, output));
+        }
+    }
+}
+
 bool CForkUnspentDB::CopyWalker(CBufStream& ssKey, CBufStream& ssValue,
                                 CForkUnspentDB& dbUnspent)
 {
@@ -238,12 +460,35 @@ bool CForkUnspentDB::LoadWalker(CBufStream& ssKey, CBufStream& ssValue,
     return walker.Walk(txout, output);
 }
 
+bool CForkUnspentDB::RebuildWalker(CBufStream& ssKey, CBufStream& ssValue,
+                                   vector<CTxUnspent>& vAddNew, bool& fCompleted)
+{
+    CTxOutPoint txout;
+    CTxOut output;
+    ssKey >> txout;
+    ssValue >> output;
+
+    vAddNew.push_back(CTxUnspent(txout, output));
+    if (vAddNew.size() >= UNSPENT_ADDRESS_REBUILD_BATCH)
+    {
+        if (!dbAddress.UpdateAddress(vAddNew, vector<CTxUnspent>()))
+        {
+            fCompleted = false;
+            return false;
+        }
+        vAddNew.clear();
+    }
+    return true;
+}
+
 bool CForkUnspentDB::Flush()
 {
     xengine::CUpgradeLock ulock(rwLower);
 
     vector<pair<CTxOutPoint, CTxOut>> vAddNew;
     vector<CTxOutPoint> vRemove;
+    vector<CTxUnspent> vAddressNew;
+    vector<CTxUnspent> vAddressRemove;
 
     MapType& mapLower = dblCache.GetLowerMap();
     for (typename MapType::iterator it = mapLower.begin(); it != mapLower.end(); ++it)
@@ -252,6 +497,7 @@ bool CForkUnspentDB::Flush()
         if (!output.IsNull())
         {
             vAddNew.push_back(*it);
+            vAddressNew.push_back(CTxUnspent((*it).first, output));
         }
         else
         {
@@ -259,6 +505,16 @@ bool CForkUnspentDB::Flush()
         }
     }
 
+    bool fUpdateAddress = (!vAddNew.empty() || !vRemove.empty());
+    if (fUpdateAddress)
+    {
+        RetrieveRemoved(vRemove, vAddressRemove);
+        if (!dbAddress.SetSynced(false))
+        {
+            return false;
+        }
+    }
+
     if (!TxnBegin())
     {
         return false;
@@ -279,6 +535,14 @@ bool CForkUnspentDB::Flush()
         return false;
     }
 
+    if (fUpdateAddress)
+    {
+        if (!dbAddress.UpdateAddress(vAddressNew, vAddressRemove) || !dbAddress.SetSynced(true))
+        {
+            return false;
+        }
+    }
+
     ulock.Upgrade();
 
     {
@@ -301,6 +565,7 @@ CUnspentDB::CUnspentDB()
 bool CUnspentDB::Initialize(const boost::filesystem::path& pathData)
 {
     pathUnspent = pathData / "unspent";
+    pathAddress = pathData / "unspentaddress";
 
     if (!boost::filesystem::exists(pathUnspent))
     {
@@ -312,6 +577,16 @@ bool CUnspentDB::Initialize(const boost::filesystem::path& pathData)
         return false;
     }
 
+    if (!boost::filesystem::exists(pathAddress))
+    {
+        boost::filesystem::create_directories(pathAddress);
+    }
+
+    if (!boost::filesystem::is_directory(pathAddress))
+    {
+        return false;
+    }
+
     fStopFlush = false;
     pThreadFlush = new boost::thread(boost::bind(&CUnspentDB::FlushProc, this));
     if (pThreadFlush == nullptr)
@@ -362,7 +637,7 @@ bool CUnspentDB::AddNewFork(const uint256& hashFork)
         return true;
     }
 
-    std::shared_ptr<CForkUnspentDB> spUnspent(new CForkUnspentDB(pathUnspent / hashFork.GetHex()));
+    std::shared_ptr<CForkUnspentDB> spUnspent(new CForkUnspentDB(pathUnspent / hashFork.GetHex(), pathAddress / hashFork.GetHex()));
     if (spUnspent == nullptr || !spUnspent->IsValid())
     {
         return false;
@@ -465,6 +740,18 @@ bool CUnspentDB::WalkThrough(const uint256& hashFork, CForkUnspentDBWalker& walk
     return false;
 }
 
+bool CUnspentDB::WalkThrough(const uint256& hashFork, const CDestination& dest, CForkUnspentDBWalker& walker)
+{
+    CReadLock rlock(rwAccess);
+
+    map<uint256, std::shared_ptr<CForkUnspentDB>>::iterator it = mapUnspentDB.find(hashFork);
+    if (it != mapUnspentDB.end())
+    {
+        return (*it).second->WalkThroughUnspent(dest, walker);
+    }
+    return false;
+}
+
 void CUnspentDB::Flush(const uint256& hashFork)
 {
     boost::unique_lock<boost::mutex> lock(mtxFlush);
@@ -88,53 +88,30 @@ public:
 };
 
 //////////////////////////////
-// CListUnspentBatchWalker
+// CForkUnspentAddressDB
 
-class CListUnspentBatchWalker : public CForkUnspentDBWalker
+class CForkUnspentAddressDB : public xengine::CKVDB
 {
-public:
-    CListUnspentBatchWalker(const uint256& forkidIn, std::map<CDestination, std::vector<CTxUnspent>>& mapOwnersIn, uint32 maxIn)
-      : forkId(forkidIn), mapUnspent(mapOwnersIn), nMax(maxIn)
-    {
-        for (const auto& i : mapUnspent)
-        {
-            mapCount.insert(std::make_pair(i.first, 0));
-        }
-    }
-    bool Walk(const CTxOutPoint& txout, const CTxOut& output) override
-    {
-        if (nMax != 0 && AllFill())
-        {
-            return false; //exit walk through processing
-        }
-        if (mapUnspent.count(output.destTo) && (nMax == 0 || mapUnspent[output.destTo].size() < nMax))
-        {
-            mapUnspent[output.destTo].emplace_back(CTxUnspent(txout, output));
-            ++mapCount[output.destTo];
-        }
-        return true; //continue walk through processing
-    }
-
-private:
-    bool AllFill() const
-    {
-        for (const auto& i : mapCount)
-        {
-            if (i.second < nMax)
-            {
-                return false;
-            }
-        }
-        return true;
-    }
+    typedef std::map<CTxOutPoint, CTxOut> MapType;
 
 public:
-    const uint256& forkId;
-    uint32 nMax;
-    std::map<CDestination, std::vector<CTxUnspent>>& mapUnspent;
-    std::map<CDestination, uint8> mapCount;
+    CForkUnspentAddressDB(const boost::filesystem::path& pathDB);
+    ~CForkUnspentAddressDB();
+    bool IsSynced();
+    bool SetSynced(bool fSynced);
+    bool UpdateAddress(const std::vector<CTxUnspent>& vAddNew, const std::vector<CTxUnspent>& vRemove);
+    bool WriteAddress(const CTxOutPoint& txout, const CTxOut& output);
+    bool WalkThroughAddress(const CDestination& dest, CForkUnspentDBWalker& walker,
+                            const MapType& mapUpper, const MapType& mapLower);
+
+protected:
+    bool AddressWalker(xengine::CBufStream& ssKey, xengine::CBufStream& ssValue, const CDestination& dest,
+                       CForkUnspentDBWalker& walker, const MapType& mapUpper, const MapType& mapLower);
 };
 
+//////////////////////////////
+// CForkUnspentDB
+
 class CForkUnspentDB : public xengine::CKVDB
 {
     typedef std::map<CTxOutPoint, CTxOut> MapType;
@@ -170,7 +147,7 @@ class CForkUnspentDB : public xengine::CKVDB
     };
 
 public:
-    CForkUnspentDB(const boost::filesystem::path& pathDB);
+    CForkUnspentDB(const boost::filesystem::path& pathDB, const boost::filesystem::path& pathAddressDB);
     ~CForkUnspentDB();
     bool RemoveAll();
     bool UpdateUnspent(const std::vector<CTxUnspent>& vAddNew, const std::vector<CTxOutPoint>& vRemove);
@@ -183,18 +160,24 @@ public:
         dblCache = dblCacheIn;
     }
     bool WalkThroughUnspent(CForkUnspentDBWalker& walker);
+    bool WalkThroughUnspent(const CDestination& dest, CForkUnspentDBWalker& walker);
     bool Flush();
 
 protected:
+    bool RebuildAddress();
+    void RetrieveRemoved(const std::vector<CTxOutPoint>& vTxOut, std::vector<CTxUnspent>& vRemoved);
     bool CopyWalker(xengine::CBufStream& ssKey, xengine::CBufStream& ssValue,
                     CForkUnspentDB& dbUnspent);
     bool LoadWalker(xengine::CBufStream& ssKey, xengine::CBufStream& ssValue,
                     CForkUnspentDBWalker& walker, const MapType& mapUpper, const MapType& mapLower);
+    bool RebuildWalker(xengine::CBufStream& ssKey, xengine::CBufStream& ssValue,
+                       std::vector<CTxUnspent>& vAddNew, bool& fCompleted);
 
 protected:
     xengine::CRWAccess rwUpper;
     xengine::CRWAccess rwLower;
     CDblMap dblCache;
+    CForkUnspentAddressDB dbAddress;
 };
 
 class CUnspentDB
@@ -216,6 +199,7 @@ public:
     bool Retrieve(const uint256& hashFork, const CTxOutPoint& txout, CTxOut& output);
     bool Copy(const uint256& srcFork, const uint256& destFork);
     bool WalkThrough(const uint256& hashFork, CForkUnspentDBWalker& walker);
+    bool WalkThrough(const uint256& hashFork, const CDestination& dest, CForkUnspentDBWalker& walker);
     void Flush(const uint256& hashFork);
 
 protected:
@@ -223,6 +207,7 @@ protected:
 
 protected:
     boost::filesystem::path pathUnspent;
+    boost::filesystem::path pathAddress;
     xengine::CRWAccess rwAccess;
     std::map<uint256, std::shared_ptr<CForkUnspentDB>> mapUnspentDB;
 
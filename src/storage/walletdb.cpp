@@ -114,6 +114,8 @@ bool CWalletTxDB::Initialize(const boost::filesystem::path& pathWallet)
         return false;
     }
 
+    bool fResync = false;
+    fResyncIncomplete = (Read(string("resync"), fResync) && fResync);
     if (!Read(string("txcount"), nTxCount) || !Read(string("sequence"), nSequence))
     {
         return Reset();
@@ -271,6 +273,16 @@ size_t CWalletTxDB::GetTxCount()
     return nTxCount;
 }
 
+bool CWalletTxDB::SetResyncIncomplete(bool fIncomplete)
+{
+    if (!(fIncomplete ? Write(string("resync"), true) : Erase(string("resync"))))
+    {
+        return false;
+    }
+    fResyncIncomplete = fIncomplete;
+    return true;
+}
+
 bool CWalletTxDB::WalkThroughTxSeq(CWalletDBTxSeqWalker& walker)
 {
     return WalkThrough(boost::bind(&CWalletTxDB::TxSeqWalker, this, _1, _2, boost::ref(walker)),
@@ -357,6 +369,13 @@ bool CWalletTxDB::Reset()
         return false;
     }
 
+    // the marker is kept through Clear
+    if (fResyncIncomplete && !Write(string("resync"), true))
+    {
+        TxnAbort();
+        return false;
+    }
+
     return TxnCommit();
 }
 
@@ -629,5 +648,15 @@ bool CWalletDB::ClearTx()
     return dbWtx.Clear();
 }
 
+bool CWalletDB::IsResyncIncomplete() const
+{
+    return dbWtx.IsResyncIncomplete();
+}
+
+bool CWalletDB::SetResyncIncomplete(bool fIncomplete)
+{
+    return dbWtx.SetResyncIncomplete(fIncomplete);
+}
+
 } // namespace storage
 } // namespace bigbang
@@ -80,7 +80,7 @@ class CWalletTxDB : public xengine::CKVDB
 {
 public:
     CWalletTxDB()
-      : nSequence(0), nTxCount(0) {}
+      : nSequence(0), nTxCount(0), fResyncIncomplete(false) {}
     bool Initialize(const boost::filesystem::path& pathWallet);
     void Deinitialize();
     bool Clear();
@@ -97,6 +97,11 @@ public:
     bool RetrieveTx(const uint256& txid, CWalletTx& wtx);
     bool ExistsTx(const uint256& txid);
     std::size_t GetTxCount();
+    bool IsResyncIncomplete() const
+    {
+        return fResyncIncomplete;
+    }
+    bool SetResyncIncomplete(bool fIncomplete);
     bool WalkThroughTxSeq(CWalletDBTxSeqWalker& walker);
     bool WalkThroughTx(CWalletDBTxWalker& walker);
 
@@ -108,6 +113,7 @@ protected:
 protected:
     uint64 nSequence;
     std::size_t nTxCount;
+    bool fResyncIncomplete;
 };
 
 class CWalletTxCache
@@ -214,6 +220,9 @@ public:
     bool ListRollBackTx(const uint256& hashFork, int nMinHeight, std::vector<uint256>& vForkTx);
     bool WalkThroughTx(CWalletDBTxWalker& walker);
     bool ClearTx();
+    // Set while the wallet txs are being rebuilt, a marker left at startup means the last resync did not finish
+    bool IsResyncIncomplete() const;
+    bool SetResyncIncomplete(bool fIncomplete);
 
 protected:
     bool ListDBTx(const uint256& hashFork, int nOffset, int nCount, std::vector<CWalletTx>& vWalletTx);
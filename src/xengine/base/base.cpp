@@ -20,12 +20,14 @@ namespace xengine
 IBase::IBase()
 {
     status = STATUS_OUTDOCKER;
+    pDocker = nullptr;
 }
 
 IBase::IBase(const string& ownKeyIn)
 {
     status = STATUS_OUTDOCKER;
     ownKey = ownKeyIn;
+    pDocker = nullptr;
 }
 
 IBase::~IBase()
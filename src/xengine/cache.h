@@ -10,6 +10,8 @@
 #include <boost/multi_index/sequenced_index.hpp>
 #include <boost/multi_index_container.hpp>
 #include <boost/thread/thread.hpp>
+#include <list>
+#include <unordered_map>
 
 #include "rwlock.h"
 
@@ -88,6 +90,105 @@ protected:
     std::size_t nMaxCount;
 };
 
+template <typename K, typename V, std::size_t N = 16, typename H = std::hash<K>>
+class CShardedLRUCache
+{
+    class CEntry
+    {
+    public:
+        K key;
+        V value;
+        std::size_t nCost;
+
+    public:
+        CEntry(const K& keyIn, const V& valueIn, std::size_t nCostIn)
+          : key(keyIn), value(valueIn), nCost(nCostIn) {}
+    };
+    typedef std::list<CEntry> CEntryList;
+    class CShard
+    {
+    public:
+        CShard()
+          : nCost(0) {}
+
+    public:
+        boost::mutex mtx;
+        CEntryList listEntry;
+        std::unordered_map<K, typename CEntryList::iterator, H> mapEntry;
+        std::size_t nCost;
+    };
+
+public:
+    CShardedLRUCache(std::size_t nMaxCostIn = 0)
+      : nMaxShardCost(nMaxCostIn / N) {}
+    bool Retrieve(const K& key, V& value)
+    {
+        CShard& shard = GetShard(key);
+        boost::unique_lock<boost::mutex> lock(shard.mtx);
+        typename std::unordered_map<K, typename CEntryList::iterator, H>::iterator it = shard.mapEntry.find(key);
+        if (it == shard.mapEntry.end())
+        {
+            return false;
+        }
+        shard.listEntry.splice(shard.listEntry.begin(), shard.listEntry, (*it).second);
+        value = (*(*it).second).value;
+        return true;
+    }
+    void AddNew(const K& key, const V& value, std::size_t nCost = 1)
+    {
+        CShard& shard = GetShard(key);
+        boost::unique_lock<boost::mutex> lock(shard.mtx);
+        Erase(shard, key);
+        if (nMaxShardCost != 0 && nCost > nMaxShardCost)
+        {
+            return;
+        }
+        shard.listEntry.push_front(CEntry(key, value, nCost));
+        shard.mapEntry.insert(std::make_pair(key, shard.listEntry.begin()));
+        shard.nCost += nCost;
+        while (nMaxShardCost != 0 && shard.nCost > nMaxShardCost)
+        {
+            Erase(shard, shard.listEntry.back().key);
+        }
+    }
+    void Remove(const K& key)
+    {
+        CShard& shard = GetShard(key);
+        boost::unique_lock<boost::mutex> lock(shard.mtx);
+        Erase(shard, key);
+    }
+    void Clear()
+    {
+        for (std::size_t i = 0; i < N; i++)
+        {
+            boost::unique_lock<boost::mutex> lock(vShard[i].mtx);
+            vShard[i].listEntry.clear();
+            vShard[i].mapEntry.clear();
+            vShard[i].nCost = 0;
+        }
+    }
+
+protected:
+    CShard& GetShard(const K& key)
+    {
+        return vShard[H()(key) % N];
+    }
+    void Erase(CShard& shard, const K& key)
+    {
+        typename std::unordered_map<K, typename CEntryList::iterator, H>::iterator it = shard.mapEntry.find(key);
+        if (it != shard.mapEntry.end())
+        {
+            shard.nCost -= (*(*it).second).nCost;
+            shard.listEntry.erase((*it).second);
+            shard.mapEntry.erase(it);
+        }
+    }
+
+protected:
+    CShard vShard[N];
+    std::size_t nMaxShardCost;
+};
+
 } // namespace xengine
 
 #endif //XENGINE_CACHE_H
@@ -5,8 +5,10 @@
 #ifndef XENGINE_KVDB_H
 #define XENGINE_KVDB_H
 
+#include <boost/bind.hpp>
 #include <boost/function.hpp>
 #include <boost/thread.hpp>
+#include <memory>
 
 #include "stream/stream.h"
 #include "util.h"
@@ -14,6 +16,18 @@
 namespace xengine
 {
 
+class CKVDBIterator
+{
+public:
+    virtual ~CKVDBIterator() {}
+
+    virtual bool MoveFirst() = 0;
+    virtual bool MoveTo(CBufStream& ssKey) = 0;
+    virtual bool MoveNext(CBufStream& ssKey, CBufStream& ssValue) = 0;
+};
+
+// Get and NewIterator may be called from many threads at once,
+// the other operations are serialized by CKVDB
 class CKVDBEngine
 {
 public:
@@ -28,11 +42,12 @@ public:
     virtual bool Put(CBufStream& ssKey, CBufStream& ssValue, bool fOverwrite) = 0;
     virtual bool Remove(CBufStream& ssKey) = 0;
     virtual bool RemoveAll() = 0;
-    virtual bool MoveFirst() = 0;
-    virtual bool MoveTo(CBufStream& ssKey) = 0;
-    virtual bool MoveNext(CBufStream& ssKey, CBufStream& ssValue) = 0;
+    virtual CKVDBIterator* NewIterator() = 0;
 };
 
+// Reads and walks share rwAccess, Open, Close and RemoveAll replace the engine under its
+// exclusive side. Writes and transactions are serialized by mtx, taken after rwAccess
+
 class CKVDB
 {
 public:
@@ -43,6 +58,7 @@ public:
     CKVDB(CKVDBEngine* engine)
       : dbEngine(engine)
     {
+        boost::unique_lock<boost::shared_mutex> wlock(rwAccess);
         boost::recursive_mutex::scoped_lock lock(mtx);
         if (dbEngine != nullptr)
         {
@@ -56,19 +72,17 @@ public:
 
     virtual ~CKVDB()
     {
+        boost::unique_lock<boost::shared_mutex> wlock(rwAccess);
         boost::recursive_mutex::scoped_lock lock(mtx);
-        if (dbEngine != nullptr)
-        {
-            dbEngine->Close();
-            delete dbEngine;
-        }
+        CloseEngine();
     }
 
     bool Open(CKVDBEngine* engine)
     {
+        boost::unique_lock<boost::shared_mutex> wlock(rwAccess);
+        boost::recursive_mutex::scoped_lock lock(mtx);
         if (dbEngine == nullptr && engine != nullptr && engine->Open())
         {
-            boost::recursive_mutex::scoped_lock lock(mtx);
             dbEngine = engine;
             return true;
         }
@@ -78,13 +92,9 @@ public:
 
     void Close()
     {
+        boost::unique_lock<boost::shared_mutex> wlock(rwAccess);
         boost::recursive_mutex::scoped_lock lock(mtx);
-        if (dbEngine != nullptr)
-        {
-            dbEngine->Close();
-            delete dbEngine;
-            dbEngine = nullptr;
-        }
+        CloseEngine();
     }
 
     bool TxnBegin()
@@ -118,6 +128,7 @@ public:
 
     bool RemoveAll()
     {
+        boost::unique_lock<boost::shared_mutex> wlock(rwAccess);
         boost::recursive_mutex::scoped_lock lock(mtx);
         if (dbEngine != nullptr)
         {
@@ -125,13 +136,14 @@ public:
             {
                 return true;
             }
-            Close();
+            CloseEngine();
         }
         return false;
     }
 
-    bool IsValid() const
+    bool IsValid()
     {
+        boost::shared_lock<boost::shared_mutex> rlock(rwAccess);
         return (dbEngine != nullptr);
     }
 
@@ -148,7 +160,7 @@ protected:
 
         try
         {
-            boost::recursive_mutex::scoped_lock lock(mtx);
+            boost::shared_lock<boost::shared_mutex> rlock(rwAccess);
 
             if (dbEngine == nullptr)
                 return false;
@@ -226,86 +238,45 @@ protected:
 
     bool WalkThrough()
     {
-        try
-        {
-            boost::recursive_mutex::scoped_lock lock(mtx);
-
-            if (dbEngine == nullptr)
-                return false;
-
-            if (!dbEngine->MoveFirst())
-                return false;
-
-            for (;;)
-            {
-                CBufStream ssKey, ssValue;
-                if (!dbEngine->MoveNext(ssKey, ssValue))
-                    break;
-
-                if (!DBWalker(ssKey, ssValue))
-                    break;
-            }
-            return true;
-        }
-        catch (std::exception& e)
-        {
-            StdError(__PRETTY_FUNCTION__, e.what());
-        }
-
-        return false;
+        return Walk(boost::bind(&CKVDB::DBWalker, this, _1, _2), nullptr);
     }
 
     bool WalkThrough(WalkerFunc fnWalker)
     {
-        try
-        {
-            boost::recursive_mutex::scoped_lock lock(mtx);
-
-            if (dbEngine == nullptr)
-                return false;
-
-            if (!dbEngine->MoveFirst())
-                return false;
-
-            for (;;)
-            {
-                CBufStream ssKey, ssValue;
-                if (!dbEngine->MoveNext(ssKey, ssValue))
-                    break;
-
-                if (!fnWalker(ssKey, ssValue))
-                    break;
-            }
-            return true;
-        }
-        catch (std::exception& e)
-        {
-            StdError(__PRETTY_FUNCTION__, e.what());
-        }
-
-        return false;
+        return Walk(fnWalker, nullptr);
     }
 
     template <typename K>
     bool WalkThrough(WalkerFunc fnWalker, const K& keyBegin)
+    {
+        CBufStream ssKeyBegin;
+        ssKeyBegin << keyBegin;
+        return Walk(fnWalker, &ssKeyBegin);
+    }
+
+private:
+    bool Walk(WalkerFunc fnWalker, CBufStream* pssKeyBegin)
     {
         try
         {
-            boost::recursive_mutex::scoped_lock lock(mtx);
+            // the engine is kept until the walk ends, a walker must not open, close or clear its own database
+            boost::shared_lock<boost::shared_mutex> rlock(rwAccess);
 
             if (dbEngine == nullptr)
                 return false;
 
-            CBufStream ssKeyBegin;
-            ssKeyBegin << keyBegin;
+            // each walk reads its own snapshot, writes committed meanwhile are not seen
+            std::unique_ptr<CKVDBIterator> spIter(dbEngine->NewIterator());
+            if (spIter == nullptr)
+                return false;
 
-            if (!dbEngine->MoveTo(ssKeyBegin))
+            if (!(pssKeyBegin != nullptr ? spIter->MoveTo(*pssKeyBegin) : spIter->MoveFirst()))
                 return false;
 
             for (;;)
             {
                 CBufStream ssKey, ssValue;
-                if (!dbEngine->MoveNext(ssKey, ssValue))
+                if (!spIter->MoveNext(ssKey, ssValue))
                     break;
 
                 if (!fnWalker(ssKey, ssValue))
@@ -313,6 +284,10 @@ protected:
             }
             return true;
         }
+        catch (const boost::thread_interrupted&)
+        {
+            throw;
+        }
         catch (std::exception& e)
         {
             StdError(__PRETTY_FUNCTION__, e.what());
@@ -321,7 +296,18 @@ protected:
         return false;
     }
 
+    void CloseEngine()
+    {
+        if (dbEngine != nullptr)
+        {
+            dbEngine->Close();
+            delete dbEngine;
+            dbEngine = nullptr;
+        }
+    }
+
 protected:
+    boost::shared_mutex rwAccess;
     boost::recursive_mutex mtx;
     CKVDBEngine* dbEngine;
 };
@@ -0,0 +1,167 @@
+// Copyright (c) 2019-2020 The Bigbang developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef XENGINE_PARALLELPOOL_H
+#define XENGINE_PARALLELPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "util.h"
+
+namespace xengine
+{
+
+/**
+ * Parallel computer on long-lived threads, for tasks repeated too often to start threads per call.
+ * The threads are started by the first call.
+ */
+class CParallelPool
+{
+public:
+    CParallelPool(uint8_t nNum = std::thread::hardware_concurrency())
+      : nParallelNum(nNum), fStop(false), fOpen(false), nJob(0), nWorking(0), nTotal(0)
+    {
+        if (nParallelNum == 0)
+        {
+            nParallelNum = std::thread::hardware_concurrency();
+        }
+    }
+    ~CParallelPool()
+    {
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            fStop = true;
+        }
+        condWork.notify_all();
+        for (std::thread& t : vThread)
+        {
+            t.join();
+        }
+    }
+
+    /**
+     * Execute [nTotal] tasks by [fnTrans] on the pool threads and the calling thread.
+     * Return the lowest index whose task returns false, or nTotal if all tasks return true.
+     * nTotal, number of tasks.
+     * fnTrans, function "bool (index)".
+     *
+     * NOTICE: Tasks above a failed index may be skipped, all tasks below the returned index are executed.
+     * NOTICE: Calls are serialized, but [fnTrans] must be multi-threads safety.
+     */
+    template <typename TransFunc>
+    uint32_t ExecuteUntilFirst(const uint32_t nTotalIn, TransFunc fnTrans)
+    {
+        std::unique_lock<std::mutex> lockCall(mtxCall);
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            while (vThread.size() + 1 < nParallelNum)
+            {
+                vThread.push_back(std::thread(&CParallelPool::WorkerThreadFunc, this));
+            }
+            fnTask = fnTrans;
+            nTotal = nTotalIn;
+            nCurrent.store(0);
+            nFailed.store(nTotalIn);
+            fOpen = true;
+            nJob++;
+        }
+        condWork.notify_all();
+
+        Work();
+
+        std::unique_lock<std::mutex> lock(mtx);
+        fOpen = false;
+        while (nWorking > 0)
+        {
+            condDone.wait(lock);
+        }
+        fnTask = nullptr;
+        return nFailed.load();
+    }
+
+protected:
+    void WorkerThreadFunc()
+    {
+        uint64_t nJobDone = 0;
+        std::unique_lock<std::mutex> lock(mtx);
+        while (true)
+        {
+            // a worker joins the job only before the caller closes it
+            while (!fStop && !(fOpen && nJob != nJobDone))
+            {
+                condWork.wait(lock);
+            }
+            if (fStop)
+            {
+                return;
+            }
+            nJobDone = nJob;
+            nWorking++;
+            lock.unlock();
+
+            Work();
+
+            lock.lock();
+            if (--nWorking == 0)
+            {
+                condDone.notify_all();
+            }
+        }
+    }
+
+    void Work()
+    {
+        uint32_t nIndex;
+        // indices are taken in order and nFailed only falls, so every index below the final nFailed is executed
+        while ((nIndex = nCurrent.fetch_add(1)) < nTotal && nIndex < nFailed.load())
+        {
+            bool fSuccess = false;
+            try
+            {
+                fSuccess = fnTask(nIndex);
+            }
+            catch (std::exception& e)
+            {
+                StdError(__PRETTY_FUNCTION__, e.what());
+            }
+            catch (...)
+            {
+                StdError(__PRETTY_FUNCTION__, "unknown exception");
+            }
+            if (!fSuccess)
+            {
+                uint32_t nPrev = nFailed.load();
+                while (nIndex < nPrev && !nFailed.compare_exchange_weak(nPrev, nIndex))
+                {
+                }
+            }
+        }
+    }
+
+protected:
+    uint8_t nParallelNum;
+    std::mutex mtxCall;
+    std::mutex mtx;
+    std::condition_variable condWork;
+    std::condition_variable condDone;
+    std::vector<std::thread> vThread;
+    bool fStop;
+    bool fOpen;
+    uint64_t nJob;
+    std::size_t nWorking;
+    uint32_t nTotal;
+    std::function<bool(uint32_t)> fnTask;
+    std::atomic<uint32_t> nCurrent;
+    std::atomic<uint32_t> nFailed;
+};
+
+} // namespace xengine
+
+#endif //XENGINE_PARALLELPOOL_H
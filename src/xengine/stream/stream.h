@@ -242,6 +242,39 @@ public:
     }
 };
 
+// Read-only stream over an external memory region, e.g. a mapped file
+class CMemoryStream : public std::streambuf, public CStream
+{
+public:
+    CMemoryStream(const char* pData, std::size_t nSize)
+      : CStream(this)
+    {
+        char* p = const_cast<char*>(pData);
+        setg(p, p, p + nSize);
+    }
+
+    const char* GetData() const
+    {
+        return gptr();
+    }
+
+    std::size_t GetSize()
+    {
+        return (std::size_t)(egptr() - gptr());
+    }
+
+    std::size_t GetCurPos() const
+    {
+        return (std::size_t)(gptr() - eback());
+    }
+
+    void Seek(std::size_t pos)
+    {
+        ios.clear();
+        setg(eback(), eback() + pos, egptr());
+    }
+};
+
 // Circular buffer stream
 class CCircularStream : public circularbuf, public CStream
 {
@@ -8,6 +8,7 @@
 #include <base/base.h>
 #include <cache.h>
 #include <compacttv.h>
+#include <parallelpool.h>
 #include <console/console.h>
 #include <db/kvdb.h>
 #include <docker/config.h>
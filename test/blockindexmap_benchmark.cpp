@@ -0,0 +1,87 @@
+// Copyright (c) 2019-2020 The Bigbang developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <algorithm>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/test/unit_test.hpp>
+#include <fstream>
+#include <map>
+#include <random>
+#include <unistd.h>
+
+#include "blockindexmap.h"
+#include "crypto.h"
+#include "test_big.h"
+
+using namespace std;
+using namespace xengine;
+using namespace bigbang;
+using namespace bigbang::storage;
+
+BOOST_FIXTURE_TEST_SUITE(blockindexmap_benchmark, BasicUtfSetup)
+
+static std::size_t GetResidentSize()
+{
+    std::size_t nPages = 0, nResident = 0;
+    std::ifstream ifs("/proc/self/statm");
+    ifs >> nPages >> nResident;
+    return nResident * sysconf(_SC_PAGESIZE);
+}
+
+BOOST_AUTO_TEST_CASE(rss_and_lookup)
+{
+    // resident size and lookup latency against the former map of heap nodes, mainnet sized index
+    const std::size_t nCount = 2000000;
+    std::vector<uint256> vHash(nCount);
+    for (uint256& hash : vHash)
+    {
+        crypto::CryptoGetRand256(hash);
+    }
+    std::vector<uint256> vLookup(vHash.begin(), vHash.end());
+    std::mt19937_64 rng(0x5E33A1EF);
+    std::shuffle(vLookup.begin(), vLookup.end(), rng);
+
+    CBlockIndexMap mapIndex;
+    std::size_t nRss = GetResidentSize();
+    for (const uint256& hash : vHash)
+    {
+        mapIndex.Insert(hash);
+    }
+    std::size_t nArenaRss = GetResidentSize() - nRss;
+    boost::posix_time::ptime t0 = boost::posix_time::microsec_clock::universal_time();
+    std::size_t nFound = 0;
+    for (const uint256& hash : vLookup)
+    {
+        nFound += (mapIndex.Find(hash) != nullptr);
+    }
+    int64 nArenaTime = (boost::posix_time::microsec_clock::universal_time() - t0).total_microseconds();
+    BOOST_CHECK(nFound == nCount);
+    mapIndex.Clear();
+
+    nRss = GetResidentSize();
+    std::map<uint256, CBlockIndex*> mapHeap;
+    for (const uint256& hash : vHash)
+    {
+        mapHeap.insert(std::make_pair(hash, new CBlockIndex()));
+    }
+    std::size_t nMapRss = GetResidentSize() - nRss;
+    t0 = boost::posix_time::microsec_clock::universal_time();
+    nFound = 0;
+    for (const uint256& hash : vLookup)
+    {
+        nFound += (mapHeap.find(hash) != mapHeap.end());
+    }
+    int64 nMapTime = (boost::posix_time::microsec_clock::universal_time() - t0).total_microseconds();
+    BOOST_CHECK(nFound == nCount);
+    for (auto& it : mapHeap)
+    {
+        delete it.second;
+    }
+
+    cout << "block index " << nCount << " entries, std::map: rss " << (nMapRss >> 20) << "MB, lookup "
+         << nMapTime * 1000 / (int64)nCount << "ns; arena map: rss " << (nArenaRss >> 20) << "MB, lookup "
+         << nArenaTime * 1000 / (int64)nCount << "ns" << endl;
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,72 @@
+// Copyright (c) 2019-2020 The Bigbang developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockindexmap.h"
+
+#include <boost/test/unit_test.hpp>
+#include <map>
+
+#include "crypto.h"
+#include "test_big.h"
+
+using namespace std;
+using namespace xengine;
+using namespace bigbang;
+using namespace bigbang::storage;
+
+BOOST_FIXTURE_TEST_SUITE(blockindexmap_tests, BasicUtfSetup)
+
+BOOST_AUTO_TEST_CASE(blockindexmap)
+{
+    std::vector<uint256> vHash;
+    for (int i = 0; i < 10000; i++)
+    {
+        uint256 hash;
+        crypto::CryptoGetRand256(hash);
+        vHash.push_back(hash);
+    }
+
+    CBlockIndexMap mapIndex;
+    std::map<uint256, CBlockIndex*> mapRef;
+    for (const uint256& hash : vHash)
+    {
+        CBlockIndex* pIndex = mapIndex.Insert(hash);
+        BOOST_CHECK(pIndex->GetBlockHash() == hash);
+        BOOST_CHECK(pIndex->pOrigin == pIndex);
+        mapRef[hash] = pIndex;
+    }
+    BOOST_CHECK(mapIndex.Size() == vHash.size());
+    BOOST_CHECK(mapIndex.Insert(vHash[0]) == mapRef[vHash[0]]);
+
+    // erase every third hash, the rest keeps its node address
+    for (std::size_t i = 0; i < vHash.size(); i += 3)
+    {
+        BOOST_CHECK(mapIndex.Erase(vHash[i]));
+        BOOST_CHECK(!mapIndex.Erase(vHash[i]));
+        mapRef.erase(vHash[i]);
+    }
+    BOOST_CHECK(mapIndex.Size() == mapRef.size());
+    for (std::size_t i = 0; i < vHash.size(); i++)
+    {
+        BOOST_CHECK(mapIndex.Find(vHash[i]) == (i % 3 == 0 ? nullptr : mapRef[vHash[i]]));
+    }
+    std::size_t nVisit = 0;
+    mapIndex.ForEach([&](const uint256& hash, CBlockIndex* pIndex) {
+        BOOST_CHECK(mapRef[hash] == pIndex);
+        nVisit++;
+    });
+    BOOST_CHECK(nVisit == mapRef.size());
+
+    // erased slots are reused
+    for (std::size_t i = 0; i < vHash.size(); i += 3)
+    {
+        BOOST_CHECK(mapIndex.Insert(vHash[i])->GetBlockHash() == vHash[i]);
+    }
+    BOOST_CHECK(mapIndex.Size() == vHash.size());
+
+    mapIndex.Clear();
+    BOOST_CHECK(mapIndex.Empty() && mapIndex.Find(vHash[1]) == nullptr);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
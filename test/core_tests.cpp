@@ -0,0 +1,286 @@
+// Copyright (c) 2019-2020 The Bigbang developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "core.h"
+
+#include <boost/test/unit_test.hpp>
+#include <thread>
+
+#include "blockchain.h"
+#include "key.h"
+#include "test_big.h"
+#include "transaction.h"
+
+using namespace std;
+using namespace xengine;
+using namespace bigbang;
+
+BOOST_FIXTURE_TEST_SUITE(core_tests, BasicUtfSetup)
+
+class CSigCacheTestProtocol : public CCoreProtocol
+{
+public:
+    typedef CShardedLRUCache<uint256, bool, 16, CSigCacheHasher> CSignatureCache;
+
+    bool Verify(const CTransaction& tx, const CDestination& destIn, const vector<uint8>& vchSig, int nForkHeight, const uint256& fork)
+    {
+        return VerifyTxSignature(tx, destIn, vchSig, nForkHeight, fork);
+    }
+    bool IsCached(const CTransaction& tx, const CDestination& destIn, const vector<uint8>& vchSig, int nForkHeight, const uint256& fork)
+    {
+        bool fVerified = false;
+        return cacheSignature.Retrieve(GetSignatureCacheKey(tx.GetSignatureHash(), destIn, vchSig, nForkHeight, fork), fVerified);
+    }
+    void AddCached(const CTransaction& tx, const CDestination& destIn, const vector<uint8>& vchSig, int nForkHeight, const uint256& fork)
+    {
+        cacheSignature.AddNew(GetSignatureCacheKey(tx.GetSignatureHash(), destIn, vchSig, nForkHeight, fork), true);
+    }
+};
+
+static CTransaction MakeSignedTx(const crypto::CKey& key, int64 nAmount, vector<uint8>& vchSig)
+{
+    CTransaction tx;
+    tx.nType = CTransaction::TX_TOKEN;
+    tx.nTimeStamp = 1000;
+    tx.sendTo = CDestination(key.GetPubKey());
+    tx.nAmount = nAmount;
+    tx.nTxFee = 100;
+    BOOST_CHECK(key.Sign(tx.GetSignatureHash(), vchSig));
+    return tx;
+}
+
+BOOST_AUTO_TEST_CASE(sigcache)
+{
+    CSigCacheTestProtocol protocol;
+    const uint256 fork(uint64(1));
+
+    crypto::CKey key, keyOther;
+    BOOST_CHECK(key.Renew() && keyOther.Renew());
+    const CDestination destIn(key.GetPubKey());
+    const CDestination destOther(keyOther.GetPubKey());
+
+    vector<uint8> vchSig;
+    CTransaction tx = MakeSignedTx(key, 1000, vchSig);
+
+    // miss, then a verified signature is cached
+    BOOST_CHECK(!protocol.IsCached(tx, destIn, vchSig, 10, fork));
+    BOOST_CHECK(protocol.Verify(tx, destIn, vchSig, 10, fork));
+    BOOST_CHECK(protocol.IsCached(tx, destIn, vchSig, 10, fork));
+
+    // a plain public key signature is reused at any height, not on another fork
+    BOOST_CHECK(protocol.IsCached(tx, destIn, vchSig, 20, fork));
+    BOOST_CHECK(!protocol.IsCached(tx, destIn, vchSig, 10, uint256(uint64(2))));
+
+    // a failed verification is never cached
+    vector<uint8> vchBadSig(vchSig);
+    vchBadSig[0] ^= 1;
+    BOOST_CHECK(!protocol.Verify(tx, destIn, vchBadSig, 10, fork));
+    BOOST_CHECK(!protocol.IsCached(tx, destIn, vchBadSig, 10, fork));
+    BOOST_CHECK(!protocol.Verify(tx, destOther, vchSig, 10, fork));
+    BOOST_CHECK(!protocol.IsCached(tx, destOther, vchSig, 10, fork));
+}
+
+BOOST_AUTO_TEST_CASE(sigcache_binding)
+{
+    CSigCacheTestProtocol protocol;
+    const uint256 fork(uint64(1));
+
+    crypto::CKey key, keyOther;
+    BOOST_CHECK(key.Renew() && keyOther.Renew());
+    const CDestination destIn(key.GetPubKey());
+    const CDestination destOther(keyOther.GetPubKey());
+
+    vector<uint8> vchSig;
+    CTransaction tx = MakeSignedTx(key, 1000, vchSig);
+
+    // a hit skips the signature check, so a forged entry shows which lookups reach it
+    vector<uint8> vchForged(vchSig.size(), 0x5a);
+    BOOST_CHECK(!protocol.Verify(tx, destIn, vchForged, 10, fork));
+    protocol.AddCached(tx, destIn, vchForged, 10, fork);
+    BOOST_CHECK(protocol.Verify(tx, destIn, vchForged, 10, fork));
+
+    // the entry never accepts another tx or another public key
+    CTransaction txOther = tx;
+    txOther.nAmount += 1;
+    BOOST_CHECK(!protocol.Verify(txOther, destIn, vchForged, 10, fork));
+    BOOST_CHECK(!protocol.Verify(tx, destOther, vchForged, 10, fork));
+    BOOST_CHECK(!protocol.Verify(tx, destIn, vchForged, 10, uint256(uint64(2))));
+
+    // nor does a genuine entry
+    BOOST_CHECK(protocol.Verify(tx, destIn, vchSig, 10, fork));
+    BOOST_CHECK(!protocol.Verify(txOther, destIn, vchSig, 10, fork));
+    BOOST_CHECK(!protocol.Verify(tx, destOther, vchSig, 10, fork));
+}
+
+BOOST_AUTO_TEST_CASE(sigcache_eviction)
+{
+    // two entries per shard, keys in the same shard are evicted least recently used first
+    CSigCacheTestProtocol::CSignatureCache cache(32);
+    bool fVerified = false;
+    const uint256 hash1(uint64(16)), hash2(uint64(32)), hash3(uint64(48)), hashOtherShard(uint64(17));
+
+    cache.AddNew(hash1, true);
+    cache.AddNew(hash2, true);
+    cache.AddNew(hashOtherShard, true);
+    BOOST_CHECK(cache.Retrieve(hash1, fVerified) && fVerified);
+
+    cache.AddNew(hash3, true);
+    BOOST_CHECK(cache.Retrieve(hash1, fVerified));
+    BOOST_CHECK(!cache.Retrieve(hash2, fVerified));
+    BOOST_CHECK(cache.Retrieve(hash3, fVerified));
+    BOOST_CHECK(cache.Retrieve(hashOtherShard, fVerified));
+
+    cache.Remove(hash1);
+    BOOST_CHECK(!cache.Retrieve(hash1, fVerified));
+    cache.Clear();
+    BOOST_CHECK(!cache.Retrieve(hash3, fVerified));
+}
+
+BOOST_AUTO_TEST_CASE(powprevalidation)
+{
+    std::string fullpath = boost::filesystem::initial_path<boost::filesystem::path>().string() + "/test/block/block_000001.dat";
+    xengine::CFileStream fs(fullpath.c_str());
+
+    std::vector<CBlock> vBlock;
+    for (int i = 0; i < 11; i++)
+    {
+        uint32 nMagic, nSize;
+        CBlockEx block;
+        fs >> nMagic >> nSize >> block;
+        if (block.IsProofOfWork() && block.vchProof.size() >= CProofOfHashWorkCompact::PROOFHASHWORK_SIZE)
+        {
+            vBlock.push_back(block);
+        }
+    }
+    BOOST_REQUIRE(!vBlock.empty());
+
+    // serial hashing, as done by the validation path without prevalidation
+    std::vector<uint256> vSerial;
+    boost::posix_time::ptime t0 = boost::posix_time::microsec_clock::universal_time();
+    for (const CBlock& block : vBlock)
+    {
+        std::vector<unsigned char> vch;
+        block.GetSerializedProofOfWorkData(vch);
+        vSerial.push_back(crypto::CryptoPowHash(&vch[0], vch.size()));
+    }
+    int64 nSerial = (boost::posix_time::microsec_clock::universal_time() - t0).total_microseconds();
+
+    // queue all blocks, hash them on workers and pick the results up in chain order
+    CPowHashPrevalidator prevalidator(64, 64);
+    std::vector<std::thread> vWorker;
+    const unsigned int nThreads = std::max(2u, std::thread::hardware_concurrency());
+    t0 = boost::posix_time::microsec_clock::universal_time();
+    for (const CBlock& block : vBlock)
+    {
+        prevalidator.Prevalidate(block);
+    }
+    for (unsigned int i = 0; i < nThreads; i++)
+    {
+        vWorker.emplace_back([&prevalidator]() {
+            // as the core protocol workers do, release the thread local scratchpad on exit
+            crypto::CryptoPowHashAllocState();
+            while (prevalidator.WorkerThreadFunc())
+            {
+            }
+            crypto::CryptoPowHashFreeState();
+        });
+    }
+    std::size_t nHit = 0;
+    for (std::size_t i = 0; i < vBlock.size(); i++)
+    {
+        uint256 hashPow;
+        if (!prevalidator.Retrieve(vBlock[i].GetHash(), hashPow))
+        {
+            std::vector<unsigned char> vch;
+            vBlock[i].GetSerializedProofOfWorkData(vch);
+            hashPow = crypto::CryptoPowHash(&vch[0], vch.size());
+        }
+        else
+        {
+            nHit++;
+        }
+        BOOST_CHECK(hashPow == vSerial[i]);
+    }
+    int64 nParallel = (boost::posix_time::microsec_clock::universal_time() - t0).total_microseconds();
+    prevalidator.Interrupt();
+    for (std::thread& t : vWorker)
+    {
+        t.join();
+    }
+
+    cout << "pow prevalidation: blocks " << vBlock.size() << ", threads " << nThreads << ", hits " << nHit
+         << ", serial " << nSerial << "us, prevalidated " << nParallel << "us" << endl;
+}
+
+// nTimeStamp of a tx is its verification time in ms, nLockUntil the error it fails with
+class CVerifyTxTestProtocol : public CCoreProtocol
+{
+public:
+    Errno VerifyBlockTx(const CTransaction& tx, const CTxContxt& txContxt, CBlockIndex* pIndexPrev, int nForkHeight, const uint256& fork) override
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(tx.nTimeStamp));
+        if (tx.nLockUntil == (uint32)-1)
+        {
+            throw ERR_TRANSACTION_INPUT_INVALID;
+        }
+        return (Errno)tx.nLockUntil;
+    }
+};
+
+class CVerifyTxTestChain : public CBlockChain
+{
+public:
+    CVerifyTxTestChain(ICoreProtocol* pCoreProtocolIn)
+    {
+        pCoreProtocol = pCoreProtocolIn;
+    }
+    using CBlockChain::VerifyBlockTx;
+};
+
+BOOST_AUTO_TEST_CASE(verify_block_tx_first_failure)
+{
+    CVerifyTxTestProtocol protocol;
+    CVerifyTxTestChain chain(&protocol);
+
+    uint256 hashPrev(1);
+    CBlockIndex indexPrev;
+    indexPrev.phashBlock = &hashPrev;
+
+    CBlock block;
+    block.vtx.resize(64);
+    vector<CTxContxt> vTxContxt(block.vtx.size());
+    vector<uint32> vVerifyTx;
+    for (uint32 i = 0; i < block.vtx.size(); i++)
+    {
+        block.vtx[i].nTimeStamp = 0;
+        block.vtx[i].nLockUntil = OK;
+        vVerifyTx.push_back(i);
+    }
+    BOOST_CHECK(chain.VerifyBlockTx(block, vTxContxt, vVerifyTx, &indexPrev, 1) == OK);
+
+    // a slow failing tx ahead of a fast one is still the one reported, serial and parallel
+    for (const size_t nCount : { 8, 64 })
+    {
+        vector<uint32> vVerify(vVerifyTx.begin(), vVerifyTx.begin() + nCount);
+        const uint32 nFirst = 2, nLater = nCount - 2;
+        block.vtx[nFirst].nTimeStamp = 50;
+        block.vtx[nFirst].nLockUntil = ERR_TRANSACTION_INPUT_INVALID;
+        block.vtx[nLater].nLockUntil = ERR_TRANSACTION_SIGNATURE_INVALID;
+        for (int i = 0; i < 3; i++)
+        {
+            BOOST_CHECK(chain.VerifyBlockTx(block, vTxContxt, vVerify, &indexPrev, 1) == ERR_TRANSACTION_INPUT_INVALID);
+        }
+        block.vtx[nFirst].nTimeStamp = 0;
+        block.vtx[nFirst].nLockUntil = OK;
+        block.vtx[nLater].nLockUntil = OK;
+    }
+
+    // a task throwing a non std::exception fails its tx and leaves the pool usable
+    block.vtx[5].nLockUntil = (uint32)-1;
+    BOOST_CHECK(chain.VerifyBlockTx(block, vTxContxt, vVerifyTx, &indexPrev, 1) == ERR_BLOCK_TRANSACTIONS_INVALID);
+    block.vtx[5].nLockUntil = OK;
+    BOOST_CHECK(chain.VerifyBlockTx(block, vTxContxt, vVerifyTx, &indexPrev, 1) == OK);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -112,4 +112,23 @@ BOOST_AUTO_TEST_CASE(multisign_defect)
     std::cout << "multisign verify2 count : " << count << "; time per count : " << verifyTime2 / count << "us.; time per key: " << verifyTime2 / signCount << "us." << std::endl;
 }
 
+BOOST_AUTO_TEST_CASE(short_hash)
+{
+    // SipHash-2-4 reference vector, key 00..0f, message 00..1f
+    uint256 key, h;
+    for (int i = 0; i < 32; i++)
+    {
+        key.begin()[i] = (i < 16) ? i : 0xff;
+        h.begin()[i] = i;
+    }
+    BOOST_CHECK(CryptoShortHash(key, h) == 0x7127512f72f27cceULL);
+
+    // only the low 128 bits of the key are used
+    uint256 key2 = key;
+    key2.begin()[31] = 0;
+    BOOST_CHECK(CryptoShortHash(key2, h) == CryptoShortHash(key, h));
+    key2.begin()[0] = 1;
+    BOOST_CHECK(CryptoShortHash(key2, h) != CryptoShortHash(key, h));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -91,6 +91,52 @@ BOOST_AUTO_TEST_CASE(ctsdb)
         std::cout << "Retrieve : " << (t.Elapse() / vTest.size()) << "\n";
     }
 
+    {
+        const int nCached = 100;
+        xengine::CTicks t;
+        for (int i = vTest.size() - nCached; i < vTest.size(); i++)
+        {
+            CMetaData data;
+            BOOST_CHECK(db.Retrieve(vTest[i].first, vTest[i].second, data));
+        }
+
+        std::cout << "Retrieve cached : " << (t.Elapse() / nCached) << "\n";
+    }
+
+    {
+        int nMatched = 0;
+        xengine::CTicks t;
+        for (int i = 0; i < vTest.size(); i++)
+        {
+            uint256 txid;
+            bigbang::crypto::CryptoGetRand256(txid);
+
+            CMetaData data;
+            if (db.Retrieve((vTest[i].first + 1800) % 3600, uint224(txid), data))
+            {
+                nMatched++;
+            }
+        }
+        BOOST_CHECK(nMatched == 0);
+
+        std::cout << "Retrieve missing : " << (t.Elapse() / vTest.size()) << "\n";
+    }
+
+    db.Deinitialize();
+    BOOST_CHECK(db.Initialize(boost::filesystem::path(fullpath)));
+
+    {
+        xengine::CTicks t;
+        for (int i = 0; i < vTest.size(); i++)
+        {
+            CMetaData data;
+            BOOST_CHECK(db.Retrieve(vTest[i].first, vTest[i].second, data));
+            BOOST_CHECK(data.hash == vTest[i].second);
+        }
+
+        std::cout << "Retrieve reloaded : " << (t.Elapse() / vTest.size()) << "\n";
+    }
+
     db.Deinitialize();
     boost::filesystem::remove_all(fullpath);
 }
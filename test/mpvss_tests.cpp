@@ -166,6 +166,44 @@ BOOST_AUTO_TEST_CASE(ed25519)
     // }
 }
 
+BOOST_AUTO_TEST_CASE(multiscalarmult)
+{
+    srand(time(0));
+    uint8_t md32[32];
+
+    // 26 and 51 are the polynomial sizes of a full delegate round, 512 goes through bucket method
+    vector<size_t> vCount = { 1, 2, 26, 51, 512 };
+    for (const size_t count : vCount)
+    {
+        vector<CSC25519> vScalar;
+        vector<CEdwards25519> vPoint;
+        for (size_t i = 0; i < count; i++)
+        {
+            RandGeneretor(md32);
+            vScalar.push_back(CSC25519(md32));
+            RandGeneretor(md32);
+            CEdwards25519 P;
+            P.Generate(CSC25519(md32));
+            vPoint.push_back(P);
+        }
+
+        boost::posix_time::ptime t0 = boost::posix_time::microsec_clock::universal_time();
+        CEdwards25519 S;
+        for (size_t i = 0; i < count; i++)
+        {
+            S += vPoint[i].ScalarMult(vScalar[i]);
+        }
+        int64 nSingle = (boost::posix_time::microsec_clock::universal_time() - t0).ticks();
+
+        t0 = boost::posix_time::microsec_clock::universal_time();
+        CEdwards25519 M = CEdwards25519::MultiScalarMult(vScalar, vPoint);
+        int64 nMulti = (boost::posix_time::microsec_clock::universal_time() - t0).ticks();
+
+        BOOST_CHECK(S == M);
+        cout << "multiscalarmult count : " << count << "; single time : " << nSingle << "us.; multi time : " << nMulti << "us.\n";
+    }
+}
+
 BOOST_AUTO_TEST_CASE(interpolation)
 {
     srand(time(0));
@@ -0,0 +1,217 @@
+// Copyright (c) 2019-2020 The Bigbang developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "peer.h"
+
+#include <boost/test/unit_test.hpp>
+#include <snappy.h>
+
+#include "block.h"
+#include "crypto.h"
+#include "peerevent.h"
+#include "test_big.h"
+
+using namespace std;
+using namespace xengine;
+using namespace bigbang;
+using namespace bigbang::network;
+
+BOOST_FIXTURE_TEST_SUITE(network_tests, BasicUtfSetup)
+
+static void MakePayload(size_t nSize, CBufStream& ssPayload)
+{
+    // repeated text compresses well
+    const string strText = "bigbang compact payload ";
+    for (size_t i = 0; i < nSize; i++)
+    {
+        ssPayload << (uint8)strText[i % strText.size()];
+    }
+}
+
+static uint32 GetPayloadChecksum(CBufStream& ssPayload)
+{
+    return crypto::CryptoHash(ssPayload.GetData(), ssPayload.GetSize()).Get32();
+}
+
+BOOST_AUTO_TEST_CASE(header_flags)
+{
+    CPeerMessageHeader hdr;
+    hdr.nMagic = 0x12345678;
+    hdr.nType = CPeerMessageHeader::GetMessageType(PROTO_CHN_DATA, PROTO_CMD_BLOCK);
+    hdr.nPayloadSize = MESSAGE_PAYLOAD_MAX_SIZE;
+    hdr.nPayloadChecksum = 0xabcdef01;
+
+    // the flags ride in the high byte of the payload size field and are covered by the header checksum
+    for (uint8 nFlags : { (uint8)0, (uint8)MESSAGE_FLAG_SNAPPY, (uint8)0xff })
+    {
+        hdr.nFlags = nFlags;
+        hdr.nHeaderChecksum = hdr.GetHeaderChecksum();
+        CBufStream ss;
+        ss << hdr;
+        BOOST_CHECK(ss.GetSize() == MESSAGE_HEADER_SIZE);
+
+        CPeerMessageHeader hdrLoad;
+        ss >> hdrLoad;
+        BOOST_CHECK(hdrLoad.nMagic == hdr.nMagic);
+        BOOST_CHECK(hdrLoad.nType == hdr.nType);
+        BOOST_CHECK(hdrLoad.nPayloadSize == hdr.nPayloadSize);
+        BOOST_CHECK(hdrLoad.nPayloadChecksum == hdr.nPayloadChecksum);
+        BOOST_CHECK(hdrLoad.nHeaderChecksum == hdr.nHeaderChecksum);
+        BOOST_CHECK(hdrLoad.nFlags == nFlags);
+        BOOST_CHECK(hdrLoad.Verify());
+
+        hdrLoad.nFlags ^= MESSAGE_FLAG_SNAPPY;
+        BOOST_CHECK(!hdrLoad.Verify());
+    }
+
+    // without flags the header is laid out as before
+    hdr.nFlags = 0;
+    hdr.nHeaderChecksum = hdr.GetHeaderChecksum();
+    CBufStream ss;
+    ss << hdr;
+    BOOST_CHECK(*(const uint32*)(ss.GetData() + 5) == MESSAGE_PAYLOAD_MAX_SIZE);
+}
+
+BOOST_AUTO_TEST_CASE(payload_checksum)
+{
+    for (bool fCompress : { false, true })
+    {
+        CBufStream ssPayload;
+        MakePayload(0x10000, ssPayload);
+        const size_t nSize = ssPayload.GetSize();
+        const uint32 nChecksum = GetPayloadChecksum(ssPayload);
+
+        CPeerMessageHeader hdr;
+        CBufStream ssMessage;
+        BOOST_CHECK(CBbPeer::EncodeMessage(0x12345678, PROTO_CHN_DATA, PROTO_CMD_BLOCK, ssPayload, nChecksum, fCompress, hdr, ssMessage));
+        BOOST_CHECK(hdr.nFlags == (fCompress ? MESSAGE_FLAG_SNAPPY : 0));
+        BOOST_CHECK(fCompress ? hdr.nPayloadSize < nSize : hdr.nPayloadSize == nSize);
+
+        // the receiver sees a valid header and checks the payload checksum after uncompressing
+        CPeerMessageHeader hdrRecv;
+        ssMessage >> hdrRecv;
+        BOOST_CHECK(hdrRecv.Verify());
+        BOOST_CHECK(hdrRecv.nFlags == hdr.nFlags);
+        BOOST_CHECK(hdrRecv.nPayloadSize == ssMessage.GetSize());
+        BOOST_CHECK(hdrRecv.nPayloadChecksum == nChecksum);
+        if (hdrRecv.nFlags & MESSAGE_FLAG_SNAPPY)
+        {
+            BOOST_CHECK(GetPayloadChecksum(ssMessage) != nChecksum);
+            BOOST_CHECK(CBbPeer::DecodePayload(ssMessage));
+        }
+        BOOST_CHECK(ssMessage.GetSize() == nSize);
+        BOOST_CHECK(GetPayloadChecksum(ssMessage) == nChecksum);
+    }
+
+    // a payload that does not shrink goes out uncompressed
+    CBufStream ssPayload;
+    for (int i = 0; i < 2048; i++)
+    {
+        ssPayload << (uint8)crypto::CryptoGetRand32();
+    }
+    CPeerMessageHeader hdr;
+    CBufStream ssMessage;
+    BOOST_CHECK(CBbPeer::EncodeMessage(0x12345678, PROTO_CHN_DATA, PROTO_CMD_BLOCK, ssPayload, GetPayloadChecksum(ssPayload), true, hdr, ssMessage));
+    BOOST_CHECK(hdr.nFlags == 0);
+    BOOST_CHECK(hdr.nPayloadSize == 2048);
+}
+
+BOOST_AUTO_TEST_CASE(compressible)
+{
+    const size_t nSize = 0x10000;
+    BOOST_CHECK(CBbPeer::IsCompressible(NODE_NETWORK | NODE_SNAPPY, PROTO_CHN_DATA, PROTO_CMD_BLOCK, nSize));
+    BOOST_CHECK(CBbPeer::IsCompressible(NODE_NETWORK | NODE_SNAPPY, PROTO_CHN_DATA, PROTO_CMD_TX, nSize));
+
+    // a peer without NODE_SNAPPY gets the payload uncompressed
+    BOOST_CHECK(!CBbPeer::IsCompressible(NODE_NETWORK, PROTO_CHN_DATA, PROTO_CMD_BLOCK, nSize));
+    CBufStream ssPayload;
+    MakePayload(nSize, ssPayload);
+    CPeerMessageHeader hdr;
+    CBufStream ssMessage;
+    bool fCompress = CBbPeer::IsCompressible(NODE_NETWORK, PROTO_CHN_DATA, PROTO_CMD_BLOCK, ssPayload.GetSize());
+    BOOST_CHECK(CBbPeer::EncodeMessage(0x12345678, PROTO_CHN_DATA, PROTO_CMD_BLOCK, ssPayload, GetPayloadChecksum(ssPayload), fCompress, hdr, ssMessage));
+    BOOST_CHECK(hdr.nFlags == 0);
+    BOOST_CHECK(ssMessage.GetSize() == MESSAGE_HEADER_SIZE + nSize);
+
+    // small payloads and other channels are never compressed
+    BOOST_CHECK(!CBbPeer::IsCompressible(NODE_NETWORK | NODE_SNAPPY, PROTO_CHN_DATA, PROTO_CMD_BLOCK, 100));
+    BOOST_CHECK(!CBbPeer::IsCompressible(NODE_NETWORK | NODE_SNAPPY, PROTO_CHN_NETWORK, PROTO_CMD_BLOCK, nSize));
+}
+
+BOOST_AUTO_TEST_CASE(oversized_payload)
+{
+    // a tiny stream may claim a huge uncompressed length, it is rejected before uncompressing
+    string strPayload(MESSAGE_PAYLOAD_MAX_SIZE + 1, 'a');
+    string strCompressed;
+    snappy::Compress(strPayload.data(), strPayload.size(), &strCompressed);
+    BOOST_CHECK(strCompressed.size() < MESSAGE_PAYLOAD_MAX_SIZE);
+
+    CBufStream ss;
+    ss.Write(strCompressed.data(), strCompressed.size());
+    BOOST_CHECK(!CBbPeer::DecodePayload(ss));
+
+    // the largest payload is accepted
+    strPayload.resize(MESSAGE_PAYLOAD_MAX_SIZE);
+    snappy::Compress(strPayload.data(), strPayload.size(), &strCompressed);
+    ss.Clear();
+    ss.Write(strCompressed.data(), strCompressed.size());
+    BOOST_CHECK(CBbPeer::DecodePayload(ss));
+    BOOST_CHECK(ss.GetSize() == MESSAGE_PAYLOAD_MAX_SIZE);
+
+    // garbage is rejected
+    ss.Clear();
+    const unsigned char garbage[] = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x01 };
+    ss.Write((const char*)garbage, sizeof(garbage));
+    BOOST_CHECK(!CBbPeer::DecodePayload(ss));
+}
+
+BOOST_AUTO_TEST_CASE(cmpctblock)
+{
+    std::string fullpath = boost::filesystem::initial_path<boost::filesystem::path>().string() + "/test/block/block_000001.dat";
+    xengine::CFileStream fs(fullpath.c_str());
+
+    for (int i = 0; i < 11; i++)
+    {
+        uint32 nMagic, nSize;
+        CBlockEx block;
+        fs >> nMagic >> nSize >> block;
+
+        CBufStream ss;
+        ss << network::CCmpctBlock(block, i);
+        network::CCmpctBlock cmpctBlock;
+        ss >> cmpctBlock;
+        BOOST_CHECK(cmpctBlock.header.GetHash() == block.GetHash());
+        BOOST_CHECK(cmpctBlock.header.vtx.empty());
+        BOOST_CHECK(cmpctBlock.vShortTxId.size() == block.vtx.size());
+
+        // rebuild from a pool holding the block txs in reverse order
+        uint256 hashSalt = cmpctBlock.GetSalt();
+        std::map<uint64, std::size_t> mapIndex;
+        for (std::size_t n = 0; n < cmpctBlock.vShortTxId.size(); n++)
+        {
+            mapIndex[cmpctBlock.vShortTxId[n]] = n;
+        }
+        BOOST_CHECK(mapIndex.size() == block.vtx.size());
+
+        CBlock blockRebuild = cmpctBlock.header;
+        blockRebuild.vtx.resize(block.vtx.size());
+        for (auto it = block.vtx.rbegin(); it != block.vtx.rend(); ++it)
+        {
+            auto mt = mapIndex.find(network::CCmpctBlock::GetShortTxId(hashSalt, it->GetHash()));
+            BOOST_CHECK(mt != mapIndex.end());
+            blockRebuild.vtx[mt->second] = *it;
+        }
+        BOOST_CHECK(blockRebuild.CalcMerkleTreeRoot() == block.hashMerkle);
+        BOOST_CHECK(blockRebuild.GetHash() == block.GetHash());
+
+        // another salt gives other short txids
+        if (!block.vtx.empty())
+        {
+            network::CCmpctBlock cmpctOther(block, i + 100);
+            BOOST_CHECK(cmpctOther.vShortTxId[0] != cmpctBlock.vShortTxId[0]);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,118 @@
+// Copyright (c) 2019-2020 The Bigbang developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "powengine.h"
+
+#include <boost/test/unit_test.hpp>
+#include <thread>
+
+#include "crypto.h"
+#include "test_big.h"
+#include "uint256.h"
+#include "util.h"
+
+using namespace std;
+using namespace xengine;
+using namespace bigbang;
+
+BOOST_FIXTURE_TEST_SUITE(powengine_tests, BasicUtfSetup)
+
+static vector<unsigned char> MakeWorkData(uint64 nBaseNonce)
+{
+    vector<unsigned char> vchWorkData(100);
+    for (size_t i = 0; i < vchWorkData.size(); i++)
+    {
+        vchWorkData[i] = (unsigned char)i;
+    }
+    *((uint64*)&vchWorkData[vchWorkData.size() - sizeof(uint64)]) = nBaseNonce;
+    return vchWorkData;
+}
+
+static uint64 GetNonce(const vector<unsigned char>& vchWorkData)
+{
+    return *((const uint64*)&vchWorkData[vchWorkData.size() - sizeof(uint64)]);
+}
+
+BOOST_AUTO_TEST_CASE(search)
+{
+    CPowMiningEngine engine;
+    BOOST_CHECK(engine.Start());
+    BOOST_CHECK(engine.GetThreadCount() == 1);
+
+    // any hash hits the widest target, the first nonce wins
+    vector<unsigned char> vchWorkData = MakeWorkData(0x1000);
+    uint256 hash;
+    uint64 nHashCount = 0;
+    int nResult = engine.Search(vchWorkData, ~uint256(uint64(0)), 10000, engine.GetCancelGeneration(), hash, nHashCount);
+    BOOST_CHECK(nResult == CPowMiningEngine::SEARCH_FOUND);
+    BOOST_CHECK(GetNonce(vchWorkData) == 0x1000);
+    BOOST_CHECK(nHashCount == 1);
+    BOOST_CHECK(hash == crypto::CryptoPowHash(&vchWorkData[0], vchWorkData.size()));
+
+    // nothing hits a zero target, the base nonce moves past the searched range
+    nResult = engine.Search(vchWorkData, uint256(uint64(0)), 100, engine.GetCancelGeneration(), hash, nHashCount);
+    BOOST_CHECK(nResult == CPowMiningEngine::SEARCH_TIMEOUT);
+    BOOST_CHECK(nHashCount > 0);
+    BOOST_CHECK(GetNonce(vchWorkData) == 0x1000 + nHashCount);
+
+    engine.Stop();
+    nResult = engine.Search(vchWorkData, ~uint256(uint64(0)), 100, engine.GetCancelGeneration(), hash, nHashCount);
+    BOOST_CHECK(nResult == CPowMiningEngine::SEARCH_CANCELLED);
+}
+
+BOOST_AUTO_TEST_CASE(threads)
+{
+    CPowMiningEngine engine;
+    BOOST_CHECK(engine.Start(2));
+    BOOST_CHECK(engine.GetThreadCount() == 2);
+
+    // every thread hashes its own nonce range, the lowest range is taken as the next base
+    vector<unsigned char> vchWorkData = MakeWorkData(0);
+    uint256 hash;
+    uint64 nHashCount = 0;
+    int nResult = engine.Search(vchWorkData, uint256(uint64(0)), 100, engine.GetCancelGeneration(), hash, nHashCount);
+    BOOST_CHECK(nResult == CPowMiningEngine::SEARCH_TIMEOUT);
+    BOOST_CHECK(GetNonce(vchWorkData) > 0);
+    BOOST_CHECK(GetNonce(vchWorkData) <= nHashCount);
+
+    nResult = engine.Search(vchWorkData, ~uint256(uint64(0)), 10000, engine.GetCancelGeneration(), hash, nHashCount);
+    BOOST_CHECK(nResult == CPowMiningEngine::SEARCH_FOUND);
+    BOOST_CHECK(hash == crypto::CryptoPowHash(&vchWorkData[0], vchWorkData.size()));
+}
+
+BOOST_AUTO_TEST_CASE(cancel)
+{
+    CPowMiningEngine engine;
+    BOOST_CHECK(engine.Start());
+
+    // a cancel issued before the search is not lost
+    vector<unsigned char> vchWorkData = MakeWorkData(0);
+    uint256 hash;
+    uint64 nHashCount = 0;
+    uint64 nCancelGeneration = engine.GetCancelGeneration();
+    engine.Cancel();
+    int nResult = engine.Search(vchWorkData, ~uint256(uint64(0)), 10000, nCancelGeneration, hash, nHashCount);
+    BOOST_CHECK(nResult == CPowMiningEngine::SEARCH_CANCELLED);
+    BOOST_CHECK(nHashCount == 0);
+    BOOST_CHECK(GetNonce(vchWorkData) == 0);
+
+    // a new generation searches again
+    nResult = engine.Search(vchWorkData, ~uint256(uint64(0)), 10000, engine.GetCancelGeneration(), hash, nHashCount);
+    BOOST_CHECK(nResult == CPowMiningEngine::SEARCH_FOUND);
+
+    // a cancel during the search stops it before the timeout
+    nCancelGeneration = engine.GetCancelGeneration();
+    thread thrCancel([&engine]() {
+        this_thread::sleep_for(chrono::milliseconds(100));
+        engine.Cancel();
+    });
+    int64 nTime = GetTimeMillis();
+    nResult = engine.Search(vchWorkData, uint256(uint64(0)), 60000, nCancelGeneration, hash, nHashCount);
+    nTime = GetTimeMillis() - nTime;
+    thrCancel.join();
+    BOOST_CHECK(nResult == CPowMiningEngine::SEARCH_CANCELLED);
+    BOOST_CHECK(nTime < 30000);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -2,9 +2,11 @@
 // Distributed under the MIT/X11 software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
-//#include "rpcmod.h"
+#include <atomic>
 #include <boost/test/unit_test.hpp>
+#include <thread>
 
+#include "rpcmod.h"
 #include "test_big.h"
 using namespace boost;
 
@@ -45,4 +47,99 @@ BOOST_AUTO_TEST_CASE(rpc_getblock)
     //    BOOST_CHECK_THROW(CallRPCAPI("getblock"), std::runtime_error);
 }
 
+BOOST_AUTO_TEST_CASE(rpc_execmode)
+{
+    bigbang::CRPCMod rpcmod;
+    BOOST_CHECK(rpcmod.GetExecMode("stop") == bigbang::CRPCMod::RPC_EXEC_DISPATCHER);
+    BOOST_CHECK(rpcmod.GetExecMode("resyncwallet") == bigbang::CRPCMod::RPC_EXEC_SERIAL);
+    BOOST_CHECK(rpcmod.GetExecMode("importprivkey") == bigbang::CRPCMod::RPC_EXEC_SERIAL);
+    BOOST_CHECK(rpcmod.GetExecMode("sendfrom") == bigbang::CRPCMod::RPC_EXEC_SERIAL);
+    BOOST_CHECK(rpcmod.GetExecMode("getwork") == bigbang::CRPCMod::RPC_EXEC_SERIAL);
+    BOOST_CHECK(rpcmod.GetExecMode("submitwork") == bigbang::CRPCMod::RPC_EXEC_SERIAL);
+    // progress and cancel of a resync must not queue behind it
+    BOOST_CHECK(rpcmod.GetExecMode("getresyncstatus") == bigbang::CRPCMod::RPC_EXEC_WORKER);
+    BOOST_CHECK(rpcmod.GetExecMode("cancelresync") == bigbang::CRPCMod::RPC_EXEC_WORKER);
+    BOOST_CHECK(rpcmod.GetExecMode("getblock") == bigbang::CRPCMod::RPC_EXEC_WORKER);
+    BOOST_CHECK(rpcmod.GetExecMode("getbalance") == bigbang::CRPCMod::RPC_EXEC_WORKER);
+}
+
+BOOST_AUTO_TEST_CASE(rpc_taskqueue)
+{
+    const std::size_t nTask = 10000;
+    const int nThread = 4;
+
+    // a pool of workers takes every task once, results are checked here after the join
+    bigbang::CRPCTaskQueue queWorker;
+    std::vector<std::vector<std::size_t>> vFetched(nThread);
+    std::atomic<std::size_t> nDone(0);
+    std::vector<std::thread> vThread;
+    for (int n = 0; n < nThread; n++)
+    {
+        vThread.push_back(std::thread([&, n]() {
+            bigbang::CRPCTask task(nullptr, 0);
+            while (queWorker.Fetch(task))
+            {
+                vFetched[n].push_back(task.nIndex);
+                nDone++;
+            }
+        }));
+    }
+    for (std::size_t i = 0; i < nTask; i++)
+    {
+        queWorker.AddNew(bigbang::CRPCTask(nullptr, i));
+    }
+    while (nDone < nTask)
+    {
+        std::this_thread::yield();
+    }
+    // interrupt wakes the idle workers
+    queWorker.Interrupt();
+    for (std::thread& t : vThread)
+    {
+        t.join();
+    }
+    std::vector<bool> vSeen(nTask, false);
+    bool fOnce = true;
+    for (const std::vector<std::size_t>& vIndex : vFetched)
+    {
+        for (std::size_t nIndex : vIndex)
+        {
+            fOnce = fOnce && !vSeen[nIndex];
+            vSeen[nIndex] = true;
+        }
+    }
+    BOOST_CHECK(fOnce);
+    BOOST_CHECK(std::find(vSeen.begin(), vSeen.end(), false) == vSeen.end());
+
+    // a single consumer sees tasks in arrival order, an interrupted queue is reusable after reset
+    bigbang::CRPCTaskQueue queSerial;
+    queSerial.Interrupt();
+    bigbang::CRPCTask task(nullptr, 0);
+    BOOST_CHECK(!queSerial.Fetch(task));
+    queSerial.Reset();
+    std::vector<std::size_t> vSerial;
+    std::thread thrSerial([&]() {
+        bigbang::CRPCTask task(nullptr, 0);
+        while (queSerial.Fetch(task))
+        {
+            vSerial.push_back(task.nIndex);
+            if (task.nIndex == nTask - 1)
+            {
+                break;
+            }
+        }
+    });
+    for (std::size_t i = 0; i < nTask; i++)
+    {
+        queSerial.AddNew(bigbang::CRPCTask(nullptr, i));
+    }
+    thrSerial.join();
+    bool fOrdered = (vSerial.size() == nTask);
+    for (std::size_t i = 0; fOrdered && i < nTask; i++)
+    {
+        fOrdered = (vSerial[i] == i);
+    }
+    BOOST_CHECK(fOrdered);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
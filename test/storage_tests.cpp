@@ -2,12 +2,20 @@
 // Distributed under the MIT/X11 software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include <atomic>
 #include <boost/test/unit_test.hpp>
+#include <fstream>
+#include <thread>
 
 #include "address.h"
 #include "block.h"
+#include "blockbase.h"
+#include "blockindexmap.h"
+#include "blockindexsnapshot.h"
 #include "test_big.h"
 #include "timeseries.h"
+#include "txindexdb.h"
+#include "walletdb.h"
 
 using namespace std;
 using namespace xengine;
@@ -167,4 +175,482 @@ BOOST_AUTO_TEST_CASE(fileread)
     free(pBuf);
 }
 
+BOOST_AUTO_TEST_CASE(forkheightindex)
+{
+    // origin at height 10, a primary chain up to height 60 with an extended block at height 30
+    vector<uint256> vHash(200);
+    list<CBlockIndex> listIndex;
+    auto fnNewIndex = [&](CBlockIndex* pPrev, uint16 nType) -> CBlockIndex* {
+        listIndex.push_back(CBlockIndex());
+        CBlockIndex* pIndex = &listIndex.back();
+        vHash[listIndex.size() - 1] = uint256(listIndex.size());
+        pIndex->phashBlock = &vHash[listIndex.size() - 1];
+        pIndex->nType = nType;
+        pIndex->pPrev = pPrev;
+        if (pPrev != nullptr)
+        {
+            pIndex->pOrigin = (nType == CBlock::BLOCK_ORIGIN ? pIndex : pPrev->pOrigin);
+            pIndex->nHeight = pPrev->nHeight + (nType == CBlock::BLOCK_EXTENDED ? 0 : 1);
+        }
+        return pIndex;
+    };
+
+    CBlockIndex* pParent = fnNewIndex(nullptr, CBlock::BLOCK_GENESIS);
+    for (int i = 1; i < 10; i++)
+    {
+        pParent = fnNewIndex(pParent, CBlock::BLOCK_PRIMARY);
+    }
+    CBlockIndex* pIndex = fnNewIndex(pParent, CBlock::BLOCK_ORIGIN);
+    CBlockFork fork(CProfile(), pIndex);
+    CBlockIndex *pIndex29 = nullptr, *pExtended = nullptr;
+    for (int nHeight = 11; nHeight <= 60; nHeight++)
+    {
+        pIndex = fnNewIndex(pIndex, CBlock::BLOCK_PRIMARY);
+        fork.UpdateLast(pIndex);
+        if (nHeight == 29)
+        {
+            pIndex29 = pIndex;
+        }
+        if (nHeight == 30)
+        {
+            pExtended = pIndex = fnNewIndex(pIndex, CBlock::BLOCK_EXTENDED);
+            fork.UpdateLast(pIndex);
+        }
+    }
+
+    BOOST_CHECK(fork.GetIndexOfHeight(9) == nullptr);
+    BOOST_CHECK(fork.GetIndexOfHeight(61) == nullptr);
+    BOOST_CHECK(fork.GetIndexOfHeight(10) == fork.GetOrigin());
+    BOOST_CHECK(fork.GetIndexOfHeight(60) == fork.GetLast());
+    BOOST_CHECK(fork.GetIndexOfHeight(30) == pExtended);
+    BOOST_CHECK(fork.IsOnMainChain(pExtended->pPrev));
+
+    // reorg to a branch from height 29 that is shorter than the old chain
+    pIndex = pIndex29;
+    for (int nHeight = 30; nHeight <= 40; nHeight++)
+    {
+        pIndex = fnNewIndex(pIndex, CBlock::BLOCK_VACANT);
+    }
+    fork.UpdateLast(pIndex);
+
+    BOOST_CHECK(fork.GetIndexOfHeight(41) == nullptr);
+    BOOST_CHECK(fork.GetIndexOfHeight(29) == pIndex29);
+    BOOST_CHECK(fork.GetIndexOfHeight(30)->IsVacant());
+    BOOST_CHECK(!fork.IsOnMainChain(pExtended));
+    for (CBlockIndex* p = fork.GetLast(); p != fork.GetOrigin(); p = p->pPrev)
+    {
+        BOOST_CHECK(fork.GetIndexOfHeight(p->GetBlockHeight()) == p);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(cachedhash)
+{
+    std::string fullpath = boost::filesystem::initial_path<boost::filesystem::path>().string() + "/test/block/block_000001.dat";
+    xengine::CFileStream fs(fullpath.c_str());
+
+    uint32 nMagic, nSize;
+    CBlockEx block;
+    fs >> nMagic >> nSize >> block;
+    BOOST_CHECK(!block.IsNull());
+
+    // cached at deserialization
+    CBlock blockCopy = block;
+    BOOST_CHECK(block.GetHash() == blockCopy.GetHash());
+    BOOST_CHECK(block.txMint.GetHash() == CTransaction(block.txMint).GetHash());
+
+    CTransaction tx = block.txMint;
+    BOOST_CHECK(tx.GetHash() == block.txMint.GetHash());
+    BOOST_CHECK(tx.GetSignatureHash() == block.txMint.GetSignatureHash());
+
+    // copies and assignments don't carry the cache
+    tx = block.txMint;
+    tx.nAmount += 1;
+    BOOST_CHECK(tx.GetHash() != block.txMint.GetHash());
+    BOOST_CHECK(tx.GetSignatureHash() != block.txMint.GetSignatureHash());
+    tx.UpdateHash();
+    CTransaction txCopy = tx;
+    txCopy.nAmount -= 1;
+    BOOST_CHECK(txCopy.GetHash() == block.txMint.GetHash());
+
+    blockCopy.nTimeStamp += 1;
+    BOOST_CHECK(blockCopy.GetHash() != block.GetHash());
+    blockCopy = block;
+    blockCopy.txMint.nAmount += 1;
+    BOOST_CHECK(blockCopy.GetHash() != block.GetHash());
+
+    // in-memory objects are never cached
+    CTransaction txNew;
+    uint256 hashNull = txNew.GetHash();
+    txNew.nAmount = 1;
+    BOOST_CHECK(txNew.GetHash() != hashNull);
+
+    uint256 hashSum;
+    int64 nTime = GetTimeMillis();
+    for (int i = 0; i < 100000; i++)
+    {
+        hashSum ^= block.txMint.GetHash();
+    }
+    int64 nCachedTime = GetTimeMillis() - nTime;
+    nTime = GetTimeMillis();
+    for (int i = 0; i < 100000; i++)
+    {
+        hashSum ^= txCopy.GetHash();
+    }
+    cout << "tx GetHash 100000 times, cached: " << nCachedTime << " ms, uncached: " << GetTimeMillis() - nTime << " ms" << endl;
+}
+
+BOOST_AUTO_TEST_CASE(rawblocksize)
+{
+    std::string fullpath = boost::filesystem::initial_path<boost::filesystem::path>().string() + "/test/block/block_000001.dat";
+    xengine::CFileStream fs(fullpath.c_str());
+
+    for (int i = 0; i < 11; i++)
+    {
+        uint32 nMagic, nSize;
+        CBlockEx block;
+        fs >> nMagic >> nSize >> block;
+
+        // stored record is CBlockEx, raw relay trims it to the CBlock part
+        CBufStream ss;
+        ss << block;
+        BOOST_CHECK(ss.GetSize() == nSize);
+
+        std::size_t nBlockSize = 0;
+        BOOST_CHECK(CBlock::GetSerializedSize((const unsigned char*)ss.GetData(), ss.GetSize(), nBlockSize));
+        BOOST_CHECK(nBlockSize == GetSerializeSize(static_cast<CBlock&>(block)));
+        BOOST_CHECK(!CBlock::GetSerializedSize((const unsigned char*)ss.GetData(), nBlockSize - 1, nBlockSize));
+
+        CBufStream ssRaw;
+        ssRaw.Write(ss.GetData(), nBlockSize);
+        CBlock blockRaw;
+        ssRaw >> blockRaw;
+        BOOST_CHECK(blockRaw.GetHash() == block.GetHash());
+        BOOST_CHECK(blockRaw.vtx.size() == block.vtx.size());
+    }
+}
+
+class CTestSnapshotWalker : public CBlockIndexSnapshotWalker
+{
+public:
+    bool Walk(CBlockOutline& outline) override
+    {
+        mapOutline[outline.GetBlockHash()] = outline;
+        return true;
+    }
+    bool Remove(const uint256& hashBlock) override
+    {
+        return (mapOutline.erase(hashBlock) > 0);
+    }
+
+public:
+    std::map<uint256, CBlockOutline> mapOutline;
+};
+
+BOOST_AUTO_TEST_CASE(blockindexsnapshot)
+{
+    path pathData = temp_directory_path() / "bigbang_snapshot_test";
+    remove_all(pathData);
+
+    CBlockIndexMap mapIndex;
+    std::vector<uint256> vHash;
+    for (int i = 0; i < 1000; i++)
+    {
+        uint256 hash;
+        crypto::CryptoGetRand256(hash);
+        CBlockIndex* pIndex = mapIndex.Insert(hash);
+        pIndex->pPrev = (vHash.empty() ? nullptr : mapIndex.Find(vHash.back()));
+        pIndex->nHeight = i;
+        pIndex->nTimeStamp = 1000 + i;
+        vHash.push_back(hash);
+    }
+    std::vector<std::pair<uint256, uint256>> vFork = { std::make_pair(vHash[0], vHash.back()) };
+
+    CBlockIndexSnapshot snapshot;
+    BOOST_CHECK(snapshot.Initialize(pathData));
+    BOOST_CHECK(snapshot.Save(mapIndex, vFork));
+
+    // changes after the snapshot go to the journal
+    uint256 hashNew;
+    crypto::CryptoGetRand256(hashNew);
+    CBlockIndex* pIndexNew = mapIndex.Insert(hashNew);
+    pIndexNew->pPrev = mapIndex.Find(vHash.back());
+    pIndexNew->nHeight = 1000;
+    snapshot.AddNewBlock(CBlockOutline(pIndexNew));
+    snapshot.RemoveBlock(vHash[10]);
+    snapshot.Deinitialize();
+
+    CTestSnapshotWalker walker;
+    std::vector<std::pair<uint256, uint256>> vForkLoad;
+    BOOST_CHECK(snapshot.Load(walker, vForkLoad));
+    BOOST_CHECK(vForkLoad == vFork);
+    BOOST_CHECK(walker.mapOutline.size() == vHash.size());
+    BOOST_CHECK(walker.mapOutline.count(vHash[10]) == 0);
+    BOOST_CHECK(walker.mapOutline[hashNew].hashPrev == vHash.back());
+    BOOST_CHECK(walker.mapOutline[vHash[20]].hashPrev == vHash[19]);
+    BOOST_CHECK(walker.mapOutline[vHash[20]].nTimeStamp == 1020);
+    BOOST_CHECK(snapshot.GetJournalCount() == 2);
+    std::vector<std::pair<uint8, uint256>> vTail;
+    snapshot.GetJournalTail(vTail);
+    BOOST_CHECK(vTail.size() == 2);
+    BOOST_CHECK(vTail[0] == std::make_pair((uint8)CBlockIndexSnapshot::JOURNAL_ADDNEW, hashNew));
+    BOOST_CHECK(vTail[1] == std::make_pair((uint8)CBlockIndexSnapshot::JOURNAL_REMOVE, vHash[10]));
+    snapshot.Deinitialize();
+
+    // the journal tail is checked against the block index db, a block journaled but never written is caught
+    {
+        CBlockIndexDB dbIndex;
+        BOOST_CHECK(dbIndex.Initialize(pathData));
+        BOOST_CHECK(!dbIndex.ExistsBlock(hashNew));
+        BOOST_CHECK(dbIndex.AddNewBlock(CBlockOutline(pIndexNew)));
+        BOOST_CHECK(dbIndex.ExistsBlock(hashNew));
+        BOOST_CHECK(dbIndex.RemoveBlock(hashNew));
+        BOOST_CHECK(!dbIndex.ExistsBlock(hashNew));
+        dbIndex.Deinitialize();
+    }
+
+    // a torn journal entry rejects the snapshot
+    path pathJournal = pathData / "block" / "index.journal";
+    resize_file(pathJournal, file_size(pathJournal) - 1);
+    CTestSnapshotWalker walkerTorn;
+    BOOST_CHECK(!snapshot.Load(walkerTorn, vForkLoad));
+
+    // a damaged snapshot body is rejected
+    BOOST_CHECK(snapshot.Save(mapIndex, vFork));
+    snapshot.Deinitialize();
+    {
+        std::fstream fs((pathData / "block" / "index.snapshot").string(), std::ios::in | std::ios::out | std::ios::binary);
+        fs.seekp(100);
+        fs.put(0x5a);
+    }
+    CTestSnapshotWalker walkerBad;
+    BOOST_CHECK(!snapshot.Load(walkerBad, vForkLoad));
+
+    BOOST_CHECK(snapshot.Remove());
+    remove_all(pathData);
+}
+
+BOOST_AUTO_TEST_CASE(timeseriesmapped)
+{
+    path pathData = temp_directory_path() / "bigbang_timeseries_test";
+    remove_all(pathData);
+
+    CTimeSeriesCached tsData;
+    BOOST_CHECK(tsData.Initialize(pathData, "data"));
+
+    // records of block size spread, written through the append handle
+    const int nCount = 4000;
+    std::vector<std::vector<unsigned char>> vData(nCount);
+    std::vector<CDiskPos> vPos(nCount);
+    for (int i = 0; i < nCount; i++)
+    {
+        vData[i].resize(200 + (i * 7919) % 20000, (unsigned char)i);
+        BOOST_CHECK(tsData.Write(vData[i], vPos[i], false));
+    }
+
+    // read ahead runs through the end of the last object, not its start
+    CBufStream ssLast;
+    ssLast << vData[9];
+    BOOST_CHECK(tsData.Prefetch(vPos[0].nFile, vPos[0].nOffset, vPos[9].nOffset) == vPos[9].nOffset + ssLast.GetSize() - vPos[0].nOffset);
+    BOOST_CHECK(tsData.Prefetch(vPos[9].nFile, vPos[9].nOffset, vPos[9].nOffset) == ssLast.GetSize());
+
+    // read back while writing, the last file is remapped as it grows
+    std::vector<unsigned char> vRead;
+    std::vector<unsigned char> vAppend(5000, 0xAB);
+    CDiskPos posAppend;
+    BOOST_CHECK(tsData.Read(vRead, vPos[0], false) && vRead == vData[0]);
+    BOOST_CHECK(tsData.Write(vAppend, posAppend, false));
+    BOOST_CHECK(tsData.Read(vRead, posAppend, false) && vRead == vAppend);
+    std::vector<unsigned char> vchRaw;
+    BOOST_CHECK(tsData.ReadRaw(vchRaw, posAppend.nFile, posAppend.nOffset));
+    CBufStream ss;
+    ss << vAppend;
+    BOOST_CHECK(vchRaw == std::vector<unsigned char>(ss.GetData(), ss.GetData() + ss.GetSize()));
+
+    // concurrent readers against the former open/seek/read per call
+    const int nThread = 4;
+    std::string strFile = (pathData / "data_000001.dat").string();
+    boost::posix_time::ptime t0 = boost::posix_time::microsec_clock::universal_time();
+    for (int i = 0; i < nCount; i++)
+    {
+        CFileStream fs(strFile.c_str());
+        fs.Seek(vPos[i].nOffset);
+        fs >> vRead;
+    }
+    int64 nStreamTime = (boost::posix_time::microsec_clock::universal_time() - t0).total_microseconds();
+
+    std::atomic<int> nError(0);
+    t0 = boost::posix_time::microsec_clock::universal_time();
+    std::vector<std::thread> vThread;
+    for (int n = 0; n < nThread; n++)
+    {
+        vThread.push_back(std::thread([&, n]() {
+            std::vector<unsigned char> v;
+            for (int i = n; i < nCount; i += nThread)
+            {
+                if (!tsData.Read(v, vPos[i], false) || v != vData[i])
+                {
+                    nError++;
+                }
+            }
+        }));
+    }
+    for (std::thread& t : vThread)
+    {
+        t.join();
+    }
+    int64 nMappedTime = (boost::posix_time::microsec_clock::universal_time() - t0).total_microseconds();
+    BOOST_CHECK(nError == 0);
+
+    cout << "block file read " << nCount << " records, file stream: " << nStreamTime << "us, mapped with "
+         << nThread << " threads: " << nMappedTime << "us" << endl;
+
+    tsData.Deinitialize();
+    remove_all(pathData);
+}
+
+BOOST_AUTO_TEST_CASE(walletresyncmarker)
+{
+    path pathData = temp_directory_path() / "bigbang_walletdb_test";
+    remove_all(pathData);
+
+    {
+        CWalletDB dbWallet;
+        BOOST_CHECK(dbWallet.Initialize(pathData));
+        BOOST_CHECK(!dbWallet.IsResyncIncomplete());
+        // the marker is set ahead of clearing the txs and survives the clear
+        BOOST_CHECK(dbWallet.SetResyncIncomplete(true));
+        BOOST_CHECK(dbWallet.ClearTx());
+        BOOST_CHECK(dbWallet.IsResyncIncomplete());
+        BOOST_CHECK(dbWallet.GetTxCount() == 0);
+        dbWallet.Deinitialize();
+    }
+    {
+        // a resync stopped before the txs were rebuilt is seen at the next start
+        CWalletDB dbWallet;
+        BOOST_CHECK(dbWallet.Initialize(pathData));
+        BOOST_CHECK(dbWallet.IsResyncIncomplete());
+        BOOST_CHECK(dbWallet.SetResyncIncomplete(false));
+        dbWallet.Deinitialize();
+    }
+    {
+        CWalletDB dbWallet;
+        BOOST_CHECK(dbWallet.Initialize(pathData));
+        BOOST_CHECK(!dbWallet.IsResyncIncomplete());
+        dbWallet.Deinitialize();
+    }
+
+    remove_all(pathData);
+}
+
+BOOST_AUTO_TEST_CASE(txindexversion)
+{
+    path pathData = temp_directory_path() / "bigbang_txindex_test";
+    remove_all(pathData);
+
+    // a fork index left by an older layout has no version in the locator
+    create_directories(pathData / "txindex" / uint256(1).GetHex());
+
+    CTxIndexDB dbTxIndex;
+    BOOST_CHECK(dbTxIndex.Initialize(pathData));
+    BOOST_CHECK(dbTxIndex.IsRebuildRequired());
+    BOOST_CHECK(!exists(pathData / "txindex" / uint256(1).GetHex()));
+
+    uint256 hashFork(2);
+    CTransaction tx;
+    tx.nTimeStamp = GetTime();
+    uint256 txid = tx.GetHash();
+    vector<pair<uint256, CTxIndex>> vTxNew;
+    vTxNew.push_back(make_pair(txid, CTxIndex(10, 1, 2000, 1500, 3)));
+    BOOST_CHECK(dbTxIndex.LoadFork(hashFork));
+    BOOST_CHECK(dbTxIndex.Update(hashFork, vTxNew, vector<uint256>()));
+    BOOST_CHECK(dbTxIndex.SetRebuilt());
+    BOOST_CHECK(!dbTxIndex.IsRebuildRequired());
+    dbTxIndex.Deinitialize();
+
+    // a rebuilt index is kept across restarts and carries the tx position
+    BOOST_CHECK(dbTxIndex.Initialize(pathData));
+    BOOST_CHECK(!dbTxIndex.IsRebuildRequired());
+    BOOST_CHECK(dbTxIndex.LoadFork(hashFork));
+    CTxIndex txIndex;
+    uint256 hashForkOut;
+    BOOST_CHECK(dbTxIndex.Retrieve(txid, txIndex, hashForkOut));
+    BOOST_CHECK(hashForkOut == hashFork);
+    BOOST_CHECK(txIndex.nBlockHeight == 10 && txIndex.nFile == 1 && txIndex.nOffset == 2000);
+    BOOST_CHECK(txIndex.nBlockOffset == 1500 && txIndex.nTxOrdinal == 3 && !txIndex.IsMintTx());
+    dbTxIndex.Deinitialize();
+
+    remove_all(pathData);
+}
+
+BOOST_AUTO_TEST_CASE(txlocatorcrash)
+{
+    path pathData = temp_directory_path() / "bigbang_txlocator_test";
+    remove_all(pathData);
+    create_directories(pathData / "txindex");
+
+    uint256 hashFork(2), hashForkOut;
+    CTransaction tx;
+    tx.nTimeStamp = GetTime() - 10;
+    uint256 txid = tx.GetHash();
+    vector<pair<uint256, CTxIndex>> vTxNew(1, make_pair(txid, CTxIndex(1, 0, 100, 50, 1)));
+
+    // a clean close keeps the locator complete
+    {
+        CTxLocatorDB dbLocator;
+        BOOST_CHECK(dbLocator.Initialize(pathData / "txindex"));
+        BOOST_CHECK(dbLocator.AddFork(hashFork));
+        dbLocator.Deinitialize();
+        BOOST_CHECK(dbLocator.Initialize(pathData / "txindex"));
+        BOOST_CHECK(dbLocator.IsComplete(txid));
+
+        // one flush is enough, the process dies before the locator is closed
+        dbLocator.Update(hashFork, vTxNew, vector<uint256>());
+        BOOST_CHECK(dbLocator.Flush());
+        dbLocator.Close();
+    }
+    {
+        CTxLocatorDB dbLocator;
+        BOOST_CHECK(dbLocator.Initialize(pathData / "txindex"));
+        BOOST_CHECK(dbLocator.Retrieve(txid, hashForkOut) && hashForkOut == hashFork);
+        BOOST_CHECK(!dbLocator.IsComplete(txid));
+        dbLocator.Deinitialize();
+    }
+    remove_all(pathData);
+
+    // the fork index holds a tx the locator lost in a crash
+    {
+        CTxIndexDB dbTxIndex;
+        BOOST_CHECK(dbTxIndex.Initialize(pathData));
+        BOOST_CHECK(dbTxIndex.LoadFork(hashFork));
+        BOOST_CHECK(dbTxIndex.Update(hashFork, vTxNew, vector<uint256>()));
+        dbTxIndex.Deinitialize();
+    }
+    {
+        CTxLocatorDB dbLocator;
+        BOOST_CHECK(dbLocator.Initialize(pathData / "txindex"));
+        dbLocator.Update(hashFork, vector<pair<uint256, CTxIndex>>(), vector<uint256>(1, txid));
+        BOOST_CHECK(dbLocator.Flush());
+        BOOST_CHECK(!dbLocator.Retrieve(txid, hashForkOut));
+        dbLocator.Close();
+    }
+    {
+        CTxIndexDB dbTxIndex;
+        BOOST_CHECK(dbTxIndex.Initialize(pathData));
+        BOOST_CHECK(dbTxIndex.LoadFork(hashFork));
+        CTxIndex txIndex;
+        BOOST_CHECK(dbTxIndex.Retrieve(txid, txIndex, hashForkOut));
+        BOOST_CHECK(hashForkOut == hashFork && txIndex.nOffset == 100);
+        dbTxIndex.Deinitialize();
+    }
+    {
+        // the probe wrote the tx back to the locator
+        CTxLocatorDB dbLocator;
+        BOOST_CHECK(dbLocator.Initialize(pathData / "txindex"));
+        BOOST_CHECK(dbLocator.Retrieve(txid, hashForkOut) && hashForkOut == hashFork);
+        dbLocator.Deinitialize();
+    }
+
+    remove_all(pathData);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
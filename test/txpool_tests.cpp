@@ -4,8 +4,12 @@
 
 #include "txpool.h"
 
+#include <boost/date_time/posix_time/posix_time.hpp>
 #include <boost/test/unit_test.hpp>
+#include <thread>
 
+#include "crypto.h"
+#include "peerevent.h"
 #include "test_big.h"
 #include "transaction.h"
 #include "uint256.h"
@@ -96,4 +100,463 @@ BOOST_AUTO_TEST_CASE(seq_test)
     BOOST_CHECK(view.AddNew(tx2.GetHash(), tx2));
 }
 
+CPooledTx MakePooledTx(uint32 nTimeStamp, int64 nTxFee, const vector<uint256>& vPrevTxid, size_t nDataSize = 0)
+{
+    CTransaction tx;
+    tx.nTimeStamp = nTimeStamp;
+    tx.nAmount = 1000000;
+    tx.nTxFee = nTxFee;
+    tx.vchData.assign(nDataSize, (uint8)nTimeStamp);
+    for (const uint256& txidPrev : vPrevTxid)
+    {
+        tx.vInput.push_back(CTxIn(CTxOutPoint(txidPrev, 0)));
+    }
+    tx.UpdateHash();
+    return CPooledTx(tx, -1, GetSequenceNumber());
+}
+
+BOOST_AUTO_TEST_CASE(package_test)
+{
+    CTxPoolView view;
+
+    CPooledTx txAlone = MakePooledTx(1, 100, {});
+    CPooledTx txParent = MakePooledTx(2, 1, {});
+    CPooledTx txChild = MakePooledTx(3, 1000, { txParent.GetHash() });
+
+    BOOST_CHECK(view.AddNew(txAlone.GetHash(), txAlone));
+    BOOST_CHECK(view.AddNew(txParent.GetHash(), txParent));
+    BOOST_CHECK(view.AddNew(txChild.GetHash(), txChild));
+    BOOST_CHECK(txChild.nPackageTxFee == 1001);
+    BOOST_CHECK(txChild.nPackageSize == txParent.nSerializeSize + txChild.nSerializeSize);
+
+    // the child pays for its parent ahead of the earlier tx
+    vector<CTransaction> vtx;
+    int64 nTotalTxFee = 0;
+    map<CDestination, int> mapVoteCert;
+    map<CDestination, int64> mapVote;
+    view.ArrangeBlockTx(vtx, nTotalTxFee, 100, txParent.nSerializeSize + txChild.nSerializeSize, mapVoteCert, mapVote, 0, false);
+    BOOST_CHECK(vtx.size() == 2);
+    BOOST_CHECK(vtx.size() == 2 && vtx[0].GetHash() == txParent.GetHash() && vtx[1].GetHash() == txChild.GetHash());
+    BOOST_CHECK(nTotalTxFee == 1001);
+
+    // the child package shrinks as the parent leaves the pool, it is updated at the next arrangement
+    view.Remove(txParent.GetHash());
+    vtx.clear();
+    view.ArrangeBlockTx(vtx, nTotalTxFee, 100, MAX_BLOCK_SIZE, mapVoteCert, mapVote, 0, false);
+    BOOST_CHECK(vtx.size() == 2);
+    BOOST_CHECK(txChild.nPackageTxFee == 1000);
+    BOOST_CHECK(txChild.nPackageSize == txChild.nSerializeSize);
+}
+
+BOOST_AUTO_TEST_CASE(template_test)
+{
+    CTxPoolView view;
+    map<CDestination, int> mapVoteCert;
+    map<CDestination, int64> mapVote;
+
+    CPooledTx txParent = MakePooledTx(1, 10, {});
+    CPooledTx txChild = MakePooledTx(2, 20, { txParent.GetHash() });
+    CPooledTx txLate = MakePooledTx(50, 30, {});
+    CPooledTx txOrphan = MakePooledTx(3, 40, { txLate.GetHash() });
+
+    // txs are held back until the template is arranged
+    BOOST_CHECK(view.AddNew(txParent.GetHash(), txParent));
+    view.AddTemplateTx(txParent.GetHash());
+    vector<CTransaction> vtx;
+    int64 nTotalTxFee = 0;
+    view.GetTemplateTx(100, MAX_BLOCK_SIZE, vtx, nTotalTxFee);
+    BOOST_CHECK(vtx.empty());
+
+    view.ArrangeTemplate(mapVoteCert, mapVote, 0, false);
+    BOOST_CHECK(view.AddNew(txChild.GetHash(), txChild));
+    view.AddTemplateTx(txChild.GetHash());
+    BOOST_CHECK(view.AddNew(txLate.GetHash(), txLate));
+    view.AddTemplateTx(txLate.GetHash());
+    BOOST_CHECK(view.AddNew(txOrphan.GetHash(), txOrphan));
+    view.AddTemplateTx(txOrphan.GetHash());
+
+    vtx.clear();
+    view.GetTemplateTx(100, MAX_BLOCK_SIZE, vtx, nTotalTxFee);
+    BOOST_CHECK(vtx.size() == 4);
+    BOOST_CHECK(vtx.size() == 4 && vtx[0].GetHash() == txParent.GetHash() && vtx[1].GetHash() == txChild.GetHash());
+    BOOST_CHECK(nTotalTxFee == 100);
+
+    // the block time and size hold back a tx together with its descendants
+    vtx.clear();
+    view.GetTemplateTx(10, MAX_BLOCK_SIZE, vtx, nTotalTxFee);
+    BOOST_CHECK(vtx.size() == 2);
+    BOOST_CHECK(nTotalTxFee == 30);
+    vtx.clear();
+    view.GetTemplateTx(100, txParent.nSerializeSize, vtx, nTotalTxFee);
+    BOOST_CHECK(vtx.size() == 1);
+
+    // removed txs leave the template, the next arrangement keeps parents ahead of children
+    view.Remove(txLate.GetHash());
+    view.Remove(txOrphan.GetHash());
+    view.ArrangeTemplate(mapVoteCert, mapVote, 0, false);
+    vtx.clear();
+    view.GetTemplateTx(100, MAX_BLOCK_SIZE, vtx, nTotalTxFee);
+    BOOST_CHECK(vtx.size() == 2 && vtx[0].GetHash() == txParent.GetHash() && vtx[1].GetHash() == txChild.GetHash());
+    BOOST_CHECK(nTotalTxFee == 30);
+}
+
+BOOST_AUTO_TEST_CASE(unspent_test)
+{
+    CTxPoolView view;
+    CDestination destA(crypto::CPubKey(uint256(1)));
+    CDestination destB(crypto::CPubKey(uint256(2)));
+
+    CPooledTx txA = MakePooledTx(1, 100, {});
+    txA.sendTo = destA;
+    txA.UpdateHash();
+    CPooledTx txB = MakePooledTx(2, 100, { txA.GetHash() });
+    txB.sendTo = destB;
+    txB.destIn = destA;
+    txB.nValueIn = txA.nAmount + 300000;
+    txB.UpdateHash();
+
+    BOOST_CHECK(view.AddNew(txA.GetHash(), txA));
+    vector<CTxUnspent> vUnspent;
+    view.ListUnspent(destA, set<CTxUnspent>(), 0, vUnspent);
+    BOOST_CHECK(vUnspent.size() == 1 && vUnspent[0].hash == txA.GetHash() && vUnspent[0].n == 0);
+
+    // the output spent by the child leaves the list, the child change goes to the spender
+    BOOST_CHECK(view.AddNew(txB.GetHash(), txB));
+    vUnspent.clear();
+    view.ListUnspent(destA, set<CTxUnspent>(), 0, vUnspent);
+    BOOST_CHECK(vUnspent.size() == 1 && vUnspent[0].hash == txB.GetHash() && vUnspent[0].n == 1);
+    vUnspent.clear();
+    view.ListUnspent(destB, set<CTxUnspent>(), 0, vUnspent);
+    BOOST_CHECK(vUnspent.size() == 1 && vUnspent[0].hash == txB.GetHash() && vUnspent[0].n == 0);
+
+    // removing the child gives the output back
+    CTxPoolView viewInvolvedTx;
+    view.InvalidateSpent(CTxOutPoint(txA.GetHash(), 0), viewInvolvedTx);
+    BOOST_CHECK(viewInvolvedTx.Exists(txB.GetHash()));
+    vUnspent.clear();
+    view.ListUnspent(destB, set<CTxUnspent>(), 0, vUnspent);
+    BOOST_CHECK(vUnspent.empty());
+    vUnspent.clear();
+    view.ListUnspent(destA, set<CTxUnspent>(), 0, vUnspent);
+    BOOST_CHECK(vUnspent.size() == 1 && vUnspent[0].hash == txA.GetHash() && vUnspent[0].n == 0);
+    BOOST_CHECK(view.mapDestUnspent.size() == 1);
+}
+
+BOOST_AUTO_TEST_CASE(template_fee_test)
+{
+    CTxPoolView view;
+    map<CDestination, int> mapVoteCert;
+    map<CDestination, int64> mapVote;
+
+    // 19 large txs fill the template, a 20th does not fit
+    const size_t nDataSize = 104000;
+    vector<CPooledTx> vTx;
+    vTx.reserve(24);
+    for (int i = 0; i < 19; i++)
+    {
+        vTx.push_back(MakePooledTx(i + 1, 1000, {}, nDataSize));
+    }
+    for (CPooledTx& tx : vTx)
+    {
+        BOOST_CHECK(view.AddNew(tx.GetHash(), tx));
+    }
+    view.ArrangeTemplate(mapVoteCert, mapVote, 0, false);
+    vector<CTransaction> vtx;
+    int64 nTotalTxFee = 0;
+    view.GetTemplateTx(100, MAX_BLOCK_SIZE, vtx, nTotalTxFee);
+    BOOST_CHECK(vtx.size() == 19);
+
+    // a pushed tx paying no more waits for the next arrangement
+    vTx.push_back(MakePooledTx(20, 1000, {}, nDataSize));
+    BOOST_CHECK(view.AddNew(vTx.back().GetHash(), vTx.back()));
+    view.AddTemplateTx(vTx.back().GetHash());
+    vtx.clear();
+    view.GetTemplateTx(100, MAX_BLOCK_SIZE, vtx, nTotalTxFee);
+    BOOST_CHECK(vtx.size() == 19 && nTotalTxFee == 19000);
+
+    // a better tx evicts the last of the lowest fee rate
+    vTx.push_back(MakePooledTx(21, 100000, {}, nDataSize));
+    const uint256 txidBetter = vTx.back().GetHash();
+    BOOST_CHECK(view.AddNew(txidBetter, vTx.back()));
+    view.AddTemplateTx(txidBetter);
+    vtx.clear();
+    view.GetTemplateTx(100, MAX_BLOCK_SIZE, vtx, nTotalTxFee);
+    BOOST_CHECK(vtx.size() == 19 && nTotalTxFee == 18 * 1000 + 100000);
+    BOOST_CHECK(vtx.size() == 19 && vtx.back().GetHash() == txidBetter);
+    BOOST_CHECK(find_if(vtx.begin(), vtx.end(), [&](const CTransaction& tx) { return tx.GetHash() == vTx[18].GetHash(); }) == vtx.end());
+
+    // a child pays for its parent at the next arrangement, the packages are ranked ahead of the earlier txs
+    vTx.push_back(MakePooledTx(22, 1, {}, nDataSize));
+    CPooledTx& txParent = vTx.back();
+    BOOST_CHECK(view.AddNew(txParent.GetHash(), txParent));
+    vTx.push_back(MakePooledTx(23, 500000, { txParent.GetHash() }));
+    CPooledTx& txChild = vTx.back();
+    BOOST_CHECK(view.AddNew(txChild.GetHash(), txChild));
+    view.ArrangeTemplate(mapVoteCert, mapVote, 0, false);
+    vtx.clear();
+    view.GetTemplateTx(100, MAX_BLOCK_SIZE, vtx, nTotalTxFee);
+    BOOST_CHECK(vtx.size() >= 3 && vtx[0].GetHash() == txParent.GetHash() && vtx[1].GetHash() == txChild.GetHash()
+                && vtx[2].GetHash() == txidBetter);
+    BOOST_CHECK(vtx.size() == 20);
+}
+
+BOOST_AUTO_TEST_CASE(template_update_test)
+{
+    CTxPoolView view;
+    map<CDestination, int> mapVoteCert;
+    map<CDestination, int64> mapVote;
+
+    // 19 large txs fill the template, the 20th waits in the pool
+    const size_t nDataSize = 104000;
+    vector<CPooledTx> vTx;
+    vTx.reserve(22);
+    for (int i = 0; i < 20; i++)
+    {
+        vTx.push_back(MakePooledTx(i + 1, 1000, {}, nDataSize));
+    }
+    for (CPooledTx& tx : vTx)
+    {
+        BOOST_CHECK(view.AddNew(tx.GetHash(), tx));
+    }
+    view.ArrangeTemplate(mapVoteCert, mapVote, 0, false);
+    vector<CTransaction> vtx;
+    int64 nTotalTxFee = 0;
+    view.GetTemplateTx(100, MAX_BLOCK_SIZE, vtx, nTotalTxFee);
+    BOOST_CHECK(vtx.size() == 19 && vtx.back().GetHash() == vTx[18].GetHash());
+
+    // a confirmed tx frees its space, the freed space is filled by fee rate from the pool
+    vTx.push_back(MakePooledTx(21, 1000, { vTx[0].GetHash() }));
+    BOOST_CHECK(view.AddNew(vTx.back().GetHash(), vTx.back()));
+    view.Remove(vTx[0].GetHash());
+    view.UpdateTemplate(mapVoteCert, mapVote, 0, false);
+    vtx.clear();
+    view.GetTemplateTx(100, MAX_BLOCK_SIZE, vtx, nTotalTxFee);
+    BOOST_CHECK(vtx.size() == 20 && nTotalTxFee == 20 * 1000);
+    BOOST_CHECK(vtx.size() == 20 && vtx[18].GetHash() == vTx[20].GetHash() && vtx[19].GetHash() == vTx[19].GetHash());
+
+    // the txs left are checked against the next block, low fee txs leave it at a DPoS height
+    vTx.push_back(MakePooledTx(22, NEW_MIN_TX_FEE, {}));
+    BOOST_CHECK(view.AddNew(vTx.back().GetHash(), vTx.back()));
+    view.AddTemplateTx(vTx.back().GetHash());
+    view.UpdateTemplate(mapVoteCert, mapVote, 0, true);
+    vtx.clear();
+    view.GetTemplateTx(100, MAX_BLOCK_SIZE, vtx, nTotalTxFee);
+    BOOST_CHECK(vtx.size() == 1 && vtx[0].GetHash() == vTx.back().GetHash());
+    BOOST_CHECK(nTotalTxFee == NEW_MIN_TX_FEE);
+}
+
+BOOST_AUTO_TEST_CASE(arrange_benchmark)
+{
+    const int nChainCount = 20000;
+    const int nChainLength = 5;
+
+    vector<CPooledTx> vTx;
+    vTx.reserve(nChainCount * nChainLength);
+    srand(1);
+    for (int i = 0; i < nChainCount; i++)
+    {
+        for (int j = 0; j < nChainLength; j++)
+        {
+            vector<uint256> vPrevTxid;
+            if (j != 0)
+            {
+                vPrevTxid.push_back(vTx.back().GetHash());
+            }
+            vTx.push_back(MakePooledTx(i * nChainLength + j, 10000 + rand() % 100000, vPrevTxid));
+        }
+    }
+
+    CTxPoolView view;
+    boost::posix_time::ptime t0 = boost::posix_time::microsec_clock::universal_time();
+    for (CPooledTx& tx : vTx)
+    {
+        BOOST_CHECK(view.AddNew(tx.GetHash(), tx));
+    }
+    boost::posix_time::ptime t1 = boost::posix_time::microsec_clock::universal_time();
+
+    vector<CTransaction> vtx;
+    int64 nTotalTxFee = 0;
+    map<CDestination, int> mapVoteCert;
+    map<CDestination, int64> mapVote;
+    view.ArrangeBlockTx(vtx, nTotalTxFee, vTx.size(), MAX_BLOCK_SIZE, mapVoteCert, mapVote, 0, false);
+    boost::posix_time::ptime t2 = boost::posix_time::microsec_clock::universal_time();
+
+    size_t nTotalSize = 0;
+    set<uint256> setArranged;
+    for (const CTransaction& tx : vtx)
+    {
+        for (const CTxIn& txin : tx.vInput)
+        {
+            BOOST_CHECK(setArranged.count(txin.prevout.hash));
+        }
+        setArranged.insert(tx.GetHash());
+        nTotalSize += GetSerializeSize(tx);
+    }
+    BOOST_CHECK(nTotalSize <= MAX_BLOCK_SIZE);
+
+    std::cout << "arrange pooled tx count : " << vTx.size() << "; add time : " << (t1 - t0).total_milliseconds()
+              << "ms.; arrange time : " << (t2 - t1).total_milliseconds() << "ms.; arranged count : " << vtx.size() << std::endl;
+}
+
+// push txs without the block chain, the anchor of a tx is its fork
+class CTxPoolPushTester : public CTxPool
+{
+protected:
+    bool GetPushFork(const CTransaction& tx, uint256& hashFork) override
+    {
+        hashFork = tx.hashAnchor;
+        return true;
+    }
+    bool GetPushHeight(const uint256& hashFork, uint256& hashLast, int& nHeight) override
+    {
+        hashLast = 0;
+        nHeight = 0;
+        return true;
+    }
+    Errno VerifyPooledTx(const CTxPoolView& txView, const uint256& txid, const CTransaction& tx, const uint256& hashFork, int nForkHeight,
+                         CDestination& destIn, int64& nValueIn) override
+    {
+        for (const CTxIn& txin : tx.vInput)
+        {
+            if (txView.IsSpent(txin.prevout))
+            {
+                return ERR_TRANSACTION_CONFLICTING_INPUT;
+            }
+        }
+        destIn = tx.sendTo;
+        nValueIn = tx.nAmount + tx.nTxFee;
+        return OK;
+    }
+};
+
+int64 PushBenchmark(const vector<vector<CTransaction>>& vProducerTx, size_t nForkCount)
+{
+    CTxPoolPushTester txPool;
+    boost::posix_time::ptime t0 = boost::posix_time::microsec_clock::universal_time();
+    vector<std::thread> vProducer;
+    // Boost.Test assertions are not thread safe, the producers only count failures
+    vector<size_t> vFailed(vProducerTx.size(), 0);
+    for (size_t i = 0; i < vProducerTx.size(); i++)
+    {
+        vProducer.push_back(std::thread([&txPool, &vProducerTx, &vFailed, i]() {
+            for (const CTransaction& tx : vProducerTx[i])
+            {
+                uint256 hashFork;
+                CDestination destIn;
+                int64 nValueIn;
+                if (txPool.Push(tx, hashFork, destIn, nValueIn) != OK)
+                {
+                    vFailed[i]++;
+                }
+            }
+        }));
+    }
+    for (std::thread& t : vProducer)
+    {
+        t.join();
+    }
+    boost::posix_time::ptime t1 = boost::posix_time::microsec_clock::universal_time();
+
+    for (size_t nFailed : vFailed)
+    {
+        BOOST_CHECK(nFailed == 0);
+    }
+
+    size_t nCount = 0;
+    for (size_t i = 0; i < nForkCount; i++)
+    {
+        nCount += txPool.Count(uint256(i + 1));
+    }
+    BOOST_CHECK(nCount == vProducerTx.size() * vProducerTx[0].size());
+    BOOST_CHECK(txPool.Exists(vProducerTx.back().back().GetHash()));
+    return (t1 - t0).total_milliseconds();
+}
+
+BOOST_AUTO_TEST_CASE(push_benchmark)
+{
+    const size_t nProducerCount = max(2u, std::thread::hardware_concurrency());
+    const size_t nChainLength = 20000;
+
+    // each producer pushes a chain of txs, the producers share one fork or have a fork each
+    vector<vector<CTransaction>> vSharedForkTx(nProducerCount), vOwnForkTx(nProducerCount);
+    for (size_t i = 0; i < nProducerCount; i++)
+    {
+        for (size_t j = 0; j < nChainLength; j++)
+        {
+            for (int k = 0; k < 2; k++)
+            {
+                vector<CTransaction>& vTx = (k == 0 ? vSharedForkTx[i] : vOwnForkTx[i]);
+                CTransaction tx;
+                tx.hashAnchor = (k == 0 ? uint256(1) : uint256(i + 1));
+                tx.nTimeStamp = i * nChainLength + j;
+                tx.nAmount = 1000000;
+                tx.nTxFee = 100;
+                if (!vTx.empty())
+                {
+                    tx.vInput.push_back(CTxIn(CTxOutPoint(vTx.back().GetHash(), 0)));
+                }
+                tx.UpdateHash();
+                vTx.push_back(tx);
+            }
+        }
+    }
+
+    int64 nSharedForkTime = PushBenchmark(vSharedForkTx, 1);
+    int64 nOwnForkTime = PushBenchmark(vOwnForkTx, nProducerCount);
+
+    std::cout << "push tx : " << nProducerCount << " producers x " << nChainLength << " txs; one fork : " << nSharedForkTime
+              << "ms.; " << nProducerCount << " forks : " << nOwnForkTime << "ms." << std::endl;
+}
+
+BOOST_AUTO_TEST_CASE(fetch_cmpct_test)
+{
+    CTxPoolPushTester txPool;
+    const uint256 hashFork(1);
+    vector<CTransaction> vTx;
+    for (int i = 0; i < 10; i++)
+    {
+        CTransaction tx;
+        tx.hashAnchor = hashFork;
+        tx.nTimeStamp = i;
+        tx.nAmount = 1000000;
+        tx.nTxFee = 100;
+        if (!vTx.empty())
+        {
+            tx.vInput.push_back(CTxIn(CTxOutPoint(vTx.back().GetHash(), 0)));
+        }
+        tx.UpdateHash();
+        vTx.push_back(tx);
+        if (i < 8)
+        {
+            uint256 hashPushFork;
+            CDestination destIn;
+            int64 nValueIn;
+            BOOST_CHECK(txPool.Push(tx, hashPushFork, destIn, nValueIn) == OK);
+        }
+    }
+
+    // the block holds pooled txs in another order and two txs the pool has not seen
+    vector<uint256> vBlockTxId = { vTx[9].GetHash(), vTx[5].GetHash(), vTx[2].GetHash(), vTx[8].GetHash(), vTx[3].GetHash() };
+    const uint256 hashSalt = crypto::CryptoHash(uint256(7), uint256(11));
+    map<uint64, uint32> mapShortTxId;
+    for (uint32 i = 0; i < vBlockTxId.size(); i++)
+    {
+        mapShortTxId[network::CCmpctBlock::GetShortTxId(hashSalt, vBlockTxId[i])] = i;
+    }
+
+    vector<CTransaction> vBlockTx(vBlockTxId.size());
+    vector<bool> vFilled(vBlockTxId.size(), false);
+    BOOST_CHECK(txPool.FetchCmpctTx(hashFork, hashSalt, mapShortTxId, vBlockTx, vFilled));
+    BOOST_CHECK(vFilled == vector<bool>({ false, true, true, false, true }));
+    for (uint32 i = 0; i < vBlockTxId.size(); i++)
+    {
+        BOOST_CHECK(!vFilled[i] || vBlockTx[i].GetHash() == vBlockTxId[i]);
+    }
+
+    // another fork has none of them
+    vector<bool> vOtherFilled(vBlockTxId.size(), false);
+    BOOST_CHECK(txPool.FetchCmpctTx(uint256(2), hashSalt, mapShortTxId, vBlockTx, vOtherFilled));
+    BOOST_CHECK(count(vOtherFilled.begin(), vOtherFilled.end(), true) == 0);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
\ No newline at end of file
@@ -0,0 +1,237 @@
+// Copyright (c) 2019-2020 The Bigbang developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <atomic>
+#include <boost/test/unit_test.hpp>
+
+#include "crypto.h"
+#include "test_big.h"
+#include "uint256.h"
+#include "unspentdb.h"
+#include "xengine.h"
+
+BOOST_FIXTURE_TEST_SUITE(unspentdb_tests, BasicUtfSetup)
+
+using namespace bigbang;
+using namespace bigbang::storage;
+
+static CDestination MakeDestination()
+{
+    uint256 data;
+    bigbang::crypto::CryptoGetRand256(data);
+    return CDestination(bigbang::crypto::CPubKey(data));
+}
+
+static CTxUnspent MakeUnspent(const CDestination& dest)
+{
+    uint256 txid;
+    bigbang::crypto::CryptoGetRand256(txid);
+    return CTxUnspent(CTxOutPoint(txid, 0), CTxOut(dest, 100, 0, 0));
+}
+
+static std::set<CTxOutPoint> ListByWalk(CUnspentDB& db, const uint256& hashFork, const CDestination& dest)
+{
+    CListUnspentWalker walker(hashFork, dest, 0);
+    BOOST_CHECK(db.WalkThrough(hashFork, walker));
+    return std::set<CTxOutPoint>(walker.vUnspent.begin(), walker.vUnspent.end());
+}
+
+static std::set<CTxOutPoint> ListByAddress(CUnspentDB& db, const uint256& hashFork, const CDestination& dest)
+{
+    CListUnspentWalker walker(hashFork, dest, 0);
+    BOOST_CHECK(db.WalkThrough(hashFork, dest, walker));
+    return std::set<CTxOutPoint>(walker.vUnspent.begin(), walker.vUnspent.end());
+}
+
+BOOST_AUTO_TEST_CASE(unspent_address)
+{
+    std::string fullpath = boost::filesystem::initial_path<boost::filesystem::path>().string() + "/unspentpath";
+    boost::filesystem::remove_all(fullpath);
+
+    CUnspentDB db;
+    BOOST_CHECK(db.Initialize(boost::filesystem::path(fullpath)));
+
+    uint256 hashFork;
+    bigbang::crypto::CryptoGetRand256(hashFork);
+    BOOST_CHECK(db.AddNewFork(hashFork));
+
+    std::vector<CDestination> vDest;
+    for (int i = 0; i < 10; i++)
+    {
+        vDest.push_back(MakeDestination());
+    }
+
+    // flushed, lower cache and upper cache each hold a part of the unspent set
+    std::vector<CTxUnspent> vUnspent;
+    for (int round = 0; round < 3; round++)
+    {
+        std::vector<CTxUnspent> vAddNew;
+        std::vector<CTxOutPoint> vRemove;
+        for (int i = 0; i < 100; i++)
+        {
+            vAddNew.push_back(MakeUnspent(vDest[i % vDest.size()]));
+        }
+        for (int i = 0; i < vUnspent.size(); i += 7)
+        {
+            vRemove.push_back(vUnspent[i]);
+        }
+        BOOST_CHECK(db.Update(hashFork, vAddNew, vRemove));
+        db.Flush(hashFork);
+        vUnspent.insert(vUnspent.end(), vAddNew.begin(), vAddNew.end());
+    }
+
+    for (const CDestination& dest : vDest)
+    {
+        std::set<CTxOutPoint> setWalk = ListByWalk(db, hashFork, dest);
+        BOOST_CHECK(!setWalk.empty());
+        BOOST_CHECK(setWalk == ListByAddress(db, hashFork, dest));
+    }
+
+    std::vector<CTxUnspent> vRepair;
+    std::vector<CTxOutPoint> vRepairRemove;
+    vRepair.push_back(MakeUnspent(vDest[0]));
+    vRepairRemove.push_back(vUnspent[1]);
+    db.Flush(hashFork);
+    db.Flush(hashFork);
+    BOOST_CHECK(db.RepairUnspent(hashFork, vRepair, vRepairRemove));
+    BOOST_CHECK(ListByWalk(db, hashFork, vDest[0]) == ListByAddress(db, hashFork, vDest[0]));
+    BOOST_CHECK(ListByWalk(db, hashFork, vDest[1]) == ListByAddress(db, hashFork, vDest[1]));
+
+    db.Deinitialize();
+
+    // reopen with a dropped index, it should be rebuilt from the unspent records
+    boost::filesystem::remove_all(boost::filesystem::path(fullpath) / "unspentaddress");
+    BOOST_CHECK(db.Initialize(boost::filesystem::path(fullpath)));
+    BOOST_CHECK(db.AddNewFork(hashFork));
+    for (const CDestination& dest : vDest)
+    {
+        BOOST_CHECK(ListByWalk(db, hashFork, dest) == ListByAddress(db, hashFork, dest));
+    }
+
+    db.Deinitialize();
+    boost::filesystem::remove_all(fullpath);
+}
+
+BOOST_AUTO_TEST_CASE(unspent_address_benchmark)
+{
+    const int nUnspentCount = 10000000;
+    const int nDestCount = 1000000;
+    const int nBatchSize = 100000;
+
+    std::string fullpath = boost::filesystem::initial_path<boost::filesystem::path>().string() + "/unspentpath";
+    boost::filesystem::remove_all(fullpath);
+
+    CUnspentDB db;
+    BOOST_CHECK(db.Initialize(boost::filesystem::path(fullpath)));
+
+    uint256 hashFork;
+    bigbang::crypto::CryptoGetRand256(hashFork);
+    BOOST_CHECK(db.AddNewFork(hashFork));
+
+    std::vector<CDestination> vDest;
+    for (int i = 0; i < nDestCount; i++)
+    {
+        vDest.push_back(MakeDestination());
+    }
+
+    {
+        xengine::CTicks t;
+        for (int n = 0; n < nUnspentCount; n += nBatchSize)
+        {
+            std::vector<CTxUnspent> vAddNew;
+            vAddNew.reserve(nBatchSize);
+            for (int i = n; i < n + nBatchSize; i++)
+            {
+                vAddNew.push_back(MakeUnspent(vDest[i % nDestCount]));
+            }
+            BOOST_CHECK(db.Update(hashFork, vAddNew, std::vector<CTxOutPoint>()));
+            db.Flush(hashFork);
+        }
+        db.Flush(hashFork);
+        std::cout << "Insert " << nUnspentCount << " unspent : " << (t.Elapse() / 1000) << "ms\n";
+    }
+
+    const CDestination& dest = vDest[nDestCount / 2];
+    std::size_t nWalk = 0, nAddress = 0;
+    {
+        xengine::CTicks t;
+        nWalk = ListByWalk(db, hashFork, dest).size();
+        std::cout << "Walk through fork : " << (t.Elapse() / 1000) << "ms\n";
+    }
+    {
+        xengine::CTicks t;
+        nAddress = ListByAddress(db, hashFork, dest).size();
+        std::cout << "Walk through address : " << t.Elapse() << "us\n";
+    }
+    BOOST_CHECK(nWalk == nUnspentCount / nDestCount);
+    BOOST_CHECK(nWalk == nAddress);
+
+    db.Deinitialize();
+    boost::filesystem::remove_all(fullpath);
+}
+
+BOOST_AUTO_TEST_CASE(unspent_read_benchmark)
+{
+    const int nUnspentCount = 1000000;
+    const int nBatchSize = 100000;
+    const int nReadCount = 400000;
+
+    std::string fullpath = boost::filesystem::initial_path<boost::filesystem::path>().string() + "/unspentpath";
+    boost::filesystem::remove_all(fullpath);
+
+    CUnspentDB db;
+    BOOST_CHECK(db.Initialize(boost::filesystem::path(fullpath)));
+
+    uint256 hashFork;
+    bigbang::crypto::CryptoGetRand256(hashFork);
+    BOOST_CHECK(db.AddNewFork(hashFork));
+
+    CDestination dest = MakeDestination();
+    std::vector<CTxOutPoint> vOutPoint;
+    vOutPoint.reserve(nUnspentCount);
+    for (int n = 0; n < nUnspentCount; n += nBatchSize)
+    {
+        std::vector<CTxUnspent> vAddNew;
+        vAddNew.reserve(nBatchSize);
+        for (int i = n; i < n + nBatchSize; i++)
+        {
+            vAddNew.push_back(MakeUnspent(dest));
+            vOutPoint.push_back(vAddNew.back());
+        }
+        BOOST_CHECK(db.Update(hashFork, vAddNew, std::vector<CTxOutPoint>()));
+        db.Flush(hashFork);
+    }
+    // both cache maps are empty after two flushes, every read goes to leveldb
+    db.Flush(hashFork);
+    db.Flush(hashFork);
+
+    // warm up the file cache, so the first round is not charged for it
+    for (const int nThread : { 1, 1, 2, 4, 8 })
+    {
+        std::atomic<int> nFound(0);
+        xengine::CTicks t;
+        boost::thread_group group;
+        for (int n = 0; n < nThread; n++)
+        {
+            group.create_thread([&, n]() {
+                CTxOut output;
+                for (int i = n; i < nReadCount; i += nThread)
+                {
+                    if (db.Retrieve(hashFork, vOutPoint[((int64)i * 7919) % nUnspentCount], output))
+                    {
+                        ++nFound;
+                    }
+                }
+            });
+        }
+        group.join_all();
+        BOOST_CHECK(nFound == nReadCount);
+        std::cout << "Read " << nReadCount << " unspent by " << nThread << " threads : " << (t.Elapse() / 1000) << "ms\n";
+    }
+
+    db.Deinitialize();
+    boost::filesystem::remove_all(fullpath);
+}
+
+BOOST_AUTO_TEST_SUITE_END()